@@ -0,0 +1,92 @@
+#include "../../core/include/webpp/http/syntax/http_lexer.hpp"
+#include "../benchmark.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+using namespace webpp;
+
+namespace {
+
+    // a header-heavy request, the way the browsers send them (large cookies and tracing headers)
+    std::string make_headers() {
+        std::string headers;
+        headers += "Host: www.example.com\r\n";
+        headers += "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n";
+        headers += "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,*/*;q=0.8\r\n";
+        headers += "Accept-Language: en-US,en;q=0.5\r\n";
+        headers += "Accept-Encoding: gzip, deflate, br\r\n";
+        headers += "Referer: https://www.example.com/some/long/path/to/the/previous/page.html"
+                   "?query=value\r\n";
+        headers += "traceparent: 00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01\r\n";
+        headers += "tracestate: congo=t61rcWkgMzE,rojo=00f067aa0ba902b7\r\n";
+        headers += "X-Request-Id: 9b2c4f6e-3d1a-4b7e-8f0c-2a6d5e1b9c3f\r\n";
+        headers += "Cookie: ";
+        for (int i = 0; i < 40; ++i) {
+            headers += "session_cookie_" + std::to_string(i) + "=a3f9c2e1b7d64f0e8c5a1b2d3e4f5a6b7c8d9e0f; ";
+        }
+        headers += "last=1\r\n";
+        headers += "Connection: keep-alive\r\n";
+        headers += "\r\n";
+        return headers;
+    }
+
+    std::string const headers = make_headers();
+
+    // the longest line; the field content scanners stop at its CR
+    std::string_view const cookie_line = std::string_view{headers}.substr(headers.find("Cookie:"));
+
+} // namespace
+
+static void HTTPLexer_ScalarFieldContent(benchmark::State& state) {
+    for (auto _ : state) {
+        auto pos = http::details::scalar_find_first_not_field_content(cookie_line);
+        benchmark::DoNotOptimize(pos);
+    }
+}
+BENCHMARK(HTTPLexer_ScalarFieldContent);
+
+static void HTTPLexer_ScalarTChar(benchmark::State& state) {
+    std::string_view const str = "Accept-Encoding-Of-A-Very-Long-Custom-Header-Name-For-The-Benchmark:";
+    for (auto _ : state) {
+        auto pos = http::details::scalar_find_first_not_tchar(str);
+        benchmark::DoNotOptimize(pos);
+    }
+}
+BENCHMARK(HTTPLexer_ScalarTChar);
+
+#ifdef WEBPP_EVE
+static void HTTPLexer_SIMDFieldContent(benchmark::State& state) {
+    for (auto _ : state) {
+        auto pos = http::details::simd_find_first_not_field_content(cookie_line);
+        benchmark::DoNotOptimize(pos);
+    }
+}
+BENCHMARK(HTTPLexer_SIMDFieldContent);
+
+static void HTTPLexer_SIMDTChar(benchmark::State& state) {
+    std::string_view const str = "Accept-Encoding-Of-A-Very-Long-Custom-Header-Name-For-The-Benchmark:";
+    for (auto _ : state) {
+        auto pos = http::details::simd_find_first_not_tchar(str);
+        benchmark::DoNotOptimize(pos);
+    }
+}
+BENCHMARK(HTTPLexer_SIMDTChar);
+#endif
+
+// the whole lexer, with whichever scanner is available
+static void HTTPLexer_ConsumeAll(benchmark::State& state) {
+    using lexer_type = http::http_lexer<std::string_view, std::allocator<char>>;
+    lexer_type lexer;
+    lexer.header_views.reserve(32);
+    for (auto _ : state) {
+        lexer.raw_view = headers;
+        lexer.finished = false;
+        lexer.header_views.clear();
+        auto status = lexer.consume_all();
+        benchmark::DoNotOptimize(status);
+        benchmark::DoNotOptimize(lexer.header_views.data());
+    }
+}
+BENCHMARK(HTTPLexer_ConsumeAll);
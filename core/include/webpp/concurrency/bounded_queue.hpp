@@ -0,0 +1,161 @@
+#ifndef WEBPP_BOUNDED_QUEUE_HPP
+#define WEBPP_BOUNDED_QUEUE_HPP
+
+#include "../std/std.hpp"
+
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <new>
+
+namespace webpp {
+
+    /**
+     * A lock-free, bounded, multi-producer multi-consumer queue.
+     *
+     * This is Dmitry Vyukov's bounded MPMC queue; each cell has a sequence number that tells the producers
+     * and the consumers whether the cell is ready to be written to or read from, so both push and pop are
+     * a single CAS on their own index in the common case and no locks are ever taken.
+     * More info:
+     *   https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+     *
+     * The capacity is rounded up to the next power of two, and it's fixed after construction; the storage
+     * is allocated once so neither push nor pop allocates.
+     */
+    template <typename T, typename AllocType = stl::allocator<T>>
+    struct bounded_queue {
+        using value_type = T;
+        using size_type  = stl::size_t;
+
+      private:
+        // avoid false sharing between the producers' and the consumers' indices
+        static constexpr size_type cache_line_size = 64;
+
+        struct cell {
+            stl::atomic<size_type> sequence;
+            alignas(value_type) stl::byte storage[sizeof(value_type)];
+
+            [[nodiscard]] value_type* value() noexcept {
+                return stl::launder(reinterpret_cast<value_type*>(storage)); // NOLINT
+            }
+        };
+
+        using cell_allocator_type = typename stl::allocator_traits<AllocType>::template rebind_alloc<cell>;
+        using cell_alloc_traits   = stl::allocator_traits<cell_allocator_type>;
+
+        [[no_unique_address]] cell_allocator_type alloc;
+
+        size_type mask;
+        cell*     cells;
+
+        alignas(cache_line_size) stl::atomic<size_type> enqueue_pos{0};
+        alignas(cache_line_size) stl::atomic<size_type> dequeue_pos{0};
+
+      public:
+        explicit bounded_queue(size_type capacity, AllocType const& input_alloc = AllocType{})
+          : alloc{input_alloc},
+            mask{stl::bit_ceil(capacity < 2 ? size_type{2} : capacity) - 1},
+            cells{cell_alloc_traits::allocate(alloc, mask + 1)} {
+            for (size_type i = 0; i != mask + 1; ++i) {
+                stl::construct_at(&cells[i].sequence, i);
+            }
+        }
+
+        bounded_queue(bounded_queue const&)            = delete;
+        bounded_queue(bounded_queue&&)                 = delete;
+        bounded_queue& operator=(bounded_queue const&) = delete;
+        bounded_queue& operator=(bounded_queue&&)      = delete;
+
+        ~bounded_queue() {
+            // destroy the values that are still in the queue
+            for (size_type pos = dequeue_pos.load(stl::memory_order_relaxed),
+                           end = enqueue_pos.load(stl::memory_order_relaxed);
+                 pos != end;
+                 ++pos) {
+                stl::destroy_at(cells[pos & mask].value());
+            }
+            cell_alloc_traits::deallocate(alloc, cells, mask + 1);
+        }
+
+        [[nodiscard]] size_type capacity() const noexcept {
+            return mask + 1;
+        }
+
+        /**
+         * Construct a value at the end of the queue.
+         * Returns false if the queue is full.
+         */
+        template <typename... Args>
+        [[nodiscard]] bool try_emplace(Args&&... args) noexcept(
+          stl::is_nothrow_constructible_v<value_type, Args...>) {
+            cell*     the_cell; // NOLINT(cppcoreguidelines-init-variables)
+            size_type pos = enqueue_pos.load(stl::memory_order_relaxed);
+            for (;;) {
+                the_cell            = &cells[pos & mask];
+                size_type const seq = the_cell->sequence.load(stl::memory_order_acquire);
+                auto const      dif = static_cast<stl::intptr_t>(seq) - static_cast<stl::intptr_t>(pos);
+                if (dif == 0) {
+                    if (enqueue_pos.compare_exchange_weak(pos, pos + 1, stl::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (dif < 0) {
+                    return false; // full
+                } else {
+                    pos = enqueue_pos.load(stl::memory_order_relaxed);
+                }
+            }
+            stl::construct_at(the_cell->value(), stl::forward<Args>(args)...);
+            the_cell->sequence.store(pos + 1, stl::memory_order_release);
+            return true;
+        }
+
+        [[nodiscard]] bool try_push(value_type&& value) noexcept(
+          stl::is_nothrow_move_constructible_v<value_type>) {
+            return try_emplace(stl::move(value));
+        }
+
+        [[nodiscard]] bool try_push(value_type const& value) noexcept(
+          stl::is_nothrow_copy_constructible_v<value_type>) {
+            return try_emplace(value);
+        }
+
+        /**
+         * Move the first value of the queue into "out".
+         * Returns false if the queue is empty.
+         */
+        [[nodiscard]] bool try_pop(value_type& out) noexcept(stl::is_nothrow_move_assignable_v<value_type>) {
+            cell*     the_cell; // NOLINT(cppcoreguidelines-init-variables)
+            size_type pos = dequeue_pos.load(stl::memory_order_relaxed);
+            for (;;) {
+                the_cell            = &cells[pos & mask];
+                size_type const seq = the_cell->sequence.load(stl::memory_order_acquire);
+                auto const      dif = static_cast<stl::intptr_t>(seq) - static_cast<stl::intptr_t>(pos + 1);
+                if (dif == 0) {
+                    if (dequeue_pos.compare_exchange_weak(pos, pos + 1, stl::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (dif < 0) {
+                    return false; // empty
+                } else {
+                    pos = dequeue_pos.load(stl::memory_order_relaxed);
+                }
+            }
+            auto* const value = the_cell->value();
+            out               = stl::move(*value);
+            stl::destroy_at(value);
+            the_cell->sequence.store(pos + mask + 1, stl::memory_order_release);
+            return true;
+        }
+
+        /**
+         * This is only a hint, the queue may have been changed by other threads by the time you use the
+         * result.
+         */
+        [[nodiscard]] bool empty() const noexcept {
+            return dequeue_pos.load(stl::memory_order_relaxed) == enqueue_pos.load(stl::memory_order_relaxed);
+        }
+    };
+
+} // namespace webpp
+
+#endif // WEBPP_BOUNDED_QUEUE_HPP
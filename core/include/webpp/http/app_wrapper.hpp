@@ -187,6 +187,24 @@ namespace webpp::http {
             }
         }
 
+        /**
+         * The head of a request is received, and its body is not read yet; the protocols that can, call this
+         * before reading the body, if the application has an "on_request_head(req)".
+         * The application can refuse the request by returning an error status (its body is never read), or
+         * change how its body is read (its size limit, or streaming it) through the request.
+         */
+        [[nodiscard]] constexpr http::status_code on_request_head(HTTPRequest auto& req) {
+            if constexpr (requires {
+                              {
+                                  application_type::on_request_head(req)
+                              } -> stl::convertible_to<http::status_code>;
+                          }) {
+                return application_type::on_request_head(req);
+            } else {
+                return http::status_code::continue_;
+            }
+        }
+
         template <HTTPRequest ReqType>
         [[nodiscard]] constexpr HTTPResponse auto operator()(ReqType&& request) noexcept {
             if constexpr (stl::is_nothrow_invocable_v<application_type, ReqType>) {
@@ -10,6 +10,7 @@
 #include "../../std/string_view.hpp"
 #include "../../storage/file.hpp"
 #include "../../strings/size.hpp"
+#include "../headers/date.hpp"
 #include "../http_concepts.hpp"
 #include "../routes/router_concepts.hpp"
 #include "../status_code.hpp"
@@ -58,27 +59,58 @@ namespace webpp::http {
             return str;
         }
 
-        // load a file as a string body and return a response
+        /**
+         * Respond with a file. The embedded files are sent as strings; the rest are sent as file bodies
+         * (with sendfile(2), if the protocol supports it), with the Last-Modified and ETag of the file.
+         * Where the body can't hold a file (not on POSIX), the file is loaded into a string.
+         */
         [[nodiscard]] response_type file(stl::filesystem::path const& filepath) noexcept {
-            auto result = object::make_general<string_type>(*this);
-
-            bool const res = file::get_to(filepath, result);
-            if (res) {
-                // read the file successfully
+            if (auto const efile = embedded_file::search(filepath)) {
+                auto result = object::make_general<string_type>(*this);
+                result      = efile->content();
                 return this->response_body(result);
-            } else {
+            }
 
-                this->logger.error("Response/File",
-                                   fmt::format("Cannot load the specified file: {}", filepath.string()));
-                // todo: retry feature
-                if constexpr (context_type::is_debug()) {
-                    return this->error(http::status_code::internal_server_error);
-                } else {
-                    return this->error(
-                      http::status_code::internal_server_error,
-                      fmt::format("We're not able to load the specified file: {}", filepath.string()));
+            if constexpr (requires { typename body_type::file_communicator_type; }) {
+                using file_body_type = typename body_type::file_communicator_type;
+                if (file_body_type file_body{filepath}; file_body.is_open()) {
+                    using header_field_type = typename response_type::headers_type::field_type;
+                    using field_string_type = typename header_field_type::string_type;
+
+                    response_type res{*this};
+                    auto const    alloc = res.headers.get_allocator();
+
+                    field_string_type last_modified{alloc};
+                    append_http_date(last_modified, file_body.last_modified());
+                    res.headers.emplace_back(
+                      header_field_type{field_string_type{"Last-Modified", alloc}, stl::move(last_modified)});
+
+                    field_string_type etag{alloc};
+                    file_body.etag_to(etag);
+                    res.headers.emplace_back(
+                      header_field_type{field_string_type{"ETag", alloc}, stl::move(etag)});
+
+                    res.body = stl::move(file_body);
+                    return res;
+                }
+            } else {
+                // the body can't hold a file, so it's loaded into a string
+                auto result = object::make_general<string_type>(*this);
+                if (file::get_to(filepath, result)) {
+                    return this->response_body(result);
                 }
             }
+
+            this->logger.error("Response/File",
+                               fmt::format("Cannot load the specified file: {}", filepath.string()));
+            // todo: retry feature
+            if constexpr (context_type::is_debug()) {
+                return this->error(http::status_code::internal_server_error);
+            } else {
+                return this->error(
+                  http::status_code::internal_server_error,
+                  fmt::format("We're not able to load the specified file: {}", filepath.string()));
+            }
         }
     };
 
@@ -0,0 +1,98 @@
+#ifndef WEBPP_HTTP_HEADERS_DATE_HPP
+#define WEBPP_HTTP_HEADERS_DATE_HPP
+
+#include "../../std/string.hpp"
+#include "../../std/string_view.hpp"
+
+#include <algorithm>
+#include <array>
+#include <ctime>
+
+namespace webpp::http {
+
+    /**
+     * The preferred format of the dates in HTTP (IMF-fixdate), used by the Date, Last-Modified, and Expires
+     * header fields:
+     *
+     *     Sun, 06 Nov 1994 08:49:37 GMT
+     *
+     * https://www.rfc-editor.org/rfc/rfc9110#section-5.6.7
+     */
+    static constexpr stl::size_t http_date_size = 29;
+
+    using http_date_type = stl::array<char, http_date_size>;
+
+    /**
+     * Format the time (in seconds since epoch) as an HTTP date; this doesn't depend on the locale, unlike
+     * strftime.
+     */
+    [[nodiscard]] inline http_date_type format_http_date(stl::time_t time) noexcept {
+        static constexpr stl::array<char const*, 7>  days{"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+        static constexpr stl::array<char const*, 12> months{
+          "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+        stl::tm parts{};
+        ::gmtime_r(&time, &parts);
+
+        http_date_type date{};
+        auto*          out = date.data();
+
+        auto const append = [&out](char const* str, stl::size_t size) noexcept {
+            out = stl::copy_n(str, size, out);
+        };
+        auto const append_2digits = [&out](int number) noexcept {
+            *out++ = static_cast<char>('0' + number / 10);
+            *out++ = static_cast<char>('0' + number % 10);
+        };
+
+        append(days[static_cast<stl::size_t>(parts.tm_wday)], 3);
+        append(", ", 2);
+        append_2digits(parts.tm_mday);
+        *out++ = ' ';
+        append(months[static_cast<stl::size_t>(parts.tm_mon)], 3);
+        *out++ = ' ';
+        append_2digits((parts.tm_year + 1900) / 100);
+        append_2digits((parts.tm_year + 1900) % 100);
+        *out++ = ' ';
+        append_2digits(parts.tm_hour);
+        *out++ = ':';
+        append_2digits(parts.tm_min);
+        *out++ = ':';
+        append_2digits(parts.tm_sec);
+        append(" GMT", 4);
+        return date;
+    }
+
+    template <istl::String StrT>
+    void append_http_date(StrT& out, stl::time_t time) {
+        auto const date = format_http_date(time);
+        out.append(date.data(), date.size());
+    }
+
+    // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+    static constexpr stl::size_t date_field_size = 6 + http_date_size + 2;
+
+    /**
+     * The whole Date field of the current second; it's formatted once a second by each thread, instead of
+     * once a response. The returned view is valid until the next call in the same thread.
+     */
+    [[nodiscard]] inline stl::string_view cached_date_field() noexcept {
+        struct date_field_cache {
+            stl::time_t                        time = -1;
+            stl::array<char, date_field_size> field{'D', 'a', 't', 'e', ':', ' '};
+        };
+        thread_local date_field_cache cache{};
+
+        if (auto const now = stl::time(nullptr); now != cache.time) {
+            auto const date = format_http_date(now);
+            auto*      out  = stl::copy(date.begin(), date.end(), cache.field.data() + 6);
+            *out++          = '\r';
+            *out            = '\n';
+            cache.time      = now;
+        }
+        return {cache.field.data(), cache.field.size()};
+    }
+
+} // namespace webpp::http
+
+#endif // WEBPP_HTTP_HEADERS_DATE_HPP
@@ -286,7 +286,8 @@ namespace webpp::http {
         nothing    = 0, // contains nothing (monostate)
         text_based = 1,
         blob_based,
-        stream_based
+        stream_based,
+        file_based
     };
 
     template <typename T>
@@ -3,10 +3,31 @@
 #ifndef WEBPP_BEAST_HPP
 #define WEBPP_BEAST_HPP
 
+#include "../../server/socket_handoff.hpp"
+#include "../../server/socket_options.hpp"
+#include "../../server/usage.hpp"
+#include "../../std/optional.hpp"
 #include "../../std/string_view.hpp"
 #include "beast_proto/beast_body_communicator.hpp"
 #include "beast_proto/beast_server.hpp"
+#include "beast_proto/beast_websocket.hpp"
 #include "common/common_http_protocol.hpp"
+#include "shosted/limits.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <mutex>
+
+#ifdef __linux__
+#    include <pthread.h>
+#    include <sched.h>
+#endif
+
+// clang-format off
+#include asio_include(ip/v6_only)
+#include asio_include(local/stream_protocol)
+// clang-format on
 
 
 namespace webpp::http {
@@ -31,6 +52,10 @@ namespace webpp::http {
         using endpoint_type             = asio::ip::tcp::endpoint;
         using acceptor_type             = asio::ip::tcp::acceptor;
         using socket_type               = asio::ip::tcp::socket;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        using local_protocol_type = asio::local::stream_protocol;
+        using local_acceptor_type = typename local_protocol_type::acceptor;
+#endif
         using thread_worker_type        = beast_proto::thread_worker<protocol_type>;
         using http_worker_type          = beast_proto::http_worker<protocol_type>;
         using allocator_pack_type       = typename etraits::allocator_pack_type;
@@ -42,46 +67,579 @@ namespace webpp::http {
         using thread_pool_type          = asio::thread_pool;
         using request_type              = simple_request<protocol_type, beast_proto::beast_request>;
         using request_body_communicator = beast_proto::beast_request_body_communicator<protocol_type>;
+        using websocket_options         = beast_proto::websocket_options;
+        using body_limits_type          = shosted::limits_type::body_limits;
+
+        // the deadlines of the connections; the clients that are slower than these are disconnected
+        duration header_timeout{stl::chrono::seconds(3)}; // receiving the head of the first request
+        duration body_timeout{stl::chrono::seconds(3)};   // receiving the body, after its head
+        duration write_timeout{stl::chrono::seconds(3)};  // sending each part of a response
+
+        // the precision of the deadlines; they may expire up to this much late
+        duration timer_resolution{stl::chrono::milliseconds(100)};
+
+        // how long an idle persistent connection is kept open while waiting for its next request
+        duration keep_alive_timeout{stl::chrono::seconds(5)};
+
+        // maximum number of requests served over one connection before we close it; 1 disables keep-alive
+        stl::size_t max_keep_alive_requests{default_max_keep_alive_requests};
+
+        // maximum number of accepted connections that wait for a free http worker; when this many are
+        // already waiting, the new connections are answered with "503 Service Unavailable" and closed.
+        // It's rounded up to a power of two.
+        stl::size_t max_pending_connections{default_max_pending_connections};
 
-        // each request should finish before this
-        duration timeout{stl::chrono::seconds(3)};
+        // when set, the new connections and requests are answered with "503 Service Unavailable" while the
+        // host is busier than these limits (see shed_load)
+        stl::optional<host::usage_options> load_shedding{stl::nullopt};
 
+        // the size limits of the request bodies; GET and HEAD get the first one, the other methods the second
+        // one. The application can change them per request (see the "on_request_head" of the application).
+        body_limits_type body_limits{};
 
-        static constexpr auto        log_cat                   = "Beast";
-        static constexpr port_type   default_http_port         = 80u;
-        static constexpr port_type   default_https_port        = 443u;
-        static constexpr stl::size_t default_http_worker_count = 20;
+        // the limits of the connections that are upgraded to WebSocket (see beast_proto::websocket_route)
+        websocket_options websocket{};
+
+        // the options of the listeners and of the connections that they accept
+        socket_options sock_options{};
+
+        // how long the connections are given to finish their requests when the server is drained
+        duration drain_timeout{stl::chrono::seconds(30)};
+
+        // the Unix socket that the listeners are handed over through, to the next process (see handoff)
+        stl::string handoff_path{};
+
+        // how long the processes wait for each other during a handoff
+        duration handoff_timeout{stl::chrono::seconds(10)};
+
+        static constexpr auto        log_cat                         = "Beast";
+        static constexpr port_type   default_http_port               = 80u;
+        static constexpr port_type   default_https_port              = 443u;
+        static constexpr stl::size_t default_http_worker_count       = 20;
+        static constexpr stl::size_t default_max_keep_alive_requests = 100;
+        static constexpr stl::size_t default_max_pending_connections = 128;
+
+        // maximum number of pipelined requests that are served before their responses are written
+        static constexpr stl::size_t max_pipelined_requests = 16;
 
       private:
         using super = common_http_protocol<TraitsType, App, RootExtensions>;
 
+#ifdef SO_REUSEPORT
+        using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+        // a Unix domain socket that the server listens on, see listen_unix
+        struct unix_socket {
+            stl::string            path;
+            stl::filesystem::perms permissions;
+            bool                   bound = false; // its file is ours to remove
+        };
+
+        // The acceptors of all the endpoints, on the same io context
+        struct listeners {
+            stl::list<acceptor_type> acceptors;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            stl::list<local_acceptor_type> local_acceptors;
+#endif
+        };
+
+        // An io context that's only run by one thread, with its own acceptors and http workers; used in the
+        // "shard per core" mode.
+        struct shard {
+            asio::io_context   io{1};
+            listeners          acceptors;
+            thread_worker_type thread_workers;
+
+            shard(protocol_type& server) : thread_workers{server, io} {}
+        };
+
         friend http_worker_type;
         friend thread_worker_type;
 
-        address_type       bind_address;
-        port_type          bind_port = default_http_port;
-        asio::io_context   io{static_cast<int>(stl::thread::hardware_concurrency())};
-        acceptor_type      acceptor;
-        stl::size_t        http_worker_count{default_http_worker_count};
-        stl::size_t        thread_worker_count{stl::thread::hardware_concurrency()};
-        thread_pool_type   pool{stl::thread::hardware_concurrency() - 1}; // there's a main thread too
-        thread_worker_type thread_workers;
-        stl::mutex         app_call_mutex;
-        bool               synced = false;
+        address_type               bind_address;
+        port_type                  bind_port        = default_http_port;
+        bool                       default_endpoint = true; // listen on the bind address and the bind port
+        stl::vector<endpoint_type> more_endpoints;          // see listen
+        stl::vector<unix_socket>   unix_sockets;            // see listen_unix
+        asio::io_context           io{static_cast<int>(stl::thread::hardware_concurrency())};
+        listeners                  acceptors;
+        stl::size_t                http_worker_count{default_http_worker_count};
+        stl::size_t                thread_worker_count{stl::thread::hardware_concurrency()};
+        thread_pool_type           pool{stl::thread::hardware_concurrency() - 1}; // there's a main thread too
+        thread_worker_type         thread_workers;
+        stl::list<shard>           shards;
+        stl::mutex                 app_call_mutex;
+        bool                       synced      = false;
+        bool                       sharded     = false;
+        bool                       pin_threads = false;
+
+        // the server is drained: the listeners are closed, and the connections are not kept alive
+        stl::atomic<bool>                 draining{false};
+        stl::optional<asio::steady_timer> drain_timer{stl::nullopt};
+
+        // see handoff
+        inherited_sockets inherited{};      // the listeners of the previous process, while binding
+        bool              handed_off{false}; // the listeners (and their files) belong to the new process
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        stl::optional<local_acceptor_type> handoff_acceptor{stl::nullopt};
+#endif
+
+
+
+        // the connections are accepted right onto the strand of their connection group
+        template <typename AcceptorType>
+        void async_accept(AcceptorType& acc, thread_worker_type& workers) noexcept {
+            using accepted_socket_type = typename AcceptorType::protocol_type::socket;
+
+            auto& group     = workers.next_group();
+            auto  on_accept = [this, &acc, &workers, &group](boost::beast::error_code ec,
+                                                             accepted_socket_type     sock) {
+                if (!ec) [[likely]] {
+                    // todo: start_work may throw errors, deal with them
+                    if constexpr (stl::same_as<accepted_socket_type, socket_type>) {
+                        tune_connection(sock);
+                        workers.start_work(stl::move(sock), group);
+                    } else {
+                        // The http workers only know TCP sockets; reading from and writing to a stream
+                        // socket is the same for all the address families, so the connection is handed
+                        // over as one.
+                        socket_type tcp_sock{sock.get_executor()};
+                        tcp_sock.assign(asio::ip::tcp::v6(), sock.release(ec), ec);
+                        if (!ec) [[likely]] {
+                            workers.start_work(stl::move(tcp_sock), group);
+                        }
+                    }
+                }
+                if (is_draining()) [[unlikely]] {
+                    return; // the acceptor is closed
+                }
+                if (ec) [[unlikely]] {
+                    this->logger.warning(log_cat, "Accepting error", ec);
+                }
+                this->async_accept(acc, workers);
+            };
+            acc.async_accept(group.strand, stl::move(on_accept));
+        }
+
+        // set the socket options of an accepted TCP connection
+        void tune_connection([[maybe_unused]] socket_type& sock) noexcept {
+#ifdef webpp_posix
+            // the family is only checked for the Unix sockets; the IPv4 and IPv6 ones get the same options
+            if (auto const failed = apply_connection_options(sock.native_handle(), AF_INET, sock_options);
+                !failed.empty()) [[unlikely]] {
+                this->logger.warning(log_cat,
+                                     fmt::format("Cannot set {} on the connection.", failed),
+                                     stl::error_code{errno, stl::system_category()});
+            }
+#endif
+        }
+
+        // set the socket options of a listener; they're set before it starts listening
+        [[nodiscard]] bool tune_listener([[maybe_unused]] auto&             acc,
+                                         [[maybe_unused]] int               family,
+                                         [[maybe_unused]] stl::string_view name) {
+#ifdef webpp_posix
+            if (auto const failed = apply_listener_options(acc.native_handle(), family, sock_options);
+                !failed.empty()) {
+                this->logger.error(log_cat,
+                                   fmt::format("Cannot set {} on {}", failed, name),
+                                   stl::error_code{errno, stl::system_category()});
+                return false;
+            }
+#endif
+            return true;
+        }
+
+        [[nodiscard]] static stl::string endpoint_name(endpoint_type const& ep) {
+            if (ep.address().is_v6()) {
+                return fmt::format("[{}]:{}", ep.address().to_string(), ep.port());
+            }
+            return fmt::format("{}:{}", ep.address().to_string(), ep.port());
+        }
+
+        // open, bind, and listen; or take over the listener of the previous process
+        [[nodiscard]] bool listen(acceptor_type& acc, endpoint_type const& ep) noexcept {
+            boost::beast::error_code ec;
+            if (auto const sock = inherited.take(ep.data()); sock != -1) {
+                acc.assign(ep.protocol(), sock, ec);
+                if (ec) {
+                    ::close(sock);
+                    this->logger.error(log_cat,
+                                       fmt::format("Cannot take over the listener of {}", endpoint_name(ep)),
+                                       ec);
+                    return false;
+                }
+                return true;
+            }
+
+            // open
+            acc.open(ep.protocol(), ec);
+            if (ec) {
+                this->logger.error(log_cat,
+                                   fmt::format("Cannot open protocol for {}", endpoint_name(ep)),
+                                   ec);
+                return false;
+            }
+
+            // Allow address reuse
+            acc.set_option(asio::socket_base::reuse_address(true), ec);
+            if (ec) {
+                this->logger.error(log_cat,
+                                   fmt::format("Cannot set reuse option on {}", endpoint_name(ep)),
+                                   ec);
+                return false;
+            }
+
+            // the IPv4 addresses have their own endpoints, so "::" and "0.0.0.0" can both be listened on
+            if (ep.address().is_v6()) {
+                acc.set_option(asio::ip::v6_only(true), ec);
+                if (ec) {
+                    this->logger.error(log_cat,
+                                       fmt::format("Cannot set v6-only on {}", endpoint_name(ep)),
+                                       ec);
+                    return false;
+                }
+            }
+
+            // Let all the shards listen on the same port; the kernel balances the connections between them
+            if (sharded) {
+#ifdef SO_REUSEPORT
+                acc.set_option(reuse_port(true), ec);
+                if (ec) {
+                    this->logger.error(log_cat,
+                                       fmt::format("Cannot set reuse port option on {}", endpoint_name(ep)),
+                                       ec);
+                    return false;
+                }
+#else
+                this->logger.error(log_cat, "Sharding is not supported on this platform (no SO_REUSEPORT).");
+                return false;
+#endif
+            }
+
+            // bind
+            acc.bind(ep, ec);
+            if (ec) {
+                this->logger.error(log_cat, fmt::format("Cannot bind to {}", endpoint_name(ep)), ec);
+                return false;
+            }
+
+            // listen
+            if (!tune_listener(acc, ep.protocol().family(), endpoint_name(ep))) {
+                return false;
+            }
+            acc.listen(sock_options.backlog, ec);
+            if (ec) {
+                this->logger.error(log_cat, fmt::format("Cannot listen to {}", endpoint_name(ep)), ec);
+                return false;
+            }
+            return true;
+        }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        // the abstract names (Linux only) start with '@', which is a null character in the address
+        [[nodiscard]] static bool is_abstract(unix_socket const& sock) noexcept {
+            return sock.path.starts_with('@');
+        }
+
+        [[nodiscard]] static typename local_protocol_type::endpoint local_endpoint(unix_socket const& sock) {
+            if (is_abstract(sock)) {
+                auto name = sock.path;
+                name[0]   = '\0';
+                return {name};
+            }
+            return {sock.path};
+        }
+
+        // A socket file that's left from a previous run is removed, if nobody is listening on it
+        void remove_stale_socket(unix_socket const& sock) {
+            stl::error_code fs_ec;
+            if (is_abstract(sock) || !stl::filesystem::is_socket(sock.path, fs_ec)) {
+                return;
+            }
+            boost::beast::error_code             ec;
+            typename local_protocol_type::socket probe{io};
+            probe.connect(local_endpoint(sock), ec);
+            if (ec == asio::error::connection_refused) {
+                stl::filesystem::remove(sock.path, fs_ec);
+            }
+        }
+
+        // open, bind, and listen on a Unix domain socket
+        [[nodiscard]] bool listen(local_acceptor_type& acc, unix_socket& sock) noexcept {
+            boost::beast::error_code ec;
+            try {
+                auto const ep = local_endpoint(sock);
+                if (auto const inherited_sock = inherited.take(ep.data()); inherited_sock != -1) {
+                    acc.assign(ep.protocol(), inherited_sock, ec);
+                    if (ec) {
+                        ::close(inherited_sock);
+                    }
+                    sock.bound = !ec;
+                } else {
+                    remove_stale_socket(sock);
+                    acc.open(ep.protocol(), ec);
+                    if (!ec) {
+                        acc.bind(ep, ec);
+                        sock.bound = !ec;
+                    }
+                }
+                if (!ec && !is_abstract(sock)) {
+                    stl::error_code fs_ec;
+                    stl::filesystem::permissions(sock.path, sock.permissions, fs_ec);
+                    if (fs_ec) {
+                        this->logger.error(log_cat,
+                                           fmt::format("Cannot set the permissions of {}", sock.path),
+                                           fs_ec);
+                        return false;
+                    }
+                }
+                if (!ec && !tune_listener(acc, AF_UNIX, sock.path)) {
+                    return false;
+                }
+                if (!ec) {
+                    acc.listen(sock_options.backlog, ec);
+                }
+            } catch (stl::exception const& ex) {
+                this->logger.error(log_cat,
+                                   fmt::format("Cannot listen on the Unix socket {}", sock.path),
+                                   ex);
+                return false;
+            }
+            if (ec) {
+                this->logger.error(log_cat,
+                                   fmt::format("Cannot listen on the Unix socket {}", sock.path),
+                                   ec);
+                return false;
+            }
+            return true;
+        }
+
+#endif
+
+        // close the acceptors, and remove the files of the Unix sockets
+        void stop_listening() noexcept {
+            auto const close_all = [](listeners& accs) noexcept {
+                boost::beast::error_code ec;
+                for (auto& acc : accs.acceptors) {
+                    acc.close(ec);
+                }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+                for (auto& acc : accs.local_acceptors) {
+                    acc.close(ec);
+                }
+#endif
+            };
+            close_all(acceptors);
+            for (auto& the_shard : shards) {
+                close_all(the_shard.acceptors);
+            }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            for (auto& sock : unix_sockets) {
+                stl::error_code ec;
+                if (sock.bound && !is_abstract(sock) && !handed_off) {
+                    stl::filesystem::remove(sock.path, ec);
+                }
+                sock.bound = false;
+            }
+            if (handoff_acceptor) {
+                boost::beast::error_code ec;
+                handoff_acceptor->close(ec);
+                handoff_acceptor.reset();
+                if (!handed_off) {
+                    stl::error_code fs_ec;
+                    stl::filesystem::remove(handoff_path, fs_ec);
+                }
+            }
+#endif
+        }
+
+        // the native handles of all the listeners, to be handed over to the next process
+        [[nodiscard]] stl::vector<int> listener_handles() {
+            stl::vector<int> socks;
+            auto const       add_all = [&socks](listeners& accs) {
+                for (auto& acc : accs.acceptors) {
+                    socks.push_back(acc.native_handle());
+                }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+                for (auto& acc : accs.local_acceptors) {
+                    socks.push_back(acc.native_handle());
+                }
+#endif
+            };
+            add_all(acceptors);
+            for (auto& the_shard : shards) {
+                add_all(the_shard.acceptors);
+            }
+            return socks;
+        }
+
+        /**
+         * Listen on the handoff socket for the next process; the file of the previous process is replaced.
+         * The thread that hands the listeners over waits for the next process to take them.
+         */
+        void listen_for_handoff(asio::io_context& ctx) {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            int const sock = listen_handoff(handoff_path);
+            if (sock == -1) {
+                this->logger.warning(log_cat,
+                                     fmt::format("Cannot listen on the handoff socket {}", handoff_path),
+                                     stl::error_code{errno, stl::system_category()});
+                return;
+            }
+            handoff_acceptor.emplace(ctx, local_protocol_type{}, sock);
+            async_wait_for_handoff();
+#else
+            static_cast<void>(ctx);
+            this->logger.warning(log_cat, "Unix domain sockets are not supported, there's no handoff.");
+#endif
+        }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        void async_wait_for_handoff() {
+            handoff_acceptor->async_wait(local_acceptor_type::wait_read, [this](boost::beast::error_code ec) {
+                if (ec || is_draining()) {
+                    return;
+                }
+                auto const socks = listener_handles();
+                if (!hand_over_sockets(handoff_acceptor->native_handle(), socks, handoff_timeout)) {
+                    this->logger.warning(log_cat, "The new process didn't take the listeners.");
+                    async_wait_for_handoff();
+                    return;
+                }
+                this->logger.info(log_cat, "The listeners are handed over to the new process; draining.");
+                handed_off = true;
+                drain();
+            });
+        }
+#endif
+
+        // the connections of all the thread workers
+        [[nodiscard]] stl::size_t connection_count() const noexcept {
+            stl::size_t count = thread_workers.connection_count();
+            for (auto const& the_shard : shards) {
+                count += the_shard.thread_workers.connection_count();
+            }
+            return count;
+        }
+
+        // stop the io contexts when the connections are closed, or when the drain timeout is up
+        void async_wait_for_drain(stl::chrono::steady_clock::time_point deadline) {
+            drain_timer->expires_after(timer_resolution);
+            drain_timer->async_wait([this, deadline](boost::beast::error_code ec) {
+                if (ec) {
+                    return;
+                }
+                if (connection_count() != 0 && stl::chrono::steady_clock::now() < deadline) {
+                    async_wait_for_drain(deadline);
+                    return;
+                }
+                this->logger.info(log_cat,
+                                  connection_count() == 0
+                                    ? "The connections are drained."
+                                    : "The drain timeout is up; closing the rest of the connections.");
+                stop();
+            });
+        }
+
+        // the io context that the server's own timers and signals run on
+        [[nodiscard]] asio::io_context& main_io() noexcept {
+            return sharded ? shards.front().io : io;
+        }
+
+        /**
+         * Open the acceptors of all the endpoints on the io context; the Unix sockets can't be shared between
+         * the shards, they're only listened on by the first one.
+         */
+        [[nodiscard]] bool listen_all(listeners& accs, asio::io_context& ctx, bool with_unix_sockets) {
+            auto const add_acceptor = [&]() -> acceptor_type& {
+                if (sharded) {
+                    return accs.acceptors.emplace_back(ctx);
+                }
+                return accs.acceptors.emplace_back(asio::make_strand(ctx));
+            };
+            if (default_endpoint && !listen(add_acceptor(), endpoint_type{bind_address, bind_port})) {
+                return false;
+            }
+            for (auto const& ep : more_endpoints) {
+                if (!listen(add_acceptor(), ep)) {
+                    return false;
+                }
+            }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            if (with_unix_sockets) {
+                for (auto& sock : unix_sockets) {
+                    auto& acc = sharded ? accs.local_acceptors.emplace_back(ctx)
+                                        : accs.local_acceptors.emplace_back(asio::make_strand(ctx));
+                    if (!listen(acc, sock)) {
+                        return false;
+                    }
+                }
+            }
+#else
+            if (with_unix_sockets && !unix_sockets.empty()) {
+                this->logger.error(log_cat, "Unix domain sockets are not supported on this platform.");
+                return false;
+            }
+#endif
+            if (accs.acceptors.empty() && unix_sockets.empty()) {
+                this->logger.error(log_cat, "There's no endpoint to listen on.");
+                return false;
+            }
+            return true;
+        }
 
+        // We need to be executing within a strand to perform async operations on the I/O objects in this
+        // session.
+        void start_accepting(listeners& accs, thread_worker_type& workers) {
+            for (auto& acc : accs.acceptors) {
+                asio::dispatch(acc.get_executor(), [this, &acc, &workers] {
+                    async_accept(acc, workers);
+                });
+            }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            for (auto& acc : accs.local_acceptors) {
+                asio::dispatch(acc.get_executor(), [this, &acc, &workers] {
+                    async_accept(acc, workers);
+                });
+            }
+#endif
+        }
 
+        // the endpoints, for the logs
+        [[nodiscard]] stl::string endpoint_names() const {
+            stl::string names;
+            auto const  add = [&names](stl::string_view name) {
+                if (!names.empty()) {
+                    names += ", ";
+                }
+                names += name;
+            };
+            if (default_endpoint) {
+                add(endpoint_name(endpoint_type{bind_address, bind_port}));
+            }
+            for (auto const& ep : more_endpoints) {
+                add(endpoint_name(ep));
+            }
+            for (auto const& sock : unix_sockets) {
+                add(fmt::format("unix:{}", sock.path));
+            }
+            return names;
+        }
 
-        void async_accept() noexcept {
-            acceptor.async_accept(asio::make_strand(io),
-                                  [this](boost::beast::error_code ec, socket_type sock) {
-                                      if (!ec) [[likely]] {
-                                          // todo: start_work may throw errors, deal with them
-                                          thread_workers.start_work(stl::move(sock));
-                                      } else [[unlikely]] {
-                                          this->logger.warning(log_cat, "Accepting error", ec);
-                                      }
-                                      this->async_accept();
-                                  });
+        // pin the current thread to the specified cpu
+        void pin_thread(stl::size_t cpu) noexcept {
+#ifdef __linux__
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu % CPU_SETSIZE, &cpus);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+                this->logger.warning(log_cat, fmt::format("Cannot pin thread {} to cpu {}.", cpu, cpu));
+            }
+#else
+            this->logger.warning(log_cat, fmt::format("Pinning threads is not supported; thread {}.", cpu));
+#endif
         }
 
         // call the app
@@ -94,6 +652,24 @@ namespace webpp::http {
             }
         }
 
+        // let the app look at the head of a request before its body is read; a failure refuses the request
+        [[nodiscard]] http::status_code call_app_head(request_type& req) noexcept {
+            try {
+                if (synced) {
+                    stl::scoped_lock lock{app_call_mutex};
+                    return this->app.on_request_head(req);
+                }
+                return this->app.on_request_head(req);
+            } catch (stl::exception const& ex) {
+                this->logger.error(log_cat, "Failed to check the head of a request.", ex);
+                return http::status_code::internal_server_error;
+            }
+        }
+
+        [[nodiscard]] bool is_overloaded() const noexcept {
+            return load_shedding && host::is_busy(*load_shedding);
+        }
+
         template <typename ServerT>
         friend struct http_worker;
 
@@ -108,8 +684,7 @@ namespace webpp::http {
         template <typename... Args>
         beast(Args&&... args)
           : super{stl::forward<Args>(args)...},
-            acceptor{asio::make_strand(io)},
-            thread_workers{*this} {}
+            thread_workers{*this, io} {}
 
 
         beast& address(string_view_type addr) noexcept {
@@ -127,14 +702,221 @@ namespace webpp::http {
             return *this;
         }
 
+        /**
+         * Listen on this endpoint too, besides the address and the port; the connections of all the
+         * endpoints are served by the same http workers.
+         *   server.address("0.0.0.0").port(80).listen("::", 80)
+         */
+        beast& listen(string_view_type addr, port_type p) {
+            asio::error_code ec;
+            auto const       ip = asio::ip::make_address(istl::to_std_string_view(addr), ec);
+            if (ec) {
+                this->logger.error(log_cat, "Cannot set address", ec);
+                return *this;
+            }
+            more_endpoints.emplace_back(ip, p);
+            return *this;
+        }
+
+        /**
+         * Listen on a Unix domain socket too; for the clients on the same host (a reverse proxy, mostly),
+         * it's cheaper than the loopback TCP. A path that starts with '@' is in the abstract namespace of
+         * Linux (it has no file). A socket file that's left from a previous run is replaced, and the file is
+         * removed when the server stops.
+         */
+        beast& listen_unix(string_view_type           path,
+                           stl::filesystem::perms permissions = stl::filesystem::perms::owner_read |
+                                                                stl::filesystem::perms::owner_write |
+                                                                stl::filesystem::perms::group_read |
+                                                                stl::filesystem::perms::group_write) {
+            unix_sockets.push_back({.path = stl::string{path}, .permissions = permissions, .bound = false});
+            return *this;
+        }
+
+        // Don't listen on the address and the port, only on the endpoints of listen and listen_unix
+        beast& disable_default_endpoint() noexcept {
+            default_endpoint = false;
+            return *this;
+        }
+
         beast& post();
         beast& defer();
 
+        /**
+         * Number of connections that are served concurrently; the rest of them wait in a bounded queue
+         * (see max_pending_connections).
+         */
         beast& set_worker_count(stl::size_t val) {
             http_worker_count = val;
             return *this;
         }
 
+        /**
+         * Configure HTTP/1.1 persistent connections.
+         * The connection is closed after it's been idle for "idle_timeout", or after "max_requests"
+         * requests have been served over it, whichever comes first.
+         */
+        beast& keep_alive(duration idle_timeout, stl::size_t max_requests = default_max_keep_alive_requests) {
+            keep_alive_timeout      = idle_timeout;
+            max_keep_alive_requests = max_requests;
+            return *this;
+        }
+
+        /**
+         * The deadlines of the reads and the writes of the connections; the idle persistent connections
+         * get the keep-alive timeout instead of the header timeout (see keep_alive).
+         */
+        beast& timeouts(duration header, duration body, duration write) noexcept {
+            header_timeout = header;
+            body_timeout   = body;
+            write_timeout  = write;
+            return *this;
+        }
+
+        beast& disable_keep_alive() noexcept {
+            max_keep_alive_requests = 1;
+            return *this;
+        }
+
+        /**
+         * Answer the new connections and requests with a precomputed "503 Service Unavailable" (with a
+         * Retry-After) while the CPU usage, the memory usage, or the number of in-flight requests is over the
+         * limits. Under a traffic spike, turning some clients away quickly is better than letting the latency
+         * grow for everyone.
+         */
+        beast& shed_load(host::usage_options limits = {}) noexcept {
+            load_shedding = limits;
+            return *this;
+        }
+
+        beast& disable_load_shedding() noexcept {
+            load_shedding.reset();
+            return *this;
+        }
+
+        /**
+         * The limits of the WebSocket connections: the size of the messages, and the send queue of each
+         * connection, which is what keeps a slow client from growing our memory.
+         */
+        beast& websockets(websocket_options options) noexcept {
+            websocket = options;
+            return *this;
+        }
+
+        /**
+         * The options of the listening sockets (the backlog, TCP_DEFER_ACCEPT, TCP_FASTOPEN, and the
+         * buffer sizes) and of the accepted connections (TCP_NODELAY, TCP_QUICKACK, and SO_BUSY_POLL).
+         */
+        beast& sockets(socket_options options) noexcept {
+            sock_options = options;
+            return *this;
+        }
+
+        /**
+         * Restart without downtime: the server takes over the listeners of the process that's listening on
+         * this Unix socket (with SCM_RIGHTS), which is then drained; and it listens on it for the next
+         * process itself. The new process should listen on the same endpoints.
+         */
+        beast& handoff(string_view_type path, duration timeout = stl::chrono::seconds(10)) {
+            handoff_path    = stl::string{path};
+            handoff_timeout = timeout;
+            return *this;
+        }
+
+        /**
+         * Use these listeners instead of opening new ones, for the endpoints that they're bound to; the ones
+         * that are not used are closed when the server starts (see posix::prefork).
+         */
+        beast& inherit(inherited_sockets&& socks) noexcept {
+            inherited = stl::move(socks);
+            return *this;
+        }
+
+        [[nodiscard]] bool is_draining() const noexcept {
+            return draining.load(stl::memory_order_relaxed);
+        }
+
+        /**
+         * Stop accepting, and stop the server when its connections are closed: the connections that are
+         * waiting for their next request are closed right away, the others after their current response
+         * (without keep-alive). The connections that are still open after the drain timeout are cut off,
+         * and so are the WebSocket connections. The first SIGINT or SIGTERM drains the server.
+         * It's safe to call this from any thread, while the server is running.
+         */
+        void drain() {
+            asio::post(main_io(), [this] {
+                if (draining.exchange(true, stl::memory_order_relaxed)) {
+                    return;
+                }
+                auto const close_all = [](listeners& accs) {
+                    for (auto& acc : accs.acceptors) {
+                        asio::post(acc.get_executor(), [&acc]() noexcept {
+                            boost::beast::error_code ec;
+                            acc.close(ec);
+                        });
+                    }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+                    for (auto& acc : accs.local_acceptors) {
+                        asio::post(acc.get_executor(), [&acc]() noexcept {
+                            boost::beast::error_code ec;
+                            acc.close(ec);
+                        });
+                    }
+#endif
+                };
+                close_all(acceptors);
+                thread_workers.drain();
+                for (auto& the_shard : shards) {
+                    close_all(the_shard.acceptors);
+                    the_shard.thread_workers.drain();
+                }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+                if (handoff_acceptor) {
+                    boost::beast::error_code ec;
+                    handoff_acceptor->cancel(ec);
+                }
+#endif
+                drain_timer.emplace(main_io());
+                async_wait_for_drain(stl::chrono::steady_clock::now() + drain_timeout);
+            });
+        }
+
+        /**
+         * Stop the server right away; the open connections are cut off. The second SIGINT or SIGTERM stops
+         * the server. It's safe to call this from any thread.
+         */
+        void stop() noexcept {
+            // Stop the `io_context`. This will cause `run()`
+            // to return immediately, eventually destroying the
+            // `io_context` and all the sockets in it.
+            io.stop();
+            thread_workers.stop();
+            for (auto& the_shard : shards) {
+                // the workers of the other shards belong to other threads; stopping their io context is
+                // enough
+                the_shard.io.stop();
+            }
+            pool.stop();
+        }
+
+        /**
+         * Shard per core: every thread runs its own io context, with its own acceptors bound to the same
+         * endpoints (with SO_REUSEPORT) and its own http workers. The kernel spreads the connections
+         * between the threads, and a connection never leaves the thread that accepted it.
+         * Each shard gets "worker count" http workers. The Unix sockets are only accepted by the first shard.
+         */
+        beast& enable_sharding(bool pin_to_cpus = false) noexcept {
+            sharded     = true;
+            pin_threads = pin_to_cpus;
+            return *this;
+        }
+
+        beast& disable_sharding() noexcept {
+            sharded     = false;
+            pin_threads = false;
+            return *this;
+        }
+
         [[nodiscard]] bool is_ssl_active() const noexcept {
             return false;
         }
@@ -199,71 +981,74 @@ namespace webpp::http {
 
         // run the server
         [[nodiscard]] int operator()() noexcept {
-
-            // Capture SIGINT and SIGTERM to perform a clean shutdown
-            asio::signal_set signals(io, SIGINT, SIGTERM);
-            signals.async_wait([this](boost::beast::error_code const&, int) {
-                this->logger.info(log_cat, "Stopping the server, got a signal");
-
-                // Stop the `io_context`. This will cause `run()`
-                // to return immediately, eventually destroying the
-                // `io_context` and all the sockets in it.
-                io.stop();
-                thread_workers.stop();
-                pool.stop();
-            });
-
-            boost::beast::error_code ec;
-            const endpoint_type      ep{bind_address, bind_port};
-
-            // open
-            acceptor.open(ep.protocol(), ec);
-            if (ec) {
-                this->logger.error(log_cat,
-                                   fmt::format("Cannot open protocol for {}", bound_uri().to_string()),
-                                   ec);
-                return -1;
-            }
-
-            // Allow address reuse
-            acceptor.set_option(asio::socket_base::reuse_address(true), ec);
-            if (ec) {
-                this->logger.error(log_cat,
-                                   fmt::format("Cannot set reuse option on {}", bound_uri().to_string()),
-                                   ec);
-                return -1;
+            if (!handoff_path.empty()) {
+                try {
+                    inherited = inherited_sockets{handoff_path, handoff_timeout};
+                } catch (stl::exception const& ex) {
+                    this->logger.warning(log_cat, "Cannot take the listeners of the previous process.", ex);
+                }
             }
+            bool const took_over = !inherited.empty();
+            if (sharded) {
+                for (stl::size_t i = 0ul; i < stl::max(thread_worker_count, 1ul); ++i) {
+                    auto& the_shard = shards.emplace_back(*this);
+                    if (!listen_all(the_shard.acceptors, the_shard.io, i == 0)) {
+                        stop_listening();
+                        return -1;
+                    }
+                    the_shard.thread_workers.initialize();
+                    start_accepting(the_shard.acceptors, the_shard.thread_workers);
+                }
+            } else {
+                if (!listen_all(acceptors, io, true)) {
+                    stop_listening();
+                    return -1;
+                }
 
-            // bind
-            acceptor.bind(ep, ec);
-            if (ec) {
-                this->logger.error(log_cat, fmt::format("Cannot bind to {}", bound_uri().to_string()), ec);
-                return -1;
+                // create the http workers
+                thread_workers.initialize();
+                start_accepting(acceptors, thread_workers);
             }
-
-            // listen
-            acceptor.listen(asio::socket_base::max_listen_connections, ec);
-            if (ec) {
-                this->logger.error(log_cat, fmt::format("Cannot listen to {}", bound_uri().to_string()), ec);
-                return -1;
+            if (!handoff_path.empty()) {
+                if (took_over) {
+                    this->logger.info(log_cat, "Took over the listeners of the previous process.");
+                }
+                listen_for_handoff(main_io());
+                inherited.confirm(); // the previous process is drained
             }
 
-            // We need to be executing within a strand to perform async operations
-            // on the I/O objects in this session.
-            asio::dispatch(acceptor.get_executor(),
-                           boost::beast::bind_front_handler(&protocol_type::async_accept, this));
+            // Capture SIGINT and SIGTERM to perform a clean shutdown; a second signal doesn't wait for the
+            // connections to be drained
+            asio::signal_set signals(main_io(), SIGINT, SIGTERM);
+            signals.async_wait([this, &signals](boost::beast::error_code const& ec, int) {
+                if (ec) {
+                    return;
+                }
+                this->logger.info(log_cat, "Draining the server, got a signal");
+                drain();
+                signals.async_wait([this](boost::beast::error_code const& second_ec, int) {
+                    if (!second_ec) {
+                        this->logger.info(log_cat, "Stopping the server, got a signal");
+                        stop();
+                    }
+                });
+            });
 
             this->logger.info(log_cat,
-                              fmt::format("Starting beast server on {} with {} thread workers.",
-                                          bound_uri().to_string(),
-                                          thread_worker_count));
+                              fmt::format("Starting beast server on {} with {} thread workers{}.",
+                                          endpoint_names(),
+                                          sharded ? shards.size() : thread_worker_count,
+                                          sharded ? " (sharded)" : ""));
 
-            auto get_thread = [this](stl::size_t i) noexcept {
-                return [this, io_index = i, tries = 0ul]() mutable noexcept {
-                    for (; !io.stopped(); ++tries) {
+            auto get_thread = [this](stl::size_t i, asio::io_context& ctx) noexcept {
+                return [this, &ctx, io_index = i, tries = 0ul]() mutable noexcept {
+                    if (pin_threads) {
+                        pin_thread(io_index);
+                    }
+                    for (; !ctx.stopped(); ++tries) {
                         try {
                             // run executor in this thread
-                            io.run();
+                            ctx.run();
                             this->logger.info(log_cat,
                                               fmt::format("Thread {} went down peacefully.", io_index));
                         } catch (stl::exception const& err) {
@@ -289,13 +1074,21 @@ namespace webpp::http {
 
 
             // start accepting in all workers
-            for (stl::size_t i = 1ul; i != thread_worker_count - 1; ++i) {
-                asio::post(pool, get_thread(i));
+            if (sharded) {
+                auto the_shard = stl::next(shards.begin());
+                for (stl::size_t i = 1ul; the_shard != shards.end(); ++i, ++the_shard) {
+                    asio::post(pool, get_thread(i, the_shard->io));
+                }
+                get_thread(0, shards.front().io)();
+            } else {
+                for (stl::size_t i = 1ul; i < thread_worker_count; ++i) {
+                    asio::post(pool, get_thread(i, io));
+                }
+                get_thread(0, io)();
             }
 
-            get_thread(0)();
-
             pool.attach();
+            stop_listening();
             this->logger.info(log_cat, "Server is down.");
             return 0;
         }
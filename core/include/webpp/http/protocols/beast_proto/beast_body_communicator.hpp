@@ -54,7 +54,7 @@ namespace webpp::http::beast_proto {
         }
 
         [[nodiscard]] size_type size() const noexcept {
-            return request->payload_size();
+            return static_cast<size_type>(request->body().size());
         }
 
       private:
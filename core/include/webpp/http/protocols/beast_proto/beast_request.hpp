@@ -3,6 +3,7 @@
 #ifndef WEBPP_BEAST_REQUEST_HPP
 #define WEBPP_BEAST_REQUEST_HPP
 
+#include "../../../std/functional.hpp"
 #include "../../../std/string.hpp"
 #include "../../../std/string_view.hpp"
 #include "../../../traits/traits.hpp"
@@ -10,7 +11,9 @@
 #include "../../request_view.hpp"
 #include "../../version.hpp"
 #include "beast_string_body.hpp"
+#include "beast_websocket.hpp"
 
+#include <boost/beast/core/string.hpp>
 #include <boost/beast/http/fields.hpp>
 #include <boost/beast/http/message.hpp>
 #include <boost/beast/http/parser.hpp>
@@ -27,6 +30,7 @@ namespace webpp::http::beast_proto {
         using allocator_pack_type      = typename common_http_request_type::allocator_pack_type;
         using headers_type             = typename common_http_request_type::headers_type;
         using field_type               = typename headers_type::field_type;
+        using body_sink_type           = stl::function<void(stl::string_view)>;
 
       private:
         using request_header_type = typename common_http_request_type::headers_type;
@@ -48,7 +52,10 @@ namespace webpp::http::beast_proto {
 
         using super = common_http_request_type;
 
-        beast_request_ptr breq;
+        beast_request_ptr                  breq;
+        stl::shared_ptr<websocket_handler> ws_handler{}; // set when the route accepts a WebSocket upgrade
+        stl::uint64_t                      max_body_size = 0;
+        body_sink_type                     body_sink{};
 
         template <typename StrT>
         constexpr string_view_type string_viewify(StrT&& str) const noexcept {
@@ -112,8 +119,58 @@ namespace webpp::http::beast_proto {
             return http::version{major, minor};
         }
 
+        [[nodiscard]] bool is_websocket_upgrade() const noexcept {
+            return boost::beast::websocket::is_upgrade(*breq);
+        }
+
+        /**
+         * The connection is upgraded to a WebSocket after this request, and is handed to the specified
+         * handler; see websocket_route.
+         */
+        void accept_websocket(stl::shared_ptr<websocket_handler> handler) noexcept {
+            ws_handler = stl::move(handler);
+        }
+
+        // the client has sent "Expect: 100-continue"; it waits for the request to be accepted before sending
+        // its body
+        [[nodiscard]] bool expects_continue() const noexcept {
+            return breq->version() >= 11 &&
+                   boost::beast::iequals((*breq)[boost::beast::http::field::expect], "100-continue");
+        }
+
+        /**
+         * The size limit of the body of this request; the bigger bodies are answered with
+         * "413 Payload Too Large". It's only changed before the body is read (in the "on_request_head" of the
+         * application); the server sets the default limit of the request's method before that.
+         */
+        void body_limit(stl::uint64_t limit) noexcept {
+            max_body_size = limit;
+        }
+
+        [[nodiscard]] stl::uint64_t body_limit() const noexcept {
+            return max_body_size;
+        }
+
+        /**
+         * Give the body to the sink piece by piece as it's received, instead of keeping it in the body of the
+         * request; so a large upload is not held in the memory. Only has effect before the body is read (in
+         * the "on_request_head" of the application); the application is called after the whole body is given
+         * to the sink, with an empty body.
+         */
+        void stream_body(body_sink_type sink) {
+            body_sink = stl::move(sink);
+        }
+
+        [[nodiscard]] body_sink_type& body_stream() noexcept {
+            return body_sink;
+        }
+
         //////////////////////////////////////////
 
+        [[nodiscard]] stl::shared_ptr<websocket_handler> release_websocket_handler() noexcept {
+            return stl::exchange(ws_handler, nullptr);
+        }
+
         void set_beast_parser(beast_parser_ref parser) noexcept {
             breq = &parser.get();
             // todo: not very efficient, is it?
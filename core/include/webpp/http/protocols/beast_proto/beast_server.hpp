@@ -1,27 +1,44 @@
 #ifndef WEBPP_HTTP_PROTO_BEAST_SERVER_HPP
 #define WEBPP_HTTP_PROTO_BEAST_SERVER_HPP
 
+#include "../../../concurrency/bounded_queue.hpp"
 #include "../../../configs/constants.hpp"
 #include "../../../libs/asio.hpp"
 #include "../../../memory/object.hpp"
+#include "../../../server/timer_wheel.hpp"
+#include "../../../server/usage.hpp"
 #include "../../../std/format.hpp"
 #include "../../../std/string_view.hpp"
+#include "../../../std/vector.hpp"
 #include "../../../traits/enable_traits.hpp"
 #include "../../../uri/uri.hpp"
 #include "../../http_concepts.hpp"
 #include "../../request.hpp"
+#include "../../syntax/response_serializer.hpp"
 #include "../../version.hpp"
 #include "beast_request.hpp"
 #include "beast_string_body.hpp"
+#include "beast_websocket.hpp"
 
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <deque>
+#include <limits>
 #include <list>
 #include <mutex>
 #include <thread>
 
+#ifdef __linux__
+#    include <cerrno>
+#    include <sys/sendfile.h>
+#endif
+
 // clang-format off
 #include asio_include(ip/address)
 #include asio_include(post)
 #include asio_include(thread_pool)
+#include asio_include(write)
 #include asio_include(ip/tcp)
 #include asio_include(signal_set)
 #include asio_include(strand)
@@ -33,6 +50,37 @@
 
 namespace webpp::http::beast_proto {
 
+    template <typename ServerT>
+    struct thread_worker;
+
+    // the deadline of the current read or write of an http worker, on the timer wheel of its connection group
+    template <typename WorkerT>
+    struct worker_deadline : timer_wheel_entry {
+        WorkerT* owner = nullptr;
+    };
+
+    /**
+     * The connections of a thread worker are spread over a few groups; the connections of a group run on
+     * the strand of the group, and their deadlines are kept on the timer wheel of the group, which is turned
+     * on the same strand. So the deadlines are armed and cancelled without a lock, and the threads don't
+     * share a wheel.
+     */
+    template <typename WorkerT>
+    struct connection_group {
+        using strand_type      = asio::strand<asio::io_context::executor_type>;
+        using deadline_type    = worker_deadline<WorkerT>;
+        using timer_wheel_type = timer_wheel<deadline_type>;
+        using duration         = typename timer_wheel_type::duration;
+
+        strand_type        strand;
+        timer_wheel_type   wheel;
+        asio::steady_timer ticker;
+
+        connection_group(asio::io_context& ctx, duration resolution)
+          : strand{asio::make_strand(ctx)},
+            wheel{resolution},
+            ticker{strand} {}
+    };
 
     template <typename ServerT>
     struct http_worker : enable_traits<typename ServerT::etraits> {
@@ -56,18 +104,28 @@ namespace webpp::http::beast_proto {
         using beast_fields_type   = boost::beast::http::basic_fields<fields_allocator_type>;
         using string_type         = traits::general_string<traits_type>;
         using beast_body_type     = string_body_of<string_type>;
-        using beast_response_type = boost::beast::http::response<beast_body_type, beast_fields_type>;
-        using beast_response_serializer_type =
-          boost::beast::http::response_serializer<beast_body_type, beast_fields_type>;
-        using socket_type      = asio::ip::tcp::socket;
-        using stream_type      = boost::beast::tcp_stream;
-        using string_view_type = traits::string_view<traits_type>;
+        using socket_type         = asio::ip::tcp::socket;
+        using stream_type         = boost::beast::tcp_stream;
+        using string_view_type    = traits::string_view<traits_type>;
+        using owner_type          = thread_worker<server_type>;
 
         using beast_request_type = boost::beast::http::request<beast_body_type, beast_fields_type>;
         using beast_request_parser_type =
           boost::beast::http::request_parser<beast_body_type, char_allocator_type>;
+        using app_response_type = stl::remove_cvref_t<decltype(stl::declval<server_type&>().call_app(
+          stl::declval<request_type&>()))>;
+        using response_body_type = typename app_response_type::body_type;
+
+        static constexpr auto        log_cat                = "BeastWorker";
+        static constexpr stl::size_t max_pipelined_requests = server_type::max_pipelined_requests;
+        static constexpr stl::size_t chunk_size             = 16 * 1024; // of the streamed bodies
+
+        // the limit of a body is only known after the app has seen the head of its request (see on_head)
+        static constexpr stl::uint64_t unlimited_body = stl::numeric_limits<stl::uint64_t>::max();
 
-        static constexpr auto log_cat = "BeastWorker";
+        static constexpr stl::string_view crlf              = "\r\n";
+        static constexpr stl::string_view last_chunk        = "0\r\n\r\n";
+        static constexpr stl::string_view continue_response = "HTTP/1.1 100 Continue\r\n\r\n";
 
 
         static_assert(HTTPRequestHeaders<request_header_type>,
@@ -76,14 +134,58 @@ namespace webpp::http::beast_proto {
 
 
 
+        // a response that's waiting to be written; its head is already serialized into the header buffer
+        struct pending_response {
+            string_type body{};            // the body, unless it's streamed
+            bool        keep_alive = true; // keep the connection after the response is written
+            bool        chunked    = false;
+        };
+
+        using responses_type     = stl::array<stl::optional<pending_response>, max_pipelined_requests>;
+        using header_ends_type   = stl::array<stl::size_t, max_pipelined_requests>;
+        using write_buffers_type = stl::vector<asio::const_buffer>;
+        using chunk_buffer_type  = stl::array<char, chunk_size>;
+
+        using deadline_type      = worker_deadline<http_worker>;
+        using group_type         = connection_group<http_worker>;
+        using websocket_ptr      = stl::shared_ptr<websocket_handler>;
+
       private:
-        stl::optional<stream_type>                    stream{stl::nullopt};
-        stl::optional<beast_response_type>            bres{stl::nullopt};
-        stl::optional<beast_response_serializer_type> str_serializer{stl::nullopt};
-        server_type*                                  server;
-        stl::optional<request_type>                   req{stl::nullopt};
-        stl::optional<beast_request_parser_type>      parser{stl::nullopt};
+        stl::optional<stream_type>               stream{stl::nullopt};
+        server_type*                             server;
+        owner_type*                              owner; // the thread worker that hands us the connections
+        stl::optional<request_type>              req{stl::nullopt};
+        stl::optional<beast_request_parser_type> parser{stl::nullopt};
         buffer_type buf{default_buffer_size}; // fixme: see if this is using our allocator
+        stl::size_t served_requests = 0;      // number of requests served on the current connection
+        bool        head_checked    = false;  // the app has seen the head of this request (see on_head)
+        bool        waiting         = false;  // idle; waiting for the next request (see close_if_waiting)
+        bool        expired         = false;  // the deadline fired; the cancelled operation is not an error
+
+        // the group of the connection; the deadline is on its timer wheel
+        group_type*   group = nullptr;
+        deadline_type deadline{};
+
+        // The responses that are waiting to be written; more than one response is only collected when the
+        // client pipelines its requests (sends the next request before receiving the previous response).
+        responses_type    responses{};
+        pending_response* bres              = nullptr; // the response that is being made
+        stl::size_t       pending_responses = 0;
+
+        // serialized headers of the pending responses, header of response "i" ends at header_ends[i]
+        string_type        header_buf{};
+        header_ends_type   header_ends{};
+        write_buffers_type write_buffers{};
+
+        // The body of the last pending response, if it's sent in chunks as it's produced (stream and blob
+        // bodies); one chunk is read from it at a time, after the previous chunk is written to the socket.
+        stl::optional<response_body_type> streamed_body{stl::nullopt};
+        chunk_buffer_type                 chunk_buf{};
+        stl::array<char, 18>              chunk_header{}; // the size of the chunk in hex, and CRLF
+
+        // the handler of the WebSocket that the last request is upgraded to; the connection is handed over
+        // to it after the pending responses are written
+        websocket_ptr upgrade{};
 
         template <typename StrT>
         constexpr string_view_type string_viewify(StrT&& str) const noexcept {
@@ -98,9 +200,10 @@ namespace webpp::http::beast_proto {
         http_worker& operator=(http_worker&&) noexcept = delete;
         ~http_worker()                                 = default;
 
-        http_worker(server_type* in_server)
+        http_worker(server_type* in_server, owner_type* in_owner)
           : etraits{*in_server},
             server{in_server},
+            owner{in_owner},
             req{*server},
             parser{
               stl::in_place,
@@ -108,20 +211,49 @@ namespace webpp::http::beast_proto {
               stl::make_tuple(), // body args
               stl::make_tuple(
                 alloc::featured_alloc_for<alloc::sync_pool_features, beast_fields_type>(*this)) // fields args
-            } {}
+            } {
+            write_buffers.reserve(max_pipelined_requests * 2);
+            deadline.owner = this;
+            parser->body_limit(unlimited_body);
+        }
 
         /**
          * Running async_read_request directly in the constructor will not make
          * make_shared (or alike) functions work properly.
+         * The socket runs on the strand of its group.
          */
-        void set_socket(socket_type&& in_sock) {
+        void set_socket(socket_type&& in_sock, group_type& in_group) {
             stream.emplace(stl::move(in_sock));
+            group = &in_group;
         }
 
         void start() noexcept {
             async_read_request();
         }
 
+        /**
+         * The deadline is expired; called by the timer wheel of the group, on the strand of the connection,
+         * so the connection is still open.
+         */
+        void expire() noexcept {
+            expired = true;
+            boost::beast::error_code ec;
+            stream->socket().cancel(ec);
+        }
+
+        /**
+         * The server is drained; close the connection if it's waiting for its next request. Called for the
+         * armed deadlines of the group, on the strand of the connection, like expire.
+         */
+        void close_if_waiting() noexcept {
+            if (!waiting) {
+                return; // it's reading or writing a request
+            }
+            boost::beast::error_code ec;
+            stream->socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+            stream->socket().cancel(ec);
+        }
+
         [[nodiscard]] bool is_idle() noexcept {
             return !stream.has_value();
         }
@@ -129,11 +261,10 @@ namespace webpp::http::beast_proto {
       private:
         template <TextBasedBodyReader BodyType>
         void set_response_body_string(BodyType& body) {
-            using body_type              = stl::remove_cvref_t<BodyType>;
-            using beast_body_string_type = typename beast_body_type::value_type;
-            using beast_char_type        = typename beast_body_string_type::value_type;
-            if constexpr (stl::same_as<body_type, typename beast_body_type::value_type>) {
-                swap(bres->body(), body);
+            using body_type       = stl::remove_cvref_t<BodyType>;
+            using beast_char_type = typename string_type::value_type;
+            if constexpr (stl::same_as<body_type, string_type>) {
+                swap(bres->body, body);
             } else {
                 using body_char_type = stl::remove_pointer_t<stl::remove_cvref_t<decltype(body.data())>>;
                 static constexpr stl::size_t char_type_size = sizeof(body_char_type);
@@ -141,45 +272,49 @@ namespace webpp::http::beast_proto {
                 const auto                   body_data = static_cast<beast_char_type const*>(body.data());
                 if (body_size == 0 || body_data == nullptr)
                     return;
-                bres->body().replace(0,
-                                     bres->body().size(),
-                                     body_data,
-                                     body_size * sizeof(beast_char_type) / char_type_size);
+                bres->body.replace(0,
+                                   bres->body.size(),
+                                   body_data,
+                                   body_size * sizeof(beast_char_type) / char_type_size);
             }
         }
 
+        // read the next chunk of the body into the chunk buffer; returns zero when the body is finished
+        template <BlobBasedBodyReader BodyType>
+        [[nodiscard]] stl::size_t read_chunk(BodyType& body) noexcept {
+            using byte_type = typename stl::remove_cvref_t<BodyType>::byte_type;
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            auto const size = body.read(reinterpret_cast<byte_type*>(chunk_buf.data()),
+                                        static_cast<stl::streamsize>(chunk_buf.size()));
+            return size > 0 ? static_cast<stl::size_t>(size) : 0;
+        }
+
+        // the whole body is copied into the response; only used when the body can't be streamed
         template <BlobBasedBodyReader BodyType>
         void set_response_body_blob(BodyType& body) {
-            using body_type = stl::remove_cvref_t<BodyType>;
-            // todo: string optimizations
-            using byte_type = typename body_type::byte_type;
-            // NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
-            while (stl::streamsize read_size = body.read(reinterpret_cast<byte_type const*>(buf.data()),
-                                                         static_cast<stl::streamsize>(buf.size()))) {
-                bres->body().append(buf.data(), read_size);
+            while (auto const size = read_chunk(body)) {
+                bres->body.append(chunk_buf.data(), size);
             }
-            // NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
         }
 
 
         template <StreamBasedBodyReader BodyType>
         void set_response_body_stream(BodyType& body) {
-            using body_type              = stl::remove_cvref_t<BodyType>;
-            using beast_body_string_type = typename beast_body_type::value_type;
-            if constexpr (stl::same_as<body_type, beast_body_string_type> && requires { body.str(); }) {
-                swap(bres->body(), body.str());
+            using body_type = stl::remove_cvref_t<BodyType>;
+            if constexpr (stl::same_as<body_type, string_type> && requires { body.str(); }) {
+                swap(bres->body, body.str());
             } else if constexpr (requires {
                                      body.tellp();
                                      body.seekg(0);
                                      body.rdbuf();
                                  }) {
-                bres->body().resize(body.tellp());
+                bres->body.resize(body.tellp());
                 auto g = body.tellg();
                 body.seekg(0);
-                body.rdbuf()->sgetn(bres->body().data(), body.tellp());
+                body.rdbuf()->sgetn(bres->body.data(), body.tellp());
                 body.seekg(g);
             } else {
-                body >> bres->body();
+                body >> bres->body;
             }
         }
 
@@ -190,11 +325,12 @@ namespace webpp::http::beast_proto {
 
             using body_type = stl::remove_cvref_t<BodyType>;
             if constexpr (RuntimeCommunicatorIndecation<body_type>) {
-                switch (body.witch_communicator()) {
+                switch (body.which_communicator()) {
                     case http::communicator_type::nothing: return;
                     case http::communicator_type::text_based: set_response_body_string(body); return;
                     case http::communicator_type::blob_based: set_response_body_blob(body); return;
-                    case http::communicator_type::stream_based: set_response_body_stream(body); return;
+                    case http::communicator_type::stream_based:
+                    case http::communicator_type::file_based: set_response_body_blob(body); return;
                 }
             } else if constexpr (TextBasedBodyReader<body_type>) {
                 set_response_body_string(body);
@@ -210,93 +346,510 @@ namespace webpp::http::beast_proto {
         }
 
 
+        // the file bodies are sent with sendfile(2), with a Content-Length
+        template <typename BodyType>
+        [[nodiscard]] static bool is_sendfile_body([[maybe_unused]] BodyType const& body) noexcept {
+#ifdef __linux__
+            if constexpr (stl::same_as<BodyType, response_body_type> &&
+                          RuntimeCommunicatorIndecation<BodyType>) {
+                return body.which_communicator() == http::communicator_type::file_based;
+            }
+#endif
+            return false;
+        }
+
+        /**
+         * The stream and blob bodies are sent with the chunked transfer coding as they're being read, so the
+         * memory usage doesn't grow with the size of the body, and the first bytes are sent sooner.
+         * HTTP/1.0 doesn't have chunked bodies; they're copied into the response for those clients.
+         */
+        template <typename BodyType>
+        [[nodiscard]] bool is_streamable(BodyType const& body) const noexcept {
+            if constexpr (stl::same_as<BodyType, response_body_type> &&
+                          RuntimeCommunicatorIndecation<BodyType>) {
+                auto const communicator = body.which_communicator();
+                return is_sendfile_body(body) ||
+                       (parser->get().version() >= 11 &&
+                        (communicator == http::communicator_type::blob_based ||
+                         communicator == http::communicator_type::stream_based ||
+                         communicator == http::communicator_type::file_based));
+            } else {
+                return false;
+            }
+        }
+
+        // The host is busy; answer with the precomputed 503, and close the connection after it.
+        void shed_request() noexcept {
+            bres             = &responses[pending_responses].emplace();
+            bres->keep_alive = false;
+            header_buf.append(service_unavailable_response);
+            header_ends[pending_responses] = header_buf.size();
+            ++pending_responses;
+            ++served_requests;
+        }
+
         void make_beast_response() noexcept {
             using std::swap;
             using stl::swap;
 
+            // the requests of the persistent connections are checked as well, not just the new connections
+            if (server->is_overloaded()) [[unlikely]] {
+                host::requests_started();
+                shed_request();
+                return;
+            }
+            host::requests_started(); // until its response is written
+
             // putting the beast's request into webpp's request
-            req->set_beast_parser(*parser);
+            if (!head_checked) {
+                req->set_beast_parser(*parser);
+            }
 
             HTTPResponse auto res = server->call_app(*req);
-
-            // putting the user's response into beast's response
-            bres.emplace();
+            if (upgrade = req->release_websocket_handler(); upgrade) [[unlikely]] {
+                // it's not an in-flight request anymore; the websocket session answers the handshake
+                host::requests_finished();
+                return;
+            }
             res.calculate_default_headers();
-            bres->version(parser->get().version());
-            for (auto const& h : res.headers) {
-                bres->set(h.name, h.value);
+            bres = &responses[pending_responses].emplace();
+
+            auto const& request      = parser->get();
+            bool const  head_request = request.method() == boost::beast::http::verb::head;
+
+            // the connection is kept open only if both the client and the app agree on it and
+            // this connection hasn't reached its request limit yet
+            response_head_options options{
+              .version    = request.version() == 10 ? http_1_0 : http_1_1,
+              .keep_alive = request.keep_alive() && served_requests + 1 < server->max_keep_alive_requests &&
+                            !server->is_draining(),
+              .date       = true};
+
+            if (is_streamable(res.body)) {
+                if (is_sendfile_body(res.body)) {
+                    options.content_length = res.body.size();
+                } else {
+                    options.framing = body_framing::chunked;
+                    bres->chunked   = true;
+                }
+                if (!head_request) {
+                    streamed_body.emplace(stl::move(res.body));
+                }
+            } else {
+                set_response_body(res.body);
+                options.content_length = bres->body.size();
+                if (head_request) {
+                    bres->body.clear();
+                }
+            }
+
+            // the head is serialized right into the header buffer, the body is written from the response
+            bres->keep_alive = serialize_response_head(header_buf, res.headers, options);
+            header_ends[pending_responses] = header_buf.size();
+            ++pending_responses;
+            ++served_requests;
+        }
+
+        /**
+         * Parse the next request if it's already in the read buffer.
+         * Returns false if the request is not complete yet; the parser keeps what it has parsed so far and
+         * the rest of it will be read from the socket. Only the head is parsed here; the body is read after
+         * the app has seen the head (see on_head).
+         */
+        [[nodiscard]] bool parse_buffered_request() noexcept {
+            boost::beast::error_code ec;
+            while (buf.size() != 0 && !parser->is_header_done()) {
+                auto const used = parser->put(buf.data(), ec);
+                buf.consume(used);
+                if (ec || used == 0) {
+                    // need_more means the rest of the request is still on the wire; any other errors will
+                    // be caught again (and handled) by the next async read
+                    return false;
+                }
+            }
+            return parser->is_done();
+        }
+
+        /**
+         * Serve the request that's just been read, and all the other complete requests that are already
+         * in the read buffer, then write all of their responses at once.
+         */
+        void handle_requests() noexcept {
+            for (;;) {
+                make_beast_response();
+                if (upgrade) [[unlikely]] {
+                    if (pending_responses == 0) {
+                        start_websocket();
+                        return;
+                    }
+                    break; // the responses of the previous pipelined requests are written first
+                }
+                clear();
+                if (!bres->keep_alive || pending_responses == max_pipelined_requests || streamed_body ||
+                    !parse_buffered_request()) {
+                    break;
+                }
             }
+            async_write_responses();
+        }
 
-            // bres.content_length(res.body.size());
-            set_response_body(res.body);
-            bres->prepare_payload();
-            str_serializer.emplace(*bres);
+
+        // The operations that don't finish before the deadline are cancelled by the timer wheel of the group.
+        void arm_deadline(duration timeout) noexcept {
+            group->wheel.arm(deadline, timeout);
         }
 
+        void cancel_deadline() noexcept {
+            group->wheel.cancel(deadline);
+        }
 
-        // Asynchronously receive a complete request message.
+        /**
+         * Asynchronously receive the head of the next request, then its body; each with its own deadline,
+         * so a client that sends its request slowly (slowloris) is disconnected.
+         */
         void async_read_request() noexcept {
-            stream->expires_after(server->timeout);
-            boost::beast::http::async_read(
+            waiting = served_requests != 0 && buf.size() == 0;
+            if (waiting && server->is_draining()) [[unlikely]] {
+                boost::beast::error_code ec;
+                stream->socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+                reset();
+                return;
+            }
+
+            // the first request gets the header timeout, an idle persistent connection gets the
+            // keep-alive timeout instead
+            arm_deadline(served_requests == 0 ? server->header_timeout : server->keep_alive_timeout);
+            boost::beast::http::async_read_header(
               *stream,
               buf,
               *parser,
-              [this](boost::beast::error_code ec, [[maybe_unused]] std::size_t bytes_transferred) {
-                  if (!ec) [[likely]] {
-                      async_write_response();
-                  } else [[unlikely]] {
-
-                      // This means they closed the connection
-                      if (ec == boost::beast::http::error::end_of_stream) {
-                          // try sending shutdown signal
-                          // don't need to log if it fails
-                          stream->socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
-                          reset();
-                      } else {
-
-                          this->logger.warning(log_cat, "Connection error.", ec);
-
-                          // if we don't reset here, the connection will hang if there are too many concurrent
-                          // connections for some reason.
-                          // fixme: are we hard-closing the connection without letting the shutdown signal to be sent?
-                          reset();
-                      }
+              [this](boost::beast::error_code ec, stl::size_t) noexcept {
+                  waiting = false;
+                  if (!ec && !parser->is_done()) {
+                      on_head();
+                      return;
                   }
+                  on_read(ec);
               });
         }
 
+        /**
+         * The head of a request with a body is received; the app looks at it before the body is read, so it
+         * can refuse the request, or change the size limit of its body, or stream its body. The clients that
+         * have sent "Expect: 100-continue" are only asked for the body after that.
+         */
+        void on_head() noexcept {
+            cancel_deadline();
+
+            // shed the request before its body is read, or the client is asked for it
+            if (server->is_overloaded()) [[unlikely]] {
+                host::requests_started(); // until its response is written
+                shed_request();
+                clear();
+                async_write_responses();
+                return;
+            }
+
+            auto const method = parser->get().method();
+            bool const no_content =
+              method == boost::beast::http::verb::get || method == boost::beast::http::verb::head;
+            req->set_beast_parser(*parser);
+            req->body_limit(no_content ? server->body_limits.get_method : server->body_limits.post_method);
+            head_checked = true;
+
+            if (auto const status = server->call_app_head(*req); status != http::status_code::continue_) {
+                reject_request(status);
+                return;
+            }
 
-        void async_write_response() noexcept {
-            make_beast_response();
-            boost::beast::http::async_write(
+            // a declared size that's over the limit is refused before the body is sent
+            auto const limit = req->body_limit();
+            if (auto const length = parser->content_length(); length && *length > limit) {
+                reject_request(http::status_code::payload_too_large);
+                return;
+            }
+            parser->body_limit(limit);
+
+            if (req->expects_continue()) {
+                arm_deadline(server->write_timeout);
+                asio::async_write(*stream,
+                                  asio::buffer(continue_response.data(), continue_response.size()),
+                                  [this](boost::beast::error_code ec, stl::size_t) noexcept {
+                                      if (ec) [[unlikely]] {
+                                          on_read(ec);
+                                          return;
+                                      }
+                                      async_read_body();
+                                  });
+                return;
+            }
+            async_read_body();
+        }
+
+        void async_read_body() noexcept {
+            if (req->body_stream()) {
+                parser->eager(true);
+                async_stream_body();
+                return;
+            }
+            arm_deadline(server->body_timeout);
+            boost::beast::http::async_read(*stream,
+                                           buf,
+                                           *parser,
+                                           [this](boost::beast::error_code ec, stl::size_t) noexcept {
+                                               on_read(ec);
+                                           });
+        }
+
+        /**
+         * Read the body piece by piece, and give each piece to the body sink of the request; so the memory
+         * of a connection doesn't grow with the size of its body. Each read gets its own deadline, so a long
+         * upload is not cut off, but a stalled client is.
+         */
+        void async_stream_body() noexcept {
+            arm_deadline(server->body_timeout);
+            boost::beast::http::async_read_some(
               *stream,
-              *str_serializer,
+              buf,
+              *parser,
               [this](boost::beast::error_code ec, stl::size_t) noexcept {
-                  if (ec) [[unlikely]] {
-                      this->logger.warning(log_cat, "Write error on socket.", ec);
-                  } else {
-                      // todo: check if we need the else part of this condition to be an else stmt.
-                      stream->socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
-                      if (ec) [[unlikely]] {
-                          this->logger.warning(log_cat, "Error on sending shutdown into socket.", ec);
+                  if (!ec) [[likely]] {
+                      if (!drain_body()) {
+                          return;
+                      }
+                      if (!parser->is_done()) {
+                          async_stream_body();
+                          return;
                       }
                   }
-                  reset();
+                  on_read(ec);
               });
         }
 
+        // give the received part of the body to the body sink; a failing sink refuses the request
+        [[nodiscard]] bool drain_body() noexcept {
+            auto& body = parser->get().body();
+            if (body.empty()) {
+                return true;
+            }
+            try {
+                req->body_stream()(stl::string_view{body.data(), body.size()});
+            } catch (stl::exception const& ex) {
+                this->logger.error(log_cat, "The body sink failed.", ex);
+                reject_request(http::status_code::internal_server_error);
+                return false;
+            }
+            body.clear();
+            return true;
+        }
 
-      public:
-        void reset() noexcept {
+        /**
+         * Answer the current request with an empty error response before (or while) its body is read, and
+         * close the connection after it, since the rest of the body is not read.
+         */
+        void reject_request(http::status_code status) noexcept {
+            cancel_deadline();
+            host::requests_started(); // until its response is written
+            bres             = &responses[pending_responses].emplace();
+            bres->keep_alive = false;
+
+            auto const                  code = static_cast<status_code_type>(status);
+            response_head_options const options{
+              .version    = parser->get().version() == 10 ? http_1_0 : http_1_1,
+              .keep_alive = false,
+              .date       = true};
+            append_status_line(header_buf, code, options);
+            append_date_field(header_buf, options);
+            append_framing_fields(header_buf, code, options);
+            header_buf.append(crlf);
+            header_ends[pending_responses] = header_buf.size();
+            ++pending_responses;
+            ++served_requests;
+            clear();
+            async_write_responses();
+        }
 
-            // todo: half of these things can be yanked out with the help of allocators
+        void on_read(boost::beast::error_code ec) noexcept {
+            if (!ec) [[likely]] {
+                cancel_deadline();
+                handle_requests();
+            } else if (ec == boost::beast::http::error::body_limit) {
+                reject_request(http::status_code::payload_too_large);
+            } else [[unlikely]] {
+
+                // This means they closed the connection, or we did because the connection has been idle for
+                // too long or the server is drained
+                if (ec == boost::beast::http::error::end_of_stream ||
+                    (ec == asio::error::operation_aborted && (expired || server->is_draining()))) {
+                    // try sending shutdown signal
+                    // don't need to log if it fails
+                    stream->socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+                    reset();
+                } else {
+
+                    this->logger.warning(log_cat, "Connection error.", ec);
+
+                    // if we don't reset here, the connection will hang if there are too many concurrent
+                    // connections for some reason.
+                    // fixme: are we hard-closing the connection without letting the shutdown signal to be sent?
+                    reset();
+                }
+            }
+        }
+
+
+        // Write all the pending responses with one gathered write.
+        void async_write_responses() noexcept {
+            auto const* const headers_data = header_buf.data();
+            stl::size_t       header_start = 0;
+            write_buffers.clear();
+            for (stl::size_t i = 0; i != pending_responses; ++i) {
+                write_buffers.emplace_back(headers_data + header_start, header_ends[i] - header_start);
+                header_start = header_ends[i];
+
+                auto const& res = *responses[i];
+                if (!res.body.empty()) {
+                    write_buffers.emplace_back(res.body.data(), res.body.size());
+                }
+            }
+
+            arm_deadline(server->write_timeout);
+            asio::async_write(
+              *stream,
+              write_buffers,
+              [this](boost::beast::error_code ec, stl::size_t) noexcept {
+                  on_write(ec);
+              });
+        }
+
+        /**
+         * Write the next chunk of the streamed body.
+         * The next chunk is read from the body only after the previous one is written, so a slow client
+         * slows down the reading of the body, instead of growing the memory.
+         */
+        void async_write_chunk() noexcept {
+            auto const size = read_chunk(*streamed_body);
+            write_buffers.clear();
+            if (size == 0) {
+                streamed_body.reset();
+                write_buffers.emplace_back(last_chunk.data(), last_chunk.size());
+            } else {
+                auto* const header_end = chunk_header.data() + chunk_header.size();
+                auto const  res        = stl::to_chars(chunk_header.data(), header_end, size, 16);
+                stl::copy(crlf.begin(), crlf.end(), res.ptr);
+                auto const header_size = static_cast<stl::size_t>(res.ptr - chunk_header.data());
+                write_buffers.emplace_back(chunk_header.data(), header_size + crlf.size());
+                write_buffers.emplace_back(chunk_buf.data(), size);
+                write_buffers.emplace_back(crlf.data(), crlf.size());
+            }
+
+            // each chunk gets its own deadline, so a long body is not cut off, but a stalled client is
+            arm_deadline(server->write_timeout);
+            asio::async_write(
+              *stream,
+              write_buffers,
+              [this](boost::beast::error_code ec, stl::size_t) noexcept {
+                  on_write(ec);
+              });
+        }
+
+#ifdef __linux__
+        /**
+         * Send the file body with sendfile(2); the file's content never enters the user space.
+         * The socket is non-blocking; when its send buffer is full, we wait for it to be writable again,
+         * each wait with its own deadline.
+         */
+        void async_send_file() noexcept {
+            auto&                    file = *streamed_body->file();
+            auto&                    sock = stream->socket();
             boost::beast::error_code ec;
-            stream->socket().close(ec);
-            if (ec) [[unlikely]] {
-                this->logger.warning(log_cat, "Error on closing the connection.", ec);
+            sock.native_non_blocking(true, ec);
+            while (!ec && file.remaining() != 0) {
+                auto       offset = static_cast<off_t>(file.offset());
+                auto const sent =
+                  ::sendfile(sock.native_handle(), file.native_handle(), &offset, file.remaining());
+                if (sent > 0) {
+                    file.consume(static_cast<stl::size_t>(sent));
+                } else if (sent == 0) {
+                    ec = asio::error::eof; // the file is truncated since it was opened
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    arm_deadline(server->write_timeout);
+                    sock.async_wait(socket_type::wait_write,
+                                    [this](boost::beast::error_code wait_ec) noexcept {
+                                        if (wait_ec) [[unlikely]] {
+                                            on_write(wait_ec);
+                                            return;
+                                        }
+                                        async_send_file();
+                                    });
+                    return;
+                } else if (errno != EINTR) {
+                    ec.assign(errno, boost::system::system_category());
+                }
+            }
+            streamed_body.reset();
+            on_write(ec);
+        }
+#endif
+
+        // the pending responses (or the last chunk of them) are written
+        void on_write(boost::beast::error_code ec) noexcept {
+            if (!ec && streamed_body) [[unlikely]] {
+#ifdef __linux__
+                if (streamed_body->file() != nullptr && !bres->chunked) {
+                    async_send_file();
+                    return;
+                }
+#endif
+                async_write_chunk();
+                return;
             }
+            bool const keep_alive = bres->keep_alive;
+            clear_responses();
+            if (!ec && upgrade) [[unlikely]] {
+                start_websocket();
+                return;
+            } else if (ec) [[unlikely]] {
+                this->logger.warning(log_cat, "Write error on socket.", ec);
+            } else if (keep_alive) [[likely]] {
+                // keep the connection (and the stream) alive and wait for the next request
+                async_read_request();
+                return;
+            } else {
+                stream->socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+                if (ec) [[unlikely]] {
+                    this->logger.warning(log_cat, "Error on sending shutdown into socket.", ec);
+                }
+            }
+            reset();
+        }
+
+        /**
+         * Hand the connection over to a websocket session, with the upgrade request that's still in the
+         * parser; this worker is then free to take the next connection.
+         * The client doesn't send its messages before the handshake is answered, so the read buffer has
+         * nothing for the session.
+         */
+        void start_websocket() noexcept {
+            try {
+                auto session = stl::make_shared<websocket_session<http_worker>>(*server,
+                                                                                stl::move(*stream),
+                                                                                parser->release(),
+                                                                                stl::move(upgrade));
+                session->start();
+            } catch (stl::exception const& ex) {
+                this->logger.error(log_cat, "Cannot upgrade the connection to WebSocket.", ex);
+            }
+            reset();
+        }
 
+        /**
+         * Get ready for the next request on the same connection.
+         * The read buffer is kept as is, because it may already contain the beginning of the next request.
+         */
+        void clear() noexcept {
             // destroy the request type + be ready for the next request
+            head_checked = false;
             req.emplace(*server);
             parser.emplace(
               stl::piecewise_construct,
@@ -304,16 +857,50 @@ namespace webpp::http::beast_proto {
               stl::make_tuple(
                 alloc::featured_alloc_for<alloc::sync_pool_features, beast_fields_type>(*this)) // fields args
             );
+            parser->body_limit(unlimited_body);
+        }
+
+        // destroy the responses that are already sent
+        void clear_responses() noexcept {
+            if (pending_responses != 0) {
+                host::requests_finished(pending_responses);
+            }
+            for (stl::size_t i = 0; i != pending_responses; ++i) {
+                responses[i].reset();
+            }
+            pending_responses = 0;
+            bres              = nullptr;
+            header_buf.clear();
+            streamed_body.reset();
+        }
 
 
+      public:
+        void reset() noexcept {
 
-            str_serializer.reset();
-            bres.reset();
+            // todo: half of these things can be yanked out with the help of allocators
+            boost::beast::error_code ec;
+            if (stream->socket().is_open()) { // it's not open if it's handed over to a websocket session
+                stream->socket().close(ec);
+            }
+            if (ec) [[unlikely]] {
+                this->logger.warning(log_cat, "Error on closing the connection.", ec);
+            }
+
+            clear();
+            clear_responses();
+            buf.clear();
+            upgrade.reset();
+            served_requests = 0;
+            waiting         = false;
+            expired         = false;
 
-            // Sleep indefinitely until we're given a new deadline.
-            stream->expires_never();
+            cancel_deadline();
 
             stream.reset(); // go in the idle mode
+
+            // give ourselves back to the thread worker; we may be handed a pending connection right away
+            owner->release(this);
         }
 
 
@@ -329,6 +916,11 @@ namespace webpp::http::beast_proto {
      * A single thread worker which will include multiple http workers.
      * More info:
      *   https://stackoverflow.com/a/63717201/4987470
+     *
+     * The idle http workers are kept in a lock-free queue, so handing a connection to a worker, and getting
+     * the worker back when its connection is closed, are O(1) and never take a lock.
+     * When all the workers are busy, the accepted connections wait in a bounded queue; and when that queue
+     * is full as well, the connection is answered with a "503 Service Unavailable" and closed right away.
      */
     template <typename ServerT>
     struct thread_worker {
@@ -339,8 +931,21 @@ namespace webpp::http::beast_proto {
         static constexpr auto worker_alloc_features = alloc::feature_pack{alloc::sync};
         using http_worker_allocator_type =
           typename allocator_pack_type::template best_allocator<worker_alloc_features, http_worker_type>;
-        using http_workers_type = stl::list<http_worker_type, http_worker_allocator_type>;
-        using socket_type       = asio::ip::tcp::socket;
+        using http_workers_type    = stl::list<http_worker_type, http_worker_allocator_type>;
+        using socket_type          = asio::ip::tcp::socket;
+        using group_type           = connection_group<http_worker_type>;
+        using groups_type          = stl::deque<group_type>;
+        using idle_workers_type    = bounded_queue<http_worker_type*>;
+        using deadline_type        = worker_deadline<http_worker_type>;
+        using duration             = typename server_type::duration;
+
+        // an accepted connection that's waiting for a free http worker
+        struct pending_connection {
+            socket_type sock;
+            group_type* group;
+        };
+
+        using pending_sockets_type = bounded_queue<pending_connection>;
 
         static constexpr auto log_cat = "Beast";
 
@@ -350,26 +955,76 @@ namespace webpp::http::beast_proto {
         thread_worker& operator=(thread_worker&&) noexcept = delete;
         ~thread_worker()                                   = default;
 
-        thread_worker(server_type& input_server)
+        thread_worker(server_type& input_server, asio::io_context& input_io)
           : server(&input_server),
-            http_workers{alloc::featured_alloc_for<worker_alloc_features, http_workers_type>(*server)} {
+            io(&input_io),
+            http_workers{alloc::featured_alloc_for<worker_alloc_features, http_workers_type>(*server)} {}
+
+        /**
+         * Create the http workers, and the connection groups; a group per thread of the io context.
+         * This is done when the server starts, so the worker count, the pending connections limit, and the
+         * timer resolution can be configured up until then.
+         */
+        void initialize() {
+            idle_workers.emplace(server->http_worker_count);
+            pending_sockets.emplace(server->max_pending_connections);
+            auto const group_count = server->sharded ? 1ul : stl::max(server->thread_worker_count, 1ul);
+            for (stl::size_t i = 0ul; i != group_count; ++i) {
+                tick(groups.emplace_back(*io, server->timer_resolution));
+            }
             for (stl::size_t i = 0ul; i != server->http_worker_count; ++i) {
-                http_workers.emplace_back(server);
+                auto& hworker = http_workers.emplace_back(server, this);
+                // the queue has room for all the workers
+                static_cast<void>(idle_workers->try_push(&hworker));
             }
-            worker = http_workers.begin();
         }
 
 
-        void start_work(socket_type&& sock) {
-            http_worker_type* worker_ptr; // NOLINT(cppcoreguidelines-init-variables)
-            {
-                [[maybe_unused]] stl::scoped_lock lock{worker_mutex};
+        /**
+         * The group that the next connection is accepted into; the connections are spread over the groups
+         * in turn. The socket should be accepted on the strand of the group.
+         */
+        [[nodiscard]] group_type& next_group() noexcept {
+            return groups[next_group_index.fetch_add(1, stl::memory_order_relaxed) % groups.size()];
+        }
 
-                worker_ptr = worker.operator->();
-                worker_ptr->set_socket(stl::move(sock));
-                next_worker();
+        void start_work(socket_type&& sock, group_type& group) {
+            if (server->is_overloaded()) [[unlikely]] {
+                reject(sock, "The host is busy; rejected a connection.");
+                return;
             }
-            worker_ptr->start();
+
+            open_connections.fetch_add(1, stl::memory_order_relaxed);
+            http_worker_type* hworker = nullptr;
+            if (idle_workers->try_pop(hworker)) [[likely]] {
+                hand_over(*hworker, stl::move(sock), group);
+                return;
+            }
+
+            // all the workers are busy, the connection has to wait for one of them
+            if (!pending_sockets->try_emplace(stl::move(sock), &group)) [[unlikely]] {
+                open_connections.fetch_sub(1, stl::memory_order_relaxed);
+                reject(sock, "All the workers are busy; rejected a connection.");
+                return;
+            }
+            dispatch_pending();
+        }
+
+        /**
+         * The http worker is done with its connection; give it the next pending connection, or put it
+         * back into the idle workers.
+         */
+        void release(http_worker_type* hworker) {
+            open_connections.fetch_sub(1, stl::memory_order_release);
+            pending_connection conn{.sock = socket_type{*io}, .group = nullptr};
+            if (pending_sockets->try_pop(conn)) {
+                hand_over(*hworker, stl::move(conn.sock), *conn.group);
+                return;
+            }
+
+            // the queue has room for all the workers
+            static_cast<void>(idle_workers->try_push(hworker));
+            dispatch_pending();
         }
 
         void stop() {
@@ -378,22 +1033,99 @@ namespace webpp::http::beast_proto {
             }
         }
 
+        /**
+         * The server is drained: close the connections that are waiting for their next request; the others
+         * are closed after their current response (the server doesn't keep them alive anymore).
+         * The open connections of a group are the ones with an armed deadline, they're closed on its strand.
+         */
+        void drain() {
+            for (auto& group : groups) {
+                asio::post(group.strand, [&group]() noexcept {
+                    group.wheel.for_each([](deadline_type& deadline) noexcept {
+                        deadline.owner->close_if_waiting();
+                    });
+                });
+            }
+        }
+
+        // the connections that are being served, or waiting for a worker; the websockets are not counted
+        [[nodiscard]] stl::size_t connection_count() const noexcept {
+            return open_connections.load(stl::memory_order_acquire);
+        }
+
       private:
-        // get the next available worker
-        void next_worker() noexcept {
-            // todo: a cooler algorithm can be used here, right? You can even give the user a choice
-            do {
-                ++worker;
-                if (worker == http_workers.end()) {
-                    worker = http_workers.begin();
+        /**
+         * Turn the timer wheel of the group every tick, and cancel the connections that have missed their
+         * deadlines; the deadlines of all the connections of a group are turned by this one timer, so arming
+         * and cancelling them is O(1), and doesn't create a timer operation per read.
+         */
+        void tick(group_type& group) noexcept {
+            group.ticker.expires_after(group.wheel.tick_resolution());
+            group.ticker.async_wait([this, &group](boost::beast::error_code ec) noexcept {
+                if (ec) [[unlikely]] {
+                    return; // the server is stopped
                 }
-            } while (!worker->is_idle());
+                group.wheel.advance([](deadline_type& deadline) noexcept {
+                    deadline.owner->expire();
+                });
+                tick(group);
+            });
         }
 
-        server_type*                         server;
-        http_workers_type                    http_workers;
-        typename http_workers_type::iterator worker;
-        stl::mutex                           worker_mutex;
+        // the worker starts on the strand of the group, which may not be the strand that we're on
+        void hand_over(http_worker_type& hworker, socket_type&& sock, group_type& group) {
+            hworker.set_socket(stl::move(sock), group);
+            asio::dispatch(group.strand, [&hworker]() noexcept {
+                hworker.start();
+            });
+        }
+
+        /**
+         * Pair up the idle workers with the pending connections.
+         * A connection may get queued at the same time that a worker becomes idle; both sides call this after
+         * pushing into their queue, so at least one of them sees the other's push and no connection is left
+         * waiting while there's an idle worker.
+         */
+        void dispatch_pending() {
+            stl::atomic_thread_fence(stl::memory_order_seq_cst);
+            while (!pending_sockets->empty()) {
+                http_worker_type* hworker = nullptr;
+                if (!idle_workers->try_pop(hworker)) {
+                    return; // the next worker that gets released will take it
+                }
+                pending_connection conn{.sock = socket_type{*io}, .group = nullptr};
+                if (!pending_sockets->try_pop(conn)) {
+                    // another thread took it first, check again
+                    static_cast<void>(idle_workers->try_push(hworker));
+                    stl::atomic_thread_fence(stl::memory_order_seq_cst);
+                    continue;
+                }
+                hand_over(*hworker, stl::move(conn.sock), *conn.group);
+            }
+        }
+
+        // We're over capacity; let the client know, as cheaply as possible, and close the connection.
+        void reject(socket_type& sock, stl::string_view reason) noexcept {
+            boost::system::error_code ec;
+            sock.non_blocking(true, ec);
+            sock.write_some(
+              asio::buffer(service_unavailable_response.data(), service_unavailable_response.size()),
+              ec);
+            sock.shutdown(socket_type::shutdown_send, ec);
+            sock.close(ec);
+            server->logger.warning(log_cat, reason);
+        }
+
+        server_type*                        server;
+        asio::io_context*                   io; // the io context that the sockets belong to
+        http_workers_type                   http_workers;
+        stl::optional<idle_workers_type>    idle_workers{stl::nullopt};
+        stl::optional<pending_sockets_type> pending_sockets{stl::nullopt};
+        stl::atomic<stl::size_t>            open_connections{0};
+
+        // the http workers of a thread worker run on all the threads of the io context, unless it's sharded
+        groups_type              groups{};
+        stl::atomic<stl::size_t> next_group_index{0};
     };
 
 } // namespace webpp::http::beast_proto
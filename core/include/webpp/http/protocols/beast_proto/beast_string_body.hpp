@@ -9,6 +9,7 @@
 // clang-format off
 #include asio_include(buffer)
 // clang-format on
+#include <algorithm>
 #include <boost/beast/core/buffers_range.hpp>
 #include <boost/beast/http/error.hpp>
 #include <boost/beast/http/message.hpp>
@@ -55,6 +56,10 @@ namespace webpp::http::beast_proto {
         class reader {
             value_type& body_;
 
+            // The declared length is only trusted this much before the body arrives; the rest grows as it's
+            // received. A streamed body is drained as it's received, so it never grows that big.
+            static constexpr std::uint64_t max_reserve = 64 * 1024;
+
           public:
             template <bool isRequest, class Fields>
             explicit reader(boost::beast::http::header<isRequest, Fields>&, value_type& b) : body_(b) {}
@@ -65,7 +70,7 @@ namespace webpp::http::beast_proto {
                         ec = boost::beast::http::error::buffer_overflow;
                         return;
                     }
-                    body_.reserve(boost::beast::detail::clamp(*length));
+                    body_.reserve(boost::beast::detail::clamp(std::min(*length, max_reserve)));
                 }
                 ec = {};
             }
@@ -0,0 +1,360 @@
+#ifndef WEBPP_HTTP_PROTO_BEAST_WEBSOCKET_HPP
+#define WEBPP_HTTP_PROTO_BEAST_WEBSOCKET_HPP
+
+#include "../../../libs/asio.hpp"
+#include "../../../std/memory.hpp"
+#include "../../../std/string.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../http_concepts.hpp"
+#include "../../routes/router_concepts.hpp"
+#include "../../status_code.hpp"
+
+#include <atomic>
+#include <deque>
+
+// clang-format off
+#include asio_include(dispatch)
+// clang-format on
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+namespace webpp::http::beast_proto {
+
+    struct websocket_options {
+        // the bigger messages (after their fragments are put together) close the connection (1009)
+        stl::size_t max_message_size = 1024 * 1024;
+
+        // the messages that are queued to be sent to a client, before send starts to refuse new ones
+        stl::size_t max_queued_messages = 64;
+        stl::size_t max_queued_bytes    = 4 * 1024 * 1024;
+
+        // the outgoing messages are sent in fragments of this size
+        stl::size_t fragment_size = 16 * 1024;
+
+        // compress the messages, if the client asks for it (RFC 7692)
+        bool permessage_deflate = true;
+    };
+
+    /**
+     * One side of an open WebSocket connection, given to the websocket handlers.
+     * It's kept alive by its pending operations; keep a shared pointer to it (shared_from_this) to send
+     * messages to the client later on, from any thread.
+     */
+    struct websocket_connection : stl::enable_shared_from_this<websocket_connection> {
+        websocket_connection()                                       = default;
+        websocket_connection(websocket_connection const&)            = delete;
+        websocket_connection(websocket_connection&&)                 = delete;
+        websocket_connection& operator=(websocket_connection const&) = delete;
+        websocket_connection& operator=(websocket_connection&&)      = delete;
+        virtual ~websocket_connection()                              = default;
+
+        /**
+         * Queue a message to be sent to the client; returns false, and drops the message, if the send queue
+         * of this connection is full, which means the client is not reading as fast as we're writing.
+         */
+        [[nodiscard]] bool send(stl::string_view message) {
+            return queue_message(stl::string{message}, false);
+        }
+
+        [[nodiscard]] bool send_binary(stl::string_view message) {
+            return queue_message(stl::string{message}, true);
+        }
+
+        // close the connection after the queued messages are sent
+        virtual void close(
+          boost::beast::websocket::close_code code = boost::beast::websocket::close_code::normal) = 0;
+
+      protected:
+        virtual bool queue_message(stl::string&& message, bool binary) = 0;
+    };
+
+    /**
+     * The handler of a WebSocket connection; each connection gets its own handler object.
+     * All of its methods are called on the executor of the connection, one at a time.
+     */
+    struct websocket_handler {
+        websocket_handler()                                    = default;
+        websocket_handler(websocket_handler const&)            = default;
+        websocket_handler(websocket_handler&&)                 = default;
+        websocket_handler& operator=(websocket_handler const&) = default;
+        websocket_handler& operator=(websocket_handler&&)      = default;
+        virtual ~websocket_handler()                           = default;
+
+        virtual void on_open([[maybe_unused]] websocket_connection& conn) {}
+
+        // a whole message; the fragments of the message are already put together
+        virtual void on_message(websocket_connection& conn, stl::string_view message, bool binary) = 0;
+
+        // the connection is closed, by either side; the messages that are sent now are dropped
+        virtual void on_close([[maybe_unused]] websocket_connection& conn) {}
+    };
+
+
+    /**
+     * The route that upgrades the connection to a WebSocket; the requests that are not WebSocket upgrades
+     * (or the protocols that can't upgrade) get "426 Upgrade Required".
+     *
+     *   root / "live" >>= websocket_route<feed_handler>{feed_handler{&hub}}
+     *
+     * Each connection gets a copy of the specified handler.
+     */
+    template <typename HandlerType>
+        requires(stl::derived_from<HandlerType, websocket_handler> && stl::copy_constructible<HandlerType>)
+    struct websocket_route {
+        HandlerType handler{}; // NOLINT(misc-non-private-member-variables-in-classes)
+
+        template <Context CtxT, HTTPRequest ReqT>
+        [[nodiscard]] HTTPResponse auto operator()(CtxT& ctx, ReqT& req) const {
+            auto res = ctx.response();
+            if constexpr (requires { req.accept_websocket(stl::make_shared<HandlerType>(handler)); }) {
+                if (req.is_websocket_upgrade()) {
+                    // the response of the handshake is written by the websocket session
+                    req.accept_websocket(stl::make_shared<HandlerType>(handler));
+                    res.headers = http::status_code::switching_protocols;
+                    return res;
+                }
+            }
+            res.headers = http::status_code::upgrade_required;
+            res.headers.emplace_back("Upgrade", "websocket");
+            return res;
+        }
+    };
+
+
+    /**
+     * A connection that's been upgraded to WebSocket; it owns the stream of the connection (the http worker
+     * that had it is given the next connection), and keeps itself alive with its pending operations.
+     *
+     * One message is read at a time, and given to the handler; the outgoing messages are written in the
+     * order that they're sent, one at a time, from a queue that's bounded by the websocket options.
+     */
+    template <typename WorkerT>
+    struct websocket_session final : websocket_connection {
+        using worker_type        = WorkerT;
+        using server_type        = typename worker_type::server_type;
+        using beast_request_type = typename worker_type::beast_request_type;
+        using stream_type        = boost::beast::websocket::stream<boost::beast::tcp_stream>;
+        using handler_ptr        = stl::shared_ptr<websocket_handler>;
+
+        static constexpr auto log_cat = "BeastWebSocket";
+
+      private:
+        struct queued_message {
+            stl::string data;
+            bool        binary = false;
+        };
+
+        using close_code_type = boost::beast::websocket::close_code;
+
+        server_type*               server;
+        stream_type                ws;
+        beast_request_type         upgrade_request; // the handshake is answered from it
+        handler_ptr                handler;
+        boost::beast::flat_buffer  buf;
+        stl::deque<queued_message> queue;              // only touched on the executor of the connection
+        stl::atomic<stl::size_t>   queued_messages{0}; // reserved by "send", from any thread
+        stl::atomic<stl::size_t>   queued_bytes{0};
+        close_code_type            close_code = close_code_type::normal;
+        bool                       writing    = false;
+        bool                       closing    = false; // close after the queue is written
+        bool                       closed     = false;
+
+        [[nodiscard]] stl::shared_ptr<websocket_session> self() {
+            return stl::static_pointer_cast<websocket_session>(shared_from_this());
+        }
+
+        // the limits are checked before the message is queued, so they hold when many threads send at once
+        [[nodiscard]] bool reserve(stl::size_t size) noexcept {
+            auto const& options = server->websocket;
+            if (queued_messages.fetch_add(1, stl::memory_order_relaxed) >= options.max_queued_messages) {
+                queued_messages.fetch_sub(1, stl::memory_order_relaxed);
+                return false;
+            }
+            if (queued_bytes.fetch_add(size, stl::memory_order_relaxed) + size > options.max_queued_bytes) {
+                queued_bytes.fetch_sub(size, stl::memory_order_relaxed);
+                queued_messages.fetch_sub(1, stl::memory_order_relaxed);
+                return false;
+            }
+            return true;
+        }
+
+        void release(stl::size_t size) noexcept {
+            queued_bytes.fetch_sub(size, stl::memory_order_relaxed);
+            queued_messages.fetch_sub(1, stl::memory_order_relaxed);
+        }
+
+        bool queue_message(stl::string&& message, bool binary) override {
+            if (!reserve(message.size())) {
+                return false;
+            }
+            // runs right here if we're already on the executor of the connection (in a handler)
+            asio::dispatch(ws.get_executor(),
+                           [conn = self(), msg = queued_message{stl::move(message), binary}]() mutable {
+                               conn->push(stl::move(msg));
+                           });
+            return true;
+        }
+
+        void push(queued_message&& msg) {
+            if (closing || closed) {
+                release(msg.data.size());
+                return;
+            }
+            queue.push_back(stl::move(msg));
+            if (!writing) {
+                async_write_next();
+            }
+        }
+
+        void async_write_next() noexcept {
+            writing = true;
+            auto const& msg = queue.front();
+            ws.binary(msg.binary);
+            ws.async_write(asio::buffer(msg.data),
+                           [conn = self()](boost::beast::error_code ec, stl::size_t) {
+                               conn->on_write(ec);
+                           });
+        }
+
+        void on_write(boost::beast::error_code ec) noexcept {
+            release(queue.front().data.size());
+            queue.pop_front();
+            writing = false;
+            if (ec) [[unlikely]] {
+                drop_queue();
+                return; // the read fails as well, and finishes the connection
+            }
+            if (!queue.empty()) {
+                async_write_next();
+            } else if (closing) {
+                async_close();
+            }
+        }
+
+        void drop_queue() noexcept {
+            while (!queue.empty()) {
+                release(queue.front().data.size());
+                queue.pop_front();
+            }
+        }
+
+        void async_close() noexcept {
+            ws.async_close(close_code, [conn = self()](boost::beast::error_code) {
+                // the pending read finishes the connection
+            });
+        }
+
+        void async_read_message() noexcept {
+            ws.async_read(buf, [conn = self()](boost::beast::error_code ec, stl::size_t) {
+                conn->on_read(ec);
+            });
+        }
+
+        void on_read(boost::beast::error_code ec) noexcept {
+            if (ec) [[unlikely]] {
+                if (ec != boost::beast::websocket::error::closed && ec != asio::error::operation_aborted) {
+                    server->logger.warning(log_cat, "Connection error.", ec);
+                }
+                finish();
+                return;
+            }
+            auto const data = buf.cdata();
+            call_handler([&] {
+                handler->on_message(*this,
+                                    stl::string_view{static_cast<char const*>(data.data()), data.size()},
+                                    ws.got_binary());
+            });
+            buf.consume(buf.size());
+            if (!closed) {
+                async_read_message();
+            }
+        }
+
+        // an exception of the handler closes the connection (1011)
+        template <typename Callable>
+        void call_handler(Callable&& callable) noexcept {
+            try {
+                callable();
+            } catch (stl::exception const& ex) {
+                server->logger.error(log_cat, "The websocket handler failed; closing the connection.", ex);
+                close(boost::beast::websocket::close_code::internal_error);
+            } catch (...) {
+                server->logger.error(log_cat, "The websocket handler failed; closing the connection.");
+                close(boost::beast::websocket::close_code::internal_error);
+            }
+        }
+
+        void finish() noexcept {
+            if (closed) {
+                return;
+            }
+            closed = true;
+            drop_queue();
+            call_handler([this] {
+                handler->on_close(*this);
+            });
+        }
+
+      public:
+        websocket_session(server_type& in_server,
+                          boost::beast::tcp_stream&& stream,
+                          beast_request_type&& req,
+                          handler_ptr&& in_handler)
+          : server{&in_server},
+            ws{stl::move(stream)},
+            upgrade_request{stl::move(req)},
+            handler{stl::move(in_handler)} {}
+
+        /**
+         * Answer the upgrade request, then start reading the messages.
+         * The timeouts of the handshake and of the idle connections (with the pings that keep the healthy
+         * idle connections open) are beast's suggested ones for the servers.
+         */
+        void start() {
+            auto const& options = server->websocket;
+            ws.set_option(
+              boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::server));
+            if (options.permessage_deflate) {
+                boost::beast::websocket::permessage_deflate deflate;
+                deflate.server_enable = true;
+                ws.set_option(deflate);
+            }
+            ws.read_message_max(options.max_message_size);
+            ws.auto_fragment(true);
+            ws.write_buffer_bytes(options.fragment_size);
+            ws.async_accept(upgrade_request, [conn = self()](boost::beast::error_code ec) {
+                conn->on_accept(ec);
+            });
+        }
+
+        void close(boost::beast::websocket::close_code code) override {
+            asio::dispatch(ws.get_executor(), [conn = self(), code]() noexcept {
+                if (conn->closing || conn->closed) {
+                    return;
+                }
+                conn->closing    = true;
+                conn->close_code = code;
+                if (!conn->writing) {
+                    conn->async_close();
+                }
+            });
+        }
+
+      private:
+        void on_accept(boost::beast::error_code ec) noexcept {
+            if (ec) [[unlikely]] {
+                server->logger.warning(log_cat, "WebSocket handshake failed.", ec);
+                closed = true;
+                return;
+            }
+            call_handler([this] {
+                handler->on_open(*this);
+            });
+            async_read_message();
+        }
+    };
+
+} // namespace webpp::http::beast_proto
+
+#endif // WEBPP_HTTP_PROTO_BEAST_WEBSOCKET_HPP
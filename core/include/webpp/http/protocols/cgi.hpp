@@ -2,16 +2,22 @@
 #define WEBPP_PROTOCOLS_CGI_HPP
 
 #include "../../convert/casts.hpp"
+#include "../../std/span.hpp"
 #include "../../std/string_view.hpp"
 #include "../../traits/default_traits.hpp"
 #include "../request.hpp"
 #include "../request_body.hpp"
 #include "../response.hpp"
+#include "../syntax/response_serializer.hpp"
+#include "cgi_proto/cgi_environment.hpp"
 #include "cgi_proto/cgi_request.hpp"
 #include "cgi_proto/cgi_request_body_communicator.hpp"
 #include "common/common_http_protocol.hpp"
 
+#include <cerrno>
 #include <iostream>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace webpp::http {
 
@@ -89,45 +95,73 @@ namespace webpp::http {
         }
 
 
+        /**
+         * Write the buffers to the standard output, with as few system calls as they take; the iostreams are
+         * not used, so the user should not use cout either.
+         */
+        static bool write_buffers(stl::span<iovec> bufs) noexcept {
+            while (!bufs.empty()) {
+                auto written = ::writev(STDOUT_FILENO, bufs.data(), static_cast<int>(bufs.size()));
+                if (written == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                // skip the buffers that are written, the pipe may take a part of them
+                auto done = static_cast<stl::size_t>(written);
+                while (!bufs.empty() && done >= bufs.front().iov_len) {
+                    done -= bufs.front().iov_len;
+                    bufs  = bufs.subspan(1);
+                }
+                if (!bufs.empty()) {
+                    bufs.front().iov_base  = static_cast<char*>(bufs.front().iov_base) + done;
+                    bufs.front().iov_len  -= done;
+                }
+            }
+            return true;
+        }
+
         /**
          * Send the stream to the user
          * @param stream
          */
         static void write(auto& stream) noexcept {
             // TODO: check if you need to ignore the input or not
-
-            // I think o-stream is not readable, so we cannot do this:
-            // https://stackoverflow.com/questions/15629886/how-to-write-ostringstream-directly-to-cout
-            stl::cout << stream.rdbuf(); // TODO: test this, I don't trust myself :)
+            stl::array<char, default_buffer_size> buf;
+            while (stl::streamsize const read_size =
+                     stream.rdbuf()->sgetn(buf.data(), static_cast<stl::streamsize>(buf.size()))) {
+                write(buf.data(), read_size);
+            }
         }
 
         /**
          * Send data to the user
          */
         static void write(char const* data, stl::streamsize length) noexcept {
-            stl::cout.write(data, length);
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+            iovec buf{.iov_base = const_cast<char*>(data), .iov_len = static_cast<stl::size_t>(length)};
+            write_buffers(stl::span<iovec>{&buf, 1});
         }
 
         /**
          * Get the environment value safely
          */
-        [[nodiscard]] static inline stl::string_view env(char const* key) noexcept {
-            if (const auto value = getenv(key))
-                return value;
-            return {};
+        [[nodiscard]] static inline stl::string_view env(stl::string_view key) noexcept {
+            return cgi_proto::cgi_environment::get(key);
         }
 
       private:
+        // write the body that's not in the memory (blob, stream, and file bodies) as it's read
         template <typename BodyType>
-        void write_response_body(BodyType& body) {
+        static void write_response_body(BodyType& body) {
             using body_type = stl::remove_cvref_t<BodyType>;
-            if constexpr (TextBasedBodyReader<body_type>) {
-                write(body.data(), static_cast<stl::streamsize>(body.size()));
-            } else if constexpr (BlobBasedBodyReader<body_type>) {
-                stl::array<char_type, default_buffer_size> buf;
+            if constexpr (BlobBasedBodyReader<body_type>) {
+                stl::array<stl::byte, default_buffer_size> buf;
                 while (stl::streamsize read_size =
                          body.read(buf.data(), static_cast<stl::streamsize>(buf.size()))) {
-                    write(buf.data(), read_size);
+                    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                    write(reinterpret_cast<char const*>(buf.data()), read_size);
                 }
             } else if constexpr (StreamBasedBodyReader<body_type>) {
                 write(body);
@@ -139,6 +173,38 @@ namespace webpp::http {
             }
         }
 
+        /**
+         * Write the head (the first 3 buffers) and the body; a text body is written with the head at once,
+         * the rest of the bodies are written after it, in pieces.
+         */
+        template <typename BodyType>
+        static void write_response(stl::span<iovec, 4> bufs, BodyType& body) {
+            using body_type = stl::remove_cvref_t<BodyType>;
+            if constexpr (requires { body.which_communicator(); }) {
+                switch (body.which_communicator()) {
+                    case communicator_type::blob_based:
+                    case communicator_type::stream_based:
+                    case communicator_type::file_based:
+                        if (write_buffers(bufs.first(3))) {
+                            write_response_body(body);
+                        }
+                        return;
+                    default: break; // the data is in the memory
+                }
+            }
+            if constexpr (TextBasedBodyReader<body_type>) {
+                if (auto const* data = body.data(); data != nullptr) {
+                    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+                    bufs[3] = iovec{.iov_base = const_cast<char*>(data), .iov_len = body.size()};
+                }
+                write_buffers(bufs);
+            } else {
+                if (write_buffers(bufs.first(3))) {
+                    write_response_body(body);
+                }
+            }
+        }
+
       public:
         int operator()() noexcept {
             try {
@@ -154,17 +220,29 @@ namespace webpp::http {
                 // extension-code = 3digit
                 // reason-phrase  = *TEXT
 
-                // todo: give the user the ability to change the status phrase
-                auto status_line = object::make_local<string_type>(this->alloc_pack);
-                fmt::format_to(stl::back_inserter(status_line),
-                               "Status: {} {}\r\n",
-                               res.headers.status_code,
-                               http::status_code_reason_phrase(res.headers.status_code));
-                write(status_line.data(), static_cast<stl::streamsize>(status_line.size()));
-
-                write(header_str.data(), static_cast<stl::streamsize>(header_str.size()));
-                write("\r\n", 2L);
-                write_response_body(res.body);
+                // the status line is one of the precomputed ones, unless the app has its own reason phrase
+                response_head_options const options{.style = status_line_style::cgi};
+                string_type                 status_buf{alloc::general_alloc_for<string_type>(*this)};
+                stl::string_view            status = res.headers.reason_phrase.empty()
+                                                       ? status_line(res.headers.status_code, options)
+                                                       : stl::string_view{};
+                if (status.empty()) {
+                    append_status_line(status_buf,
+                                       res.headers.status_code,
+                                       options,
+                                       res.headers.reason_phrase);
+                    status = status_buf;
+                }
+
+                // NOLINTBEGIN(cppcoreguidelines-pro-type-const-cast)
+                stl::array<iovec, 4> bufs{
+                  iovec{.iov_base = const_cast<char*>(status.data()), .iov_len = status.size()},
+                  iovec{.iov_base = const_cast<char*>(header_str.data()), .iov_len = header_str.size()},
+                  iovec{.iov_base = const_cast<char*>("\r\n"), .iov_len = 2},
+                  iovec{}, // the body, if it's a text
+                };
+                // NOLINTEND(cppcoreguidelines-pro-type-const-cast)
+                write_response(bufs, res.body);
             } catch (stl::exception const& ex) {
                 this->logger.error("CGI", "Fatal exception is thrown.", ex);
             } catch (...) {
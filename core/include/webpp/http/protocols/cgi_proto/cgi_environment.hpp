@@ -0,0 +1,72 @@
+#ifndef WEBPP_CGI_ENVIRONMENT_HPP
+#define WEBPP_CGI_ENVIRONMENT_HPP
+
+#include "../../../std/string_view.hpp"
+#include "../../../std/unordered_map.hpp"
+
+// TODO: use GetEnvironmentStringsA for Windows operating system
+#include <unistd.h> // for environ
+
+namespace webpp::http::cgi_proto {
+
+    /**
+     * The environment variables of the process, which are the request of a CGI process; the names and the
+     * values are string views into "environ", nothing is copied.
+     *
+     * A lookup scans the whole environment (that's what getenv does), and a request looks up a lot of them,
+     * so they're looked up in a hash index that's built on the first lookup. The variables that are set
+     * after that (with setenv) are not seen.
+     */
+    struct cgi_environment {
+        using map_type = stl::unordered_map<stl::string_view, stl::string_view>;
+
+      private:
+        map_type index{};
+
+        cgi_environment() {
+            stl::size_t count = 0;
+            for (auto it = ::environ; *it; ++it) {
+                ++count;
+            }
+            index.reserve(count);
+            for (auto it = ::environ; *it; ++it) {
+                stl::string_view const var{*it};
+                auto const             equal_sign = var.find('=');
+                if (equal_sign != stl::string_view::npos) {
+                    // the first one wins if it's set twice, as in getenv
+                    index.emplace(var.substr(0, equal_sign), var.substr(equal_sign + 1));
+                }
+            }
+        }
+
+      public:
+        /**
+         * Get the value of the variable; it's empty if it's not set.
+         */
+        [[nodiscard]] static stl::string_view get(stl::string_view name) noexcept {
+            try {
+                static cgi_environment const env; // built on the first call, thread-safe
+                auto const                   it = env.index.find(name);
+                return it == env.index.end() ? stl::string_view{} : it->second;
+            } catch (...) {
+                return scan(name); // no memory for the index
+            }
+        }
+
+        /**
+         * Get the value of the variable without the index.
+         */
+        [[nodiscard]] static stl::string_view scan(stl::string_view name) noexcept {
+            for (auto it = ::environ; *it; ++it) {
+                stl::string_view const var{*it};
+                if (var.size() > name.size() && var[name.size()] == '=' && var.starts_with(name)) {
+                    return var.substr(name.size() + 1);
+                }
+            }
+            return {};
+        }
+    };
+
+} // namespace webpp::http::cgi_proto
+
+#endif // WEBPP_CGI_ENVIRONMENT_HPP
@@ -28,7 +28,9 @@ namespace webpp::http {
         using string_type      = typename super::string_type;
         using char_type        = traits::char_type<traits_type>;
 
-        string_type cache;
+        string_type cache; // the header names; the values are in environ
+
+        static constexpr string_view_type HTTP_prefix = "HTTP_";
 
         string_view_type put_header_name(string_view_type name) {
             using diff_t = typename stl::iterator_traits<typename string_type::iterator>::difference_type;
@@ -37,14 +39,20 @@ namespace webpp::http {
             return {cache.data() + cache.size() - name.size(), name.size()};
         }
 
-        string_view_type put_value(string_view_type value) {
-            // todo: environ is save to use as a string view, I don't think we need to store it in the holder
-            cache.append(value.data(), value.size());
-            return {cache.data() + cache.size() - value.size(), value.size()};
+        // the size of the names of the headers, so the cache is never reallocated while it's being filled
+        [[nodiscard]] static stl::size_t header_names_size() noexcept {
+            stl::size_t size = 0;
+            for (auto it = ::environ; *it; it++) {
+                string_view_type const var{*it};
+                if (**it == 'H' && ascii::starts_with(var, HTTP_prefix)) {
+                    size += var.substr(0, var.find('=')).size() - HTTP_prefix.size();
+                }
+            }
+            return size;
         }
 
         void fill_headers() {
-            static constexpr string_view_type HTTP_prefix = "HTTP_";
+            cache.reserve(header_names_size());
             for (auto it = ::environ; *it; it++) {
                 switch (**it) {
                     case 'C': {
@@ -52,8 +60,7 @@ namespace webpp::http {
                         auto const             equal_sign = hdr.find('=');
                         string_view_type const name       = hdr.substr(0, equal_sign);
                         if (name == "CONTENT_LENGTH") {
-                            string_view_type const value = hdr.substr(equal_sign + 1);
-                            this->headers.emplace("Content-Length", put_value(value));
+                            this->headers.emplace("Content-Length", hdr.substr(equal_sign + 1));
                         }
                         break;
                     }
@@ -61,13 +68,9 @@ namespace webpp::http {
                         string_view_type hdr{*it};
                         if (ascii::starts_with(hdr, HTTP_prefix)) {
                             hdr.remove_prefix(HTTP_prefix.size());
-                            auto const       equal_sign = hdr.find('=');
-                            string_view_type name       = hdr.substr(0, equal_sign);
-                            string_view_type value      = hdr.substr(equal_sign + 1);
-
-                            name  = put_header_name(name);
-                            value = put_value(value);
-                            this->headers.emplace(name, value);
+                            auto const equal_sign = hdr.find('=');
+                            this->headers.emplace(put_header_name(hdr.substr(0, equal_sign)),
+                                                  hdr.substr(equal_sign + 1));
                         }
                         break;
                     }
@@ -115,7 +118,7 @@ namespace webpp::http {
         /**
          * Get the environment value safely
          */
-        [[nodiscard]] inline string_view_type env(char const* key) const noexcept {
+        [[nodiscard]] inline string_view_type env(string_view_type key) const noexcept {
             return server_type::env(key);
         }
 
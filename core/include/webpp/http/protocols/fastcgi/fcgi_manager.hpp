@@ -58,101 +58,62 @@ namespace webpp::http::fastcgi {
          *                                  ((B3 & 0x7f) << 24) + (B2 << 16) + (B1 << 8) + B0];
          *    } FCGI_NameValuePair44;
          *
-         *
+         * On success, the data is moved to the next pair.
          */
-        static bool process_header_params(const char*       data,
-                                          const char* const data_end,
+        static bool process_header_params(char const*&      data,
+                                          char const* const data_end,
                                           stl::string_view& name,
                                           stl::string_view& value) noexcept {
-            if (data >= data_end)
+            stl::size_t name_size;  // NOLINT(cppcoreguidelines-init-variables)
+            stl::size_t value_size; // NOLINT(cppcoreguidelines-init-variables)
+            char const* pos = data;
+            if (!read_length(pos, data_end, name_size) || !read_length(pos, data_end, value_size)) {
                 return false; // no more params for you
-
-            stl::size_t name_size;
-            stl::size_t value_size;
-
-            // calculating name length
-            if (static_cast<uint8_t>(*data) & 0x80u) { // if the first bit is 1
-                // it means we've got a longer name length than uint8_t, we've got uint32_t
-                const auto* const size = reinterpret_cast<const uint8_t*>(data);
-                data += sizeof(uint32_t);
-
-                if (data >= data_end)
-                    return false; // no more params for you
-
-                name_size = join_pieces<uint32_t, uint8_t>(size) & 0x7FFFFFFFu;
-            } else {
-                name_size = static_cast<uint8_t>(*data);
-                ++data;
             }
-
-            if (data >= data_end)
-                return false;
-
-            // calculating value length
-            if (static_cast<uint8_t>(*data) & 0x80u) { // if the first bit is 1
-                // it means we've got a longer value length than uint8_t, we've got uint32_t
-                const auto* const size = reinterpret_cast<const uint8_t*>(data);
-                data += sizeof(uint32_t);
-
-                if (data >= data_end)
-                    return false; // no more params for you
-
-                value_size = join_pieces<uint32_t, uint8_t>(size) & 0x7FFFFFFFu;
-            } else {
-                value_size = static_cast<uint8_t>(*data);
-                ++data;
+            if (static_cast<stl::size_t>(data_end - pos) < name_size + value_size) {
+                return false; // the lengths are lying
             }
 
-            name     = stl::string_view{static_cast<const char*>(data), name_size};
-            value    = stl::string_view{name.data() + name_size, value_size};
-            auto end = value.data() + value_size;
-
-            return end <= data_end;
+            name  = stl::string_view{pos, name_size};
+            value = stl::string_view{pos + name_size, value_size};
+            data  = pos + name_size + value_size;
+            return true;
         }
 
-        void send(auto&& block) const noexcept {
-            // todo
+        /**
+         * The size of the name-value pair at the beginning of the data (its lengths, its name and its
+         * value); zero if its lengths are not all in the data yet.
+         */
+        [[nodiscard]] static stl::size_t pair_size(char const* data, char const* const data_end) noexcept {
+            stl::size_t name_size;  // NOLINT(cppcoreguidelines-init-variables)
+            stl::size_t value_size; // NOLINT(cppcoreguidelines-init-variables)
+            char const* pos = data;
+            if (!read_length(pos, data_end, name_size) || !read_length(pos, data_end, value_size)) {
+                return 0;
+            }
+            return static_cast<stl::size_t>(pos - data) + name_size + value_size;
         }
 
-        void handle_header(header&& _header) noexcept {
-            extern char* data; // todo
-            extern char* data_end;
-            switch (_header.type) {
-                case record_type::get_values: {
-                    stl::string_view name, value;
-                    while (process_header_params(data, data_end, name, value)) {
-                        switch (name.size()) {
-
-                            case decltype(max_conns_reply)::real_name_length:
-                                if (stl::equal(name.data(),
-                                               name.data() + name.size(),
-                                               max_conns_reply.name)) {
-                                    send(max_conns_reply);
-                                }
-                                break;
-
-                            case decltype(max_reqs_reply)::real_name_length:
-                                if (stl::equal(name.data(), name.data() + name.size(), max_reqs_reply.name)) {
-                                    send(max_reqs_reply);
-                                }
-                                break;
+      private:
+        // read a 1 or 4 byte length of a name-value pair
+        static bool read_length(char const*& data, char const* const data_end, stl::size_t& length) noexcept {
+            if (data >= data_end) {
+                return false;
+            }
+            if ((static_cast<uint8_t>(*data) & 0x80u) == 0) {
+                length = static_cast<uint8_t>(*data);
+                ++data;
+                return true;
+            }
 
-                            case decltype(mpxs_conns_reply)::real_name_length:
-                                if (stl::equal(name.data(),
-                                               name.data() + name.size(),
-                                               mpxs_conns_reply.name)) {
-                                    send(max_reqs_reply);
-                                }
-                                break;
-                        }
-                    }
-                }
-                default: {
-                    unknown_type unknown;
-                    // todo
-                    send(unknown);
-                }
+            // it means we've got a longer length than uint8_t, we've got uint32_t
+            if (data_end - data < static_cast<stl::ptrdiff_t>(sizeof(uint32_t))) {
+                return false;
             }
+            auto const* const size = reinterpret_cast<uint8_t const*>(data); // NOLINT
+            length                 = join_pieces<uint32_t, uint8_t>(size) & 0x7FFF'FFFFu;
+            data += sizeof(uint32_t);
+            return true;
         }
     };
 
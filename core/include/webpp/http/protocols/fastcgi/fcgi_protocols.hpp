@@ -3,6 +3,9 @@
 
 #include "../../../std/string_view.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
 #include <limits>
 
 // https://github.com/eddic/fastcgipp
@@ -242,6 +245,10 @@ namespace webpp::http::fastcgi {
         [[nodiscard]] enum protocol_status protocol_status() const noexcept {
             return static_cast<enum protocol_status>(protocol_status_value);
         }
+
+        void protocol_status(enum protocol_status status) noexcept {
+            protocol_status_value = static_cast<uint8_t>(status);
+        }
     };
 
     template <stl::size_t NAME_LENGTH, stl::size_t VALUE_LENGTH>
@@ -287,9 +294,77 @@ namespace webpp::http::fastcgi {
         }
     };
 
-    static constexpr management_reply max_conns_reply{"FCGI_MAX_CONNS", "10"};
-    static constexpr management_reply max_reqs_reply{"FCGI_MAX_REQS", "50"};
-    static constexpr management_reply mpxs_conns_reply{"FCGI_MPXS_CONNS", "1"};
+    // the size of a record's header
+    static constexpr stl::size_t header_size = sizeof(header);
+
+    // the largest content of a record that doesn't need any padding
+    static constexpr stl::size_t max_aligned_content_length = 0xFFFFu / chunk_size * chunk_size;
+
+    // the names of the variables that the web server can ask for in a GET_VALUES record
+    static constexpr stl::string_view max_conns_name  = "FCGI_MAX_CONNS";
+    static constexpr stl::string_view max_reqs_name   = "FCGI_MAX_REQS";
+    static constexpr stl::string_view mpxs_conns_name = "FCGI_MPXS_CONNS";
+
+    /**
+     * Number of bytes of padding that's needed for the content to be 8-byte aligned
+     */
+    [[nodiscard]] constexpr uint8_t padding_length(stl::size_t content_length) noexcept {
+        return static_cast<uint8_t>((chunk_size - content_length % chunk_size) % chunk_size);
+    }
+
+    /**
+     * Append a record (the header, the content, and the padding) to the end of the output string.
+     * The content should not be longer than 0xFFFF bytes.
+     */
+    template <typename StrT>
+    constexpr void
+    append_record(StrT& out, record_type type, uint16_t req_id, char const* data, stl::size_t size) {
+        auto const  padding = padding_length(size);
+        header const hdr{type, req_id, static_cast<uint16_t>(size), padding};
+        out.append(reinterpret_cast<char const*>(&hdr), sizeof(hdr)); // NOLINT
+        out.append(data, size);
+        out.append(padding, '\0');
+    }
+
+    /**
+     * Append a record and its content to the output string.
+     */
+    template <typename StrT, typename BodyT>
+    constexpr void append_record(StrT& out, record_type type, uint16_t req_id, BodyT const& body) {
+        append_record(out, type, req_id, reinterpret_cast<char const*>(&body), sizeof(body)); // NOLINT
+    }
+
+    /**
+     * Append a stream (STDOUT or STDERR) to the output string; it's split into as many records as needed.
+     * An empty data closes the stream.
+     */
+    template <typename StrT>
+    constexpr void append_stream(StrT& out, record_type type, uint16_t req_id, stl::string_view data) {
+        do {
+            auto const size = stl::min(data.size(), max_aligned_content_length);
+            append_record(out, type, req_id, data.data(), size);
+            data.remove_prefix(size);
+        } while (!data.empty());
+    }
+
+    /**
+     * Append a name-value pair, in the format of the PARAMS and GET_VALUES_RESULT records.
+     */
+    template <typename StrT>
+    constexpr void append_name_value(StrT& out, stl::string_view name, stl::string_view value) {
+        for (auto const length : {name.size(), value.size()}) {
+            if (length < 0x80u) {
+                out.push_back(static_cast<char>(length));
+            } else {
+                out.push_back(static_cast<char>((length >> 24u) | 0x80u));
+                out.push_back(static_cast<char>(length >> 16u));
+                out.push_back(static_cast<char>(length >> 8u));
+                out.push_back(static_cast<char>(length));
+            }
+        }
+        out.append(name.data(), name.size());
+        out.append(value.data(), value.size());
+    }
 
 } // namespace webpp::http::fastcgi
 
@@ -0,0 +1,241 @@
+#ifndef WEBPP_FCGI_RECORD_WRITER_HPP
+#define WEBPP_FCGI_RECORD_WRITER_HPP
+
+#include "../../../std/concepts.hpp"
+#include "../../../std/span.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../../std/vector.hpp"
+#include "../../../traits/enable_traits.hpp"
+#include "../../../traits/traits.hpp"
+#include "fcgi_protocols.hpp"
+
+#include <array>
+#include <cstring>
+#include <sys/uio.h>
+
+namespace webpp::http::fastcgi {
+
+    /**
+     * Frames the output of a connection into records, and gives them to the connection as a list of
+     * buffers that's sent with one scatter/gather write (writev/sendmsg).
+     *
+     * The headers of the records (and the small pieces of content) are written into a small buffer; the
+     * bodies are not copied, the buffers of the output point to them directly:
+     *   - write_ref: the data should stay valid until the output is sent
+     *   - write(string&&): the string is kept here until the output is sent
+     *   - write(string_view): the data is copied
+     *
+     * The consecutive writes of a stream are put into the same record until it's full (65528 bytes, the
+     * largest content that doesn't need padding); the padding of the last record comes from a static array.
+     */
+    template <Traits TraitsType>
+    struct fcgi_record_writer {
+        using traits_type  = TraitsType;
+        using string_type  = traits::general_string<traits_type>;
+        using strings_type = stl::vector<string_type, traits::general_allocator<traits_type, string_type>>;
+
+        // the pieces that are smaller than this are copied; it's cheaper than one more buffer
+        static constexpr stl::size_t copy_threshold = 256;
+
+      private:
+        static constexpr stl::size_t no_record = stl::string_view::npos;
+
+        static constexpr stl::array<char, chunk_size> zeros{};
+
+        // a part of the output; it's either in the "arena", or somewhere else
+        struct piece {
+            char const* data;   // null if it's in the arena
+            stl::size_t offset; // the offset in the arena
+            stl::size_t size;
+        };
+
+        using pieces_type = stl::vector<piece, traits::general_allocator<traits_type, piece>>;
+        using iovecs_type = stl::vector<iovec, traits::general_allocator<traits_type, iovec>>;
+
+        string_type  arena;
+        pieces_type  pieces;
+        iovecs_type  iovecs;
+        strings_type held; // the strings that the output points to
+
+        // the record that's being written
+        stl::size_t record_pos    = no_record; // the offset of its header in the arena
+        stl::size_t record_length = 0;
+        record_type record_kind   = record_type::std_out;
+        uint16_t    record_id     = 0;
+
+        void add_arena_piece(stl::size_t offset, stl::size_t size) {
+            if (!pieces.empty()) {
+                auto& last = pieces.back();
+                if (last.data == nullptr && last.offset + last.size == offset) {
+                    last.size += size; // it's right after the last piece
+                    return;
+                }
+            }
+            pieces.push_back({nullptr, offset, size});
+        }
+
+        void copy(char const* data, stl::size_t size) {
+            auto const offset = arena.size();
+            arena.append(data, size);
+            add_arena_piece(offset, size);
+        }
+
+        void open_record(record_type type, uint16_t req_id) {
+            if (record_pos != no_record && (record_kind != type || record_id != req_id)) {
+                close_record();
+            }
+            if (record_pos == no_record) {
+                record_pos    = arena.size();
+                record_length = 0;
+                record_kind   = type;
+                record_id     = req_id;
+                arena.append(header_size, '\0'); // the length is not known yet
+                add_arena_piece(record_pos, header_size);
+            }
+        }
+
+        void close_record() {
+            if (record_pos == no_record) {
+                return;
+            }
+            auto const   padding = padding_length(record_length);
+            header const hdr{record_kind, record_id, static_cast<uint16_t>(record_length), padding};
+            stl::memcpy(arena.data() + record_pos, &hdr, sizeof(hdr));
+            if (padding != 0) {
+                pieces.push_back({zeros.data(), 0, padding});
+            }
+            record_pos = no_record;
+        }
+
+        // write into the stream, "copy" decides whether to copy the data or just point to it
+        void write_stream(record_type type, uint16_t req_id, stl::string_view data, bool copy_data) {
+            while (!data.empty()) {
+                open_record(type, req_id);
+                auto const size = stl::min(data.size(), max_aligned_content_length - record_length);
+                if (copy_data || size < copy_threshold) {
+                    copy(data.data(), size);
+                } else {
+                    pieces.push_back({data.data(), 0, size});
+                }
+                record_length += size;
+                data.remove_prefix(size);
+                if (record_length == max_aligned_content_length) {
+                    close_record();
+                }
+            }
+        }
+
+      public:
+        template <EnabledTraits ET>
+        explicit fcgi_record_writer(ET& et)
+          : arena{alloc::general_alloc_for<string_type>(et)},
+            pieces{alloc::general_alloc_for<pieces_type>(et)},
+            iovecs{alloc::general_alloc_for<iovecs_type>(et)},
+            held{alloc::general_alloc_for<strings_type>(et)} {}
+
+        /**
+         * Write a whole record; the content is copied.
+         */
+        void record(record_type type, uint16_t req_id, char const* data, stl::size_t size) {
+            close_record();
+            auto const   padding = padding_length(size);
+            header const hdr{type, req_id, static_cast<uint16_t>(size), padding};
+            copy(reinterpret_cast<char const*>(&hdr), sizeof(hdr)); // NOLINT
+            copy(data, size);
+            if (padding != 0) {
+                copy(zeros.data(), padding);
+            }
+        }
+
+        template <typename BodyT>
+        void record(record_type type, uint16_t req_id, BodyT const& body) {
+            record(type, req_id, reinterpret_cast<char const*>(&body), sizeof(body)); // NOLINT
+        }
+
+        /**
+         * Write into a stream (STDOUT or STDERR) of a request; the data is copied
+         */
+        void write(record_type type, uint16_t req_id, stl::string_view data) {
+            write_stream(type, req_id, data, true);
+        }
+
+        /**
+         * Write into a stream without copying the data; the data should stay valid until it's sent.
+         */
+        void write_ref(record_type type, uint16_t req_id, stl::string_view data) {
+            write_stream(type, req_id, data, false);
+        }
+
+        /**
+         * Write into a stream without copying the data; the string is kept until the output is sent.
+         */
+        template <typename StrT>
+            requires(stl::same_as<StrT, string_type>) // only the rvalues
+        void write(record_type type, uint16_t req_id, StrT&& data) {
+            if (data.size() < copy_threshold) {
+                write_stream(type, req_id, data, true);
+                return;
+            }
+            // the short strings are copied, so the data of the long ones doesn't move with the string
+            auto const& str = held.emplace_back(stl::forward<StrT>(data));
+            write_stream(type, req_id, str, false);
+        }
+
+        /**
+         * Close a stream (STDOUT or STDERR) with an empty record
+         */
+        void end_stream(record_type type, uint16_t req_id) {
+            record(type, req_id, nullptr, 0);
+        }
+
+        /**
+         * Finish the record that's being written, so the writes that come after it go to a new record
+         */
+        void flush() {
+            close_record();
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return pieces.empty();
+        }
+
+        /**
+         * The buffers that should be sent, in order; they're valid until the writer is cleared.
+         * The connections move the beginning of the buffers forward as they're sent.
+         */
+        [[nodiscard]] stl::span<iovec> buffers() {
+            close_record();
+            iovecs.clear();
+            for (auto const& part : pieces) {
+                char const* data = part.data == nullptr ? arena.data() + part.offset : part.data;
+                iovecs.push_back({const_cast<char*>(data), part.size}); // NOLINT
+            }
+            return iovecs;
+        }
+
+        /**
+         * Total number of bytes of the output
+         */
+        [[nodiscard]] stl::size_t size() const noexcept {
+            stl::size_t total = 0;
+            for (auto const& part : pieces) {
+                total += part.size;
+            }
+            return total;
+        }
+
+        /**
+         * Start over; the output is sent
+         */
+        void clear() noexcept {
+            arena.clear();
+            pieces.clear();
+            iovecs.clear();
+            held.clear();
+            record_pos = no_record;
+        }
+    };
+
+} // namespace webpp::http::fastcgi
+
+#endif // WEBPP_FCGI_RECORD_WRITER_HPP
@@ -3,6 +3,16 @@
 #ifndef WEBPP_FCGI_REQUEST_MANAGER_HPP
 #define WEBPP_FCGI_REQUEST_MANAGER_HPP
 
+#include "../../../std/functional.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../../std/vector.hpp"
+#include "../../../traits/enable_traits.hpp"
+#include "../../../traits/traits.hpp"
+#include "../../syntax/response_serializer.hpp"
+#include "fcgi_manager.hpp"
+#include "fcgi_protocols.hpp"
+#include "fcgi_record_writer.hpp"
+
 namespace webpp::http::fastcgi {
 
     /**
@@ -11,8 +21,316 @@ namespace webpp::http::fastcgi {
      * that only deals with one single request at a time.
      *
      * So FastCGI Request Manager is designed to handle only one request at a time.
+     *
+     * The records of a request are collected here until the web server closes its PARAMS and STDIN
+     * streams. The params are string views into the PARAMS records themselves, in the buffer of the
+     * session; only a pair that spans two records is copied. The session reuses its buffer for the next
+     * records, so the params that are still in it are copied when it's done with the buffer (keep_params);
+     * the requests that are received with one read (most of the GET requests) are responded without
+     * copying their params.
+     *
+     * The objects of this type are reused for the next requests of the same connection, so the buffers are
+     * allocated only once; and they should not be moved, the params would point to the old object.
      */
-    struct fcgi_request_manager {};
+    template <Traits TraitsType>
+    struct fcgi_request_manager {
+        using traits_type      = TraitsType;
+        using string_view_type = traits::string_view<traits_type>;
+        using string_type      = traits::general_string<traits_type>;
+        using param_type       = stl::pair<string_view_type, string_view_type>;
+        using params_type      = stl::vector<param_type, traits::general_allocator<traits_type, param_type>>;
+        using writer_type      = fcgi_record_writer<traits_type>;
+
+      private:
+        static constexpr stl::size_t no_partial_pair = stl::string_view::npos;
+
+        string_type  params_stream; // the params that are copied out of the records
+        params_type  params_list;
+        string_type  body_content;
+        writer_type* writer           = nullptr;         // the output of the session
+        stl::size_t  partial_pair     = no_partial_pair; // the start of a pair that spans records
+        uint16_t     id               = 0;
+        enum role    request_role     = fastcgi::role::responder;
+        bool         keep_conn        = false;
+        bool         active           = false;
+        bool         params_collected = false;
+        bool         stdin_collected  = false;
+        bool         params_borrowed  = false; // some of the params are in the records (see keep_params)
+
+        // whether the string is in the params that are copied
+        [[nodiscard]] bool is_owned(string_view_type str) const noexcept {
+            stl::less_equal<> const not_after;
+            return not_after(params_stream.data(), str.data()) &&
+                   not_after(str.data(), params_stream.data() + params_stream.size());
+        }
+
+        // make room for more params; the params that are copied already are moved along
+        void grow_params(stl::size_t extra) {
+            if (params_stream.capacity() - params_stream.size() >= extra) {
+                return;
+            }
+            string_type bigger{params_stream.get_allocator()};
+            bigger.reserve(stl::max(params_stream.capacity() * 2, params_stream.size() + extra));
+            bigger.append(params_stream);
+            auto const move_along = [&](string_view_type& str) noexcept {
+                if (is_owned(str)) {
+                    str = {bigger.data() + (str.data() - params_stream.data()), str.size()};
+                }
+            };
+            for (auto& [name, value] : params_list) {
+                move_along(name);
+                move_along(value);
+            }
+            params_stream.swap(bigger);
+        }
+
+        [[nodiscard]] string_view_type copy_params(stl::string_view data) {
+            grow_params(data.size());
+            auto const start = params_stream.size();
+            params_stream.append(data.data(), data.size());
+            return {params_stream.data() + start, data.size()};
+        }
+
+        /**
+         * Copy the rest of the pair that spans records from the beginning of the data; the lengths are
+         * copied one byte at a time, since they're 1 or 4 bytes each. Returns false if the pair doesn't end
+         * in this record.
+         */
+        [[nodiscard]] bool complete_pair(stl::string_view& data) {
+            for (;;) {
+                auto const* const pair_begin = params_stream.data() + partial_pair;
+                auto const* const pair_end   = params_stream.data() + params_stream.size();
+                auto const        size       = fcgi_manager::pair_size(pair_begin, pair_end);
+                auto const needed = size == 0 ? 1 : size - static_cast<stl::size_t>(pair_end - pair_begin);
+                auto const part   = data.substr(0, needed);
+                static_cast<void>(copy_params(part));
+                data.remove_prefix(part.size());
+                if (size != 0 && part.size() == needed) {
+                    char const*      pos = params_stream.data() + partial_pair;
+                    stl::string_view name;
+                    stl::string_view value;
+                    static_cast<void>(fcgi_manager::process_header_params(
+                      pos,
+                      params_stream.data() + params_stream.size(),
+                      name,
+                      value));
+                    params_list.emplace_back(name, value);
+                    partial_pair = no_partial_pair;
+                    return true;
+                }
+                if (data.empty()) {
+                    return false;
+                }
+            }
+        }
+
+      public:
+        template <EnabledTraits ET>
+        explicit fcgi_request_manager(ET const& et)
+          : params_stream{alloc::general_alloc_for<string_type>(et)},
+            params_list{alloc::general_alloc_for<params_type>(et)},
+            body_content{alloc::general_alloc_for<string_type>(et)} {}
+
+        /**
+         * Start a new request (a BEGIN_REQUEST record is received)
+         */
+        void begin(uint16_t req_id, begin_request const& body) noexcept {
+            id               = req_id;
+            request_role     = body.role();
+            keep_conn        = !body.kill();
+            active           = true;
+            params_collected = false;
+            stdin_collected  = false;
+            params_borrowed  = false;
+            partial_pair     = no_partial_pair;
+            params_stream.clear();
+            params_list.clear();
+            body_content.clear();
+        }
+
+        /**
+         * The request is responded (or aborted), and this object can be used for another request
+         */
+        void end() noexcept {
+            active = false;
+        }
+
+        [[nodiscard]] bool is_active() const noexcept {
+            return active;
+        }
+
+        /**
+         * Parse the content of a PARAMS record; an empty content ends the stream. The content should stay
+         * valid until keep_params is called.
+         * Returns false if the params are malformed.
+         */
+        [[nodiscard]] bool append_params(stl::string_view data) {
+            if (params_collected) {
+                return true; // the stream is closed already, ignore it
+            }
+            if (data.empty()) {
+                params_collected = true;
+                return partial_pair == no_partial_pair; // or the last pair is cut off
+            }
+            if (partial_pair != no_partial_pair && !complete_pair(data)) {
+                return true; // the rest of the pair is in the next records
+            }
+            char const*       pos = data.data();
+            char const* const end = pos + data.size();
+            stl::string_view  name;
+            stl::string_view  value;
+            while (fcgi_manager::process_header_params(pos, end, name, value)) {
+                params_list.emplace_back(name, value);
+                params_borrowed = true;
+            }
+            if (pos != end) {
+                // the beginning of a pair that spans records
+                partial_pair = params_stream.size();
+                static_cast<void>(copy_params({pos, static_cast<stl::size_t>(end - pos)}));
+            }
+            return true;
+        }
+
+        /**
+         * Copy the params that are still in the records; the session calls this before it reuses its
+         * buffer for the next records.
+         */
+        void keep_params() {
+            if (!params_borrowed) {
+                return;
+            }
+            params_borrowed = false;
+
+            // the pair that spans records should stay at the end, so the rest of it is appended to it
+            string_type partial{params_stream.get_allocator()};
+            if (partial_pair != no_partial_pair) {
+                partial.assign(params_stream, partial_pair);
+                params_stream.resize(partial_pair);
+            }
+            stl::size_t size = partial.size();
+            for (auto const& [name, value] : params_list) {
+                size += (is_owned(name) ? 0 : name.size()) + (is_owned(value) ? 0 : value.size());
+            }
+            grow_params(size); // so the views don't move while they're copied
+            for (auto& [name, value] : params_list) {
+                if (!is_owned(name)) {
+                    name = copy_params(name);
+                }
+                if (!is_owned(value)) {
+                    value = copy_params(value);
+                }
+            }
+            if (partial_pair != no_partial_pair) {
+                partial_pair = params_stream.size();
+                static_cast<void>(copy_params(partial));
+            }
+        }
+
+        /**
+         * Append the content of a STDIN record; an empty content ends the stream.
+         */
+        void append_stdin(stl::string_view data) {
+            if (data.empty()) {
+                stdin_collected = true;
+                return;
+            }
+            body_content.append(data.data(), data.size());
+        }
+
+        /**
+         * The request is completely received, and it can be responded
+         */
+        [[nodiscard]] bool is_ready() const noexcept {
+            return params_collected && stdin_collected;
+        }
+
+        [[nodiscard]] uint16_t request_id() const noexcept {
+            return id;
+        }
+
+        [[nodiscard]] enum role role() const noexcept {
+            return request_role;
+        }
+
+        /**
+         * Whether the web server wants the connection to be kept open after this request
+         */
+        [[nodiscard]] bool keep_connection() const noexcept {
+            return keep_conn;
+        }
+
+        [[nodiscard]] params_type const& params() const noexcept {
+            return params_list;
+        }
+
+        /**
+         * Get the value of a param (like "REQUEST_METHOD"); empty if it's not there
+         */
+        [[nodiscard]] string_view_type param(string_view_type name) const noexcept {
+            for (auto const& [param_name, value] : params_list) {
+                if (param_name == name) {
+                    return value;
+                }
+            }
+            return {};
+        }
+
+        [[nodiscard]] string_view_type body() const noexcept {
+            return body_content;
+        }
+
+        /**
+         * The writer that the records of this request are written into
+         */
+        void output(writer_type& output_writer) noexcept {
+            writer = &output_writer;
+        }
+
+        /**
+         * Send a part of the response (in the CGI format: the headers, an empty line, and the body).
+         * The data is copied.
+         */
+        void write(stl::string_view data) {
+            writer->write(record_type::std_out, id, data);
+        }
+
+        /**
+         * Send a part of the response without copying it; the string is kept until it's sent.
+         */
+        template <typename StrT>
+            requires(stl::same_as<StrT, string_type>) // only the rvalues
+        void write(StrT&& data) {
+            writer->write(record_type::std_out, id, stl::forward<StrT>(data));
+        }
+
+        /**
+         * Send the head of the response in the CGI format (with a "Status" field, the web server writes the
+         * status line itself); the body that's written after it should be "content_length" bytes.
+         */
+        template <typename HeadersT>
+        void write_head(HeadersT const& headers, stl::size_t content_length) {
+            string_type head{body_content.get_allocator()};
+            serialize_response_head(head,
+                                    headers,
+                                    {.style = status_line_style::cgi, .content_length = content_length});
+            write(stl::move(head));
+        }
+
+        /**
+         * Send a part of the response without copying it; the data should be valid until it's sent, which
+         * is after the responder returns.
+         */
+        void write_ref(stl::string_view data) {
+            writer->write_ref(record_type::std_out, id, data);
+        }
+
+        /**
+         * Send an error message to the web server's error log
+         */
+        void write_error(stl::string_view data) {
+            writer->write(record_type::std_err, id, data);
+        }
+    };
 
 } // namespace webpp::http::fastcgi
 
@@ -3,8 +3,53 @@
 #ifndef WEBPP_FCGI_SESSION_MANAGER_HPP
 #define WEBPP_FCGI_SESSION_MANAGER_HPP
 
+#include "../../../configs/constants.hpp"
+#include "../../../platform/posix.hpp"
+#include "../../../std/functional.hpp"
+#include "../../../std/span.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../../std/vector.hpp"
+#include "../../../traits/enable_traits.hpp"
+#include "../../../traits/traits.hpp"
+#include "fcgi_manager.hpp"
+#include "fcgi_protocols.hpp"
+#include "fcgi_record_writer.hpp"
+#include "fcgi_request_manager.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+
+#ifdef webpp_posix
+#    include <sys/resource.h>
+#endif
+
 namespace webpp::http::fastcgi {
 
+    // the maximum number of concurrent requests on each connection, if not specified
+    static constexpr stl::size_t default_max_requests = 64;
+
+    // the maximum size of a record: the header, the content, and the padding
+    static constexpr stl::size_t max_record_size = header_size + 0xFFFFu + 0xFFu;
+
+    /**
+     * The maximum number of connections that we're able to accept; it's reported to the web server in the
+     * reply to FCGI_GET_VALUES.
+     */
+    [[nodiscard]] inline stl::size_t max_connections() noexcept {
+#ifdef webpp_posix
+        // each connection is one file descriptor; some of them are used by the server itself
+        static constexpr stl::size_t reserved_fds = 16;
+        rlimit                       limit{};
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+            limit.rlim_cur > reserved_fds) {
+            return static_cast<stl::size_t>(limit.rlim_cur) - reserved_fds;
+        }
+#endif
+        return 1024;
+    }
+
     /**
      * The session manager for the FastCGI protocol has to take care of all of the connections by all the
      * clients because it can only respond to one server (well, usually).
@@ -12,8 +57,272 @@ namespace webpp::http::fastcgi {
      * it can handle multiple request from multiple separate servers, but still a single fcgi session
      * manager should be able to handle multiple HTTP requests and not just one.
      * To solve this issue, it's better to have a "request manager" class as well.
+     *
+     * One session manager is created for each connection of the web server; the records of the requests
+     * can be interleaved (FCGI_MPXS_CONNS), each request id gets its own request manager, and the
+     * request is given to the responder as soon as its PARAMS and STDIN streams are closed:
+     *
+     *   responder(fcgi_request_manager&) -> the app's exit status (or void)
+     *
+     * The responder writes the response (in the CGI format) with request.write(...); it's default
+     * constructed with the session manager.
+     * This is only the protocol layer: the responder gets the raw params and body, the application's
+     * request and response types are not wired into it yet (the fcgi front end in fcgi.hpp is unfinished).
+     *
+     * This type implements the session API of the posix servers: buffer, read, output_buffers, and
+     * keep_connection; the output is sent with one scatter/gather write, the bodies are not copied.
      */
-    struct fcgi_session_manager {};
+    template <Traits TraitsType, typename ResponderType, stl::size_t MaxRequests = default_max_requests>
+    struct fcgi_session_manager : public enable_traits<TraitsType> {
+        static constexpr auto logger_category = "FastCGI/Session";
+
+        // at least one whole record should fit in the buffer
+        static constexpr stl::size_t buffer_size =
+          stl::max<stl::size_t>(default_buffer_size, max_record_size);
+        static constexpr stl::size_t max_requests = MaxRequests;
+
+        static_assert(max_requests > 0, "The session should be able to handle at least one request.");
+
+        using traits_type          = TraitsType;
+        using etraits              = enable_traits<traits_type>;
+        using responder_type       = ResponderType;
+        using string_view_type     = traits::string_view<traits_type>;
+        using string_type          = traits::general_string<traits_type>;
+        using request_manager_type = fcgi_request_manager<traits_type>;
+        using writer_type          = fcgi_record_writer<traits_type>;
+        using request_managers_type =
+          stl::vector<request_manager_type, traits::general_allocator<traits_type, request_manager_type>>;
+        using buffer_type = stl::array<char, buffer_size>;
+
+      private:
+        [[no_unique_address]] responder_type responder{};
+
+        buffer_type     buf{};
+        stl::size_t     filled = 0;          // the received bytes that are not handled yet
+        stl::span<char> space{buf};          // the part of the buffer that's not filled yet
+        writer_type     out;                 // the records that should be sent to the web server
+        bool            close_after = false; // the web server wants us to close the connection
+
+        // the request managers are reused for the next requests; the vector is never grown past its initial
+        // capacity, so they're never moved
+        request_managers_type requests;
+
+        [[nodiscard]] request_manager_type* find_request(uint16_t req_id) noexcept {
+            for (auto& req : requests) {
+                if (req.is_active() && req.request_id() == req_id) {
+                    return &req;
+                }
+            }
+            return nullptr;
+        }
+
+        void end_request(uint16_t req_id, protocol_status status, uint32_t app_status = 0) {
+            fastcgi::end_request body{};
+            body.app_status(app_status);
+            body.protocol_status(status);
+            out.record(record_type::end_request, req_id, body);
+        }
+
+        void respond(request_manager_type& req) {
+            uint32_t app_status = 0;
+            req.output(out);
+            try {
+                if constexpr (stl::is_void_v<stl::invoke_result_t<responder_type&, request_manager_type&>>) {
+                    stl::invoke(responder, req);
+                } else {
+                    app_status = static_cast<uint32_t>(stl::invoke(responder, req));
+                }
+            } catch (stl::exception const& err) {
+                this->logger.error(logger_category, "The responder failed.", err);
+                app_status = 1;
+            }
+            out.end_stream(record_type::std_out, req.request_id());
+            end_request(req.request_id(), protocol_status::request_complete, app_status);
+            if (!req.keep_connection()) {
+                close_after = true;
+            }
+            req.end();
+        }
+
+        void begin(uint16_t req_id, string_view_type content) {
+            if (content.size() < sizeof(begin_request) || find_request(req_id) != nullptr) {
+                return; // malformed, or the request is already started
+            }
+            begin_request body{};
+            stl::memcpy(&body, content.data(), sizeof(body));
+            if (body.role() != role::responder) {
+                end_request(req_id, protocol_status::unknown_role);
+                return;
+            }
+            for (auto& req : requests) {
+                if (!req.is_active()) {
+                    req.begin(req_id, body);
+                    return;
+                }
+            }
+            if (requests.size() == max_requests) {
+                end_request(req_id, protocol_status::overloaded);
+                return;
+            }
+            requests.emplace_back(static_cast<etraits const&>(*this)).begin(req_id, body);
+        }
+
+        void get_values(string_view_type content) {
+            string_type result{alloc::general_alloc_for<string_type>(*this)};
+            char const*       pos = content.data();
+            char const* const end = pos + content.size();
+            stl::string_view  name;
+            stl::string_view  value;
+            while (fcgi_manager::process_header_params(pos, end, name, value)) {
+                stl::size_t number = 0;
+                if (name == max_conns_name) {
+                    number = max_connections();
+                } else if (name == max_reqs_name) {
+                    number = max_requests;
+                } else if (name == mpxs_conns_name) {
+                    number = max_requests > 1 ? 1 : 0;
+                } else {
+                    continue; // we don't know it, the spec says to ignore it
+                }
+                stl::array<char, 20> digits{};
+                auto const res = stl::to_chars(digits.data(), digits.data() + digits.size(), number);
+                append_name_value(result, name, {digits.data(), res.ptr});
+            }
+            out.record(record_type::get_values_result, 0, result.data(), result.size());
+        }
+
+        void handle_record(header const& hdr, string_view_type content) {
+            if (hdr.is_management_record()) {
+                if (hdr.type == record_type::get_values) {
+                    get_values(content);
+                } else {
+                    unknown_type const body{.type = hdr.type, .reserved = {}};
+                    out.record(record_type::unknown_type, 0, body);
+                }
+                return;
+            }
+
+            auto const req_id = hdr.request_id();
+            if (hdr.type == record_type::begin_request) {
+                begin(req_id, content);
+                return;
+            }
+
+            auto* req = find_request(req_id);
+            if (req == nullptr) {
+                return; // the spec says to ignore the records of inactive requests
+            }
+            switch (hdr.type) {
+                case record_type::abort_request:
+                    end_request(req_id, protocol_status::request_complete);
+                    if (!req->keep_connection()) {
+                        close_after = true;
+                    }
+                    req->end();
+                    return;
+                case record_type::params:
+                    if (!req->append_params(content)) [[unlikely]] {
+                        this->logger.warning(logger_category, "Malformed FastCGI params.");
+                        req->output(out);
+                        req->write_error("Malformed FastCGI params.");
+                        end_request(req_id, protocol_status::request_complete, 1);
+                        req->end();
+                        return;
+                    }
+                    break;
+                case record_type::std_in: req->append_stdin(content); break;
+                default: return; // DATA is only for the filter role
+            }
+            if (req->is_ready()) {
+                respond(*req);
+            }
+        }
+
+      public:
+        explicit fcgi_session_manager(etraits const& et)
+          : etraits{et},
+            out{*this},
+            requests{alloc::general_alloc_for<request_managers_type>(*this)} {
+            requests.reserve(max_requests);
+        }
+
+        fcgi_session_manager(fcgi_session_manager const&)            = delete;
+        fcgi_session_manager(fcgi_session_manager&&)                 = delete;
+        fcgi_session_manager& operator=(fcgi_session_manager const&) = delete;
+        fcgi_session_manager& operator=(fcgi_session_manager&&)      = delete;
+        ~fcgi_session_manager()                                      = default;
+
+        // the connection reads into this
+        [[nodiscard]] stl::span<char>& buffer() noexcept {
+            return space;
+        }
+
+        /**
+         * Handle the records that are received so far.
+         * Returns true if there's nothing to be sent yet, and more input is needed.
+         */
+        [[nodiscard]] bool read(stl::size_t bytes) {
+            out.clear(); // the previous output is sent already
+            filled += bytes;
+
+            char const*       pos = buf.data();
+            char const* const end = pos + filled;
+            while (static_cast<stl::size_t>(end - pos) >= header_size) {
+                header hdr{record_type::unknown_type, 0, 0, 0};
+                stl::memcpy(&hdr, pos, sizeof(hdr));
+                auto const record_size = header_size + hdr.content_length() + hdr.padding_length;
+                if (static_cast<stl::size_t>(end - pos) < record_size) {
+                    break; // the rest of the record is not received yet
+                }
+                if (hdr.version != 1) [[unlikely]] {
+                    this->logger.warning(logger_category, "Unknown FastCGI protocol version.");
+                    close_after = true;
+                    break;
+                }
+                handle_record(hdr, string_view_type{pos + header_size, hdr.content_length()});
+                pos += record_size;
+            }
+
+            // the params of the requests that are not responded yet are still in the buffer
+            for (auto& req : requests) {
+                if (req.is_active()) {
+                    req.keep_params();
+                }
+            }
+
+            // keep the partially received record at the beginning of the buffer
+            filled = static_cast<stl::size_t>(end - pos);
+            stl::memmove(buf.data(), pos, filled);
+            space = stl::span<char>{buf}.subspan(filled);
+            return out.empty() && !close_after;
+        }
+
+        /**
+         * The records that should be sent, as a list of buffers; they're valid until the next read.
+         */
+        [[nodiscard]] stl::span<iovec> output_buffers() {
+            return out.buffers();
+        }
+
+        [[nodiscard]] bool keep_connection() const noexcept {
+            return !close_after;
+        }
+
+        // no request is being received, nor a part of a record; the connection can be closed when it's
+        // drained
+        [[nodiscard]] bool is_idle() const noexcept {
+            return filled == 0 && stl::none_of(requests.begin(), requests.end(), [](auto const& req) {
+                       return req.is_active();
+                   });
+        }
+
+        // the address of the web server's users are in the params (REMOTE_ADDR)
+        [[nodiscard]] string_view_type remote_addr() const noexcept {
+            return {};
+        }
+
+        void done() noexcept {}
+    };
 
 } // namespace webpp::http::fastcgi
 
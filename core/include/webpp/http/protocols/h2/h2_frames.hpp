@@ -0,0 +1,163 @@
+#ifndef WEBPP_H2_FRAMES_HPP
+#define WEBPP_H2_FRAMES_HPP
+
+#include "../../../std/string.hpp"
+#include "../../../std/string_view.hpp"
+
+#include <cstdint>
+
+/**
+ * The framing layer of HTTP/2 (RFC 9113, section 4 and 6)
+ */
+namespace webpp::http::h2 {
+
+    enum struct frame_type : stl::uint8_t {
+        data          = 0x0,
+        headers       = 0x1,
+        priority      = 0x2,
+        rst_stream    = 0x3,
+        settings      = 0x4,
+        push_promise  = 0x5,
+        ping          = 0x6,
+        goaway        = 0x7,
+        window_update = 0x8,
+        continuation  = 0x9
+    };
+
+    enum struct error_code : stl::uint32_t {
+        no_error            = 0x0,
+        protocol_error      = 0x1,
+        internal_error      = 0x2,
+        flow_control_error  = 0x3,
+        settings_timeout    = 0x4,
+        stream_closed       = 0x5,
+        frame_size_error    = 0x6,
+        refused_stream      = 0x7,
+        cancel              = 0x8,
+        compression_error   = 0x9,
+        connect_error       = 0xa,
+        enhance_your_calm   = 0xb,
+        inadequate_security = 0xc,
+        http_1_1_required   = 0xd
+    };
+
+    enum struct setting : stl::uint16_t {
+        header_table_size      = 0x1,
+        enable_push            = 0x2,
+        max_concurrent_streams = 0x3,
+        initial_window_size    = 0x4,
+        max_frame_size         = 0x5,
+        max_header_list_size   = 0x6
+    };
+
+    namespace flag {
+        static constexpr stl::uint8_t end_stream  = 0x1;
+        static constexpr stl::uint8_t ack         = 0x1;
+        static constexpr stl::uint8_t end_headers = 0x4;
+        static constexpr stl::uint8_t padded      = 0x8;
+        static constexpr stl::uint8_t priority    = 0x20;
+    } // namespace flag
+
+    static constexpr stl::size_t      frame_header_size   = 9;
+    static constexpr stl::size_t      setting_size        = 6;
+    static constexpr stl::size_t      priority_size       = 5; // stream dependency + weight
+    static constexpr stl::uint32_t    default_window_size = 65'535;
+    static constexpr stl::uint32_t    max_window_size     = 0x7FFF'FFFF;
+    static constexpr stl::uint32_t    default_frame_size  = 16'384;
+    static constexpr stl::uint32_t    max_frame_size      = 0xFF'FFFF;
+    static constexpr stl::uint32_t    stream_id_mask      = 0x7FFF'FFFF;
+    static constexpr stl::string_view connection_preface  = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    namespace details {
+        [[nodiscard]] constexpr stl::uint32_t read_uint(stl::string_view data, stl::size_t size) noexcept {
+            stl::uint32_t value = 0;
+            for (stl::size_t index = 0; index != size; ++index) {
+                value = (value << 8U) | static_cast<stl::uint8_t>(data[index]);
+            }
+            return value;
+        }
+
+        template <istl::String StrT>
+        constexpr void append_uint(StrT& out, stl::uint32_t value, stl::size_t size) {
+            while (size-- != 0) {
+                out.push_back(static_cast<char>((value >> (size * 8)) & 0xFFU));
+            }
+        }
+    } // namespace details
+
+    // the 31-bit number at the start of the data (the reserved bit is ignored)
+    [[nodiscard]] constexpr stl::uint32_t read_uint31(stl::string_view data) noexcept {
+        return details::read_uint(data, 4) & stream_id_mask;
+    }
+
+    [[nodiscard]] constexpr stl::uint32_t read_uint32(stl::string_view data) noexcept {
+        return details::read_uint(data, 4);
+    }
+
+    [[nodiscard]] constexpr stl::uint16_t read_uint16(stl::string_view data) noexcept {
+        return static_cast<stl::uint16_t>(details::read_uint(data, 2));
+    }
+
+    /**
+     * The 9 bytes at the start of every frame:
+     *   length (24) | type (8) | flags (8) | reserved (1) | stream identifier (31)
+     */
+    struct frame_header {
+        stl::uint32_t length    = 0;
+        frame_type    type      = frame_type::data;
+        stl::uint8_t  flags     = 0;
+        stl::uint32_t stream_id = 0;
+
+        // the data should have at least frame_header_size bytes
+        [[nodiscard]] static constexpr frame_header parse(stl::string_view data) noexcept {
+            return {.length    = details::read_uint(data, 3),
+                    .type      = static_cast<frame_type>(data[3]),
+                    .flags     = static_cast<stl::uint8_t>(data[4]),
+                    .stream_id = read_uint31(data.substr(5))};
+        }
+
+        [[nodiscard]] constexpr bool has(stl::uint8_t mask) const noexcept {
+            return (flags & mask) != 0;
+        }
+    };
+
+    template <istl::String StrT>
+    constexpr void append_frame_header(StrT&         out,
+                                       stl::size_t   length,
+                                       frame_type    type,
+                                       stl::uint8_t  frame_flags,
+                                       stl::uint32_t stream_id) {
+        details::append_uint(out, static_cast<stl::uint32_t>(length), 3);
+        out.push_back(static_cast<char>(type));
+        out.push_back(static_cast<char>(frame_flags));
+        details::append_uint(out, stream_id & stream_id_mask, 4);
+    }
+
+    template <istl::String StrT>
+    constexpr void append_setting(StrT& out, setting identifier, stl::uint32_t value) {
+        details::append_uint(out, static_cast<stl::uint16_t>(identifier), 2);
+        details::append_uint(out, value, 4);
+    }
+
+    template <istl::String StrT>
+    constexpr void append_window_update(StrT& out, stl::uint32_t stream_id, stl::uint32_t increment) {
+        append_frame_header(out, 4, frame_type::window_update, 0, stream_id);
+        details::append_uint(out, increment, 4);
+    }
+
+    template <istl::String StrT>
+    constexpr void append_rst_stream(StrT& out, stl::uint32_t stream_id, error_code code) {
+        append_frame_header(out, 4, frame_type::rst_stream, 0, stream_id);
+        details::append_uint(out, static_cast<stl::uint32_t>(code), 4);
+    }
+
+    template <istl::String StrT>
+    constexpr void append_goaway(StrT& out, stl::uint32_t last_stream_id, error_code code) {
+        append_frame_header(out, 8, frame_type::goaway, 0, 0);
+        details::append_uint(out, last_stream_id & stream_id_mask, 4);
+        details::append_uint(out, static_cast<stl::uint32_t>(code), 4);
+    }
+
+} // namespace webpp::http::h2
+
+#endif // WEBPP_H2_FRAMES_HPP
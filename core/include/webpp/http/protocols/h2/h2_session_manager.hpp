@@ -0,0 +1,841 @@
+#ifndef WEBPP_H2_SESSION_MANAGER_HPP
+#define WEBPP_H2_SESSION_MANAGER_HPP
+
+#include "../../../configs/constants.hpp"
+#include "../../../crypto/base64_url.hpp"
+#include "../../../server/usage.hpp"
+#include "../../../std/functional.hpp"
+#include "../../../std/span.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../../std/vector.hpp"
+#include "../../../strings/iequals.hpp"
+#include "../../../traits/enable_traits.hpp"
+#include "../../../traits/traits.hpp"
+#include "../../status_code.hpp"
+#include "../../syntax/request_parser.hpp"
+#include "../../syntax/response_serializer.hpp"
+#include "../shosted/limits.hpp"
+#include "h2_frames.hpp"
+#include "h2_stream.hpp"
+#include "hpack.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace webpp::http::h2 {
+
+    /**
+     * The session of an HTTP/2 connection without TLS (h2c); it's created once for each connection.
+     *
+     * The connection starts with either:
+     *   - the connection preface of HTTP/2 ("prior knowledge", RFC 9113 section 3.3), or
+     *   - an HTTP/1.1 request with "Upgrade: h2c" (RFC 7540 section 3.2); it's answered with
+     *     "101 Switching Protocols", and it becomes the stream 1 of the connection.
+     * The other HTTP/1.x requests are answered with "426 Upgrade Required".
+     *
+     * The frames are received into a fixed buffer, and handled as soon as they're complete. Each request is
+     * given to the responder as soon as its stream is ended by the client, so the streams don't wait for
+     * each other; and the DATA frames of the responses are interleaved (one frame from each stream in
+     * turn) as far as the flow-control windows let them, so a large response doesn't hold up the
+     * responses of the other streams of the connection.
+     *
+     *   responder(stream) -> void; it reads the request and writes the response (see h2_stream)
+     *
+     * The header blocks of the requests are decoded with one HPACK decoder (the dynamic table of the
+     * connection); the responses are encoded without the dynamic table, with the static table for the
+     * common status codes and field names.
+     *
+     * This type implements the session API of the posix servers: buffer, read, output, and
+     * keep_connection.
+     */
+    template <Traits TraitsType, typename ResponderType, shosted::limits_type Limits = shosted::limits_type{}>
+    struct h2_session_manager : public enable_traits<TraitsType> {
+        static constexpr auto logger_category = "H2/Session";
+        static constexpr auto limits          = Limits;
+
+        // a whole frame of the largest size that we allow (we don't change SETTINGS_MAX_FRAME_SIZE)
+        static constexpr stl::size_t buffer_size =
+          stl::max<stl::size_t>(default_buffer_size, frame_header_size + default_frame_size);
+
+        static constexpr stl::uint32_t max_concurrent_streams = 100;
+        static constexpr stl::size_t   max_header_block_size  = 64 * 1024;
+
+        using traits_type      = TraitsType;
+        using etraits          = enable_traits<traits_type>;
+        using responder_type   = ResponderType;
+        using string_view_type = traits::string_view<traits_type>;
+        using string_type      = traits::general_string<traits_type>;
+        using char_type        = istl::char_type_of<string_view_type>;
+        using buffer_type      = stl::array<char_type, buffer_size>;
+        using stream_type      = h2_stream<traits_type>;
+        using stream_allocator = traits::general_allocator<traits_type, stream_type>;
+        using streams_type     = stl::vector<stream_type, stream_allocator>;
+        using decoder_type     = hpack_decoder<traits_type>;
+        using parser_type      = http_request_parser<traits_type>;
+
+      private:
+        enum struct phase_type : stl::uint8_t {
+            detect,  // we don't know if it's HTTP/2 or HTTP/1.x yet
+            http1,   // an HTTP/1.x request (hopefully an upgrade)
+            preface, // the request is upgraded; the client should send the preface now
+            frames,  // HTTP/2 frames
+            closed   // GOAWAY is sent (or the connection is failed), the rest of the input is ignored
+        };
+
+        [[no_unique_address]] responder_type responder{};
+
+        buffer_type     buf{};
+        stl::size_t     filled = 0; // the bytes of the buffer that are received
+        stl::span<char> space{buf}; // the part of the buffer that's not filled yet
+        phase_type      phase = phase_type::detect;
+
+        decoder_type  decoder;
+        streams_type  streams;
+        string_type   header_block;          // the fragments of the header block that's being received
+        stl::uint32_t header_stream_id  = 0; // the stream of the header block, if CONTINUATION is expected
+        bool          header_end_stream = false;
+
+        stl::uint32_t last_stream_id  = 0; // the largest stream id that the client has used
+        stl::uint32_t active_streams  = 0;
+        bool          settings_seen   = false;
+        bool          peer_going_away = false;
+
+        // the settings of the client
+        stl::int64_t  initial_window = default_window_size;
+        stl::uint32_t peer_max_frame = default_frame_size;
+
+        stl::int64_t send_window     = default_window_size; // the connection's window
+        stl::size_t  received_unacked = 0; // the DATA bytes that the connection's window is not updated for
+
+        string_type block;               // the header block of the response that's being sent
+        string_type out;                 // the frames that should be sent
+        bool        close_after = false; // close the connection after the output is sent
+
+        ///////////////////////////// Errors /////////////////////////////
+
+        // the connection can't continue (RFC 9113, section 5.4.1)
+        void connection_error(error_code code, string_view_type message) {
+            this->logger.warning(logger_category, message);
+            if (phase == phase_type::closed) {
+                return;
+            }
+            append_goaway(out, last_stream_id, code);
+            phase       = phase_type::closed;
+            close_after = true;
+        }
+
+        // only the stream can't continue (RFC 9113, section 5.4.2)
+        void stream_error(stl::uint32_t stream_id, error_code code) {
+            append_rst_stream(out, stream_id, code);
+            if (auto* strm = find_stream(stream_id)) {
+                close_stream(*strm);
+            }
+        }
+
+        ///////////////////////////// Streams /////////////////////////////
+
+        [[nodiscard]] stream_type* find_stream(stl::uint32_t stream_id) noexcept {
+            for (auto& strm : streams) {
+                if (strm.id == stream_id) {
+                    return &strm;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * The objects of the closed streams are reused. The streams may be moved when a new one is opened,
+         * which is fine, the views of a request are only used while it's being responded.
+         */
+        [[nodiscard]] stream_type& open_stream(stl::uint32_t stream_id) {
+            auto it = stl::find_if(streams.begin(), streams.end(), [](stream_type const& strm) {
+                return strm.state == stream_state::idle;
+            });
+            if (it == streams.end()) {
+                it = streams.emplace(streams.end(), *this);
+            }
+            it->open(stream_id, initial_window);
+            ++active_streams;
+            return *it;
+        }
+
+        void close_stream(stream_type& strm) noexcept {
+            strm.close();
+            --active_streams;
+            if (peer_going_away && active_streams == 0) {
+                close_after = true;
+            }
+        }
+
+        ///////////////////////////// The Responses /////////////////////////////
+
+        // the frames of a header block; it's split into CONTINUATION frames if it's larger than a frame
+        void append_header_block(stl::uint32_t stream_id, string_view_type data, bool end_stream) {
+            auto         type       = frame_type::headers;
+            stl::uint8_t frame_flag = end_stream ? flag::end_stream : 0; // only on the HEADERS frame
+            do {
+                auto const size = stl::min<stl::size_t>(data.size(), peer_max_frame);
+                if (size == data.size()) {
+                    frame_flag |= flag::end_headers;
+                }
+                append_frame_header(out, size, type, frame_flag, stream_id);
+                out.append(data.data(), size);
+                data.remove_prefix(size);
+                type       = frame_type::continuation;
+                frame_flag = 0;
+            } while (!data.empty());
+        }
+
+        /**
+         * The request of the stream is complete; get the response from the responder, and send its
+         * HEADERS; the body is sent by send_data as the flow-control windows let it.
+         */
+        void respond(stream_type& strm) {
+            strm.state = stream_state::half_closed_remote;
+            if (strm.target().size() > limits.uri) {
+                strm.clear_response(http::status_code::uri_too_long);
+            } else if (strm.method() == "GET" && strm.body_size() > limits.body.get_method) {
+                strm.clear_response(http::status_code::payload_too_large);
+            } else if (limits.load.shed && host::is_busy(limits.load.usage)) [[unlikely]] {
+                strm.clear_response(http::status_code::service_unavailable);
+            } else {
+                host::requests_started();
+                try {
+                    stl::invoke(responder, strm);
+                } catch (stl::exception const& err) {
+                    this->logger.error(logger_category, "The responder failed.", err);
+                    strm.clear_response(http::status_code::internal_server_error);
+                }
+                host::requests_finished();
+            }
+            send_headers(strm);
+        }
+
+        void send_headers(stream_type& strm) {
+            auto const code      = static_cast<status_code_type>(strm.status());
+            bool const has_body  = http::details::can_have_body(code);
+            bool const send_body = has_body && strm.method() != "HEAD" && !strm.response_data().empty();
+
+            block.clear();
+            hpack_append_status(block, code);
+            block.append(strm.encoded_response_fields());
+            if (has_body) {
+                stl::array<char, http::details::max_number_size> digits{};
+                auto const res = stl::to_chars(digits.data(), digits.data() + digits.size(),
+                                               strm.response_data().size());
+                hpack_append_field(block, "content-length",
+                                   {digits.data(), static_cast<stl::size_t>(res.ptr - digits.data())});
+            }
+            append_header_block(strm.id, block, !send_body);
+            strm.responded = true;
+            if (!send_body) {
+                finish_response(strm);
+            }
+        }
+
+        // the last frame of the response is sent
+        void finish_response(stream_type& strm) {
+            strm.end_sent = true;
+            if (strm.state == stream_state::open) {
+                // we're not reading the rest of the request (RFC 9113, section 8.1)
+                append_rst_stream(out, strm.id, error_code::no_error);
+            }
+            close_stream(strm);
+        }
+
+        /**
+         * Send the DATA frames of the responses, one frame of each stream in turn, as far as the
+         * flow-control windows of the connection and the streams let us.
+         */
+        void send_data() {
+            bool progress = true;
+            while (progress && send_window > 0) {
+                progress = false;
+                for (auto& strm : streams) {
+                    if (strm.state == stream_state::idle || !strm.responded || strm.end_sent) {
+                        continue;
+                    }
+                    auto const window = stl::min(send_window, strm.send_window);
+                    if (window <= 0) {
+                        continue;
+                    }
+                    auto const data = strm.response_data().substr(strm.sent);
+                    auto const size =
+                      static_cast<stl::size_t>(stl::min({static_cast<stl::int64_t>(data.size()),
+                                                         static_cast<stl::int64_t>(peer_max_frame),
+                                                         window}));
+                    bool const last = size == data.size();
+                    append_frame_header(out, size, frame_type::data, last ? flag::end_stream : 0, strm.id);
+                    out.append(data.data(), size);
+                    strm.sent += size;
+                    strm.send_window -= static_cast<stl::int64_t>(size);
+                    send_window -= static_cast<stl::int64_t>(size);
+                    progress = true;
+                    if (last) {
+                        finish_response(strm);
+                    }
+                }
+            }
+        }
+
+        ///////////////////////////// The Frames /////////////////////////////
+
+        [[nodiscard]] bool apply_settings(string_view_type payload) {
+            for (; payload.size() >= setting_size; payload.remove_prefix(setting_size)) {
+                auto const value = read_uint32(payload.substr(2));
+                switch (static_cast<setting>(read_uint16(payload))) {
+                    case setting::enable_push:
+                        if (value > 1) {
+                            connection_error(error_code::protocol_error, "Invalid SETTINGS_ENABLE_PUSH.");
+                            return false;
+                        }
+                        break;
+                    case setting::initial_window_size: {
+                        if (value > max_window_size) {
+                            connection_error(error_code::flow_control_error, "Invalid initial window size.");
+                            return false;
+                        }
+                        // the windows of the open streams are changed by the difference (section 6.9.2)
+                        auto const delta = static_cast<stl::int64_t>(value) - initial_window;
+                        for (auto& strm : streams) {
+                            if (strm.state != stream_state::idle) {
+                                strm.send_window += delta;
+                                if (strm.send_window > max_window_size) {
+                                    connection_error(error_code::flow_control_error, "Window overflow.");
+                                    return false;
+                                }
+                            }
+                        }
+                        initial_window = value;
+                        break;
+                    }
+                    case setting::max_frame_size:
+                        if (value < default_frame_size || value > max_frame_size) {
+                            connection_error(error_code::protocol_error, "Invalid SETTINGS_MAX_FRAME_SIZE.");
+                            return false;
+                        }
+                        peer_max_frame = value;
+                        break;
+                    default: break; // we don't push, and we don't use the dynamic table of the client
+                }
+            }
+            return true;
+        }
+
+        void on_settings(frame_header const& frame, string_view_type payload) {
+            if (frame.stream_id != 0) {
+                connection_error(error_code::protocol_error, "SETTINGS frame on a stream.");
+                return;
+            }
+            if (frame.has(flag::ack)) {
+                if (frame.length != 0) {
+                    connection_error(error_code::frame_size_error, "SETTINGS ACK with a payload.");
+                }
+                return;
+            }
+            if (frame.length % setting_size != 0) {
+                connection_error(error_code::frame_size_error, "Invalid SETTINGS frame size.");
+                return;
+            }
+            if (apply_settings(payload)) {
+                append_frame_header(out, 0, frame_type::settings, flag::ack, 0);
+            }
+        }
+
+        void on_window_update(frame_header const& frame, string_view_type payload) {
+            if (frame.length != 4) {
+                connection_error(error_code::frame_size_error, "Invalid WINDOW_UPDATE frame size.");
+                return;
+            }
+            auto const increment = read_uint31(payload);
+            if (frame.stream_id == 0) {
+                if (increment == 0) {
+                    connection_error(error_code::protocol_error, "Zero WINDOW_UPDATE.");
+                    return;
+                }
+                send_window += increment;
+                if (send_window > max_window_size) {
+                    connection_error(error_code::flow_control_error, "Window overflow.");
+                }
+                return;
+            }
+            if (frame.stream_id > last_stream_id) {
+                connection_error(error_code::protocol_error, "WINDOW_UPDATE on an idle stream.");
+                return;
+            }
+            auto* strm = find_stream(frame.stream_id);
+            if (strm == nullptr) {
+                return; // the stream is closed already
+            }
+            if (increment == 0) {
+                stream_error(frame.stream_id, error_code::protocol_error);
+                return;
+            }
+            strm->send_window += increment;
+            if (strm->send_window > max_window_size) {
+                stream_error(frame.stream_id, error_code::flow_control_error);
+            }
+        }
+
+        void on_rst_stream(frame_header const& frame) {
+            if (frame.length != 4) {
+                connection_error(error_code::frame_size_error, "Invalid RST_STREAM frame size.");
+                return;
+            }
+            if (frame.stream_id == 0 || frame.stream_id > last_stream_id) {
+                connection_error(error_code::protocol_error, "RST_STREAM on an idle stream.");
+                return;
+            }
+            if (auto* strm = find_stream(frame.stream_id)) {
+                close_stream(*strm);
+            }
+        }
+
+        void on_ping(frame_header const& frame, string_view_type payload) {
+            if (frame.stream_id != 0) {
+                connection_error(error_code::protocol_error, "PING frame on a stream.");
+                return;
+            }
+            if (frame.length != 8) {
+                connection_error(error_code::frame_size_error, "Invalid PING frame size.");
+                return;
+            }
+            if (!frame.has(flag::ack)) {
+                append_frame_header(out, 8, frame_type::ping, flag::ack, 0);
+                out.append(payload.data(), payload.size());
+            }
+        }
+
+        void on_goaway(frame_header const& frame) {
+            if (frame.stream_id != 0) {
+                connection_error(error_code::protocol_error, "GOAWAY frame on a stream.");
+                return;
+            }
+            // we don't start streams, so there's nothing to retry; the started streams are finished first
+            peer_going_away = true;
+            if (active_streams == 0) {
+                close_after = true;
+            }
+        }
+
+        // remove the padding of a DATA or HEADERS frame; returns false if it's malformed
+        [[nodiscard]] bool remove_padding(frame_header const& frame, string_view_type& payload) {
+            if (!frame.has(flag::padded)) {
+                return true;
+            }
+            if (payload.empty()) {
+                connection_error(error_code::frame_size_error, "Padded frame without the padding length.");
+                return false;
+            }
+            auto const padding = static_cast<stl::uint8_t>(payload.front());
+            if (padding >= payload.size()) {
+                connection_error(error_code::protocol_error, "The padding is larger than the payload.");
+                return false;
+            }
+            payload = payload.substr(1, payload.size() - 1 - padding);
+            return true;
+        }
+
+        void on_data(frame_header const& frame, string_view_type payload) {
+            if (frame.stream_id == 0 || frame.stream_id > last_stream_id) {
+                connection_error(error_code::protocol_error, "DATA frame on an idle stream.");
+                return;
+            }
+            // the whole frame (with its padding) counts against the windows, and it's received already
+            received_unacked += frame.length;
+            if (received_unacked > default_window_size) {
+                connection_error(error_code::flow_control_error, "The connection's window is exceeded.");
+                return;
+            }
+            if (!remove_padding(frame, payload)) {
+                return;
+            }
+            auto* strm = find_stream(frame.stream_id);
+            if (strm == nullptr || strm->state != stream_state::open) {
+                if (strm != nullptr) {
+                    stream_error(frame.stream_id, error_code::stream_closed);
+                }
+                return; // the stream is reset or responded already; it's ignored (section 5.4.2)
+            }
+            if (strm->responded) {
+                return; // it's responded early (the body was too large); the rest of the body is dropped
+            }
+            if (strm->body_size() + payload.size() > limits.body.post_method) {
+                strm->clear_response(http::status_code::payload_too_large);
+                send_headers(*strm);
+                return;
+            }
+            strm->append_body(payload);
+            if (frame.has(flag::end_stream)) {
+                respond(*strm);
+            } else if (frame.length != 0) {
+                // the body is collected in memory, and the limit is checked above
+                append_window_update(out, frame.stream_id, frame.length);
+            }
+        }
+
+        void on_headers(frame_header const& frame, string_view_type payload) {
+            if (frame.stream_id == 0 || (frame.stream_id & 1U) == 0) {
+                connection_error(error_code::protocol_error, "HEADERS frame on an invalid stream.");
+                return;
+            }
+            if (!remove_padding(frame, payload)) {
+                return;
+            }
+            if (frame.has(flag::priority)) {
+                if (payload.size() < priority_size) {
+                    connection_error(error_code::frame_size_error, "Invalid HEADERS frame size.");
+                    return;
+                }
+                payload.remove_prefix(priority_size); // the priorities are deprecated, they're ignored
+            }
+            header_block.assign(payload.data(), payload.size());
+            header_stream_id  = frame.stream_id;
+            header_end_stream = frame.has(flag::end_stream);
+            if (frame.has(flag::end_headers)) {
+                on_header_block();
+            }
+        }
+
+        void on_continuation(frame_header const& frame, string_view_type payload) {
+            if (frame.stream_id != header_stream_id) {
+                connection_error(error_code::protocol_error, "Unexpected CONTINUATION frame.");
+                return;
+            }
+            if (header_block.size() + payload.size() > max_header_block_size) {
+                connection_error(error_code::enhance_your_calm, "The header block is too large.");
+                return;
+            }
+            header_block.append(payload.data(), payload.size());
+            if (frame.has(flag::end_headers)) {
+                on_header_block();
+            }
+        }
+
+        // a whole header block is received
+        void on_header_block() {
+            auto const stream_id = stl::exchange(header_stream_id, 0U);
+            auto*      strm      = find_stream(stream_id);
+
+            if (strm != nullptr || stream_id <= last_stream_id) {
+                // trailers; they're decoded to keep the dynamic table in sync, but they're ignored
+                bool const decoded = decoder.decode(header_block, [](auto, auto) {});
+                if (!decoded) {
+                    connection_error(error_code::compression_error, "Invalid header block.");
+                } else if (strm == nullptr) {
+                    connection_error(error_code::stream_closed, "HEADERS frame on a closed stream.");
+                } else if (strm->state != stream_state::open || !header_end_stream) {
+                    stream_error(stream_id, error_code::protocol_error);
+                } else if (!strm->responded) {
+                    respond(*strm);
+                }
+                return;
+            }
+
+            last_stream_id = stream_id;
+            if (active_streams >= max_concurrent_streams || peer_going_away) {
+                if (!decoder.decode(header_block, [](auto, auto) {})) {
+                    connection_error(error_code::compression_error, "Invalid header block.");
+                    return;
+                }
+                append_rst_stream(out, stream_id, error_code::refused_stream);
+                return;
+            }
+
+            auto& new_stream = open_stream(stream_id);
+            bool  malformed  = false;
+            if (!decoder.decode(header_block, [&](string_view_type name, string_view_type value) {
+                    malformed = malformed || !new_stream.add_field(name, value);
+                })) {
+                connection_error(error_code::compression_error, "Invalid header block.");
+                return;
+            }
+            if (malformed || !new_stream.finish_headers()) {
+                stream_error(stream_id, error_code::protocol_error);
+                return;
+            }
+            if (header_end_stream) {
+                respond(new_stream);
+            }
+        }
+
+        void on_frame(frame_header const& frame, string_view_type payload) {
+            if (header_stream_id != 0 && frame.type != frame_type::continuation) {
+                connection_error(error_code::protocol_error, "Expected a CONTINUATION frame.");
+                return;
+            }
+            if (!settings_seen) {
+                // the preface of the client ends with a SETTINGS frame
+                if (frame.type != frame_type::settings || frame.has(flag::ack)) {
+                    connection_error(error_code::protocol_error, "Expected the SETTINGS frame.");
+                    return;
+                }
+                settings_seen = true;
+            }
+            switch (frame.type) {
+                case frame_type::data: on_data(frame, payload); break;
+                case frame_type::headers: on_headers(frame, payload); break;
+                case frame_type::priority:
+                    if (frame.stream_id == 0) {
+                        connection_error(error_code::protocol_error, "PRIORITY frame on the connection.");
+                    } else if (frame.length != priority_size) {
+                        stream_error(frame.stream_id, error_code::frame_size_error);
+                    }
+                    break;
+                case frame_type::rst_stream: on_rst_stream(frame); break;
+                case frame_type::settings: on_settings(frame, payload); break;
+                case frame_type::push_promise:
+                    connection_error(error_code::protocol_error, "The clients can't push.");
+                    break;
+                case frame_type::ping: on_ping(frame, payload); break;
+                case frame_type::goaway: on_goaway(frame); break;
+                case frame_type::window_update: on_window_update(frame, payload); break;
+                case frame_type::continuation:
+                    connection_error(error_code::protocol_error, "Unexpected CONTINUATION frame.");
+                    break;
+                default: break; // the unknown frame types are ignored
+            }
+        }
+
+        // handle the complete frames in the buffer; returns the bytes that are handled
+        [[nodiscard]] stl::size_t parse_frames(stl::size_t pos) {
+            while (phase == phase_type::frames && filled - pos >= frame_header_size) {
+                string_view_type const input{buf.data() + pos, filled - pos};
+                auto const             frame = frame_header::parse(input);
+                if (frame.length > default_frame_size) {
+                    connection_error(error_code::frame_size_error, "The frame is too large.");
+                    break;
+                }
+                if (input.size() < frame_header_size + frame.length) {
+                    break;
+                }
+                on_frame(frame, input.substr(frame_header_size, frame.length));
+                pos += frame_header_size + frame.length;
+            }
+            return pos;
+        }
+
+        ///////////////////////////// The Connection Preface /////////////////////////////
+
+        void send_settings() {
+            append_frame_header(out, setting_size, frame_type::settings, 0, 0);
+            append_setting(out, setting::max_concurrent_streams, max_concurrent_streams);
+        }
+
+        // it's an HTTP/1.x request that we don't upgrade; the connection is closed after the response
+        void fail_http1(http::status_code status) {
+            response_head_options const options{.keep_alive = false};
+            auto const                  status_number = static_cast<status_code_type>(status);
+            append_status_line(out, status_number, options);
+            if (status == http::status_code::upgrade_required) {
+                out.append("Upgrade: h2c\r\nConnection: Upgrade\r\n");
+            }
+            append_framing_fields(out, status_number, options);
+            out.append("\r\n");
+            phase       = phase_type::closed;
+            close_after = true;
+        }
+
+        // is the token in the comma separated list (case-insensitive)
+        [[nodiscard]] static bool has_token(string_view_type list, string_view_type token) noexcept {
+            while (!list.empty()) {
+                auto const comma = stl::min(list.find(','), list.size());
+                auto       item  = list.substr(0, comma);
+                list.remove_prefix(stl::min(comma + 1, list.size()));
+                item.remove_prefix(stl::min(item.find_first_not_of(" \t"), item.size()));
+                item = item.substr(0, item.find_last_not_of(" \t") + 1);
+                if (ascii::iequals(item, token)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Upgrade the connection from an HTTP/1.1 request (RFC 7540, section 3.2); the request becomes the
+         * stream 1, which is half-closed already, and it's answered over HTTP/2.
+         */
+        [[nodiscard]] stl::size_t upgrade(parser_type const& parser) {
+            auto const connection = parser.header("Connection");
+            auto const settings   = parser.header("HTTP2-Settings");
+            if (!has_token(parser.header("Upgrade"), "h2c") || !has_token(connection, "Upgrade") ||
+                !has_token(connection, "HTTP2-Settings")) {
+                fail_http1(http::status_code::upgrade_required);
+                return 0;
+            }
+            string_type payload{alloc::general_alloc_for<string_type>(*this)};
+            if (!base64::url_decode<base64::url_decode_policy::ignore_padding>(settings, payload) ||
+                payload.size() % setting_size != 0) {
+                fail_http1(http::status_code::bad_request);
+                return 0;
+            }
+
+            out.append("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+            send_settings();
+            phase = phase_type::preface;
+            if (!apply_settings(payload)) {
+                return 0;
+            }
+
+            last_stream_id = 1;
+            auto& strm     = open_stream(1);
+            string_type name{alloc::general_alloc_for<string_type>(*this)};
+            bool        valid = strm.add_field(":method", parser.method_view) &&
+                         strm.add_field(":scheme", "http") &&
+                         strm.add_field(":path", parser.request_target_view);
+            if (auto const host = parser.header("Host"); !host.empty()) {
+                valid = valid && strm.add_field(":authority", host);
+            }
+            for (auto const& [field_name, value] : parser.headers()) {
+                if (is_connection_specific_field(field_name) || ascii::iequals(field_name, "host") ||
+                    ascii::iequals(field_name, "http2-settings")) {
+                    continue;
+                }
+                name.clear();
+                for (auto const chr : field_name) {
+                    name.push_back(static_cast<char>(ascii::to_lower_copy(chr)));
+                }
+                valid = valid && strm.add_field(name, value);
+            }
+            if (!valid || !strm.finish_headers()) {
+                stream_error(1, error_code::protocol_error);
+                return parser.consumed();
+            }
+            strm.append_body(parser.body());
+            respond(strm);
+            return parser.consumed();
+        }
+
+        // find out what the client speaks; returns the bytes that are handled
+        [[nodiscard]] stl::size_t parse_preface() {
+            string_view_type const input{buf.data(), filled};
+            auto const             size = stl::min(input.size(), connection_preface.size());
+            if (input.substr(0, size) != connection_preface.substr(0, size)) {
+                if (phase == phase_type::preface) {
+                    connection_error(error_code::protocol_error, "Invalid connection preface.");
+                } else {
+                    phase = phase_type::http1;
+                }
+                return 0;
+            }
+            if (size != connection_preface.size()) {
+                return 0; // wait for the rest of it
+            }
+            if (phase == phase_type::detect) {
+                send_settings();
+            }
+            phase = phase_type::frames;
+            return size;
+        }
+
+        [[nodiscard]] stl::size_t parse_http1() {
+            parser_type parser{*this};
+            parser.max_target_size = limits.uri;
+            parser.max_body_size   = limits.body.post_method;
+            if (auto const status = parser.parse({buf.data(), filled}); status != http::status_code::ok) {
+                fail_http1(status);
+                return 0;
+            }
+            if (!parser.is_done()) {
+                if (filled == buffer_size) {
+                    fail_http1(http::status_code::request_header_fields_too_large);
+                }
+                return 0;
+            }
+            return upgrade(parser);
+        }
+
+        // handle what's in the buffer, and move the rest of it to the start of the buffer
+        void parse() {
+            stl::size_t pos = 0;
+            if (phase == phase_type::detect || phase == phase_type::preface) {
+                pos = parse_preface();
+            }
+            if (phase == phase_type::http1) {
+                pos = parse_http1();
+                if (phase == phase_type::preface) {
+                    stl::memmove(buf.data(), buf.data() + pos, filled - pos);
+                    filled -= pos;
+                    pos = parse_preface();
+                }
+            }
+            pos = parse_frames(pos);
+            if (phase == phase_type::closed) {
+                filled = 0;
+                return;
+            }
+            filled -= pos;
+            stl::memmove(buf.data(), buf.data() + pos, filled);
+        }
+
+      public:
+        explicit h2_session_manager(etraits const& et)
+          : etraits{et},
+            decoder{*this},
+            streams{alloc::general_alloc_for<streams_type>(*this)},
+            header_block{alloc::general_alloc_for<string_type>(*this)},
+            block{alloc::general_alloc_for<string_type>(*this)},
+            out{alloc::general_alloc_for<string_type>(*this)} {}
+
+        h2_session_manager(h2_session_manager const&)            = delete;
+        h2_session_manager(h2_session_manager&&)                 = delete;
+        h2_session_manager& operator=(h2_session_manager const&) = delete;
+        h2_session_manager& operator=(h2_session_manager&&)      = delete;
+        ~h2_session_manager()                                    = default;
+
+        // the connection reads into this
+        [[nodiscard]] stl::span<char>& buffer() noexcept {
+            return space;
+        }
+
+        /**
+         * Read a batch of input, and handle the frames that are complete.
+         * Returns true if there's nothing to be sent yet, and more input is needed.
+         */
+        [[nodiscard]] bool read(stl::size_t bytes) {
+            out.clear(); // the previous output is sent already
+            filled += bytes;
+            parse();
+            if (phase != phase_type::closed) {
+                send_data();
+                // the connection's window is given back as soon as the frames are handled
+                if (received_unacked != 0) {
+                    append_window_update(out, 0, static_cast<stl::uint32_t>(received_unacked));
+                    received_unacked = 0;
+                }
+            }
+            space = stl::span<char>{buf}.subspan(filled);
+            return out.empty();
+        }
+
+        // the frames that should be sent; it's valid until the next read
+        [[nodiscard]] string_view_type output() const noexcept {
+            return out;
+        }
+
+        [[nodiscard]] bool keep_connection() const noexcept {
+            return !close_after;
+        }
+
+        // no stream is open, and no part of a frame is received; the connection can be closed when it's
+        // drained
+        [[nodiscard]] bool is_idle() const noexcept {
+            return filled == 0 && active_streams == 0 && header_stream_id == 0;
+        }
+
+        [[nodiscard]] string_view_type remote_addr() const noexcept {
+            return {};
+        }
+
+        void done() noexcept {}
+
+        // the number of the streams that are not closed yet
+        [[nodiscard]] stl::size_t stream_count() const noexcept {
+            return active_streams;
+        }
+    };
+
+} // namespace webpp::http::h2
+
+#endif // WEBPP_H2_SESSION_MANAGER_HPP
@@ -0,0 +1,312 @@
+#ifndef WEBPP_H2_STREAM_HPP
+#define WEBPP_H2_STREAM_HPP
+
+#include "../../../std/string.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../../std/vector.hpp"
+#include "../../../strings/iequals.hpp"
+#include "../../../traits/enable_traits.hpp"
+#include "../../../traits/traits.hpp"
+#include "../../status_code.hpp"
+#include "../../syntax/request_parser.hpp"
+#include "../../version.hpp"
+#include "h2_frames.hpp"
+#include "hpack.hpp"
+
+#include <cstdint>
+
+namespace webpp::http::h2 {
+
+    enum struct stream_state : stl::uint8_t {
+        idle,              // the object is not used by a stream
+        open,              // the request is being received
+        half_closed_remote // the request is received, the response is being sent
+    };
+
+    /**
+     * The fields that are specific to an HTTP/1.x connection, and can't be in an HTTP/2 message
+     * (RFC 9113, section 8.2.2); Content-Length is written by the session.
+     */
+    template <istl::StringView StrViewT>
+    [[nodiscard]] inline bool is_connection_specific_field(StrViewT name) noexcept {
+        using ascii::char_case_side::second_lowered;
+        switch (name.size()) {
+            case 7: return ascii::iequals<second_lowered>(name, "upgrade");
+            case 10:
+                return ascii::iequals<second_lowered>(name, "connection") ||
+                       ascii::iequals<second_lowered>(name, "keep-alive");
+            case 14: return ascii::iequals<second_lowered>(name, "content-length");
+            case 16: return ascii::iequals<second_lowered>(name, "proxy-connection");
+            case 17: return ascii::iequals<second_lowered>(name, "transfer-encoding");
+            default: return false;
+        }
+    }
+
+    /**
+     * One stream of an HTTP/2 connection: one request and its response.
+     *
+     * The session decodes the header block of the request into this (add_field, then finish_headers),
+     * and the fields are kept in one string; the method, the target, and the header views are views into
+     * it, the same views that http_request_parser gives, so the responders don't need to know which
+     * version of HTTP the request came with.
+     *
+     * The responder uses it the same way as the self-hosted session:
+     *   stream.method(), target(), version(), header(name), headers(), body()
+     *   stream.status(code), stream.response_header(name, value), stream.write(data)
+     *
+     * The header fields of the response are HPACK encoded as they're added. The objects of this type are
+     * reused for the next streams of the connection, so their buffers are allocated only once.
+     */
+    template <Traits TraitsType>
+    struct h2_stream {
+        using traits_type       = TraitsType;
+        using string_view_type  = traits::string_view<traits_type>;
+        using string_type       = traits::general_string<traits_type>;
+        using header_views_type = typename http_request_parser<traits_type>::header_views_type;
+        using header_view_type  = typename header_views_type::value_type;
+
+      private:
+        struct field_offsets {
+            stl::size_t name       = 0;
+            stl::size_t name_size  = 0;
+            stl::size_t value      = 0;
+            stl::size_t value_size = 0;
+        };
+
+        using offsets_allocator = traits::general_allocator<traits_type, field_offsets>;
+        using offsets_type      = stl::vector<field_offsets, offsets_allocator>;
+
+        // the request
+        string_type       fields;  // the names and the values of the header fields
+        offsets_type      offsets; // the fields in the order that they're received
+        header_views_type header_views;
+        string_view_type  method_view;
+        string_view_type  path_view;
+        string_view_type  scheme_view;
+        string_view_type  authority_view;
+        string_type       body_content;
+        bool              regular_seen = false; // the pseudo-header fields should be before the others
+
+        // the response
+        http::status_code code = http::status_code::ok;
+        string_type       response_fields; // HPACK encoded
+        string_type       response_body;
+
+        [[nodiscard]] string_view_type view_of(stl::size_t offset, stl::size_t size) const noexcept {
+            return {fields.data() + offset, size};
+        }
+
+        [[nodiscard]] static bool is_valid_name(string_view_type name) noexcept {
+            for (auto const chr : name) {
+                if (chr >= 'A' && chr <= 'Z') {
+                    return false; // the names should be lowercase in HTTP/2
+                }
+            }
+            return !name.empty();
+        }
+
+      public:
+        stl::uint32_t id    = 0;
+        stream_state  state = stream_state::idle;
+        stl::int64_t  send_window = default_window_size; // can be negative, after a SETTINGS frame
+        stl::size_t   sent        = 0;     // the bytes of the response body that are sent
+        bool          responded   = false; // the HEADERS of the response are sent
+        bool          end_sent    = false; // the last frame of the response is sent
+
+        template <EnabledTraits ET>
+        explicit h2_stream(ET& et)
+          : fields{alloc::general_alloc_for<string_type>(et)},
+            offsets{alloc::general_alloc_for<offsets_type>(et)},
+            header_views{alloc::general_alloc_for<header_views_type>(et)},
+            body_content{alloc::general_alloc_for<string_type>(et)},
+            response_fields{alloc::general_alloc_for<string_type>(et)},
+            response_body{alloc::general_alloc_for<string_type>(et)} {}
+
+        ///////////////////////////// The Session's Side /////////////////////////////
+
+        // start a new stream with this object
+        void open(stl::uint32_t stream_id, stl::int64_t initial_window) noexcept {
+            fields.clear();
+            offsets.clear();
+            header_views.clear();
+            method_view    = {};
+            path_view      = {};
+            scheme_view    = {};
+            authority_view = {};
+            body_content.clear();
+            regular_seen = false;
+            code         = http::status_code::ok;
+            response_fields.clear();
+            response_body.clear();
+            id          = stream_id;
+            state       = stream_state::open;
+            send_window = initial_window;
+            sent        = 0;
+            responded   = false;
+            end_sent    = false;
+        }
+
+        void close() noexcept {
+            id    = 0;
+            state = stream_state::idle;
+        }
+
+        /**
+         * Add a field of the header block of the request; returns false if the request is malformed
+         * (RFC 9113, section 8.1.1): the pseudo-header fields are only the known ones, and they come first
+         * and only once; the names are lowercase, and there are no connection-specific fields.
+         */
+        [[nodiscard]] bool add_field(string_view_type name, string_view_type value) {
+            if (!is_valid_name(name)) {
+                return false;
+            }
+            if (name.front() == ':') {
+                if (regular_seen) {
+                    return false;
+                }
+                for (auto const& offset : offsets) {
+                    if (view_of(offset.name, offset.name_size) == name) {
+                        return false;
+                    }
+                }
+                if (name != ":method" && name != ":path" && name != ":scheme" && name != ":authority") {
+                    return false;
+                }
+            } else {
+                if (is_connection_specific_field(name) && name != "content-length") {
+                    return false;
+                }
+                if (name == "te" && value != "trailers") {
+                    return false;
+                }
+                regular_seen = true;
+            }
+            offsets.push_back({.name       = fields.size(),
+                               .name_size  = name.size(),
+                               .value      = fields.size() + name.size(),
+                               .value_size = value.size()});
+            fields.append(name.data(), name.size());
+            fields.append(value.data(), value.size());
+            return true;
+        }
+
+        /**
+         * All the fields are added; the views are made now, since the fields string is not going to be
+         * reallocated anymore. Returns false if a required pseudo-header field is missing.
+         */
+        [[nodiscard]] bool finish_headers() {
+            header_views.reserve(offsets.size());
+            for (auto const& offset : offsets) {
+                auto const name  = view_of(offset.name, offset.name_size);
+                auto const value = view_of(offset.value, offset.value_size);
+                if (name == ":method") {
+                    method_view = value;
+                } else if (name == ":path") {
+                    path_view = value;
+                } else if (name == ":scheme") {
+                    scheme_view = value;
+                } else if (name == ":authority") {
+                    authority_view = value;
+                } else {
+                    header_views.emplace_back(header_view_type{name, value});
+                }
+            }
+            return !method_view.empty() && !scheme_view.empty() && !path_view.empty();
+        }
+
+        void append_body(string_view_type data) {
+            body_content.append(data.data(), data.size());
+        }
+
+        [[nodiscard]] stl::size_t body_size() const noexcept {
+            return body_content.size();
+        }
+
+        [[nodiscard]] http::status_code status() const noexcept {
+            return code;
+        }
+
+        [[nodiscard]] string_view_type encoded_response_fields() const noexcept {
+            return response_fields;
+        }
+
+        [[nodiscard]] string_view_type response_data() const noexcept {
+            return response_body;
+        }
+
+        // the responder failed, or the session answers the request itself
+        void clear_response(http::status_code status_code) noexcept {
+            code = status_code;
+            response_fields.clear();
+            response_body.clear();
+        }
+
+        ///////////////////////////// The Request /////////////////////////////
+
+        [[nodiscard]] string_view_type method() const noexcept {
+            return method_view;
+        }
+
+        [[nodiscard]] string_view_type target() const noexcept {
+            return path_view;
+        }
+
+        [[nodiscard]] string_view_type scheme() const noexcept {
+            return scheme_view;
+        }
+
+        [[nodiscard]] string_view_type authority() const noexcept {
+            return authority_view;
+        }
+
+        [[nodiscard]] http::version version() const noexcept {
+            return http::http_2_0;
+        }
+
+        [[nodiscard]] header_views_type const& headers() const noexcept {
+            return header_views;
+        }
+
+        /**
+         * Get the value of a header (the name is case-insensitive); empty if it's not there.
+         * The ":authority" pseudo-header field is the "Host" field of HTTP/2.
+         */
+        [[nodiscard]] string_view_type header(string_view_type name) const noexcept {
+            for (auto const& [field_name, value] : header_views) {
+                if (ascii::iequals(field_name, name)) {
+                    return value;
+                }
+            }
+            using ascii::char_case_side::second_lowered;
+            if (!authority_view.empty() && ascii::iequals<second_lowered>(name, "host")) {
+                return authority_view;
+            }
+            return {};
+        }
+
+        [[nodiscard]] string_view_type body() const noexcept {
+            return body_content;
+        }
+
+        ///////////////////////////// The Response /////////////////////////////
+
+        void status(http::status_code status_code) noexcept {
+            code = status_code;
+        }
+
+        // the connection-specific fields are dropped, and Content-Length is added by the session
+        void response_header(string_view_type name, string_view_type value) {
+            if (is_connection_specific_field(name)) {
+                return;
+            }
+            hpack_append_field(response_fields, name, value);
+        }
+
+        void write(string_view_type data) {
+            response_body.append(data.data(), data.size());
+        }
+    };
+
+} // namespace webpp::http::h2
+
+#endif // WEBPP_H2_STREAM_HPP
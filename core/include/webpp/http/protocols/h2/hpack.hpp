@@ -0,0 +1,562 @@
+#ifndef WEBPP_HPACK_HPP
+#define WEBPP_HPACK_HPP
+
+#include "../../../memory/allocators.hpp"
+#include "../../../std/string.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../../std/vector.hpp"
+#include "../../../strings/iequals.hpp"
+#include "../../../traits/enable_traits.hpp"
+#include "../../../traits/traits.hpp"
+#include "../../status_code.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+/**
+ * HPACK: the header compression of HTTP/2 (RFC 7541)
+ */
+namespace webpp::http::h2 {
+
+    struct hpack_field {
+        stl::string_view name;
+        stl::string_view value;
+    };
+
+    // the size of an entry of the dynamic table is the size of its name and value plus 32 (section 4.1)
+    static constexpr stl::size_t hpack_entry_overhead = 32;
+
+    // SETTINGS_HEADER_TABLE_SIZE; we don't change the default, so the peers don't need to wait for an ACK
+    static constexpr stl::size_t hpack_default_table_size = 4096;
+
+    /**
+     * The static table (Appendix A); index zero is not used.
+     */
+    static constexpr stl::array<hpack_field, 62> hpack_static_table{{
+      {"", ""},
+      {":authority", ""},
+      {":method", "GET"},
+      {":method", "POST"},
+      {":path", "/"},
+      {":path", "/index.html"},
+      {":scheme", "http"},
+      {":scheme", "https"},
+      {":status", "200"},
+      {":status", "204"},
+      {":status", "206"},
+      {":status", "304"},
+      {":status", "400"},
+      {":status", "404"},
+      {":status", "500"},
+      {"accept-charset", ""},
+      {"accept-encoding", "gzip, deflate"},
+      {"accept-language", ""},
+      {"accept-ranges", ""},
+      {"accept", ""},
+      {"access-control-allow-origin", ""},
+      {"age", ""},
+      {"allow", ""},
+      {"authorization", ""},
+      {"cache-control", ""},
+      {"content-disposition", ""},
+      {"content-encoding", ""},
+      {"content-language", ""},
+      {"content-length", ""},
+      {"content-location", ""},
+      {"content-range", ""},
+      {"content-type", ""},
+      {"cookie", ""},
+      {"date", ""},
+      {"etag", ""},
+      {"expect", ""},
+      {"expires", ""},
+      {"from", ""},
+      {"host", ""},
+      {"if-match", ""},
+      {"if-modified-since", ""},
+      {"if-none-match", ""},
+      {"if-range", ""},
+      {"if-unmodified-since", ""},
+      {"last-modified", ""},
+      {"link", ""},
+      {"location", ""},
+      {"max-forwards", ""},
+      {"proxy-authenticate", ""},
+      {"proxy-authorization", ""},
+      {"range", ""},
+      {"referer", ""},
+      {"refresh", ""},
+      {"retry-after", ""},
+      {"server", ""},
+      {"set-cookie", ""},
+      {"strict-transport-security", ""},
+      {"transfer-encoding", ""},
+      {"user-agent", ""},
+      {"vary", ""},
+      {"via", ""},
+      {"www-authenticate", ""},
+    }};
+
+    static constexpr stl::size_t hpack_static_table_size = hpack_static_table.size() - 1;
+
+    namespace details {
+
+        // the largest integer that we accept; the sizes and indices are never near this
+        static constexpr stl::uint32_t hpack_max_integer = 1U << 28U;
+
+        static constexpr stl::size_t huffman_symbol_count = 257; // 256 octets and EOS
+        static constexpr stl::size_t huffman_max_length   = 30;
+        static constexpr stl::size_t huffman_eos          = 256;
+
+        /**
+         * The lengths of the codes of the Huffman code (Appendix B); the code is canonical (the codes of
+         * the same length are consecutive, in the order of the symbols), so the codes are derived from the
+         * lengths.
+         */
+        static constexpr stl::array<stl::uint8_t, huffman_symbol_count> huffman_code_lengths{
+          13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 30, 28, 28,
+          28, 28, 28, 28, 28, 28, 28, 6,  10, 10, 12, 13, 6,  8,  11, 10, 10, 8,  11, 8,  6,  6,  6,  5,  5,
+          5,  6,  6,  6,  6,  6,  6,  6,  7,  8,  15, 6,  12, 10, 13, 6,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+          7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8,  13, 19, 13, 14, 6,  15, 5,  6,  5,
+          6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,  6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7,  15, 11,
+          14, 13, 28, 20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23, 24, 24, 22, 23, 24, 23,
+          23, 23, 23, 21, 22, 23, 22, 23, 23, 24, 22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23,
+          23, 21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23, 26, 26, 20, 19, 22, 23, 22, 25,
+          26, 26, 26, 27, 27, 26, 24, 25, 19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27, 20,
+          24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23, 26, 27, 26, 26, 27, 27, 27, 27, 27, 28,
+          27, 27, 27, 27, 27, 26, 30};
+
+        struct huffman_table {
+            stl::array<stl::uint32_t, huffman_symbol_count>   codes{};
+            stl::array<stl::uint16_t, huffman_symbol_count>   symbols{}; // in the order of their codes
+            stl::array<stl::uint32_t, huffman_max_length + 1> first_code{};
+            stl::array<stl::uint16_t, huffman_max_length + 1> first_index{};
+            stl::array<stl::uint16_t, huffman_max_length + 1> count{};
+        };
+
+        [[nodiscard]] consteval huffman_table make_huffman_table() {
+            huffman_table table;
+            for (auto const length : huffman_code_lengths) {
+                ++table.count[length];
+            }
+            stl::uint32_t code  = 0;
+            stl::uint16_t index = 0;
+            for (stl::size_t length = 1; length <= huffman_max_length; ++length) {
+                code <<= 1U;
+                table.first_code[length]  = code;
+                table.first_index[length] = index;
+                for (stl::size_t symbol = 0; symbol != huffman_symbol_count; ++symbol) {
+                    if (huffman_code_lengths[symbol] == length) {
+                        table.codes[symbol]     = code++;
+                        table.symbols[index++] = static_cast<stl::uint16_t>(symbol);
+                    }
+                }
+            }
+            return table;
+        }
+
+        static constexpr huffman_table huffman = make_huffman_table();
+
+    } // namespace details
+
+    /**
+     * Decode an integer with an N-bit prefix (section 5.1) from the start of the input, and remove it from
+     * the input; the bits of the first octet that are before the prefix are ignored.
+     */
+    [[nodiscard]] constexpr bool hpack_decode_integer(stl::string_view& input,
+                                                      stl::uint8_t      prefix_bits,
+                                                      stl::uint32_t&    value) noexcept {
+        if (input.empty()) {
+            return false;
+        }
+        auto const mask = static_cast<stl::uint32_t>((1U << prefix_bits) - 1U);
+        value           = static_cast<stl::uint8_t>(input.front()) & mask;
+        input.remove_prefix(1);
+        if (value != mask) {
+            return true;
+        }
+        for (stl::uint32_t shift = 0; !input.empty() && shift <= 21; shift += 7) {
+            auto const octet = static_cast<stl::uint8_t>(input.front());
+            input.remove_prefix(1);
+            value += static_cast<stl::uint32_t>(octet & 0x7FU) << shift;
+            if ((octet & 0x80U) == 0) {
+                return value < details::hpack_max_integer;
+            }
+        }
+        return false;
+    }
+
+    // the first octet carries the bits before the prefix (the representation)
+    template <istl::String StrT>
+    constexpr void hpack_append_integer(StrT&         out,
+                                        stl::size_t   value,
+                                        stl::uint8_t  prefix_bits,
+                                        stl::uint8_t  first_octet = 0) {
+        auto const mask = static_cast<stl::size_t>((1U << prefix_bits) - 1U);
+        if (value < mask) {
+            out.push_back(static_cast<char>(first_octet | value));
+            return;
+        }
+        out.push_back(static_cast<char>(first_octet | mask));
+        value -= mask;
+        while (value >= 0x80U) {
+            out.push_back(static_cast<char>((value & 0x7FU) | 0x80U));
+            value >>= 7U;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    /**
+     * Decode a Huffman encoded string (section 5.2), and append it to the output; the padding should be
+     * the most significant bits of EOS, and shorter than an octet.
+     */
+    template <istl::String StrT>
+    [[nodiscard]] constexpr bool huffman_decode(stl::string_view input, StrT& out) {
+        auto const&   table  = details::huffman;
+        stl::uint32_t code   = 0;
+        stl::size_t   length = 0;
+        for (auto const chr : input) {
+            auto const octet = static_cast<stl::uint8_t>(chr);
+            for (int bit = 7; bit >= 0; --bit) {
+                code = (code << 1U) | ((octet >> static_cast<unsigned>(bit)) & 1U);
+                ++length;
+                auto const offset = code - table.first_code[length];
+                if (code >= table.first_code[length] && offset < table.count[length]) {
+                    auto const symbol = table.symbols[table.first_index[length] + offset];
+                    if (symbol == details::huffman_eos) {
+                        return false;
+                    }
+                    out.push_back(static_cast<char>(symbol));
+                    code   = 0;
+                    length = 0;
+                } else if (length == details::huffman_max_length) {
+                    return false;
+                }
+            }
+        }
+        return length < 8 && code == (1U << length) - 1U;
+    }
+
+    [[nodiscard]] constexpr stl::size_t huffman_encoded_size(stl::string_view input) noexcept {
+        stl::size_t bits = 0;
+        for (auto const chr : input) {
+            bits += details::huffman_code_lengths[static_cast<stl::uint8_t>(chr)];
+        }
+        return (bits + 7) / 8;
+    }
+
+    template <istl::String StrT>
+    constexpr void huffman_encode(stl::string_view input, StrT& out) {
+        auto const&   table  = details::huffman;
+        stl::uint64_t bits   = 0;
+        stl::size_t   length = 0;
+        for (auto const chr : input) {
+            auto const symbol = static_cast<stl::uint8_t>(chr);
+            bits              = (bits << details::huffman_code_lengths[symbol]) | table.codes[symbol];
+            length += details::huffman_code_lengths[symbol];
+            while (length >= 8) {
+                length -= 8;
+                out.push_back(static_cast<char>(bits >> length));
+            }
+        }
+        if (length != 0) { // padded with the most significant bits of EOS
+            out.push_back(static_cast<char>((bits << (8 - length)) | (0xFFU >> length)));
+        }
+    }
+
+    /**
+     * Append a string literal (section 5.2); it's Huffman encoded if that makes it shorter.
+     */
+    template <istl::String StrT>
+    constexpr void hpack_append_string(StrT& out, stl::string_view str) {
+        if (auto const encoded_size = huffman_encoded_size(str); encoded_size < str.size()) {
+            hpack_append_integer(out, encoded_size, 7, 0x80U);
+            huffman_encode(str, out);
+            return;
+        }
+        hpack_append_integer(out, str.size(), 7);
+        out.append(str.data(), str.size());
+    }
+
+    /**
+     * The index of the name in the static table, or zero; the name should be lowercase.
+     */
+    [[nodiscard]] constexpr stl::size_t hpack_static_name_index(stl::string_view name) noexcept {
+        constexpr stl::size_t first_regular = 15; // after the pseudo-header fields
+        for (stl::size_t index = first_regular; index <= hpack_static_table_size; ++index) {
+            if (hpack_static_table[index].name == name) {
+                return index;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * The ":status" field; the common ones are one octet, as they're in the static table.
+     */
+    template <istl::String StrT>
+    constexpr void hpack_append_status(StrT& out, status_code_type code) {
+        constexpr stl::size_t status_name_index = 8;
+
+        stl::size_t index = 0;
+        switch (code) {
+            case 200: index = 8; break;
+            case 204: index = 9; break;
+            case 206: index = 10; break;
+            case 304: index = 11; break;
+            case 400: index = 12; break;
+            case 404: index = 13; break;
+            case 500: index = 14; break;
+            default: break;
+        }
+        if (index != 0) {
+            hpack_append_integer(out, index, 7, 0x80U); // indexed
+            return;
+        }
+        stl::array<char, 3> const digits{static_cast<char>('0' + code / 100 % 10),
+                                         static_cast<char>('0' + code / 10 % 10),
+                                         static_cast<char>('0' + code % 10)};
+        hpack_append_integer(out, status_name_index, 4); // literal without indexing, indexed name
+        hpack_append_string(out, {digits.data(), digits.size()});
+    }
+
+    /**
+     * A header field as a "literal header field without indexing" (section 6.2.2); the responses don't use
+     * the dynamic table of the peer, so the encoder doesn't have a state. The name is lowercased, as
+     * HTTP/2 requires.
+     */
+    template <istl::String StrT>
+    constexpr void hpack_append_field(StrT& out, stl::string_view name, stl::string_view value) {
+        constexpr stl::size_t max_static_name = 27; // "access-control-allow-origin"
+
+        stl::array<char, max_static_name> lowered{};
+        if (name.size() <= lowered.size()) {
+            for (stl::size_t index = 0; index != name.size(); ++index) {
+                lowered[index] = static_cast<char>(ascii::to_lower_copy(name[index]));
+            }
+            if (auto const index = hpack_static_name_index({lowered.data(), name.size()}); index != 0) {
+                hpack_append_integer(out, index, 4);
+                hpack_append_string(out, value);
+                return;
+            }
+        }
+        out.push_back('\0'); // literal without indexing, new name; the name is not Huffman encoded
+        hpack_append_integer(out, name.size(), 7);
+        for (auto const chr : name) {
+            out.push_back(static_cast<char>(ascii::to_lower_copy(chr)));
+        }
+        hpack_append_string(out, value);
+    }
+
+    /**
+     * The decoder of the header blocks of a connection; it holds the dynamic table (section 2.3.2) of the
+     * connection, so all the header blocks of a connection should be decoded by one decoder, in the order
+     * that they're received.
+     *
+     * The names and the values of the dynamic table are stored one after the other in one string, so
+     * inserting and evicting the entries doesn't allocate after the table is warmed up.
+     */
+    template <Traits TraitsType>
+    struct hpack_decoder {
+        using traits_type      = TraitsType;
+        using string_type      = traits::general_string<traits_type>;
+        using string_view_type = traits::string_view<traits_type>;
+
+      private:
+        struct table_entry {
+            stl::size_t   offset     = 0; // of the name, in the bytes
+            stl::uint32_t name_size  = 0;
+            stl::uint32_t value_size = 0;
+        };
+
+        using entries_type = stl::vector<table_entry, traits::general_allocator<traits_type, table_entry>>;
+
+        string_type  bytes;           // the names and the values of the entries, the oldest first
+        entries_type entries;         // the entries from the "first" one are in the table, the oldest first
+        stl::size_t  first      = 0;  // the oldest entry that's not evicted
+        stl::size_t  table_size = 0;  // the size of the table as HPACK calculates it
+        stl::size_t  max_size   = hpack_default_table_size;
+        stl::size_t  max_limit  = hpack_default_table_size; // the limit that we have told the peer about
+        string_type  name_buf;        // the Huffman encoded strings are decoded into these
+        string_type  value_buf;
+
+        [[nodiscard]] hpack_field entry_at(stl::size_t index) const noexcept {
+            auto const& entry = entries[index];
+            auto const* data  = bytes.data() + entry.offset;
+            return {{data, entry.name_size}, {data + entry.name_size, entry.value_size}};
+        }
+
+        void evict_to(stl::size_t size) noexcept {
+            while (table_size > size && first != entries.size()) {
+                auto const& entry = entries[first++];
+                table_size -= entry.name_size + entry.value_size + hpack_entry_overhead;
+            }
+        }
+
+        // drop the bytes of the evicted entries once they're more than half of the bytes; returns their size
+        stl::size_t compact() {
+            if (first == 0) {
+                return 0;
+            }
+            auto const dead = first == entries.size() ? bytes.size() : entries[first].offset;
+            if (dead * 2 < bytes.size()) {
+                return 0;
+            }
+            bytes.erase(0, dead);
+            entries.erase(entries.begin(), entries.begin() + static_cast<stl::ptrdiff_t>(first));
+            first = 0;
+            for (auto& entry : entries) {
+                entry.offset -= dead;
+            }
+            return dead;
+        }
+
+        // the name may be a view into the bytes (of an entry that may be evicted by inserting this one)
+        void insert(stl::string_view name, stl::string_view value) {
+            auto const entry_size = name.size() + value.size() + hpack_entry_overhead;
+            if (entry_size > max_size) {
+                evict_to(0); // it's not an error, the table just becomes empty (section 4.4)
+                return;
+            }
+            auto const* const begin    = bytes.data();
+            bool const        is_ours  = !bytes.empty() && stl::less_equal<>{}(begin, name.data()) &&
+                                  stl::less<>{}(name.data(), begin + bytes.size());
+            auto const        name_pos = is_ours ? static_cast<stl::size_t>(name.data() - begin) : 0;
+            auto const        dropped  = compact(); // the name is moved too, if it's ours
+            auto const        offset   = bytes.size();
+            bytes.reserve(offset + name.size() + value.size());
+            if (is_ours) {
+                bytes.append(bytes.data() + (name_pos - dropped), name.size());
+            } else {
+                bytes.append(name.data(), name.size());
+            }
+            bytes.append(value.data(), value.size());
+            evict_to(max_size - entry_size);
+            entries.push_back({.offset     = offset,
+                               .name_size  = static_cast<stl::uint32_t>(name.size()),
+                               .value_size = static_cast<stl::uint32_t>(value.size())});
+            table_size += entry_size;
+        }
+
+        [[nodiscard]] bool read_string(stl::string_view& input, string_type& buf, stl::string_view& str) {
+            if (input.empty()) {
+                return false;
+            }
+            bool const    huffman_encoded = (static_cast<stl::uint8_t>(input.front()) & 0x80U) != 0;
+            stl::uint32_t size            = 0;
+            if (!hpack_decode_integer(input, 7, size) || size > input.size()) {
+                return false;
+            }
+            str = input.substr(0, size);
+            input.remove_prefix(size);
+            if (huffman_encoded) {
+                buf.clear();
+                if (!huffman_decode(str, buf)) {
+                    return false;
+                }
+                str = buf;
+            }
+            return true;
+        }
+
+      public:
+        template <EnabledTraits ET>
+        explicit hpack_decoder(ET& et)
+          : bytes{alloc::general_alloc_for<string_type>(et)},
+            entries{alloc::general_alloc_for<entries_type>(et)},
+            name_buf{alloc::general_alloc_for<string_type>(et)},
+            value_buf{alloc::general_alloc_for<string_type>(et)} {}
+
+        /**
+         * Get the entry of the index (the static table first, then the dynamic table, section 2.3.3);
+         * the views of the dynamic entries are valid until the next header block is decoded.
+         */
+        [[nodiscard]] bool get(stl::size_t index, hpack_field& field) const noexcept {
+            if (index == 0) {
+                return false;
+            }
+            if (index <= hpack_static_table_size) [[likely]] {
+                field = hpack_static_table[index];
+                return true;
+            }
+            auto const dynamic_index = index - hpack_static_table_size - 1;
+            if (dynamic_index >= entries.size() - first) {
+                return false;
+            }
+            field = entry_at(entries.size() - 1 - dynamic_index);
+            return true;
+        }
+
+        // our SETTINGS_HEADER_TABLE_SIZE; the peer can make the table smaller than this, but not larger
+        void max_table_size(stl::size_t size) noexcept {
+            max_limit = size;
+            max_size  = size;
+            evict_to(max_size);
+        }
+
+        // the number of the entries of the dynamic table
+        [[nodiscard]] stl::size_t size() const noexcept {
+            return entries.size() - first;
+        }
+
+        // the size of the dynamic table as HPACK calculates it
+        [[nodiscard]] stl::size_t table_bytes() const noexcept {
+            return table_size;
+        }
+
+        /**
+         * Decode a whole header block, and call the callback with each of its fields; the views that are
+         * given to the callback are only valid in the callback.
+         * Returns false if the block can't be decoded, which is a connection error (COMPRESSION_ERROR),
+         * because the dynamic table of the peer and ours are not the same anymore.
+         */
+        template <typename CallbackType>
+        [[nodiscard]] bool decode(stl::string_view block, CallbackType&& on_field) {
+            bool first_field = true;
+            while (!block.empty()) {
+                auto const    octet = static_cast<stl::uint8_t>(block.front());
+                stl::uint32_t index = 0;
+                hpack_field   field;
+                if ((octet & 0x80U) != 0) { // indexed
+                    if (!hpack_decode_integer(block, 7, index) || !get(index, field)) {
+                        return false;
+                    }
+                    on_field(field.name, field.value);
+                } else if ((octet & 0xE0U) == 0x20U) { // dynamic table size update
+                    if (!first_field || !hpack_decode_integer(block, 5, index) || index > max_limit) {
+                        return false;
+                    }
+                    max_size = index;
+                    evict_to(max_size);
+                    continue;
+                } else {
+                    bool const    indexing = (octet & 0xC0U) == 0x40U;
+                    stl::uint8_t const prefix = indexing ? 6 : 4;
+                    if (!hpack_decode_integer(block, prefix, index)) {
+                        return false;
+                    }
+                    if (index == 0) {
+                        if (!read_string(block, name_buf, field.name)) {
+                            return false;
+                        }
+                    } else if (!get(index, field)) {
+                        return false;
+                    }
+                    if (!read_string(block, value_buf, field.value)) {
+                        return false;
+                    }
+                    on_field(field.name, field.value);
+                    if (indexing) {
+                        insert(field.name, field.value);
+                    }
+                }
+                first_field = false;
+            }
+            return true;
+        }
+    };
+
+} // namespace webpp::http::h2
+
+#endif // WEBPP_HPACK_HPP
@@ -0,0 +1,52 @@
+#ifndef WEBPP_H2C_HPP
+#define WEBPP_H2C_HPP
+
+#include "../../server/default_server_traits.hpp"
+#include "../../server/server_concepts.hpp"
+#include "../app_wrapper.hpp"
+#include "../request.hpp"
+#include "../response.hpp"
+#include "common/common_http_protocol.hpp"
+#include "h2/h2_session_manager.hpp"
+
+namespace webpp::http::h2 {
+
+    /**
+     * HTTP/2 over cleartext TCP (h2c); for the clients that know the server speaks HTTP/2 (the service to
+     * service traffic, mostly), or that upgrade their first HTTP/1.1 request to it.
+     */
+    template <Application       App,
+              ServerTraits      ServerTraitsType = default_server_traits,
+              RootExtensionList RootExtensions   = empty_extension_pack>
+    struct h2c : public common_http_protocol<typename ServerTraitsType::traits_type, App, RootExtensions> {
+
+        using server_traits_type = ServerTraitsType;
+        using traits_type        = typename server_traits_type::traits_type;
+
+      private:
+        using super = common_http_protocol<traits_type, App, RootExtensions>;
+
+      public:
+        using app_wrapper_type = typename super::app_wrapper_type;
+        using request_type     = typename super::request_type;
+        using server_type      = typename server_traits_type::template server_type<
+          h2_session_manager<traits_type, app_wrapper_type>>;
+
+        server_type server;
+
+        template <typename... Args>
+        h2c(Args&&... args) : super{stl::forward<Args>(args)...},
+                              server{this->app} {}
+
+        [[nodiscard]] static constexpr bool is_ssl_available() noexcept {
+            return false;
+        }
+
+        void operator()() noexcept {
+            this->server();
+        }
+    };
+
+} // namespace webpp::http::h2
+
+#endif // WEBPP_H2C_HPP
@@ -32,7 +32,7 @@ namespace webpp::http::inline shosted {
         using connection_type  = istl::nothing_type; // fixme: just a placeholder
         using request_type     = typename super::request_type;
         using server_type      = typename server_traits_type::template server_type<
-          shosted::self_hosted_session_manager<traits_type, app_wrapper_type, request_type, connection_type>>;
+          shosted::self_hosted_session_manager<traits_type, app_wrapper_type>>;
 
         server_type server;
 
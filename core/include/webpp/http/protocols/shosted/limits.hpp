@@ -3,6 +3,7 @@
 #ifndef WEBPP_LIMITS_HPP
 #define WEBPP_LIMITS_HPP
 
+#include "../../../server/usage.hpp"
 #include "../../../std/std.hpp"
 
 #include <cstdint>
@@ -15,6 +16,12 @@ namespace webpp::http::shosted {
             stl::uint16_t get_method  = 8 * 1024;        // 8KiB
             stl::size_t   post_method = 1 * 1024 * 1024; // 1MiB
         } body;
+
+        // the requests are answered with "503 Service Unavailable" while the host is busier than this
+        struct load_limits {
+            bool                shed = false;
+            host::usage_options usage{};
+        } load;
     };
 
 } // namespace webpp::http::shosted
@@ -5,11 +5,20 @@
 
 #include "../../../configs/constants.hpp"
 #include "../../../server/server_concepts.hpp"
+#include "../../../std/functional.hpp"
+#include "../../../std/span.hpp"
+#include "../../../std/string_view.hpp"
+#include "../../../strings/iequals.hpp"
 #include "../../../traits/enable_traits.hpp"
 #include "../../../traits/traits.hpp"
 #include "../../status_code.hpp"
+#include "../../syntax/request_parser.hpp"
+#include "../../syntax/response_serializer.hpp"
+#include "../../version.hpp"
+#include "limits.hpp"
 
 #include <array>
+#include <cstring>
 
 namespace webpp::http::shosted {
 
@@ -17,58 +26,305 @@ namespace webpp::http::shosted {
      * For a self-hosted server, the session manager class will be created once for each request (well,
      * actually for each connection to be exact); this might not be the case for other server types.
      *
-     * todo: see if we need a "shosted request manager" type too because of HTTP/2.0 that can handle multiple requests within one connection
+     * The requests are parsed incrementally (with http_request_parser), as they're received, into a fixed
+     * buffer; the method, the target, and the headers are views into that buffer, and the body is too if it
+     * fits in there (chunked bodies are decoded in place). The limits are checked as soon as possible, so a
+     * long URI is answered with 414 before its request line is even complete, and a large body is answered
+     * with 413 before it's received.
+     *
+     * The request is given to the responder (which is default constructed) as soon as it's received:
+     *
+     *   responder(session) -> void; it reads the request and writes the response with:
+     *     session.method(), target(), version(), header(name), body()
+     *     session.status(code), session.response_header(name, value), session.write(data)
+     *
+     * This type implements the session API of the posix servers: buffer, read, output, and
+     * keep_connection. The output is a view into a buffer that's reused for the next requests, so after
+     * the first few requests, nothing is allocated per request.
+     *
+     * HTTP/2 connections (with their many requests at a time) are handled by h2::h2_session_manager.
+     *
      * todo: Send 204 (No Content) when you don't want the application fails to get you a body
      */
-    template <Traits TraitsType, typename AppWrapperType, HTTPRequest RequestType, Connection ConnectionType>
-    struct self_hosted_session_manager : public ConnectionType {
+    template <Traits TraitsType, typename ResponderType, limits_type Limits = limits_type{}>
+    struct self_hosted_session_manager : public enable_traits<TraitsType> {
         static constexpr auto buffer_size     = default_buffer_size;
         static constexpr auto logger_category = "SelfHosted/Session";
+        static constexpr auto limits          = Limits;
 
-        using connection_type  = ConnectionType;
-        using traits_type      = TraitsType;
-        using string_view_type = traits::string_view<traits_type>;
-        using char_type        = istl::char_type_of<string_view_type>;
-        using allocator_type   = traits::general_allocator<traits_type, char_type>;
-        using buffer_type      = stl::array<char_type, buffer_size>;
-        using request_type     = RequestType;
-        using app_wrapper_type = AppWrapperType;
-
-        // we use this way so if the application doesn't have any fields, it'll be easier just to
-        // use a copy of it instead of using a reference
-        // todo: add "trivial" here; it's a defect to use copy-ctor or move-ctor
-        using app_wrapper_ref =
-          stl::conditional_t<sizeof(app_wrapper_type) == 0 && stl::is_move_constructible_v<app_wrapper_type>,
-                             app_wrapper_type,
-                             app_wrapper_type&>;
+        // when the buffer is full, the body that's received so far is moved out of the buffer, and the rest
+        // of it is received into the part of the buffer that's after the headers
+        static constexpr stl::size_t min_body_space = 4 * 1024;
 
+        using traits_type       = TraitsType;
+        using etraits           = enable_traits<traits_type>;
+        using responder_type    = ResponderType;
+        using string_view_type  = traits::string_view<traits_type>;
+        using string_type       = traits::general_string<traits_type>;
+        using char_type         = istl::char_type_of<string_view_type>;
+        using buffer_type       = stl::array<char_type, buffer_size>;
+        using parser_type       = http_request_parser<traits_type>;
+        using header_views_type = typename parser_type::header_views_type;
 
       private:
-        [[no_unique_address]] app_wrapper_ref app;
-        request_type                          req;
-        buffer_type                           _buffer{}; // todo: should we use char_type here?
+        [[no_unique_address]] responder_type responder{};
+
+        buffer_type     buf{};
+        stl::size_t     filled = 0;      // the bytes of the buffer that are received
+        stl::span<char> space{buf};      // the part of the buffer that's not filled yet
+        parser_type     parser;          // the views of the request point into the buffer
+        string_type     body_content;    // the body, if it doesn't fit in the buffer
+        bool            spilled = false; // the body is (partly) moved to the body content
+
+        // the response that's being written by the responder; the Date field is added by the session,
+        // unless the responder has its own
+        http::status_code code = http::status_code::ok;
+        string_type       response_headers;
+        string_type       response_body;
+        bool              has_date = false;
+
+        string_type out;                 // the responses that should be sent
+        bool        close_after = false; // close the connection after the output is sent
+
+        [[nodiscard]] bool is_head_request() const noexcept {
+            return parser.method_view == "HEAD";
+        }
+
+        [[nodiscard]] bool wants_keep_alive() const noexcept {
+            auto const connection = header("Connection");
+            if (parser.http_version_view == "1.0") {
+                return ascii::iequals(connection, "keep-alive");
+            }
+            return !ascii::iequals(connection, "close");
+        }
+
+        /**
+         * The request can't be handled; the connection is closed after the error is sent, because we don't
+         * know where the next request starts.
+         */
+        void fail(http::status_code status) {
+            this->logger.warning(logger_category, status_code_reason_phrase(status));
+            response_head_options const options{.keep_alive = false, .date = true};
+            auto const                  status_number = static_cast<status_code_type>(status);
+            append_status_line(out, status_number, options);
+            append_date_field(out, options);
+            append_framing_fields(out, status_number, options);
+            out.append("\r\n");
+            close_after = true;
+        }
+
+        void respond() {
+            if constexpr (limits.load.shed) {
+                if (host::is_busy(limits.load.usage)) [[unlikely]] {
+                    out.append(service_unavailable_response);
+                    close_after = true;
+                    return;
+                }
+            }
+
+            bool const keep_alive = wants_keep_alive();
+            code                  = http::status_code::ok;
+            response_headers.clear();
+            response_body.clear();
+            has_date = false;
+            host::requests_started();
+            try {
+                stl::invoke(responder, *this);
+            } catch (stl::exception const& err) {
+                this->logger.error(logger_category, "The responder failed.", err);
+                response_headers.clear();
+                response_body.clear();
+                has_date = false;
+                code     = http::status_code::internal_server_error;
+            }
+            host::requests_finished();
+
+            response_head_options const options{.content_length = response_body.size(),
+                                                .keep_alive     = keep_alive,
+                                                .date           = !has_date};
+            auto const                  status_number = static_cast<status_code_type>(code);
+            append_status_line(out, status_number, options);
+            out.append(response_headers);
+            append_date_field(out, options);
+            append_framing_fields(out, status_number, options);
+            out.append("\r\n");
+            if (!keep_alive) {
+                close_after = true;
+            }
+            if (!is_head_request()) {
+                out.append(response_body);
+            }
+        }
+
+        // the parser checks the limit of the bodies of POST requests, the GET requests have a lower limit
+        [[nodiscard]] bool is_body_too_large() const noexcept {
+            if (!parser.is_head_done() || (parser.method_view != "GET" && parser.method_view != "HEAD")) {
+                return false;
+            }
+            return stl::max(parser.content_length(), body_content.size() + parser.body().size()) >
+                   limits.body.get_method;
+        }
+
+        // the request is responded; the rest of the buffer belongs to the next request
+        void consume(stl::size_t size) noexcept {
+            filled -= size;
+            stl::memmove(buf.data(), buf.data() + size, filled);
+            parser.reset();
+            body_content.clear();
+            spilled = false;
+        }
+
+        // the buffer is full; move the body out of it, so the rest of the body can be received
+        [[nodiscard]] bool spill() {
+            auto const head_size = parser.head_size();
+            if (!parser.is_head_done() || buffer_size - head_size < min_body_space) {
+                return false;
+            }
+            auto const received = parser.body();
+            body_content.append(received.data(), received.size());
+            auto const unparsed = filled - parser.consumed();
+            stl::memmove(buf.data() + head_size, buf.data() + parser.consumed(), unparsed);
+            filled  = head_size + unparsed;
+            spilled = true;
+            parser.body_taken();
+            return true;
+        }
+
+        // parse and respond to the requests that are in the buffer
+        void parse() {
+            while (!close_after && filled != 0) {
+                if (auto const status = parser.parse({buf.data(), filled}); status != http::status_code::ok) {
+                    fail(status);
+                    return;
+                }
+                if (is_body_too_large()) {
+                    fail(http::status_code::payload_too_large);
+                    return;
+                }
+                if (!parser.is_done()) {
+                    if (filled == buffer_size && !spill()) {
+                        fail(http::status_code::request_header_fields_too_large);
+                    }
+                    return;
+                }
+                if (spilled) {
+                    auto const rest = parser.body();
+                    body_content.append(rest.data(), rest.size());
+                }
+                respond();
+                consume(parser.consumed());
+            }
+        }
 
       public:
-        self_hosted_session_manager(app_wrapper_ref the_app, request_type request, auto&&... args)
-          : app{the_app},
-            req{stl::move(request)},
-            connection_type{stl::forward<decltype(args)>(args)...} {}
+        explicit self_hosted_session_manager(etraits const& et)
+          : etraits{et},
+            parser{*this},
+            body_content{alloc::general_alloc_for<string_type>(*this)},
+            response_headers{alloc::general_alloc_for<string_type>(*this)},
+            response_body{alloc::general_alloc_for<string_type>(*this)},
+            out{alloc::general_alloc_for<string_type>(*this)} {
+            parser.max_target_size = limits.uri;
+            parser.max_body_size   = limits.body.post_method;
+        }
+
+        self_hosted_session_manager(self_hosted_session_manager const&)            = delete;
+        self_hosted_session_manager(self_hosted_session_manager&&)                 = delete;
+        self_hosted_session_manager& operator=(self_hosted_session_manager const&) = delete;
+        self_hosted_session_manager& operator=(self_hosted_session_manager&&)      = delete;
+        ~self_hosted_session_manager()                                             = default;
+
+        // the connection reads into this
+        [[nodiscard]] stl::span<char>& buffer() noexcept {
+            return space;
+        }
 
         /**
          * read a batch of input
          *
-         * Errors that this method should identify:
-         *   - 413 (Entity Too Large): max http header values is about 4k usually
+         * Errors that this method identifies (and responds to right away):
+         *   - 400 (Bad Request):                     the request line or the headers are malformed
+         *   - 413 (Payload Too Large):               the Content-Length is more than the limits
+         *   - 414 (URI Too Long):                    the request target is longer than the limits
+         *   - 431 (Request Header Fields Too Large): the headers don't fit in the buffer
+         *   - 501 (Not Implemented):                 the transfer coding of the body is not supported
          *
-         * But this method is in charge of identifying some error codes, but it doesn't produce the output
+         * Returns true if there's nothing to be sent yet, and more input is needed.
          */
-        status_code read(stl::size_t transferred_bytes) noexcept {}
+        [[nodiscard]] bool read(stl::size_t bytes) {
+            out.clear(); // the previous output is sent already
+            filled += bytes;
+            parse();
+            space = stl::span<char>{buf}.subspan(filled);
+            return out.empty();
+        }
 
-        // making the output
-        string_view_type output() noexcept {}
+        // the responses that should be sent; it's valid until the next read
+        [[nodiscard]] string_view_type output() const noexcept {
+            return out;
+        }
 
         [[nodiscard]] bool keep_connection() const noexcept {
-            return false;
+            return !close_after;
+        }
+
+        // nothing of the next request is received; the connection can be closed when it's drained
+        [[nodiscard]] bool is_idle() const noexcept {
+            return filled == 0;
+        }
+
+        [[nodiscard]] string_view_type remote_addr() const noexcept {
+            return {};
+        }
+
+        void done() noexcept {}
+
+        ///////////////////////////// The Request /////////////////////////////
+
+        [[nodiscard]] string_view_type method() const noexcept {
+            return parser.method_view;
+        }
+
+        [[nodiscard]] string_view_type target() const noexcept {
+            return parser.request_target_view;
+        }
+
+        [[nodiscard]] http::version version() const noexcept {
+            return parser.get_http_version();
+        }
+
+        [[nodiscard]] header_views_type const& headers() const noexcept {
+            return parser.headers();
+        }
+
+        /**
+         * Get the value of a header (the name is case-insensitive); empty if it's not there
+         */
+        [[nodiscard]] string_view_type header(string_view_type name) const noexcept {
+            return parser.header(name);
+        }
+
+        [[nodiscard]] string_view_type body() const noexcept {
+            return spilled ? string_view_type{body_content} : parser.body();
+        }
+
+        ///////////////////////////// The Response /////////////////////////////
+
+        void status(http::status_code status_code) noexcept {
+            code = status_code;
+        }
+
+        // Content-Length and Connection headers are added by the session
+        void response_header(string_view_type name, string_view_type value) {
+            has_date = has_date || details::is_date_field(name);
+            response_headers.append(name.data(), name.size());
+            response_headers.append(": ");
+            response_headers.append(value.data(), value.size());
+            response_headers.append("\r\n");
+        }
+
+        void write(string_view_type data) {
+            response_body.append(data.data(), data.size());
         }
     };
 
@@ -2,6 +2,7 @@
 #define WEBPP_HTTP_RESPONSE_HPP
 
 #include "../convert/casts.hpp"
+#include "../std/string_view.hpp"
 #include "../strings/append.hpp"
 #include "../traits/traits.hpp"
 #include "header_fields.hpp"
@@ -133,14 +134,15 @@ namespace webpp::http {
             // todo: we can optimize this, pre-calculate the default header fields and copy when needed
             // todo: use content_type class
             if (!has_content_type) {
-                static const header_field_type content_type_field{
-                  str_t{"Content-Type", headers.get_allocator()},
-                  str_t{"text/html; charset=utf-8", headers.get_allocator()}};
-                headers.emplace_back(content_type_field);
+                // not static; the strings are on the allocator of this response
+                headers.emplace_back(
+                  header_field_type{str_t{"Content-Type", headers.get_allocator()},
+                                    str_t{"text/html; charset=utf-8", headers.get_allocator()}});
             }
 
             if constexpr (SizableBody<body_type>) {
-                if (!has_content_length) {
+                // the size of a stream body is not known (npos) until it's all read
+                if (!has_content_length && body.size() != stl::string_view::npos) {
                     str_t value{headers.get_allocator()};
                     append_to(value, body.size() * sizeof(char));
                     headers.emplace_back(
@@ -2,7 +2,9 @@
 #define WEBPP_RESPONSE_BODY_HPP
 
 #include "../extensions/extension.hpp"
+#include "../platform/posix.hpp"
 #include "../std/functional.hpp"
+#include "../std/string.hpp"
 #include "../std/vector.hpp"
 #include "../traits/enable_traits.hpp"
 #include "http_concepts.hpp"
@@ -10,6 +12,15 @@
 #include <algorithm>
 #include <variant>
 
+#ifdef webpp_posix
+#    include <charconv>
+#    include <ctime>
+#    include <fcntl.h>
+#    include <filesystem>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
 namespace webpp::http {
 
 
@@ -40,22 +51,159 @@ namespace webpp::http {
         using traits_type = TraitsType;
         using byte_type   = stl::byte;
 
+      private:
+        stl::size_t read_position = 0; // the bytes before this are already read
+
+      public:
         using istl::vector<stl::byte, TraitsType>::vector; // ctors
 
         [[nodiscard]] stl::streamsize write(byte_type const* data, stl::streamsize count) {
-            this->insert(this->begin(),
+            this->insert(this->end(),
                          data,
                          data + count); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
             return count;
         }
 
+        // read the next part of the blob; returns zero when it's all read
         [[nodiscard]] stl::streamsize read(byte_type* data, stl::streamsize count) {
-            stl::copy_n(this->begin(), count, data);
-            return count;
+            auto const size = stl::min(static_cast<stl::size_t>(count), this->size() - read_position);
+            stl::copy_n(this->begin() + static_cast<stl::ptrdiff_t>(read_position), size, data);
+            read_position += size;
+            return static_cast<stl::streamsize>(size);
         }
     };
 
 
+#ifdef webpp_posix
+    /**
+     * A file that's sent as the response body. The protocols that can, send it with sendfile(2), so its
+     * content never gets copied into the user space; the rest read it like a blob.
+     * The size, the modification time, and the ETag are taken from the opened file (fstat), so they can't
+     * disagree with the content that's sent.
+     */
+    template <Traits TraitsType>
+    struct file_response_body_communicator {
+        using traits_type = TraitsType;
+        using byte_type   = stl::byte;
+
+      private:
+        int         fd        = -1;
+        stl::size_t position  = 0; // the bytes before this are already sent
+        stl::size_t file_size = 0;
+        stl::time_t modified  = 0;
+
+      public:
+        constexpr file_response_body_communicator() noexcept = default;
+
+        explicit file_response_body_communicator(stl::filesystem::path const& filepath) noexcept
+          : fd{::open(filepath.c_str(), O_RDONLY | O_CLOEXEC)} { // NOLINT(*-vararg)
+            struct stat info {};
+            if (fd == -1) {
+                return;
+            }
+            if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+                close();
+                return;
+            }
+            file_size = static_cast<stl::size_t>(info.st_size);
+            modified  = info.st_mtime;
+        }
+
+        file_response_body_communicator(file_response_body_communicator const& other) noexcept
+          : fd{other.fd == -1 ? -1 : ::fcntl(other.fd, F_DUPFD_CLOEXEC, 0)}, // NOLINT(*-vararg)
+            position{other.position},
+            file_size{other.file_size},
+            modified{other.modified} {}
+
+        file_response_body_communicator(file_response_body_communicator&& other) noexcept
+          : fd{stl::exchange(other.fd, -1)},
+            position{other.position},
+            file_size{other.file_size},
+            modified{other.modified} {}
+
+        file_response_body_communicator& operator=(file_response_body_communicator other) noexcept {
+            stl::swap(fd, other.fd);
+            position  = other.position;
+            file_size = other.file_size;
+            modified  = other.modified;
+            return *this;
+        }
+
+        ~file_response_body_communicator() noexcept {
+            close();
+        }
+
+        void close() noexcept {
+            if (fd != -1) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        [[nodiscard]] bool is_open() const noexcept {
+            return fd != -1;
+        }
+
+        [[nodiscard]] int native_handle() const noexcept {
+            return fd;
+        }
+
+        // the size of the whole file (the Content-Length)
+        [[nodiscard]] stl::size_t size() const noexcept {
+            return file_size;
+        }
+
+        // the offset of the next byte that should be sent
+        [[nodiscard]] stl::size_t offset() const noexcept {
+            return position;
+        }
+
+        [[nodiscard]] stl::size_t remaining() const noexcept {
+            return file_size - position;
+        }
+
+        // the protocols call this after sending a part of the file themselves
+        void consume(stl::size_t count) noexcept {
+            position += stl::min(count, remaining());
+        }
+
+        [[nodiscard]] stl::time_t last_modified() const noexcept {
+            return modified;
+        }
+
+        /**
+         * A strong ETag made from the modification time and the size of the file (the way nginx does it):
+         *   "<mtime in hex>-<size in hex>"
+         */
+        template <istl::String StrT>
+        void etag_to(StrT& out) const {
+            stl::array<char, 36> tag{};
+            auto* const          end = tag.data() + tag.size();
+            auto*                ptr = tag.data();
+            *ptr++                   = '"';
+            ptr                      = stl::to_chars(ptr, end, static_cast<stl::uint64_t>(modified), 16).ptr;
+            *ptr++                   = '-';
+            ptr                      = stl::to_chars(ptr, end, file_size, 16).ptr;
+            *ptr++                   = '"';
+            out.append(tag.data(), static_cast<stl::size_t>(ptr - tag.data()));
+        }
+
+        // read the next part of the file; for the protocols that can't use sendfile
+        [[nodiscard]] stl::streamsize read(byte_type* data, stl::streamsize count) noexcept {
+            auto const size = stl::min(static_cast<stl::size_t>(count), remaining());
+            if (fd == -1 || size == 0) {
+                return 0;
+            }
+            auto const res = ::pread(fd, data, size, static_cast<off_t>(position));
+            if (res <= 0) {
+                return 0;
+            }
+            position += static_cast<stl::size_t>(res);
+            return static_cast<stl::streamsize>(res);
+        }
+    };
+#endif // webpp_posix
+
 
     /**
      * @brief Response Body
@@ -70,14 +218,27 @@ namespace webpp::http {
         using string_communicator_type = string_response_body_communicator<traits_type>;
         using blob_communicator_type   = blob_response_body_communicator<traits_type>;
         using stream_communicator_type = stream_response_body_communicator<traits_type>;
+#ifdef webpp_posix
+        using file_communicator_type = file_response_body_communicator<traits_type>;
+#endif
 
         using byte_type = stl::byte; // required by BlobBasedBodyWriter
         using value_type =
           typename string_communicator_type::value_type; // required by the TextBasedBodyWriter
 
         // the order of types in this variant must match the order of http::communicator_type enum
-        using communicator_storage_type = stl::
-          variant<stl::monostate, string_communicator_type, blob_communicator_type, stream_communicator_type>;
+#ifdef webpp_posix
+        using communicator_storage_type = stl::variant<stl::monostate,
+                                                       string_communicator_type,
+                                                       blob_communicator_type,
+                                                       stream_communicator_type,
+                                                       file_communicator_type>;
+#else
+        using communicator_storage_type = stl::variant<stl::monostate,
+                                                       string_communicator_type,
+                                                       blob_communicator_type,
+                                                       stream_communicator_type>;
+#endif
 
         template <HTTPResponseBodyCommunicator NewBodyCommunicator>
         using rebind_body_communicator_type = response_body<traits_type, NewBodyCommunicator>;
@@ -89,6 +250,10 @@ namespace webpp::http {
                       "Response body Stream Based Body Communicator is not a valid SBBC.");
         static_assert(BlobBasedBodyCommunicator<blob_communicator_type>,
                       "Response body Blob Based Body Communicator is not a valid BBBC.");
+#ifdef webpp_posix
+        static_assert(BlobBasedBodyReader<file_communicator_type>,
+                      "Response body File Communicator is not a valid Blob Based Body Reader.");
+#endif
 
 
       private:
@@ -146,6 +311,11 @@ namespace webpp::http {
                             return blob_reader->size();
                         }
                     }
+#ifdef webpp_posix
+                    if (auto const* file_reader = stl::get_if<file_communicator_type>(&communicator)) {
+                        return file_reader->size();
+                    }
+#endif
                     return string_communicator_type::npos;
                 }
             }
@@ -180,20 +350,46 @@ namespace webpp::http {
             }
         }
 
-        constexpr stl::streamsize read(byte_type const* data, stl::streamsize count) {
-            if constexpr (BlobBasedBodyWriter<elist_type>) {
+        /**
+         * Read the next part of a blob or a stream body; returns zero when there's nothing left to read.
+         * The protocols use this to send the body as it's being produced.
+         */
+        constexpr stl::streamsize read(byte_type* data, stl::streamsize count) {
+            if constexpr (BlobBasedBodyReader<elist_type>) {
                 return elist_type::read(data, count);
             } else {
                 if (auto* reader = stl::get_if<blob_communicator_type>(&communicator)) {
                     return reader->read(data, count);
+#ifdef webpp_posix
+                } else if (auto* file_reader = stl::get_if<file_communicator_type>(&communicator)) {
+                    return file_reader->read(data, count);
+#endif
+                } else if (auto* stream = stl::get_if<stream_communicator_type>(&communicator)) {
+                    if (!*stream) {
+                        return 0LL;
+                    }
+                    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                    (*stream)->read(reinterpret_cast<char_type*>(data), count);
+                    return (*stream)->gcount();
                 } else {
                     return 0LL; // nothing is read because we can't read it
                 }
             }
         }
 
+#ifdef webpp_posix
+        // Get the file, if this is a file body; the protocols use it to send the file with sendfile(2)
+        [[nodiscard]] constexpr file_communicator_type* file() noexcept {
+            if constexpr (requires { elist_type::file(); }) {
+                return elist_type::file();
+            } else {
+                return stl::get_if<file_communicator_type>(&communicator);
+            }
+        }
+#endif
+
         // This member function will tell you this body contains what
-        [[nodiscard]] constexpr http::communicator_type witch_communicator() const noexcept {
+        [[nodiscard]] constexpr http::communicator_type which_communicator() const noexcept {
             return static_cast<http::communicator_type>(communicator.index());
         }
 
@@ -246,6 +442,13 @@ namespace webpp::http {
                 elist_type::set(stl::forward<T>(obj));
             } else if constexpr (requires { elist_type::operator=(stl::forward<T>(obj)); }) {
                 elist_type::operator=(stl::forward<T>(obj));
+            } else if constexpr (stl::same_as<stl::remove_cvref_t<T>, blob_communicator_type> ||
+                                 stl::same_as<stl::remove_cvref_t<T>, stream_communicator_type>) {
+                communicator = stl::forward<T>(obj); // the body is sent as it's read
+#ifdef webpp_posix
+            } else if constexpr (stl::same_as<stl::remove_cvref_t<T>, file_communicator_type>) {
+                communicator = stl::forward<T>(obj);
+#endif
             } else if constexpr (requires { serialize_response_body(stl::forward<T>(obj), *this); }) {
                 serialize_response_body(stl::forward(obj), *this);
             } else if constexpr (requires { serialize_body(stl::forward<T>(obj), *this); }) {
@@ -4,6 +4,7 @@
 #define WEBPP_RESPONSE_HEADERS_HPP
 
 #include "../std/format.hpp"
+#include "../std/string_view.hpp"
 #include "../std/vector.hpp"
 #include "../traits/traits.hpp"
 #include "header_fields.hpp"
@@ -90,11 +91,16 @@ namespace webpp::http {
 
         // NOLINTBEGIN(misc-non-private-member-variables-in-classes)
         http::status_code_type status_code = static_cast<http::status_code_type>(http::status_code::ok);
+
+        // a custom reason phrase, instead of the standard one of the status code; it's not copied, so it
+        // should outlive the response (a string literal, usually)
+        stl::string_view reason_phrase{};
         // NOLINTEND(misc-non-private-member-variables-in-classes)
 
-        // set the response http status code
+        // set the response http status code (and its standard reason phrase)
         constexpr response_headers& operator=(http::status_code code) noexcept {
-            status_code = static_cast<status_code_type>(code);
+            status_code   = static_cast<status_code_type>(code);
+            reason_phrase = {};
             return *this;
         }
 
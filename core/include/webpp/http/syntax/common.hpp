@@ -3,14 +3,39 @@
 #ifndef WEBPP_COMMON_HPP
 #define WEBPP_COMMON_HPP
 
+#include "../../strings/charset.hpp"
 #include "../../strings/trim.hpp"
 
+#include <array>
+
 namespace webpp::http {
 
     static constexpr auto http_lws = charset(" \t");
     using http_lws_type            = stl::remove_cvref_t<decltype(http_lws)>;
 
 
+    // RFC 7230 tchar: any VCHAR, except delimiters
+    static constexpr auto http_tchar = charset(ALPHA_DIGIT<char>, charset("!#$%&'*+-.^_`|~"));
+
+    // a table of the token characters, so checking a character is one lookup instead of a search
+    static constexpr auto http_tchar_table = [] {
+        stl::array<bool, 256> table{};
+        for (auto const c : http_tchar) {
+            table[static_cast<unsigned char>(c)] = true;
+        }
+        return table;
+    }();
+
+    [[nodiscard]] static constexpr bool is_tchar(char c) noexcept {
+        return http_tchar_table[static_cast<unsigned char>(c)];
+    }
+
+    // field-vchar (VCHAR / obs-text), SP, and HTAB; which is anything but the control characters
+    [[nodiscard]] static constexpr bool is_field_content(char c) noexcept {
+        auto const uc = static_cast<unsigned char>(c);
+        return (uc >= 0x20 && uc != 0x7F) || uc == '\t';
+    }
+
     // Return true if the character is HTTP "linear white space" (SP | HT).
     // This definition corresponds with the HTTP_LWS macro, and does not match
     // newlines.
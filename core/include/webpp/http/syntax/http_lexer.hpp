@@ -7,7 +7,9 @@
 #include "../../memory/allocators.hpp"
 #include "../../std/string_view.hpp"
 #include "../../std/vector.hpp"
+#include "http_scanner.hpp"
 
+#include <algorithm>
 #include <array>
 
 namespace webpp::http {
@@ -56,10 +58,14 @@ namespace webpp::http {
         static constexpr stl::array<char_type, 2> CRLF{{0x0D, 0x0A}}; // CR(\r), LF(\n)
         static constexpr stl::array<char_type, 2> OWS{{0x20, 0x09}};  // SP, HTAB
 
+        static constexpr string_view_type crlf_view{CRLF.data(), CRLF.size()};
+        static constexpr string_view_type ows_view{OWS.data(), OWS.size()};
+
         string_view_type       raw_view{};
         string_view_type       body_view{};
         header_views_type      header_views{};
         enum http::status_code status_code = http::status_code::ok;
+        bool                   finished    = false; // the empty line at the end of the headers is reached
 
         inline auto consume_next(auto&&... what_to_find) noexcept {
             auto res = raw_view.find(stl::forward<decltype(what_to_find)>(what_to_find)...);
@@ -68,29 +74,71 @@ namespace webpp::http {
             }
         }
 
-        enum http::status_code next_line() noexcept {
-            if (raw_view.starts_with(CRLF.data())) {
-                body_view = raw_view.substr(CRLF.size());
-                return http::status_code::ok;
+        /**
+         * Find the CRLF at the end of the line; the characters of the line are validated in the same pass.
+         * The status is continue_ if the line is not complete yet, and bad_request if it's malformed.
+         */
+        [[nodiscard]] static stl::pair<http::status_code, stl::size_t>
+        find_line_end(string_view_type str) noexcept {
+            auto const pos = find_first_not_field_content(str);
+            if (pos == str.size() || (pos + 1 == str.size() && str[pos] == CRLF[0])) {
+                return {http::status_code::continue_, pos};
             }
-            if (auto colon = raw_view.find(':'); colon != string_view_type::npos) {
-                if (auto after_spaces = raw_view.find_first_not(OWS.data(), colon + 1);
-                    after_spaces != string_view_type::npos) {
-                    if (auto CRLF_found = raw_view.find(CRLF.data(), after_spaces + 1);
-                        CRLF_found != string_view_type::npos) {
-                        header_views.emplace_back(stl::array<string_view_type, 2>{
-                          raw_view.substr(0, colon),
-                          raw_view.substr(after_spaces, CRLF_found - after_spaces)});
-                        return http::status_code::ok; // Good so far
-                    }
-                }
+            if (str[pos] != CRLF[0] || str[pos + 1] != CRLF[1]) {
+                return {http::status_code::bad_request, pos}; // a control character, or a bare CR or LF
             }
-            return http::status_code::bad_request; // Bad Request
+            return {http::status_code::ok, pos};
         }
 
-        http::status_code consume_all() noexcept {
+        /**
+         * Lex the next header field, and remove it from the raw view; the result is:
+         *   - ok:          a header field is added to the header views, or the empty line at the end of
+         *                  the headers is reached ("finished" is set, and the body view is the rest)
+         *   - continue_:   the line is not complete yet; nothing is consumed, more input is needed
+         *   - bad_request: the line is malformed
+         */
+        enum http::status_code next_line() {
+            // one pass over the line finds its end, and checks its characters
+            auto const [status, line_end] = find_line_end(raw_view);
+            if (status != http::status_code::ok) {
+                return status;
+            }
+            if (line_end == 0) {
+                raw_view.remove_prefix(CRLF.size());
+                body_view = raw_view;
+                finished  = true;
+                return http::status_code::ok;
+            }
+
+            // the field name is a token, followed by a colon right away
+            auto const line     = raw_view.substr(0, line_end);
+            auto const name_end = find_first_not_tchar(line);
+            if (name_end == 0 || name_end == line.size() || line[name_end] != ':') {
+                return http::status_code::bad_request; // this includes the obsolete line folding
+            }
+
+            // the value, without the optional white spaces around it
+            auto value = line.substr(name_end + 1);
+            value.remove_prefix(stl::min(value.size(), value.find_first_not_of(ows_view)));
+            value.remove_suffix(value.size() - (value.find_last_not_of(ows_view) + 1));
+
+            header_views.emplace_back(header_view_type{line.substr(0, name_end), value});
+            raw_view.remove_prefix(line_end + CRLF.size());
             return http::status_code::ok;
         }
+
+        /**
+         * Lex all the header fields of the raw view; continue_ means that the headers are not finished
+         */
+        http::status_code consume_all() {
+            while (!finished) {
+                status_code = next_line();
+                if (status_code != http::status_code::ok) {
+                    return status_code;
+                }
+            }
+            return status_code;
+        }
     };
 
 } // namespace webpp::http
@@ -0,0 +1,154 @@
+#ifndef WEBPP_HTTP_SCANNER_HPP
+#define WEBPP_HTTP_SCANNER_HPP
+
+#include "../../libs/eve.hpp"
+#include "../../std/string_view.hpp"
+#include "common.hpp"
+
+#include <cstdint>
+
+#ifdef WEBPP_EVE
+#    include <eve/algo/find.hpp>
+#    include <eve/wide.hpp>
+#endif
+
+/**
+ * The scanners that the HTTP lexer uses to find the delimiters and to validate the characters of the
+ * header fields; with "eve" they check 16 to 64 bytes at a time (depending on the CPU), otherwise they
+ * check one byte at a time with a lookup table.
+ */
+namespace webpp::http {
+
+    namespace details {
+
+        // These predicates are written once for one character and for a SIMD vector of characters, so the
+        // scalar and the SIMD versions can't disagree about the character classes.
+
+        /**
+         * Not a tchar: outside of VCHAR (0x21-0x7E), or one of the delimiters: DQUOTE and "(),/:;<=>?@[\]{}"
+         */
+        template <typename T>
+        [[nodiscard]] constexpr auto is_not_tchar(T c) noexcept {
+            using u8 = stl::uint8_t;
+            return (T(c - u8{0x21}) > u8{0x5D}) || (c == u8{'"'}) || (T(c - u8{'('}) <= u8{1}) ||
+                   (c == u8{','}) || (c == u8{'/'}) || (T(c - u8{':'}) <= u8{6}) ||
+                   (T(c - u8{'['}) <= u8{2}) || (c == u8{'{'}) || (c == u8{'}'});
+        }
+
+        /**
+         * Not field-vchar, SP, or HTAB: the control characters (this includes CR and LF)
+         */
+        template <typename T>
+        [[nodiscard]] constexpr auto is_not_field_content(T c) noexcept {
+            using u8 = stl::uint8_t;
+            return ((c < u8{0x20}) && (c != u8{'\t'})) || (c == u8{0x7F});
+        }
+
+        template <typename StrViewT>
+        [[nodiscard]] inline auto bytes_of(StrViewT str) noexcept {
+            static_assert(sizeof(istl::char_type_of<StrViewT>) == 1, "The scanners only work with bytes.");
+            auto const* first = reinterpret_cast<stl::uint8_t const*>(str.data()); // NOLINT
+            return stl::pair{first, first + str.size()};
+        }
+
+        // the scalar versions; they're used when eve is not available (and by the benchmarks)
+
+        template <istl::StringView StrViewT>
+        [[nodiscard]] constexpr stl::size_t scalar_find_first_not_tchar(StrViewT str) noexcept {
+            stl::size_t pos = 0;
+            while (pos != str.size() && is_tchar(str[pos])) {
+                ++pos;
+            }
+            return pos;
+        }
+
+        template <istl::StringView StrViewT>
+        [[nodiscard]] constexpr stl::size_t scalar_find_first_not_field_content(StrViewT str) noexcept {
+            stl::size_t pos = 0;
+            while (pos != str.size() && is_field_content(str[pos])) {
+                ++pos;
+            }
+            return pos;
+        }
+
+        template <istl::StringView StrViewT>
+        [[nodiscard]] constexpr stl::size_t scalar_find_sp(StrViewT str) noexcept {
+            stl::size_t pos = 0;
+            while (pos != str.size() && str[pos] != ' ') {
+                ++pos;
+            }
+            return pos;
+        }
+
+#ifdef WEBPP_EVE
+        template <istl::StringView StrViewT>
+        [[nodiscard]] inline stl::size_t simd_find_first_not_tchar(StrViewT str) noexcept {
+            auto const [first, last] = bytes_of(str);
+            auto const found         = eve::algo::find_if(eve::algo::as_range(first, last), [](auto c) {
+                return is_not_tchar(c);
+            });
+            return static_cast<stl::size_t>(found - first);
+        }
+
+        template <istl::StringView StrViewT>
+        [[nodiscard]] inline stl::size_t simd_find_first_not_field_content(StrViewT str) noexcept {
+            auto const [first, last] = bytes_of(str);
+            auto const found         = eve::algo::find_if(eve::algo::as_range(first, last), [](auto c) {
+                return is_not_field_content(c);
+            });
+            return static_cast<stl::size_t>(found - first);
+        }
+
+        template <istl::StringView StrViewT>
+        [[nodiscard]] inline stl::size_t simd_find_sp(StrViewT str) noexcept {
+            auto const [first, last] = bytes_of(str);
+            auto const found         = eve::algo::find_if(eve::algo::as_range(first, last), [](auto c) {
+                return c == stl::uint8_t{' '};
+            });
+            return static_cast<stl::size_t>(found - first);
+        }
+#endif
+
+    } // namespace details
+
+    /**
+     * The position of the first character that's not a tchar (the end of a field name or a method); the
+     * size of the string if they all are.
+     */
+    template <istl::StringView StrViewT>
+    [[nodiscard]] inline stl::size_t find_first_not_tchar(StrViewT str) noexcept {
+#ifdef WEBPP_EVE
+        return details::simd_find_first_not_tchar(str);
+#else
+        return details::scalar_find_first_not_tchar(str);
+#endif
+    }
+
+    /**
+     * The position of the first control character; in a header line, it's either the CR of its CRLF, or
+     * the sign of a malformed line. The size of the string if there's none.
+     */
+    template <istl::StringView StrViewT>
+    [[nodiscard]] inline stl::size_t find_first_not_field_content(StrViewT str) noexcept {
+#ifdef WEBPP_EVE
+        return details::simd_find_first_not_field_content(str);
+#else
+        return details::scalar_find_first_not_field_content(str);
+#endif
+    }
+
+    /**
+     * The position of the first SP (the end of a request-target); the size of the string if there's none.
+     */
+    template <istl::StringView StrViewT>
+    [[nodiscard]] inline stl::size_t find_sp(StrViewT str) noexcept {
+#ifdef WEBPP_EVE
+        return details::simd_find_sp(str);
+#else
+        return details::scalar_find_sp(str);
+#endif
+    }
+
+} // namespace webpp::http
+
+#endif // WEBPP_HTTP_SCANNER_HPP
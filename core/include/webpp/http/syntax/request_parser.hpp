@@ -3,9 +3,20 @@
 #ifndef WEBPP_REQUEST_PARSER_HPP
 #define WEBPP_REQUEST_PARSER_HPP
 
+#include "../../std/span.hpp"
+#include "../../std/string_view.hpp"
+#include "../../strings/iequals.hpp"
 #include "../../strings/to_case.hpp"
+#include "../../traits/enable_traits.hpp"
 #include "../../traits/traits.hpp"
+#include "../status_code.hpp"
 #include "../version.hpp"
+#include "common.hpp"
+#include "http_lexer.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <limits>
 
 namespace webpp::http {
 
@@ -18,28 +29,363 @@ namespace webpp::http {
      * attributes or values. For instance, the cookies will be parsed by the cookie class and this class
      * will not parse those.
      *
+     * The parser is resumable: the input is given to "parse" as it's received, in any size of chunks, and
+     * it continues from where it stopped the last time. The input is the whole request that's received so
+     * far (its beginning should not move between the calls); the method, the target, the version, and the
+     * headers are string views into it, so nothing is allocated other than the header views.
+     *
+     * The body is framed with Content-Length, or with the chunked transfer coding; the chunks are decoded
+     * in place (the input is modified), so the body is always one string view, right after the headers.
+     *
      * @tparam TraitsType
      */
     template <Traits TraitsType>
     struct http_request_parser {
-        using traits_type      = TraitsType;
-        using string_type      = traits::general_string<traits_type>;
-        using string_view_type = traits::string_view<traits_type>;
-        using status_code_type = uint_fast16_t;
+        using traits_type       = TraitsType;
+        using string_type       = traits::general_string<traits_type>;
+        using string_view_type  = traits::string_view<traits_type>;
+        using char_type         = istl::char_type_of<string_view_type>;
+        using status_code_type  = uint_fast16_t;
+        using char_allocator    = traits::general_allocator<traits_type, char_type>;
+        using lexer_type        = http_lexer<string_view_type, char_allocator>;
+        using header_view_type  = typename lexer_type::header_view_type;
+        using header_views_type = typename lexer_type::header_views_type;
 
         // todo: add utilities so the user is able to change these limits
         static constexpr auto METHOD_LIMIT = 10;   // return HTTP error 501 (not implemented)
         static constexpr auto URI_LIMIT    = 8000; // return HTTP error 414 (URI too long)
 
+        // the longest line of a chunk's size (with its extensions) that we accept
+        static constexpr stl::size_t chunk_size_line_limit = 1024;
+
         string_view_type method_view{};
         string_view_type request_target_view{};
         string_view_type http_version_view{}; // only the number; doesn't include "HTTP/"
 
+        // the requests that go over these limits are rejected with 414 and 413
+        stl::size_t max_target_size = URI_LIMIT;
+        stl::size_t max_body_size   = stl::numeric_limits<stl::size_t>::max();
+
+      private:
+        enum struct parse_state : stl::uint8_t {
+            request_line,
+            headers,
+            body,           // the body with a Content-Length
+            chunk_size,     // the line that has the size of the next chunk
+            chunk_data,     // the content of a chunk
+            chunk_data_end, // the CRLF after the content of a chunk
+            trailers,       // the header fields after the last chunk; they're ignored
+            done
+        };
+
+        lexer_type  lexer{};
+        char_type*  input       = nullptr; // the beginning of the input
+        stl::size_t pos         = 0;       // the parsed bytes of the input
+        stl::size_t body_begin  = 0;
+        stl::size_t body_length = 0; // the received (and decoded) bytes of the body
+        stl::size_t remaining   = 0; // the bytes of the body (or the current chunk) that are not received yet
+        stl::size_t length      = 0; // the Content-Length
+        parse_state state       = parse_state::request_line;
+        bool        chunked     = false;
+
+        static constexpr string_view_type crlf = lexer_type::crlf_view;
+
+        // the request line is not complete yet, but its method and target can be checked already
+        [[nodiscard]] http::status_code check_partial_request_line(string_view_type str) const noexcept {
+            auto const method_end = str.find(' ');
+            if (method_end == string_view_type::npos) {
+                return str.size() > METHOD_LIMIT ? http::status_code::not_implemented : http::status_code::ok;
+            }
+            auto const target = str.substr(method_end + 1);
+            if (stl::min(target.find(' '), target.size()) > max_target_size) {
+                return http::status_code::uri_too_long;
+            }
+            return http::status_code::ok;
+        }
+
+        // the body is framed with the chunked Transfer-Encoding, or with Content-Length
+        [[nodiscard]] http::status_code prepare_body() noexcept {
+            bool has_length   = false;
+            bool has_encoding = false;
+            for (auto const& [name, value] : lexer.header_views) {
+                if (ascii::iequals(name, "Content-Length")) {
+                    stl::size_t value_length = 0;
+                    auto const* value_end    = value.data() + value.size();
+                    auto const  res          = stl::from_chars(value.data(), value_end, value_length);
+                    if (value.empty() || res.ec != stl::errc{} || res.ptr != value_end ||
+                        (has_length && value_length != length)) {
+                        return http::status_code::bad_request;
+                    }
+                    has_length = true;
+                    length     = value_length;
+                } else if (ascii::iequals(name, "Transfer-Encoding")) {
+                    // we don't decode the other codings (like gzip), only the framing
+                    if (has_encoding || !ascii::iequals(value, "chunked")) {
+                        return http::status_code::not_implemented;
+                    }
+                    has_encoding = true;
+                }
+            }
+            if (has_encoding) {
+                if (has_length) {
+                    return http::status_code::bad_request; // one of them is lying
+                }
+                chunked = true;
+                state   = parse_state::chunk_size;
+                return http::status_code::ok;
+            }
+            if (length > max_body_size) {
+                return http::status_code::payload_too_large;
+            }
+            remaining = length;
+            state     = length == 0 ? parse_state::done : parse_state::body;
+            return http::status_code::ok;
+        }
+
+        [[nodiscard]] http::status_code parse_chunk_size(string_view_type line) noexcept {
+            auto const  digits = line.substr(0, line.find_first_of("; \t")); // without the chunk extensions
+            stl::size_t size   = 0;
+            auto const  res    = stl::from_chars(digits.data(), digits.data() + digits.size(), size, 16);
+            if (digits.empty() || res.ec != stl::errc{} || res.ptr != digits.data() + digits.size()) {
+                return http::status_code::bad_request;
+            }
+            if (size > max_body_size - body_length) {
+                return http::status_code::payload_too_large;
+            }
+            remaining = size;
+            state     = size == 0 ? parse_state::trailers : parse_state::chunk_data;
+            return http::status_code::ok;
+        }
+
+      public:
+        constexpr http_request_parser() = default;
+
+        // the header views are allocated with the allocators of the traits
+        template <EnabledTraits ET>
+        explicit http_request_parser(ET& et)
+          : lexer{.header_views = header_views_type{alloc::general_alloc_for<header_views_type>(et)}} {}
+
         // get the parsed http version
         [[nodiscard]] http::version get_http_version() const noexcept {
             return {http_version_view};
         }
 
+        /**
+         * Parse the input that's received so far; the input should start with the beginning of the request,
+         * and it should include the input of the previous calls.
+         * Returns "ok" if the input is good so far (check is_done to see if the request is complete), or
+         * the error status code that should be sent to the client.
+         */
+        [[nodiscard]] http::status_code parse(stl::span<char_type> data) {
+            input           = data.data();
+            auto const size = data.size();
+            for (;;) {
+                string_view_type rest{input + pos, size - pos};
+                switch (state) {
+                    case parse_state::request_line: {
+                        // empty lines before the request line are ignored (RFC 7230, section 3.5)
+                        while (rest.starts_with(crlf)) {
+                            rest.remove_prefix(crlf.size());
+                            pos += crlf.size();
+                        }
+                        auto const [line_status, line_end] = lexer_type::find_line_end(rest);
+                        if (line_status == http::status_code::continue_) {
+                            return check_partial_request_line(rest);
+                        }
+                        if (line_status != http::status_code::ok) {
+                            return line_status;
+                        }
+                        if (auto const status = parse_request_line(rest.substr(0, line_end)); status != 200) {
+                            return static_cast<http::status_code>(status);
+                        }
+                        if (request_target_view.size() > max_target_size) {
+                            return http::status_code::uri_too_long;
+                        }
+                        pos   += line_end + crlf.size();
+                        state  = parse_state::headers;
+                        break;
+                    }
+                    case parse_state::headers: {
+                        lexer.raw_view    = rest;
+                        auto const status = lexer.consume_all();
+                        pos               = static_cast<stl::size_t>(lexer.raw_view.data() - input);
+                        if (status == http::status_code::continue_) {
+                            return http::status_code::ok;
+                        }
+                        if (status != http::status_code::ok) {
+                            return status;
+                        }
+                        body_begin = pos;
+                        if (auto const body_status = prepare_body(); body_status != http::status_code::ok) {
+                            return body_status;
+                        }
+                        break;
+                    }
+                    case parse_state::body: {
+                        auto const received  = stl::min(rest.size(), remaining);
+                        pos                 += received;
+                        body_length         += received;
+                        remaining           -= received;
+                        if (remaining != 0) {
+                            return http::status_code::ok;
+                        }
+                        state = parse_state::done;
+                        break;
+                    }
+                    case parse_state::chunk_size: {
+                        auto const [line_status, line_end] = lexer_type::find_line_end(rest);
+                        if (line_status == http::status_code::continue_) {
+                            return rest.size() > chunk_size_line_limit ? http::status_code::bad_request
+                                                                       : http::status_code::ok;
+                        }
+                        if (line_status != http::status_code::ok) {
+                            return line_status;
+                        }
+                        if (auto const status = parse_chunk_size(rest.substr(0, line_end));
+                            status != http::status_code::ok) {
+                            return status;
+                        }
+                        pos += line_end + crlf.size();
+                        break;
+                    }
+                    case parse_state::chunk_data: {
+                        // the content of the chunks is moved back, right after the previous chunks
+                        auto const received = stl::min(rest.size(), remaining);
+                        auto*      body_end = input + body_begin + body_length;
+                        if (body_end != input + pos) {
+                            stl::memmove(body_end, input + pos, received);
+                        }
+                        pos         += received;
+                        body_length += received;
+                        remaining   -= received;
+                        if (remaining != 0) {
+                            return http::status_code::ok;
+                        }
+                        state = parse_state::chunk_data_end;
+                        break;
+                    }
+                    case parse_state::chunk_data_end: {
+                        if (rest.size() < crlf.size()) {
+                            return http::status_code::ok;
+                        }
+                        if (!rest.starts_with(crlf)) {
+                            return http::status_code::bad_request;
+                        }
+                        pos   += crlf.size();
+                        state  = parse_state::chunk_size;
+                        break;
+                    }
+                    case parse_state::trailers: {
+                        auto const [line_status, line_end] = lexer_type::find_line_end(rest);
+                        if (line_status == http::status_code::continue_) {
+                            return http::status_code::ok;
+                        }
+                        if (line_status != http::status_code::ok) {
+                            return line_status;
+                        }
+                        pos += line_end + crlf.size();
+                        if (line_end == 0) {
+                            state = parse_state::done;
+                        }
+                        break;
+                    }
+                    case parse_state::done: return http::status_code::ok;
+                }
+            }
+        }
+
+        /**
+         * The whole request is parsed
+         */
+        [[nodiscard]] bool is_done() const noexcept {
+            return state == parse_state::done;
+        }
+
+        /**
+         * The request line and the headers are parsed
+         */
+        [[nodiscard]] bool is_head_done() const noexcept {
+            return state > parse_state::headers;
+        }
+
+        /**
+         * The number of the bytes of the input that belong to this request and are parsed; the rest of the
+         * input (if the request is done) is the beginning of the next request.
+         */
+        [[nodiscard]] stl::size_t consumed() const noexcept {
+            return pos;
+        }
+
+        // the size of the request line and the headers
+        [[nodiscard]] stl::size_t head_size() const noexcept {
+            return body_begin;
+        }
+
+        [[nodiscard]] bool is_chunked() const noexcept {
+            return chunked;
+        }
+
+        [[nodiscard]] stl::size_t content_length() const noexcept {
+            return length;
+        }
+
+        [[nodiscard]] header_views_type const& headers() const noexcept {
+            return lexer.header_views;
+        }
+
+        /**
+         * Get the value of a header (the name is case-insensitive); empty if it's not there
+         */
+        [[nodiscard]] string_view_type header(string_view_type name) const noexcept {
+            for (auto const& [field_name, value] : lexer.header_views) {
+                if (ascii::iequals(field_name, name)) {
+                    return value;
+                }
+            }
+            return {};
+        }
+
+        /**
+         * The body that's received so far (it's decoded if it's chunked)
+         */
+        [[nodiscard]] string_view_type body() const noexcept {
+            if (input == nullptr) {
+                return {};
+            }
+            return {input + body_begin, body_length};
+        }
+
+        /**
+         * The caller has taken the body that's received so far, and has moved the rest of the input (which
+         * started at "consumed()") to where the body started; used when the body doesn't fit in the buffer.
+         */
+        void body_taken() noexcept {
+            pos         = body_begin;
+            body_length = 0;
+        }
+
+        /**
+         * Start parsing the next request; the header views are kept allocated
+         */
+        void reset() noexcept {
+            method_view         = {};
+            request_target_view = {};
+            http_version_view   = {};
+            input               = nullptr;
+            pos                 = 0;
+            body_begin          = 0;
+            body_length         = 0;
+            remaining           = 0;
+            length              = 0;
+            state               = parse_state::request_line;
+            chunked             = false;
+            lexer.raw_view      = {};
+            lexer.body_view     = {};
+            lexer.status_code   = http::status_code::ok;
+            lexer.finished      = false;
+            lexer.header_views.clear();
+        }
+
         // parse the request status line (the first line of the request)
         status_code_type parse_request_line(string_view_type str) noexcept {
             // https://tools.ietf.org/html/rfc7230#section-3.1.1
@@ -52,18 +398,21 @@ namespace webpp::http {
 
             // -------------------------------- parsing method ------------------------------------
 
-            if (auto sp = str.substr(0, METHOD_LIMIT).find(' ');
-                sp != string_view_type::npos) { // find the first SP
+            // the method is a token, so it ends at the first character that's not a tchar, which must be SP
+            auto const method = str.substr(0, METHOD_LIMIT);
+            if (auto const sp = find_first_not_tchar(method); sp == method.size()) {
+                return 501; // Now we must return a 501 (Not Implemented) error message to the user
+            } else if (sp == 0 || method[sp] != ' ') {
+                return 400; // Bad Request; the method is empty, or it's not a token
+            } else {
                 method_view = str.substr(0, sp);
                 str.remove_prefix(sp + 1);
-            } else {
-                return 501; // Now we must return a 501 (Not Implemented) error message to the user
             }
 
             // ------------------------------ parsing request target (path) ------------------------------
 
-            if (auto sp = str.substr(0, URI_LIMIT).find(' ');
-                sp != string_view_type::npos) { // find the second SP
+            auto const target = str.substr(0, URI_LIMIT);
+            if (auto const sp = find_sp(target); sp != target.size()) { // find the second SP
                 request_target_view = str.substr(0, sp);
                 str.remove_prefix(sp + 1);
             } else {
@@ -82,7 +431,7 @@ namespace webpp::http {
             //                return 400; // Bad Request
             //            }
 
-            http_version_view = str.substr(ascii::size(http_prefix) - 1, 3); // 1.1 and 1.0 are 3 chars
+            http_version_view = str.substr(ascii::size(http_prefix)); // 1.1 and 1.0 are 3 chars
             if (http_version_view != "1.0" &&
                 http_version_view != "1.1") { // todo: add 2.0 and 0.9 and others as well
                 return 505;                   // HTTP Version Not Supported
@@ -92,20 +441,6 @@ namespace webpp::http {
 
             return 200; // so far, it's a good request
         }
-
-
-
-        // parse one line of a header (A header field as it called in the RFC)
-        status_code_type parse_header_field(string_view_type& str) noexcept {
-            // todo
-        }
-
-
-        // parse the header fully
-        void parse_header(string_view_type str) noexcept {
-            auto finish_line = str.end();
-            for (auto it = str.begin(); it != finish_line; ++it) {}
-        }
     };
 
 } // namespace webpp::http
@@ -0,0 +1,310 @@
+#ifndef WEBPP_HTTP_RESPONSE_SERIALIZER_HPP
+#define WEBPP_HTTP_RESPONSE_SERIALIZER_HPP
+
+#include "../../std/string.hpp"
+#include "../../std/string_view.hpp"
+#include "../../strings/iequals.hpp"
+#include "../headers/date.hpp"
+#include "../status_code.hpp"
+#include "../version.hpp"
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+
+/**
+ * Serializing the head of a webpp response (the status line, the header fields, and the fields that frame
+ * the body) straight into the output buffer of the protocol, without an intermediate header container.
+ */
+namespace webpp::http {
+
+    // how the end of the body is marked
+    enum struct body_framing : stl::uint8_t {
+        content_length, // Content-Length: <size>
+        chunked,        // Transfer-Encoding: chunked
+        none            // the response doesn't have a body (or the end of the connection is the end of it)
+    };
+
+    // the first line of the response
+    enum struct status_line_style : stl::uint8_t {
+        http, // HTTP/1.1 200 OK
+        cgi   // Status: 200 OK; for CGI and FastCGI, the web server writes the status line itself
+    };
+
+    struct response_head_options {
+        http::version     version        = http_1_1;
+        status_line_style style          = status_line_style::http;
+        body_framing      framing        = body_framing::content_length;
+        stl::size_t       content_length = 0;
+        bool              keep_alive     = true; // the client and the server both want to keep the connection
+        bool              date           = false; // add the Date field, unless the response has one already
+    };
+
+    /**
+     * The whole response that's sent when the server is over its capacity; it's precomputed, so turning a
+     * client away costs (almost) nothing.
+     */
+    static constexpr stl::string_view service_unavailable_response = "HTTP/1.1 503 Service Unavailable\r\n"
+                                                                     "Content-Length: 0\r\n"
+                                                                     "Connection: close\r\n"
+                                                                     "Retry-After: 1\r\n"
+                                                                     "\r\n";
+
+    namespace details {
+
+        static constexpr stl::size_t max_number_size = 20; // digits of the largest 64-bit number
+
+        template <istl::String StrT>
+        void append_number(StrT& out, stl::size_t number) {
+            stl::array<char, max_number_size> digits{};
+            auto const res = stl::to_chars(digits.data(), digits.data() + digits.size(), number);
+            out.append(digits.data(), static_cast<stl::size_t>(res.ptr - digits.data()));
+        }
+
+        /**
+         * The fields that frame the body and manage the connection are written by the serializer from the
+         * options, so the response can't disagree with how the body is actually sent.
+         */
+        template <istl::StringView StrViewT>
+        [[nodiscard]] inline bool is_framing_field(StrViewT name) noexcept {
+            switch (name.size()) {
+                case 10: return ascii::iequals<ascii::char_case_side::second_lowered>(name, "connection");
+                case 14: return ascii::iequals<ascii::char_case_side::second_lowered>(name, "content-length");
+                case 17:
+                    return ascii::iequals<ascii::char_case_side::second_lowered>(name, "transfer-encoding");
+                default: return false;
+            }
+        }
+
+        // the response has a body, unless it's one of these (RFC 9110, section 6.4.1)
+        [[nodiscard]] constexpr bool can_have_body(status_code_type code) noexcept {
+            return code >= 200 && code != 204 && code != 304; // NOLINT(*-magic-numbers)
+        }
+
+        template <istl::StringView StrViewT>
+        [[nodiscard]] inline bool is_date_field(StrViewT name) noexcept {
+            return name.size() == 4 && ascii::iequals<ascii::char_case_side::second_lowered>(name, "date");
+        }
+
+        enum struct status_line_kind : stl::uint8_t { http_1_0, http_1_1, cgi };
+
+        [[nodiscard]] constexpr stl::string_view status_line_prefix(status_line_kind kind) noexcept {
+            switch (kind) {
+                case status_line_kind::http_1_0: return "HTTP/1.0 ";
+                case status_line_kind::http_1_1: return "HTTP/1.1 ";
+                case status_line_kind::cgi: return "Status: ";
+            }
+            return {};
+        }
+
+        static constexpr status_code_type first_status_code = 100;
+        static constexpr status_code_type last_status_code  = 599;
+
+        // "<prefix><code> <phrase>\r\n" of the codes that have a standard reason phrase
+        [[nodiscard]] consteval stl::size_t status_lines_size(status_line_kind kind) {
+            stl::size_t size = 0;
+            for (auto code = first_status_code; code <= last_status_code; ++code) {
+                if (auto const phrase = stl::string_view{status_code_reason_phrase(code)}; !phrase.empty()) {
+                    size += status_line_prefix(kind).size() + 4 + phrase.size() + 2;
+                }
+            }
+            return size;
+        }
+
+        /**
+         * The status lines of all the status codes, rendered at compile time into one buffer; the line of a
+         * code is found by its offset, so writing it is one copy.
+         */
+        template <status_line_kind Kind>
+        struct status_line_table {
+            static constexpr stl::size_t code_count = last_status_code - first_status_code + 1;
+
+            stl::array<char, status_lines_size(Kind)> lines{};
+            // the line of a code ends where the line of the next code starts
+            stl::array<stl::uint16_t, code_count + 1> offsets{};
+
+            consteval status_line_table() {
+                auto const  prefix = status_line_prefix(Kind);
+                stl::size_t pos    = 0;
+                for (auto code = first_status_code; code <= last_status_code; ++code) {
+                    offsets[code - first_status_code] = static_cast<stl::uint16_t>(pos);
+                    auto const phrase = stl::string_view{status_code_reason_phrase(code)};
+                    if (phrase.empty()) {
+                        continue;
+                    }
+                    for (auto const chr : prefix) {
+                        lines[pos++] = chr;
+                    }
+                    lines[pos++] = static_cast<char>('0' + code / 100);
+                    lines[pos++] = static_cast<char>('0' + code / 10 % 10);
+                    lines[pos++] = static_cast<char>('0' + code % 10);
+                    lines[pos++] = ' ';
+                    for (auto const chr : phrase) {
+                        lines[pos++] = chr;
+                    }
+                    lines[pos++] = '\r';
+                    lines[pos++] = '\n';
+                }
+                offsets[code_count] = static_cast<stl::uint16_t>(pos);
+            }
+
+            // empty if the code doesn't have a standard reason phrase
+            [[nodiscard]] constexpr stl::string_view operator[](status_code_type code) const noexcept {
+                if (code < first_status_code || code > last_status_code) {
+                    return {};
+                }
+                auto const index = code - first_status_code;
+                auto const size  = static_cast<stl::size_t>(offsets[index + 1] - offsets[index]);
+                return {lines.data() + offsets[index], size};
+            }
+        };
+
+        template <status_line_kind Kind>
+        static constexpr status_line_table<Kind> status_lines{};
+
+    } // namespace details
+
+    /**
+     * The whole status line of the code ("HTTP/1.1 200 OK\r\n"), from the tables that are rendered at
+     * compile time; it's empty for the codes that don't have a standard reason phrase, and for the versions
+     * other than HTTP/1.0 and HTTP/1.1.
+     */
+    [[nodiscard]] constexpr stl::string_view status_line(status_code_type             code,
+                                                         response_head_options const& options) noexcept {
+        using details::status_line_kind;
+        using details::status_lines;
+        if (options.style == status_line_style::cgi) {
+            return status_lines<status_line_kind::cgi>[code];
+        }
+        if (options.version == http_1_1) {
+            return status_lines<status_line_kind::http_1_1>[code];
+        }
+        if (options.version == http_1_0) {
+            return status_lines<status_line_kind::http_1_0>[code];
+        }
+        return {};
+    }
+
+    /**
+     * Append the status line; the standard ones are copied from the precomputed tables. A custom reason
+     * phrase (instead of the standard one of the code) can be specified.
+     */
+    template <istl::String StrT>
+    void append_status_line(StrT&                        out,
+                            status_code_type             code,
+                            response_head_options const& options,
+                            stl::string_view             reason_phrase = {}) {
+        if (reason_phrase.empty()) {
+            if (auto const line = status_line(code, options); !line.empty()) [[likely]] {
+                out.append(line.data(), line.size());
+                return;
+            }
+            reason_phrase = status_code_reason_phrase(code);
+        }
+        if (options.style == status_line_style::cgi) {
+            out.append("Status: ");
+        } else {
+            out.append("HTTP/");
+            details::append_number(out, options.version.major_value());
+            out.push_back('.');
+            details::append_number(out, options.version.minor_value());
+            out.push_back(' ');
+        }
+        details::append_number(out, code);
+        out.push_back(' ');
+        out.append(reason_phrase.data(), reason_phrase.size());
+        out.append("\r\n");
+    }
+
+    // the Date field of the current second (see cached_date_field); only the servers write it
+    template <istl::String StrT>
+    void append_date_field(StrT& out, response_head_options const& options) {
+        if (options.date && options.style == status_line_style::http) {
+            auto const field = cached_date_field();
+            out.append(field.data(), field.size());
+        }
+    }
+
+    template <istl::String StrT, typename NameT, typename ValueT>
+    void append_header_field(StrT& out, NameT const& name, ValueT const& value) {
+        out.append(name.data(), name.size());
+        out.append(": ");
+        out.append(value.data(), value.size());
+        out.append("\r\n");
+    }
+
+    // the framing fields, and the Connection field if the default of the HTTP version is not what we want
+    template <istl::String StrT>
+    void append_framing_fields(StrT& out, status_code_type code, response_head_options const& options) {
+        if (details::can_have_body(code)) {
+            switch (options.framing) {
+                case body_framing::content_length:
+                    out.append("Content-Length: ");
+                    details::append_number(out, options.content_length);
+                    out.append("\r\n");
+                    break;
+                case body_framing::chunked: out.append("Transfer-Encoding: chunked\r\n"); break;
+                case body_framing::none: break;
+            }
+        }
+        if (options.style == status_line_style::cgi) {
+            return; // the connection belongs to the web server
+        }
+        if (options.version >= http_1_1) {
+            if (!options.keep_alive) {
+                out.append("Connection: close\r\n");
+            }
+        } else if (options.keep_alive) {
+            out.append("Connection: keep-alive\r\n");
+        }
+    }
+
+    /**
+     * Serialize the head of the response into the output: the status line, the header fields, the framing
+     * fields, and the empty line. The size of it is calculated first, so the output is allocated at most
+     * once.
+     *
+     * The framing and connection fields of the response itself are not copied; "Connection: close" is
+     * honored though. The reason phrase of the headers (if they have one) replaces the standard one.
+     * Returns whether the connection can be kept alive after this response.
+     */
+    template <istl::String StrT, typename HeadersT>
+    bool serialize_response_head(StrT& out, HeadersT const& headers, response_head_options options) {
+        static constexpr stl::size_t status_line_size = 9 + 3 + 1 + 2; // "HTTP/1.1 200 " + CRLF
+        static constexpr stl::size_t framing_size     = 2 * 32 + 2;    // the framing fields + CRLF
+
+        auto const       code = headers.status_code;
+        stl::string_view reason_phrase{};
+        if constexpr (requires { headers.reason_phrase; }) {
+            reason_phrase = headers.reason_phrase;
+        }
+
+        stl::size_t size = status_line_size + stl::string_view{status_code_reason_phrase(code)}.size() +
+                           reason_phrase.size() + framing_size + (options.date ? date_field_size : 0);
+        for (auto const& field : headers) {
+            size += field.name.size() + field.value.size() + 4; // ": " and CRLF
+        }
+        out.reserve(out.size() + size);
+
+        append_status_line(out, code, options, reason_phrase);
+        for (auto const& field : headers) {
+            if (options.date && details::is_date_field(istl::string_viewify(field.name))) {
+                options.date = false; // the app has its own
+            } else if (details::is_framing_field(istl::string_viewify(field.name))) {
+                if (ascii::iequals<ascii::char_case_side::second_lowered>(field.name, "connection") &&
+                    ascii::iequals<ascii::char_case_side::second_lowered>(field.value, "close")) {
+                    options.keep_alive = false;
+                }
+                continue;
+            }
+            append_header_field(out, field.name, field.value);
+        }
+        append_date_field(out, options);
+        append_framing_fields(out, code, options);
+        out.append("\r\n");
+        return options.keep_alive;
+    }
+
+} // namespace webpp::http
+
+#endif // WEBPP_HTTP_RESPONSE_SERIALIZER_HPP
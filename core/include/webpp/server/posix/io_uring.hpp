@@ -0,0 +1,323 @@
+#ifndef WEBPP_POSIX_IO_URING_HPP
+#define WEBPP_POSIX_IO_URING_HPP
+
+#include "../../platform/posix.hpp"
+
+#if defined(webpp_posix) && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#    define webpp_io_uring
+#endif
+
+#ifdef webpp_io_uring
+
+#    include "../../std/std.hpp"
+
+#    include <atomic>
+#    include <cerrno>
+#    include <cstring>
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+
+namespace webpp::posix {
+
+    /**
+     * A minimal io_uring submission/completion ring that talks to the kernel with the raw system calls,
+     * so we don't depend on liburing.
+     *
+     * Only the thread that owns the ring should use it.
+     */
+    struct io_uring_ring {
+        io_uring_ring() = default;
+
+        io_uring_ring(io_uring_ring const&)            = delete;
+        io_uring_ring(io_uring_ring&&)                 = delete;
+        io_uring_ring& operator=(io_uring_ring const&) = delete;
+        io_uring_ring& operator=(io_uring_ring&&)      = delete;
+
+        ~io_uring_ring() {
+            close();
+        }
+
+        /**
+         * Create the ring.
+         * Returns 0 on success and -errno on failure; -ENOSYS means the kernel doesn't have io_uring (or it's
+         * disabled).
+         */
+        [[nodiscard]] int setup(unsigned entries, unsigned flags = 0) noexcept {
+            io_uring_params params{};
+            params.flags = flags;
+            fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+            if (fd == -1) {
+                return -errno;
+            }
+
+            sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool const single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single_mmap) {
+                sq_map_size = cq_map_size = stl::max(sq_map_size, cq_map_size);
+            }
+
+            sq_map = ::mmap(nullptr,
+                            sq_map_size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE,
+                            fd,
+                            IORING_OFF_SQ_RING);
+            if (sq_map == MAP_FAILED) {
+                return fail();
+            }
+            if (single_mmap) {
+                cq_map = sq_map;
+            } else {
+                cq_map = ::mmap(nullptr,
+                                cq_map_size,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE,
+                                fd,
+                                IORING_OFF_CQ_RING);
+                if (cq_map == MAP_FAILED) {
+                    return fail();
+                }
+            }
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes      = static_cast<io_uring_sqe*>(::mmap(nullptr,
+                                                     sqes_size,
+                                                     PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_POPULATE,
+                                                     fd,
+                                                     IORING_OFF_SQES));
+            if (sqes == MAP_FAILED) {
+                sqes = nullptr;
+                return fail();
+            }
+
+            auto* const sq = static_cast<char*>(sq_map);
+            auto* const cq = static_cast<char*>(cq_map);
+            sq_head        = reinterpret_cast<unsigned*>(sq + params.sq_off.head); // NOLINT
+            sq_tail        = reinterpret_cast<unsigned*>(sq + params.sq_off.tail); // NOLINT
+            sq_mask        = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask); // NOLINT
+            cq_head        = reinterpret_cast<unsigned*>(cq + params.cq_off.head);       // NOLINT
+            cq_tail        = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);       // NOLINT
+            cq_mask        = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask); // NOLINT
+            cqes           = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);   // NOLINT
+            sq_entries     = params.sq_entries;
+
+            // the submission entries are always used in order, so the indirection array is an identity map
+            auto* const sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array); // NOLINT
+            for (unsigned i = 0; i != sq_entries; ++i) {
+                sq_array[i] = i;
+            }
+            local_tail = *sq_tail;
+            features   = params.features;
+            return 0;
+        }
+
+        void close() noexcept {
+            if (sqes != nullptr) {
+                ::munmap(sqes, sqes_size);
+                sqes = nullptr;
+            }
+            if (cq_map != nullptr && cq_map != MAP_FAILED && cq_map != sq_map) {
+                ::munmap(cq_map, cq_map_size);
+            }
+            if (sq_map != nullptr && sq_map != MAP_FAILED) {
+                ::munmap(sq_map, sq_map_size);
+            }
+            sq_map = cq_map = nullptr;
+            if (fd != -1) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        [[nodiscard]] int native_handle() const noexcept {
+            return fd;
+        }
+
+        // check the IORING_FEAT_* flags that the kernel reported
+        [[nodiscard]] bool has_feature(unsigned feature) const noexcept {
+            return (features & feature) != 0;
+        }
+
+        /**
+         * Get an empty submission entry; the entries are submitted to the kernel on the next submit call.
+         * If the submission queue is full, the queued entries are submitted first.
+         */
+        [[nodiscard]] io_uring_sqe& next_sqe() noexcept {
+            reserve(1);
+            auto& sqe = sqes[local_tail & sq_mask];
+            stl::memset(&sqe, 0, sizeof(sqe));
+            ++local_tail;
+            return sqe;
+        }
+
+        /**
+         * Make sure the next "count" entries fit in the submission queue, so they're submitted together;
+         * the linked entries should be in the same submission.
+         */
+        void reserve(unsigned count) noexcept {
+            unsigned const queued = local_tail - stl::atomic_ref{*sq_head}.load(stl::memory_order_acquire);
+            if (sq_entries - queued < count) {
+                submit(0);
+            }
+        }
+
+        /**
+         * Submit the queued entries, and wait for at least "wait_for" completions.
+         * Returns the number of submitted entries, or -errno.
+         */
+        int submit(unsigned wait_for) noexcept {
+            unsigned const to_submit = local_tail - *sq_tail;
+            stl::atomic_ref{*sq_tail}.store(local_tail, stl::memory_order_release);
+            for (;;) {
+                auto const res = ::syscall(__NR_io_uring_enter,
+                                           fd,
+                                           to_submit,
+                                           wait_for,
+                                           wait_for > 0 ? IORING_ENTER_GETEVENTS : 0u,
+                                           nullptr,
+                                           0);
+                if (res == -1 && errno == EINTR) {
+                    continue;
+                }
+                return res == -1 ? -errno : static_cast<int>(res);
+            }
+        }
+
+        /**
+         * Call "handler" with each of the completions that are ready; returns the number of them.
+         */
+        template <typename HandlerT>
+        unsigned for_each_cqe(HandlerT&& handler) {
+            unsigned       head = *cq_head;
+            unsigned const tail = stl::atomic_ref{*cq_tail}.load(stl::memory_order_acquire);
+            unsigned const count = tail - head;
+            for (; head != tail; ++head) {
+                // the handler may add new submissions, but it can't see this completion again
+                io_uring_cqe const cqe = cqes[head & cq_mask];
+                stl::atomic_ref{*cq_head}.store(head + 1, stl::memory_order_release);
+                handler(cqe);
+            }
+            return count;
+        }
+
+      private:
+        int fail() noexcept {
+            int const err = -errno;
+            close();
+            return err;
+        }
+
+        int           fd          = -1;
+        void*         sq_map      = nullptr;
+        void*         cq_map      = nullptr;
+        stl::size_t   sq_map_size = 0;
+        stl::size_t   cq_map_size = 0;
+        stl::size_t   sqes_size   = 0;
+        io_uring_sqe* sqes        = nullptr;
+        io_uring_cqe* cqes        = nullptr;
+        unsigned*     sq_head     = nullptr;
+        unsigned*     sq_tail     = nullptr;
+        unsigned*     cq_head     = nullptr;
+        unsigned*     cq_tail     = nullptr;
+        unsigned      sq_mask     = 0;
+        unsigned      cq_mask     = 0;
+        unsigned      sq_entries  = 0;
+        unsigned      features    = 0;
+        unsigned      local_tail  = 0; // the tail of the entries that are queued but not submitted yet
+    };
+
+
+    /**
+     * A group of buffers that's provided to the kernel (IORING_OP_PROVIDE_BUFFERS); the kernel picks a
+     * buffer for each read from this group, so the idle connections don't hold any read buffers.
+     */
+    struct provided_buffers {
+        // the user data of the completions of the provide-buffers requests
+        static constexpr stl::uint64_t user_data = 0;
+
+        provided_buffers() = default;
+
+        provided_buffers(provided_buffers const&)            = delete;
+        provided_buffers(provided_buffers&&)                 = delete;
+        provided_buffers& operator=(provided_buffers const&) = delete;
+        provided_buffers& operator=(provided_buffers&&)      = delete;
+
+        ~provided_buffers() {
+            if (data_map != nullptr) {
+                ::munmap(data_map, data_map_size);
+            }
+        }
+
+        /**
+         * Provide "count" buffers of "size" bytes as the buffer group "group_id" of the ring.
+         * Should be called before anything else is submitted to the ring.
+         * Returns 0 on success and -errno on failure.
+         */
+        [[nodiscard]] int
+        setup(io_uring_ring& new_ring, unsigned short count, unsigned size, unsigned short group_id) {
+            ring          = &new_ring;
+            buffer_size   = size;
+            group         = group_id;
+            data_map_size = static_cast<stl::size_t>(count) * size;
+            data_map =
+              ::mmap(nullptr, data_map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data_map == MAP_FAILED) {
+                data_map = nullptr;
+                return -errno;
+            }
+
+            provide(0, count);
+            if (int const res = ring->submit(1); res < 0) {
+                return res;
+            }
+            int res = 0;
+            ring->for_each_cqe([&res](io_uring_cqe const& cqe) {
+                res = cqe.res < 0 ? cqe.res : 0;
+            });
+            return res;
+        }
+
+        [[nodiscard]] char* data(unsigned short bid) const noexcept {
+            return static_cast<char*>(data_map) + static_cast<stl::size_t>(bid) * buffer_size;
+        }
+
+        /**
+         * Give the buffer back to the kernel; it's submitted with the next batch of the ring.
+         * The successful completions are skipped if the kernel supports it, the rest of them have
+         * provided_buffers::user_data as their user data.
+         */
+        void recycle(unsigned short bid) noexcept {
+            auto& sqe = provide(bid, 1);
+            if (ring->has_feature(IORING_FEAT_CQE_SKIP)) {
+                sqe.flags = IOSQE_CQE_SKIP_SUCCESS;
+            }
+        }
+
+      private:
+        io_uring_sqe& provide(unsigned short bid, unsigned short count) noexcept {
+            auto& sqe     = ring->next_sqe();
+            sqe.opcode    = IORING_OP_PROVIDE_BUFFERS;
+            sqe.fd        = count;
+            sqe.addr      = reinterpret_cast<stl::uint64_t>(data(bid)); // NOLINT
+            sqe.len       = buffer_size;
+            sqe.off       = bid;
+            sqe.buf_group = group;
+            sqe.user_data = user_data;
+            return sqe;
+        }
+
+        io_uring_ring* ring          = nullptr;
+        void*          data_map      = nullptr;
+        stl::size_t    data_map_size = 0;
+        unsigned       buffer_size   = 0;
+        unsigned short group         = 0;
+    };
+
+} // namespace webpp::posix
+
+#endif // webpp_io_uring
+
+#endif // WEBPP_POSIX_IO_URING_HPP
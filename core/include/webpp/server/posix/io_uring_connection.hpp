@@ -0,0 +1,191 @@
+#ifndef WEBPP_POSIX_IO_URING_CONNECTION_HPP
+#define WEBPP_POSIX_IO_URING_CONNECTION_HPP
+
+#include "./io_uring.hpp"
+
+#ifdef webpp_io_uring
+
+#    include "../../std/optional.hpp"
+#    include "../../traits/enable_traits.hpp"
+#    include "./posix_connection.hpp"
+
+#    include <cstring>
+#    include <stdexcept>
+#    include <sys/socket.h>
+
+namespace webpp::posix {
+
+    /**
+     * A connection of the io_uring event loop (see io_uring_server).
+     *
+     * Unlike posix_connection, this type doesn't do any I/O itself, the event loop submits the reads and
+     * the writes, and the connection feeds what's been received to the session and keeps track of what's
+     * left to be sent; the session API is the same as posix_connection's.
+     */
+    template <typename TraitsType, typename SessionType>
+    struct io_uring_connection : public enable_traits<TraitsType> {
+        using traits_type  = TraitsType;
+        using session_type = SessionType;
+        using socket_type  = int;
+        using etraits      = enable_traits<traits_type>;
+
+        static constexpr auto           logger_category = "Posix/IOUringConnection";
+        static constexpr unsigned short no_buffer       = 0xFFFFu;
+
+      private:
+        socket_type                 sock = -1;
+        stl::optional<session_type> session{stl::nullopt};
+
+        // the received bytes that are not given to the session yet, and the provided buffer they're in
+        char const*    in_data   = nullptr;
+        stl::size_t    in_size   = 0;
+        unsigned short in_buffer = no_buffer;
+
+        // the part of the output that's not sent yet, and the message that it's sent with
+        pending_output out{};
+        msghdr         out_msg{};
+        bool           closing = false; // the server is drained; don't keep the connection (see drain)
+
+      public:
+        explicit io_uring_connection(auto&&... args) noexcept
+          : etraits{stl::forward<decltype(args)>(args)...} {}
+
+        io_uring_connection(io_uring_connection&&)                 = delete;
+        io_uring_connection(io_uring_connection const&)            = delete;
+        io_uring_connection& operator=(io_uring_connection const&) = delete;
+        io_uring_connection& operator=(io_uring_connection&&)      = delete;
+
+        ~io_uring_connection() {
+            done();
+        }
+
+        void open(socket_type new_sock) {
+            sock = new_sock;
+            session.emplace(static_cast<etraits const&>(*this));
+        }
+
+        [[nodiscard]] bool is_open() const noexcept {
+            return sock != -1;
+        }
+
+        [[nodiscard]] socket_type native_handle() const noexcept {
+            return sock;
+        }
+
+        [[nodiscard]] sockaddr_storage remote_addr() const noexcept {
+            sockaddr_storage addr{};
+            socklen_t        addr_len = sizeof(addr);
+            ::getpeername(sock, reinterpret_cast<sockaddr*>(&addr), &addr_len); // NOLINT
+            return addr;
+        }
+
+        // the session's own buffer; used for reading when there's no provided buffer left
+        [[nodiscard]] stl::pair<char*, stl::size_t> session_buffer() noexcept {
+            auto& buf = session->buffer();
+            return {reinterpret_cast<char*>(stl::data(buf)), // NOLINT
+                    stl::size(buf) * sizeof(*stl::data(buf))};
+        }
+
+        void received(char const* data, stl::size_t size, unsigned short buffer_id = no_buffer) noexcept {
+            in_data   = data;
+            in_size   = size;
+            in_buffer = buffer_id;
+        }
+
+        /**
+         * Give the received bytes to the session until it has something to send.
+         * Returns true if there's output to be sent.
+         */
+        [[nodiscard]] bool consume_input() {
+            while (in_size != 0) {
+                // the buffer of the session may shrink (or move) as the request arrives
+                auto const [buf, buf_size] = session_buffer();
+                if (buf_size == 0) [[unlikely]] {
+                    throw stl::length_error("The session doesn't take the rest of the input.");
+                }
+                stl::size_t const size = stl::min(in_size, buf_size);
+                if (in_data != buf) {
+                    stl::memcpy(buf, in_data, size);
+                }
+                in_data += size;
+                in_size -= size;
+                if (!session->read(size)) {
+                    out.reset(*session);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // the provided buffer that can be given back to the kernel, since all of it is consumed
+        [[nodiscard]] unsigned short release_buffer() noexcept {
+            if (in_size != 0) {
+                return no_buffer;
+            }
+            return stl::exchange(in_buffer, no_buffer);
+        }
+
+        /**
+         * The message of the next send; it should stay valid until the send is done, so it's kept here.
+         */
+        [[nodiscard]] msghdr* output_message() noexcept {
+            out_msg            = {};
+            out_msg.msg_iov    = out.data();
+            out_msg.msg_iovlen = out.size();
+            return &out_msg;
+        }
+
+        [[nodiscard]] bool has_output() const noexcept {
+            return !out.empty();
+        }
+
+        // whether the rest of the output can be sent with one send
+        [[nodiscard]] bool is_last_send() const noexcept {
+            return out.is_last_batch();
+        }
+
+        void sent(stl::size_t bytes) noexcept {
+            out.consume(bytes);
+        }
+
+        [[nodiscard]] bool keep_connection() const noexcept {
+            return !closing && session->keep_connection();
+        }
+
+        /**
+         * The server is drained: the connection is closed after its current response is sent. Returns true
+         * if it's idle (waiting for its next request), so the event loop can close it right away instead.
+         */
+        [[nodiscard]] bool drain() noexcept {
+            closing = true;
+            if constexpr (requires { session->is_idle(); }) {
+                return !has_output() && session->is_idle();
+            } else {
+                return false;
+            }
+        }
+
+        // the socket is closed (by us or by the kernel); returns the provided buffer that it was holding
+        unsigned short closed() noexcept {
+            sock    = -1;
+            in_data = nullptr;
+            in_size = 0;
+            closing = false;
+            out.clear();
+            session.reset();
+            return stl::exchange(in_buffer, no_buffer);
+        }
+
+        unsigned short done() noexcept {
+            if (sock != -1 && ::close(sock) == -1) [[unlikely]] {
+                this->logger.error(logger_category, "Problem with closing connection.", last_error());
+            }
+            return closed();
+        }
+    };
+
+} // namespace webpp::posix
+
+#endif // webpp_io_uring
+
+#endif // WEBPP_POSIX_IO_URING_CONNECTION_HPP
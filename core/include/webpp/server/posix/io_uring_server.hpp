@@ -0,0 +1,502 @@
+#ifndef WEBPP_POSIX_IO_URING_SERVER_HPP
+#define WEBPP_POSIX_IO_URING_SERVER_HPP
+
+#include "./io_uring.hpp"
+
+#ifdef webpp_io_uring
+
+#    include "../../traits/enable_traits.hpp"
+#    include "../../traits/traits.hpp"
+#    include "../server_concepts.hpp"
+#    include "./io_uring_connection.hpp"
+#    include "./posix_listeners.hpp"
+#    include "./posix_thread_pool.hpp"
+#    include "../../std/optional.hpp"
+
+#    include <chrono>
+#    include <linux/time_types.h>
+#    include <poll.h>
+
+namespace webpp::posix {
+
+    /**
+     * This class is the server and the connection manager; the io_uring version of posix_server.
+     *
+     * Each thread has its own ring; and all the I/O is submitted in batches, one io_uring_enter call per
+     * loop iteration submits all the new operations and waits for the next completions:
+     *   - the listeners use multishot accepts, one submission accepts connections until it's cancelled
+     *   - the reads select their buffer from a group of provided buffers, so the idle connections don't
+     *     hold a read buffer
+     *   - when the session doesn't want to keep the connection, the last write and the close are linked
+     *   - when it's drained (or its listeners are handed over to a new process, see handoff_path), the
+     *     accepts are cancelled, the idle connections are closed, and the others are closed after their
+     *     current response; each loop is done when its connections are closed (or the drain timeout is up)
+     *
+     * Use this if io_uring_server::is_supported(), otherwise operator() logs an error and returns -1.
+     */
+    template <Traits TraitsType, SessionManager SessionType, ThreadPool ThreadPoolType = posix_thread_pool>
+    struct io_uring_server : public posix_listeners<TraitsType> {
+        using traits_type      = TraitsType;
+        using etraits          = enable_traits<traits_type>;
+        using super            = posix_listeners<traits_type>;
+        using session_type     = SessionType;
+        using connection_type  = io_uring_connection<traits_type, session_type>;
+        using socket_type      = int;
+        using thread_pool_type = ThreadPoolType;
+
+        static constexpr unsigned default_ring_entries      = 1024;
+        static constexpr unsigned default_read_buffer_size  = 16 * 1024;
+        static constexpr unsigned default_read_buffer_count = 256;
+
+        // how often a draining loop checks if it's done
+        static constexpr int               drain_check_interval = 100; // milliseconds
+        static constexpr __kernel_timespec drain_check_timeout{.tv_sec  = 0,
+                                                               .tv_nsec = drain_check_interval * 1'000'000};
+
+      private:
+        // the type of the operation is kept in the lower bits of the user data; the rest of it is the
+        // connection's pointer, or the listener's index
+        enum struct operation : stl::uint64_t {
+            accept      = 1,
+            stop        = 2, // the stop event, or the handoff socket (see handoff_index)
+            recv        = 3, // into a provided buffer
+            recv_direct = 4, // into the session's buffer
+            send        = 5,
+            send_last   = 6, // linked to a close
+            close       = 7
+        };
+        static constexpr stl::uint64_t operation_mask = 0b111u;
+        static constexpr unsigned short buffer_group  = 0;
+        // the indices of the stop operations
+        static constexpr stl::size_t stop_index        = 0; // the poll of the stop event
+        static constexpr stl::size_t handoff_index     = 1; // the poll of the handoff socket
+        static constexpr stl::size_t drain_check_index = 2; // the timeout of a draining loop
+        static constexpr stl::size_t cancel_index      = 3; // the cancellations of the accepts and the polls
+
+        // each thread has one of these
+        struct event_loop {
+            using time_point = stl::chrono::steady_clock::time_point;
+
+            io_uring_ring                    ring;
+            provided_buffers                 buffers;
+            connection_pool<connection_type> connections{};
+            bool                             multishot_accept = true;
+            bool                             running          = true;
+            bool                             draining         = false;
+            time_point                       drain_deadline{};
+
+            ~event_loop() {
+                // the kernel may still be using the provided buffers and the sessions' buffers in the
+                // in-flight operations, so the ring goes before them
+                ring.close();
+                connections.clear(); // closes the open connections
+            }
+        };
+
+        using super::handoff_fd;
+        using super::listener_families;
+        using super::listeners;
+        using super::logger_cat;
+        using super::stop_fd;
+
+        // runs the event loops of the other threads; it's made when the server starts, with one thread for
+        // each of those loops, since the thread count may be changed until then
+        stl::optional<thread_pool_type> pool{};
+
+      public:
+        using super::super;
+
+        // number of submission entries of each ring
+        unsigned ring_entries = default_ring_entries;
+
+        // number of provided read buffers of each ring, and their size
+        unsigned short read_buffer_count = default_read_buffer_count;
+        unsigned       read_buffer_size  = default_read_buffer_size;
+
+        /**
+         * Check if the kernel supports io_uring (it may be too old, or io_uring may be disabled).
+         */
+        [[nodiscard]] static bool is_supported() noexcept {
+            io_uring_ring ring;
+            return ring.setup(2) == 0;
+        }
+
+      private:
+        template <typename T>
+        static constexpr stl::uint64_t user_data(operation op, T* ptr) noexcept {
+            return reinterpret_cast<stl::uint64_t>(ptr) | static_cast<stl::uint64_t>(op); // NOLINT
+        }
+
+        static constexpr stl::uint64_t user_data(operation op, stl::size_t index) noexcept {
+            return (static_cast<stl::uint64_t>(index) << 3u) | static_cast<stl::uint64_t>(op);
+        }
+
+        void arm_accept(event_loop& loop, stl::size_t index) noexcept {
+            auto& sqe        = loop.ring.next_sqe();
+            sqe.opcode       = IORING_OP_ACCEPT;
+            sqe.fd           = listeners[index];
+            sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe.ioprio       = loop.multishot_accept ? IORING_ACCEPT_MULTISHOT : 0u;
+            sqe.user_data    = user_data(operation::accept, index);
+        }
+
+        // the stop event is never read, so it completes the poll of all the loops
+        void arm_stop(event_loop& loop) noexcept {
+            auto& sqe         = loop.ring.next_sqe();
+            sqe.opcode        = IORING_OP_POLL_ADD;
+            sqe.fd            = stop_fd;
+            sqe.poll32_events = POLLIN;
+            sqe.user_data     = user_data(operation::stop, stop_index);
+        }
+
+        // a new process that connects to the handoff socket completes the poll
+        void arm_handoff(event_loop& loop) noexcept {
+            auto& sqe         = loop.ring.next_sqe();
+            sqe.opcode        = IORING_OP_POLL_ADD;
+            sqe.fd            = handoff_fd;
+            sqe.poll32_events = POLLIN;
+            sqe.user_data     = user_data(operation::stop, handoff_index);
+        }
+
+        // a draining loop wakes up every once in a while to check if it's done
+        void arm_drain_check(event_loop& loop) noexcept {
+            auto& sqe     = loop.ring.next_sqe();
+            sqe.opcode    = IORING_OP_TIMEOUT;
+            sqe.addr      = reinterpret_cast<stl::uint64_t>(&drain_check_timeout); // NOLINT
+            sqe.len       = 1;
+            sqe.user_data = user_data(operation::stop, drain_check_index);
+        }
+
+        // cancel the operation that's submitted with this user data
+        void cancel(event_loop& loop, stl::uint64_t target) noexcept {
+            auto& sqe     = loop.ring.next_sqe();
+            sqe.opcode    = IORING_OP_ASYNC_CANCEL;
+            sqe.addr      = target;
+            sqe.user_data = user_data(operation::stop, cancel_index);
+        }
+
+        void arm_recv(event_loop& loop, connection_type& conn, bool direct = false) noexcept {
+            auto& sqe     = loop.ring.next_sqe();
+            sqe.opcode    = IORING_OP_RECV;
+            sqe.fd        = conn.native_handle();
+            if (direct) {
+                auto [buf, buf_size] = conn.session_buffer();
+                sqe.addr             = reinterpret_cast<stl::uint64_t>(buf); // NOLINT
+                sqe.len              = static_cast<stl::uint32_t>(buf_size);
+                sqe.user_data        = user_data(operation::recv_direct, &conn);
+            } else {
+                sqe.flags     = IOSQE_BUFFER_SELECT;
+                sqe.buf_group = buffer_group;
+                sqe.user_data = user_data(operation::recv, &conn);
+            }
+        }
+
+        void arm_send(event_loop& loop, connection_type& conn) noexcept {
+            // the connection is closed right after the last send, if the session doesn't want to keep it
+            bool const last = !conn.keep_connection() && conn.is_last_send();
+            if (last) {
+                loop.ring.reserve(2);
+            }
+            auto& sqe     = loop.ring.next_sqe();
+            sqe.opcode    = IORING_OP_SENDMSG;
+            sqe.fd        = conn.native_handle();
+            sqe.addr      = reinterpret_cast<stl::uint64_t>(conn.output_message()); // NOLINT
+            sqe.len       = 1;
+            sqe.msg_flags = MSG_NOSIGNAL;
+            sqe.user_data = user_data(operation::send, &conn);
+            if (last) {
+                // let the kernel retry the short writes, since we don't get the chance to do it
+                sqe.msg_flags |= MSG_WAITALL;
+                sqe.flags     = IOSQE_IO_LINK;
+                sqe.user_data = user_data(operation::send_last, &conn);
+
+                auto& close_sqe     = loop.ring.next_sqe();
+                close_sqe.opcode    = IORING_OP_CLOSE;
+                close_sqe.fd        = conn.native_handle();
+                close_sqe.user_data = user_data(operation::close, &conn);
+            }
+        }
+
+        void recycle(event_loop& loop, unsigned short buffer_id) noexcept {
+            if (buffer_id != connection_type::no_buffer) {
+                loop.buffers.recycle(buffer_id);
+            }
+        }
+
+        void close(event_loop& loop, connection_type& conn) noexcept {
+            recycle(loop, conn.done());
+            loop.connections.release(conn);
+        }
+
+        // give the received data to the session, and send its output or read more
+        void process(event_loop& loop, connection_type& conn) noexcept {
+            try {
+                if (conn.consume_input()) {
+                    arm_send(loop, conn);
+                    return;
+                }
+            } catch (stl::exception const& err) {
+                this->logger.error(logger_cat, "Session failed.", err);
+                close(loop, conn);
+                return;
+            }
+            recycle(loop, conn.release_buffer());
+            arm_recv(loop, conn);
+        }
+
+        /**
+         * Stop accepting, and close the idle connections; the reads of the idle connections complete when
+         * they're shut down, and they're closed then. The others are closed after their current response.
+         */
+        void start_draining(event_loop& loop) noexcept {
+            for (stl::size_t i = 0; i != listeners.size(); ++i) {
+                cancel(loop, user_data(operation::accept, i));
+            }
+            if (handoff_fd != -1) {
+                cancel(loop, user_data(operation::stop, handoff_index));
+            }
+            loop.connections.for_each([](connection_type& conn) noexcept {
+                if (conn.is_open() && conn.drain()) {
+                    ::shutdown(conn.native_handle(), SHUT_RDWR);
+                }
+            });
+            loop.draining       = true;
+            loop.drain_deadline = stl::chrono::steady_clock::now() + this->drain_timeout;
+            arm_drain_check(loop);
+        }
+
+        [[nodiscard]] bool is_drained(event_loop const& loop) const noexcept {
+            return loop.connections.open_count() == 0 ||
+                   stl::chrono::steady_clock::now() >= loop.drain_deadline;
+        }
+
+        void stop_operation(event_loop& loop, io_uring_cqe const& cqe, stl::size_t index) noexcept {
+            switch (index) {
+                case stop_index:
+                    // the stop event is never read, so it completes the poll of all the loops
+                    if (this->is_stopping()) {
+                        loop.running = false;
+                    } else {
+                        start_draining(loop);
+                    }
+                    return;
+                case handoff_index:
+                    if (cqe.res < 0 || loop.draining) {
+                        return; // cancelled
+                    }
+                    if (this->hand_over(); !this->handed_off) {
+                        arm_handoff(loop); // wait for the next one
+                    }
+                    return;
+                case drain_check_index:
+                    if (this->is_stopping() || is_drained(loop)) {
+                        loop.running = false;
+                    } else {
+                        arm_drain_check(loop);
+                    }
+                    return;
+                default: return; // a cancellation is done
+            }
+        }
+
+        void accepted(event_loop& loop, io_uring_cqe const& cqe, stl::size_t index) noexcept {
+            bool const more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+            if (cqe.res >= 0) [[likely]] {
+                try {
+                    auto& conn = loop.connections.checkout(*this);
+                    conn.open(cqe.res);
+                    if (loop.draining) {
+                        // accepted before the accept was cancelled; it's served once
+                        static_cast<void>(conn.drain());
+                    }
+                    this->tune_connection(cqe.res, listener_families[index]);
+                    arm_recv(loop, conn);
+                } catch (stl::exception const& err) {
+                    this->logger.error(logger_cat, "Cannot create a connection.", err);
+                    ::close(cqe.res);
+                }
+            } else if (cqe.res == -EINVAL && loop.multishot_accept) {
+                // the kernel is older than 5.19, accept them one by one
+                loop.multishot_accept = false;
+            } else if (cqe.res != -ECANCELED) {
+                // we're probably out of file descriptors
+                this->logger.warning(logger_cat,
+                                     "Could not accept the user.",
+                                     stl::error_code{-cqe.res, stl::system_category()});
+            }
+            if (!more && !loop.draining) {
+                arm_accept(loop, index);
+            }
+        }
+
+        void handle(event_loop& loop, io_uring_cqe const& cqe) noexcept {
+            if (cqe.user_data == provided_buffers::user_data) {
+                if (cqe.res < 0) [[unlikely]] {
+                    this->logger.error(logger_cat,
+                                       "Cannot give the read buffer back to the kernel.",
+                                       stl::error_code{-cqe.res, stl::system_category()});
+                }
+                return;
+            }
+            auto const op = static_cast<operation>(cqe.user_data & operation_mask);
+            switch (op) {
+                case operation::accept:
+                    accepted(loop, cqe, static_cast<stl::size_t>(cqe.user_data >> 3u));
+                    return;
+                case operation::stop:
+                    stop_operation(loop, cqe, static_cast<stl::size_t>(cqe.user_data >> 3u));
+                    return;
+                default: break;
+            }
+
+            auto& conn = *reinterpret_cast<connection_type*>(cqe.user_data & ~operation_mask); // NOLINT
+            switch (op) {
+                case operation::recv:
+                    if (cqe.res > 0) [[likely]] {
+                        auto const buffer_id =
+                          static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                        conn.received(loop.buffers.data(buffer_id),
+                                      static_cast<stl::size_t>(cqe.res),
+                                      buffer_id);
+                        process(loop, conn);
+                    } else if (cqe.res == -ENOBUFS) {
+                        // all the provided buffers are in use, read into the session's buffer instead
+                        arm_recv(loop, conn, true);
+                    } else {
+                        close(loop, conn); // closed by the client, or an error
+                    }
+                    break;
+                case operation::recv_direct:
+                    if (cqe.res > 0) [[likely]] {
+                        conn.received(conn.session_buffer().first, static_cast<stl::size_t>(cqe.res));
+                        process(loop, conn);
+                    } else {
+                        close(loop, conn);
+                    }
+                    break;
+                case operation::send:
+                    if (cqe.res < 0) [[unlikely]] {
+                        close(loop, conn);
+                    } else if (conn.sent(static_cast<stl::size_t>(cqe.res)); conn.has_output()) {
+                        arm_send(loop, conn); // short write, or more buffers than one send takes
+                    } else if (!conn.keep_connection()) {
+                        close(loop, conn);
+                    } else {
+                        // the client may have sent its next request already
+                        process(loop, conn);
+                    }
+                    break;
+                case operation::send_last:
+                    break; // the linked close handles it
+                case operation::close:
+                    if (cqe.res == -ECANCELED) {
+                        // the send has failed, and the close didn't run
+                        close(loop, conn);
+                    } else {
+                        recycle(loop, conn.closed());
+                        loop.connections.release(conn);
+                    }
+                    break;
+                default: break;
+            }
+        }
+
+        // returns 0 or -errno
+        [[nodiscard]] int setup(event_loop& loop) noexcept {
+            int res = loop.ring.setup(ring_entries,
+                                      IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                                        IORING_SETUP_SINGLE_ISSUER);
+            if (res == -EINVAL) {
+                // older kernels don't know about the flags
+                res = loop.ring.setup(ring_entries);
+            }
+            if (res != 0) {
+                return res;
+            }
+            return loop.buffers.setup(loop.ring, read_buffer_count, read_buffer_size, buffer_group);
+        }
+
+        // only one of the loops watches the handoff socket
+        void run_loop(bool watch_handoff = false) noexcept {
+            event_loop loop;
+            if (int const res = setup(loop); res != 0) {
+                this->logger.error(logger_cat,
+                                   "Cannot set up io_uring.",
+                                   stl::error_code{-res, stl::system_category()});
+                return;
+            }
+            for (stl::size_t i = 0; i != listeners.size(); ++i) {
+                arm_accept(loop, i);
+            }
+            arm_stop(loop);
+            if (watch_handoff && handoff_fd != -1) {
+                arm_handoff(loop);
+            }
+
+            this->logger.info(logger_cat, "Starting running IO tasks in a thread.");
+            while (loop.running) {
+                // submit everything that's queued, and wait for something to complete
+                if (int const res = loop.ring.submit(1); res < 0 && res != -EBUSY) [[unlikely]] {
+                    this->logger.error(logger_cat,
+                                       "Error while waiting for the events.",
+                                       stl::error_code{-res, stl::system_category()});
+                    return;
+                }
+                loop.ring.for_each_cqe([&](io_uring_cqe const& cqe) {
+                    handle(loop, cqe);
+                });
+                if (loop.draining && loop.connections.open_count() == 0) {
+                    this->logger.info(logger_cat, "Drained the connections of the thread.");
+                    return;
+                }
+            }
+            this->logger.info(logger_cat, "Finished all the IO tasks in the thread successfully.");
+        }
+
+      public:
+        int operator()() noexcept {
+            if (!is_supported()) {
+                this->logger.error(logger_cat,
+                                   "io_uring is not supported; the kernel is too old, or it's disabled.",
+                                   stl::error_code{ENOSYS, stl::system_category()});
+                return -1;
+            }
+            if (stop_fd == -1 || !this->bind()) {
+                return -1;
+            }
+
+            auto const pool_size = this->thread_count == 0 ? 0 : this->thread_count - 1;
+            try {
+                if constexpr (stl::is_constructible_v<thread_pool_type, stl::size_t>) {
+                    pool.emplace(pool_size);
+                } else {
+                    pool.emplace();
+                }
+            } catch (stl::exception const& err) {
+                this->logger.error(logger_cat, "Cannot start the threads.", err);
+                this->close_listeners();
+                this->close_handoff();
+                return -1;
+            }
+            for (stl::size_t i = 0; i < pool_size; ++i) {
+                pool->post([this] {
+                    run_loop();
+                });
+            }
+            run_loop(true);
+
+            if constexpr (requires { pool->join(); }) {
+                pool->join();
+            }
+            pool.reset();
+            this->close_listeners();
+            this->close_handoff();
+            return 0;
+        }
+    };
+
+} // namespace webpp::posix
+
+#endif // webpp_io_uring
+
+#endif // WEBPP_POSIX_IO_URING_SERVER_HPP
@@ -0,0 +1,30 @@
+#ifndef WEBPP_POSIX_IO_URING_TRAITS_HPP
+#define WEBPP_POSIX_IO_URING_TRAITS_HPP
+
+#include "../server_concepts.hpp"
+#include "io_uring_server.hpp"
+#include "posix_thread_pool.hpp"
+
+#ifdef webpp_io_uring
+
+namespace webpp::posix {
+
+
+    /**
+     * Same as posix_traits, but the server runs on io_uring instead of epoll
+     */
+    template <Traits TraitsType, ThreadPool ThreadPoolType = posix_thread_pool>
+    struct posix_io_uring_traits {
+        using traits_type      = TraitsType;
+        using thread_pool_type = ThreadPoolType;
+
+        template <SessionManager SessionType>
+        using server_type = io_uring_server<traits_type, SessionType, thread_pool_type>;
+    };
+
+
+} // namespace webpp::posix
+
+#endif // webpp_io_uring
+
+#endif // WEBPP_POSIX_IO_URING_TRAITS_HPP
@@ -1,85 +1,289 @@
-#ifndef WEBPP_INTERFACE_COMMON_CONNECTION_H
-#define WEBPP_INTERFACE_COMMON_CONNECTION_H
+#ifndef WEBPP_POSIX_CONNECTION_HPP
+#define WEBPP_POSIX_CONNECTION_HPP
 
 #include "../../platform/posix.hpp"
 
 #ifdef webpp_posix
 
 #    include "../../std/format.hpp"
+#    include "../../std/optional.hpp"
 #    include "../../traits/enable_traits.hpp"
 #    include "../server_concepts.hpp"
 
+#    include <cerrno>
+#    include <climits>
 #    include <netinet/in.h>
 #    include <netinet/tcp.h>
+#    include <sys/epoll.h>
 #    include <sys/socket.h>
 #    include <sys/types.h>
+#    include <sys/uio.h>
+#    include <system_error>
 #    include <unistd.h>
 
 namespace webpp::posix {
 
-    template <typename TraitsType>
+    // the error code of the last failed system call
+    [[nodiscard]] inline stl::error_code last_error() noexcept {
+        return {errno, stl::system_category()};
+    }
+
+    /**
+     * The part of a session's output that's not sent yet, as a list of buffers.
+     * The output of the session is either one buffer (session.output()), or a list of them
+     * (session.output_buffers()) which is sent with one scatter/gather write.
+     */
+    struct pending_output {
+      private:
+        iovec       single{};
+        iovec*      first = nullptr;
+        stl::size_t count = 0;
+
+        void skip_empty() noexcept {
+            while (count != 0 && first->iov_len == 0) {
+                ++first;
+                --count;
+            }
+        }
+
+      public:
+        template <typename SessionType>
+        void reset(SessionType& session) {
+            if constexpr (requires { session.output_buffers(); }) {
+                auto bufs = session.output_buffers();
+                first     = stl::data(bufs);
+                count     = stl::size(bufs);
+            } else {
+                auto const  out  = session.output();
+                auto const* data = reinterpret_cast<char const*>(stl::data(out)); // NOLINT
+                single.iov_base  = const_cast<char*>(data);                        // NOLINT
+                single.iov_len   = stl::size(out) * sizeof(*stl::data(out));
+                first            = &single;
+                count            = 1;
+            }
+            skip_empty();
+        }
+
+        void clear() noexcept {
+            first = nullptr;
+            count = 0;
+        }
+
+        // "bytes" of the output are sent
+        void consume(stl::size_t bytes) noexcept {
+            while (bytes != 0) {
+                auto const size = stl::min(bytes, first->iov_len);
+                first->iov_base = static_cast<char*>(first->iov_base) + size;
+                first->iov_len -= size;
+                bytes -= size;
+                skip_empty();
+            }
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return count == 0;
+        }
+
+        // the buffers that can be given to one system call
+        [[nodiscard]] iovec* data() const noexcept {
+            return first;
+        }
+
+        [[nodiscard]] stl::size_t size() const noexcept {
+            return stl::min<stl::size_t>(count, IOV_MAX);
+        }
+
+        // whether the rest of the output can be sent with one system call
+        [[nodiscard]] bool is_last_batch() const noexcept {
+            return count <= IOV_MAX;
+        }
+    };
+
+    /**
+     * A non-blocking socket that is driven by an edge-triggered epoll event loop (see posix_server).
+     *
+     * The connection owns its session, and talks to it the same way asio_connection does:
+     *   - session.buffer():          a fixed size buffer that the received bytes are read into
+     *   - session.read(bytes):       "bytes" are received into the buffer; returns true if it needs more
+     *   - session.output():          the data (with data() and size()) that should be sent to the client;
+     *                                it should stay valid until the next call to the session
+     *   - session.output_buffers():  instead of output(), a span of iovec buffers that are sent with one
+     *                                writev; the connection modifies them as they're sent
+     *   - session.keep_connection(): whether to wait for another request after the output is sent
+     *   - session.is_idle():         (optional) no part of a request is received yet; when the server is
+     *                                drained, the idle connections are closed right away
+     *
+     * The session is created from the traits of the connection, when the connection is opened.
+     * Connection objects are reused by the event loops, one connection is opened after the other is done.
+     */
+    template <typename TraitsType, typename SessionType>
     struct posix_connection : public enable_traits<TraitsType> {
-        using traits_type = TraitsType;
-        using socket_type = int;
-        using etraits     = enable_traits<traits_type>;
+        using traits_type  = TraitsType;
+        using session_type = SessionType;
+        using socket_type  = int;
+        using etraits      = enable_traits<traits_type>;
 
         static constexpr auto logger_category = "Posix/Connection";
 
       private:
-        socket_type sock;
+        socket_type                 sock = -1;
+        sockaddr_storage            addr{};
+        stl::optional<session_type> session{stl::nullopt};
+
+        pending_output out{};
+        bool           writing = false;
+        bool           closing = false; // close it after the current output is sent (see drain)
 
         /**
-         * This function will read some bytes.
+         * Read until the socket would block; edge-triggered epoll only tells us once about the new data.
          */
-        void read() noexcept {}
-
-        bool write(auto data, stl::size_t data_size) noexcept {}
-
-        bool write_file(auto&& header_buffer, stl::size_t header_buffer_size, auto&& file) noexcept {
+        void read_input() noexcept {
+            for (;;) {
+                // the buffer of the session may shrink (or move) as the request arrives, so it's asked for
+                // before each read; an empty one means the session doesn't take more input for now
+                auto&&            buf      = session->buffer();
+                stl::size_t const buf_size = stl::size(buf) * sizeof(*stl::data(buf));
+                if (buf_size == 0) [[unlikely]] {
+                    return;
+                }
+                ssize_t const res = ::recv(sock, stl::data(buf), buf_size, 0);
+                if (res > 0) [[likely]] {
+                    if (session->read(static_cast<stl::size_t>(res))) {
+                        continue; // the session needs more
+                    }
+                    out.reset(*session);
+                    writing = true;
+                    if (!flush()) {
+                        return; // the socket is full (or it's closed); wait for EPOLLOUT
+                    }
+                    continue; // the client may have sent its next request already
+                }
+                if (res == 0) {
+                    done(); // the client closed the connection
+                    return;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) [[unlikely]] {
+                    this->logger.warning(logger_category, "Error receiving data.", last_error());
+                    done();
+                }
+                return;
+            }
+        }
 
-            // Enable TCP_CORK option on 'sock' - subsequent TCP output is corked
-            // until this option is disabled or the socket is closed
-            int optval = 1; // true
-            if (setsockopt(sock, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval)) == -1) {
-                this->logger.error(logger_category, "Problem setting socket option TCP_CORK.", errno);
-                this->done();
+        /**
+         * Send as much of the output as the socket takes.
+         * Returns true if the whole output is sent and the connection is ready for the next request.
+         */
+        [[nodiscard]] bool flush() noexcept {
+            while (!out.empty()) {
+                msghdr msg{};
+                msg.msg_iov       = out.data();
+                msg.msg_iovlen    = out.size();
+                ssize_t const res = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+                if (res >= 0) [[likely]] {
+                    out.consume(static_cast<stl::size_t>(res));
+                    continue;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) [[unlikely]] {
+                    this->logger.warning(logger_category, "Error sending data.", last_error());
+                    done();
+                }
                 return false;
             }
-
-            // first send the header
-            if (ssize_t written = ::write(sock, header_buffer, header_buffer_size);
-                written != header_buffer_size) {
-                // todo: handle half writes first
+            writing = false;
+            if (closing || !session->keep_connection()) {
+                ::shutdown(sock, SHUT_WR);
+                done();
                 return false;
             }
-
-            // then send the file
-            sendfile(sock, );
             return true;
         }
 
       public:
-        explicit posix_connection(socket_type _sock, auto&&... args) noexcept
-          : sock(_sock),
-            etraits{stl::forward<decltype(args)>(args)...} {}
-
-        void done() {
-            if (close(sock) == -1) {
-                this->logger.error(logger_category, "Problem with closing connection.", errno);
-            }
-            // todo: remove the connection from the connection list
-        }
+        explicit posix_connection(auto&&... args) noexcept
+          : etraits{stl::forward<decltype(args)>(args)...} {}
 
-        // move-able, non-copy-able
-        posix_connection(posix_connection&&) noexcept        = default;
+        posix_connection(posix_connection&&)                 = delete;
         posix_connection(posix_connection const&)            = delete;
         posix_connection& operator=(posix_connection const&) = delete;
         posix_connection& operator=(posix_connection&&)      = delete;
 
-        void swap(posix_connection& con) noexcept {
-            using stl::swap;
-            swap(sock, con.sock);
-            etraits::swap(con);
+        ~posix_connection() {
+            done();
+        }
+
+        /**
+         * Start using a newly accepted socket; the socket should be non-blocking.
+         */
+        void open(socket_type new_sock, sockaddr_storage const& remote) {
+            sock = new_sock;
+            addr = remote;
+            session.emplace(static_cast<etraits const&>(*this));
+        }
+
+        /**
+         * Handle the events that epoll reported for this socket.
+         * Returns false if the connection is closed, and it can be reused for another socket.
+         */
+        [[nodiscard]] bool handle(stl::uint32_t events) noexcept {
+            if ((events & (EPOLLERR | EPOLLHUP)) != 0) [[unlikely]] {
+                done();
+                return false;
+            }
+            if (!writing) {
+                read_input();
+            } else if ((events & EPOLLOUT) != 0 && flush()) {
+                // we stopped reading while we were writing
+                read_input();
+            }
+            return is_open();
+        }
+
+        /**
+         * The server is drained: close the connection if it's idle, or after its current response is sent
+         * otherwise. Returns false if the connection is closed.
+         */
+        [[nodiscard]] bool drain() noexcept {
+            closing = true;
+            if constexpr (requires { session->is_idle(); }) {
+                if (!writing && session->is_idle()) {
+                    done();
+                }
+            }
+            return is_open();
+        }
+
+        [[nodiscard]] bool is_open() const noexcept {
+            return sock != -1;
+        }
+
+        [[nodiscard]] socket_type native_handle() const noexcept {
+            return sock;
+        }
+
+        [[nodiscard]] sockaddr_storage const& remote_addr() const noexcept {
+            return addr;
+        }
+
+        void done() noexcept {
+            if (sock == -1) {
+                return;
+            }
+            // closing the socket removes it from the epoll instance as well
+            if (::close(sock) == -1) [[unlikely]] {
+                this->logger.error(logger_category, "Problem with closing connection.", last_error());
+            }
+            sock    = -1;
+            writing = false;
+            closing = false;
+            out.clear();
+            session.reset();
         }
     };
 
@@ -87,4 +291,4 @@ namespace webpp::posix {
 
 #endif // webpp_posix
 
-#endif // WEBPP_INTERFACE_COMMON_CONNECTION_H
+#endif // WEBPP_POSIX_CONNECTION_HPP
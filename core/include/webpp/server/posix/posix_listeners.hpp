@@ -0,0 +1,594 @@
+#ifndef WEBPP_POSIX_LISTENERS_HPP
+#define WEBPP_POSIX_LISTENERS_HPP
+
+#include "../../platform/posix.hpp"
+#ifdef webpp_posix
+
+#    include "../../std/cassert.hpp"
+#    include "../../std/format.hpp"
+#    include "../../std/string.hpp"
+#    include "../../std/string_view.hpp"
+#    include "../../std/vector.hpp"
+#    include "../../traits/enable_traits.hpp"
+#    include "../../traits/traits.hpp"
+#    include "../socket_handoff.hpp"
+#    include "../socket_options.hpp"
+#    include "./posix_connection.hpp"
+
+#    include <atomic>
+#    include <chrono>
+#    include <cstddef>
+#    include <memory>
+#    include <netdb.h>
+#    include <sys/eventfd.h>
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/types.h>
+#    include <sys/un.h>
+#    include <thread>
+
+namespace webpp::posix {
+
+    struct bindable_endpoint {
+        addrinfo const* endpoint;
+
+        [[nodiscard]] bool is_ipv6() const noexcept {
+            return endpoint->ai_family == AF_INET6;
+        }
+
+        [[nodiscard]] bool is_ipv4() const noexcept {
+            return endpoint->ai_family == AF_INET;
+        }
+    };
+
+
+    /**
+     * This class has the ability to obtain all the IP addresses and Port number that the server can bind to;
+     * or it's a Unix domain socket (see unix_socket).
+     */
+    struct bindable_endpoints {
+      private:
+        addrinfo hints{.ai_flags     = AI_PASSIVE,  // passive to make it a server not a client
+                       .ai_family    = AF_UNSPEC,   // enable IPv6 and IPv4
+                       .ai_socktype  = SOCK_STREAM, // TCP only
+                       .ai_protocol  = 0,
+                       .ai_addrlen   = 0,
+                       .ai_addr      = nullptr,
+                       .ai_canonname = nullptr,
+                       .ai_next      = nullptr};
+
+
+        // yes, we're going to use std::string, we require "char", and not using allocators does not affect
+        // performance that much since this part of code is only needed to start the application and
+        // we don't care about its performance.
+        stl::string _service; // or port
+        stl::string _node;    // the address to bind to (empty means all of them), or the socket's path
+        addrinfo*   _result = nullptr;
+        mode_t      _mode   = 0660; // the permissions of the Unix socket's file
+
+      public:
+        bindable_endpoints(stl::string_view v_service = "http", stl::string_view v_node = "") noexcept
+          : _service{v_service},
+            _node{v_node} {}
+
+        bindable_endpoints(bindable_endpoints const&) =
+          delete; // I don't wanna deal with memory management for now
+        bindable_endpoints(bindable_endpoints&& other) noexcept
+          : hints{other.hints},
+            _service{stl::move(other._service)},
+            _node{stl::move(other._node)},
+            _result{stl::exchange(other._result, nullptr)},
+            _mode{other._mode} {}
+
+        bindable_endpoints& operator=(bindable_endpoints const&) = delete;
+        bindable_endpoints& operator=(bindable_endpoints&& other) noexcept {
+            if (this != &other) {
+                if (_result) {
+                    freeaddrinfo(_result);
+                }
+                hints    = other.hints;
+                _service = stl::move(other._service);
+                _node    = stl::move(other._node);
+                _result  = stl::exchange(other._result, nullptr);
+                _mode    = other._mode;
+            }
+            return *this;
+        }
+
+        ~bindable_endpoints() noexcept {
+            // don't need to free anything in "hints" because it's pointers are always nullptr
+            if (_result) {
+                freeaddrinfo(_result);
+            }
+        }
+
+        /**
+         * A Unix domain socket; for the clients on the same host (a reverse proxy, mostly), it's cheaper
+         * than the loopback TCP. A path that starts with '@' is in the abstract namespace of Linux, it has no
+         * file. A socket file that's left from a previous run is replaced.
+         */
+        [[nodiscard]] static bindable_endpoints unix_socket(stl::string_view path, mode_t mode = 0660) {
+            bindable_endpoints eps{"", path};
+            eps.hints.ai_family = AF_UNIX;
+            eps._mode           = mode;
+            return eps;
+        }
+
+        [[nodiscard]] bool is_unix() const noexcept {
+            return hints.ai_family == AF_UNIX;
+        }
+
+        [[nodiscard]] mode_t mode() const noexcept {
+            return _mode;
+        }
+
+        [[nodiscard]] addrinfo const* result() const noexcept {
+            return _result;
+        }
+
+        [[nodiscard]] stl::string const& service() const noexcept {
+            return _service;
+        }
+
+        [[nodiscard]] stl::string const& node() const noexcept {
+            return _node;
+        }
+
+        // returns the error code of getaddrinfo, 0 means success
+        int resolve() noexcept {
+            if (_result != nullptr || is_unix()) {
+                return 0;
+            }
+            return getaddrinfo(_node.empty() ? nullptr : _node.data(), _service.data(), &hints, &_result);
+        }
+
+        void enable_ipv6() noexcept {
+            switch (hints.ai_family) {
+                case AF_INET6:
+                case AF_UNSPEC: break; // nothing to do
+                case AF_INET: hints.ai_family = AF_UNSPEC; break;
+            }
+        }
+
+        void disable_ipv6() noexcept {
+            webpp_assert(hints.ai_family != AF_INET6,
+                         "cannot disable both ipv4 and ipv6; "
+                         "enable ipv4 before disabling ipv6 to "
+                         "prevent this error from happening.");
+            hints.ai_family = AF_INET;
+        }
+
+        void enable_ipv4() noexcept {
+            switch (hints.ai_family) {
+                case AF_INET:
+                case AF_UNSPEC: break; // nothing to do
+                case AF_INET6: hints.ai_family = AF_UNSPEC; break;
+            }
+        }
+
+        void disable_ipv4() noexcept {
+            webpp_assert(hints.ai_family != AF_INET,
+                         "cannot disable both ipv4 and ipv6; "
+                         "enable ipv6 before disabling ipv4 to "
+                         "prevent this error from happening.");
+            hints.ai_family = AF_INET6;
+        }
+    };
+
+
+
+    /**
+     * The parts that the posix servers have in common (the epoll and the io_uring ones):
+     *   - the listening sockets that are shared between the event loops
+     *   - the stop event that wakes up all the event loops
+     *   - the handoff socket that the listeners are handed over through, to a new process
+     */
+    template <Traits TraitsType>
+    struct posix_listeners : public enable_traits<TraitsType> {
+        using traits_type = TraitsType;
+        using etraits     = enable_traits<traits_type>;
+        using socket_type = int;
+        using duration    = stl::chrono::steady_clock::duration;
+
+        static constexpr auto logger_cat = "Posix/Server";
+
+      protected:
+        stl::vector<socket_type> listeners;
+        stl::vector<int>         listener_families; // the address family of each listener
+        stl::vector<stl::string> unix_paths; // the files of the Unix sockets, removed when they're closed
+        socket_type              stop_fd    = -1;
+        socket_type              handoff_fd = -1; // see handoff_path
+        inherited_sockets        inherited{};     // the listeners of the previous process, while binding
+        stl::atomic<bool>        stopping{false};    // stopped, not drained
+
+        // the listeners (and their files) belong to the new process now
+        bool handed_off = false;
+
+      public:
+        bindable_endpoints              endpoints;
+        stl::vector<bindable_endpoints> more_endpoints; // see listen
+
+        // the options of the listeners and of the connections that they accept
+        socket_options sock_options{};
+
+        // number of event loops (and threads) that run the server
+        stl::size_t thread_count = stl::thread::hardware_concurrency();
+
+        // how long the connections are given to finish their requests when the server is drained
+        duration drain_timeout{stl::chrono::seconds(30)};
+
+        /**
+         * Restart without downtime: the server takes the listeners of the process that's listening on this
+         * Unix socket (see socket_handoff.hpp), and then listens on it for the next process itself. When the
+         * next process takes the listeners, the server is drained.
+         */
+        stl::string handoff_path{};
+
+        // how long the processes wait for each other during a handoff; the thread of the old process that
+        // hands the listeners over waits for the new one to take them
+        duration handoff_timeout{stl::chrono::seconds(10)};
+
+        posix_listeners(auto&&... args) : etraits{stl::forward<decltype(args)>(args)...} {
+            stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (stop_fd == -1) {
+                this->logger.error(logger_cat, "Cannot create the stop event.", last_error());
+            }
+        }
+
+        posix_listeners(posix_listeners const&)            = delete;
+        posix_listeners(posix_listeners&&)                 = delete;
+        posix_listeners& operator=(posix_listeners const&) = delete;
+        posix_listeners& operator=(posix_listeners&&)      = delete;
+
+        ~posix_listeners() {
+            close_listeners();
+            close_handoff();
+            if (stop_fd != -1) {
+                ::close(stop_fd);
+            }
+        }
+
+        /**
+         * Listen on these endpoints too; the connections of all the endpoints are served by the same event
+         * loops. For example, a TCP port for the remote clients and a Unix socket for the local proxy:
+         *   server.endpoints = bindable_endpoints{"8080"};
+         *   server.listen(bindable_endpoints::unix_socket("/run/app/http.sock"));
+         */
+        void listen(bindable_endpoints&& eps) {
+            more_endpoints.push_back(stl::move(eps));
+        }
+
+        /**
+         * Use these listeners instead of opening new ones, for the endpoints that they're bound to; the ones
+         * that are not used are closed when the server starts (see prefork).
+         */
+        void inherit(inherited_sockets&& socks) noexcept {
+            inherited = stl::move(socks);
+        }
+
+        /**
+         * Stop all the event loops; it's safe to call this from other threads and from signal handlers.
+         * The open connections are closed.
+         */
+        void stop() noexcept {
+            stopping.store(true, stl::memory_order_relaxed);
+            wake_up();
+        }
+
+        /**
+         * Stop accepting, and stop the event loops when their connections are closed: the idle connections
+         * are closed right away, the others after their current response is sent. The connections that are
+         * still open after the drain timeout are closed.
+         * It's safe to call this from other threads and from signal handlers.
+         */
+        void drain() noexcept {
+            wake_up();
+        }
+
+      protected:
+        // the stop event is never read, so it wakes up all the loops
+        void wake_up() noexcept {
+            if (::eventfd_write(stop_fd, 1) == -1) {
+                this->logger.error(logger_cat, "Cannot stop the IO tasks.", last_error());
+            }
+        }
+
+        [[nodiscard]] bool is_stopping() const noexcept {
+            return stopping.load(stl::memory_order_relaxed);
+        }
+
+        void close_listeners() noexcept {
+            for (auto const sock : listeners) {
+                ::close(sock);
+            }
+            listeners.clear();
+            listener_families.clear();
+            for (auto const& path : unix_paths) {
+                if (!handed_off) {
+                    ::unlink(path.c_str());
+                }
+            }
+            unix_paths.clear();
+        }
+
+        void close_handoff() noexcept {
+            if (handoff_fd == -1) {
+                return;
+            }
+            ::close(stl::exchange(handoff_fd, -1));
+            if (!handed_off) {
+                ::unlink(handoff_path.c_str());
+            }
+        }
+
+        /**
+         * Open the listening sockets of all the endpoints; the listeners of the previous process are taken
+         * over, if there's a handoff socket.
+         */
+        [[nodiscard]] bool bind() noexcept {
+            if (!handoff_path.empty()) {
+                try {
+                    inherited = inherited_sockets{handoff_path, handoff_timeout};
+                } catch (stl::exception const& err) {
+                    this->logger.warning(logger_cat, "Cannot take the listeners of the old process.", err);
+                }
+            }
+            bool const took_over = !handoff_path.empty() && !inherited.empty();
+            bool       bound     = bind(endpoints);
+            for (auto& eps : more_endpoints) {
+                bound = bound && bind(eps);
+            }
+            if (!bound) {
+                inherited.close(); // the old process keeps serving
+                return false;
+            }
+            if (!handoff_path.empty()) {
+                handoff_fd = listen_handoff(handoff_path);
+                if (handoff_fd == -1) {
+                    this->logger.warning(logger_cat,
+                                         fmt::format("Cannot listen on the handoff socket {}", handoff_path),
+                                         last_error());
+                }
+            }
+            if (took_over) {
+                this->logger.info(logger_cat, "Took over the listeners of the previous process.");
+            }
+            inherited.confirm(); // the previous process is drained
+            return true;
+        }
+
+        /**
+         * A new process has connected to the handoff socket; give it the listeners, and drain the server if
+         * it takes them.
+         */
+        void hand_over() noexcept {
+            if (!hand_over_sockets(handoff_fd, listeners, handoff_timeout)) {
+                this->logger.warning(logger_cat, "The new process didn't take the listeners.", last_error());
+                return;
+            }
+            this->logger.info(logger_cat, "The listeners are handed over to the new process; draining.");
+            handed_off = true;
+            drain();
+        }
+
+        // set the socket options of an accepted connection
+        void tune_connection(socket_type sock, int family) noexcept {
+            if (auto const failed = apply_connection_options(sock, family, sock_options); !failed.empty())
+              [[unlikely]] {
+                this->logger.warning(logger_cat,
+                                     fmt::format("Cannot set {} on the connection.", failed),
+                                     last_error());
+            }
+        }
+
+      private:
+        // set the socket options of a listener, and start listening
+        [[nodiscard]] bool start_listening(socket_type sock, int family) noexcept {
+            if (auto const failed = apply_listener_options(sock, family, sock_options); !failed.empty()) {
+                this->logger.warning(logger_cat,
+                                     fmt::format("Cannot set {} on the listener.", failed),
+                                     last_error());
+                return false;
+            }
+            return ::listen(sock, sock_options.backlog) != -1;
+        }
+
+        // a socket file is stale if nobody's listening on it anymore
+        [[nodiscard]] static bool is_stale_socket(sockaddr_un const& addr) noexcept {
+            struct stat info {};
+            if (::stat(addr.sun_path, &info) == -1 || !S_ISSOCK(info.st_mode)) {
+                return false;
+            }
+            socket_type const sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (sock == -1) {
+                return false;
+            }
+            bool const stale =
+              ::connect(sock, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == -1 && // NOLINT
+              errno == ECONNREFUSED;
+            ::close(sock);
+            return stale;
+        }
+
+        [[nodiscard]] bool bind_unix(bindable_endpoints const& eps) {
+            auto const& path = eps.node();
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+                this->logger.error(logger_cat, fmt::format("Invalid Unix socket path: \"{}\"", path));
+                return false;
+            }
+            stl::copy(path.begin(), path.end(), static_cast<char*>(addr.sun_path));
+            bool const abstract = path.front() == '@';
+            if (abstract) {
+                addr.sun_path[0] = '\0';
+            }
+
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            if (auto const sock = inherited.take(reinterpret_cast<sockaddr const*>(&addr)); sock != -1) {
+                if (!abstract) {
+                    unix_paths.push_back(path);
+                }
+                listeners.push_back(sock);
+                listener_families.push_back(AF_UNIX);
+                return true;
+            }
+            if (!abstract && is_stale_socket(addr)) {
+                ::unlink(path.c_str());
+            }
+
+            socket_type const sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (sock == -1) {
+                this->logger.error(logger_cat, "Can't open a Unix socket.", last_error());
+                return false;
+            }
+            // the abstract names are not null-terminated, their length is in the address length
+            auto const addr_len =
+              static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1));
+            if (::bind(sock, reinterpret_cast<sockaddr const*>(&addr), addr_len) == -1) { // NOLINT
+                this->logger.error(logger_cat,
+                                   fmt::format("Can't bind to the Unix socket {}", path),
+                                   last_error());
+                ::close(sock);
+                return false;
+            }
+            if (!abstract) {
+                unix_paths.push_back(path);
+            }
+            listeners.push_back(sock);
+            listener_families.push_back(AF_UNIX);
+            if ((!abstract && ::chmod(path.c_str(), eps.mode()) == -1) || !start_listening(sock, AF_UNIX)) {
+                this->logger.error(logger_cat,
+                                   fmt::format("Can't listen on the Unix socket {}", path),
+                                   last_error());
+                return false;
+            }
+            return true;
+        }
+
+        [[nodiscard]] bool bind(bindable_endpoints& eps) noexcept {
+            if (eps.is_unix()) {
+                try {
+                    return bind_unix(eps);
+                } catch (stl::exception const& err) {
+                    this->logger.error(logger_cat, "Can't bind to the Unix socket.", err);
+                    return false;
+                }
+            }
+            if (int const res = eps.resolve(); res != 0) {
+                this->logger.error(logger_cat,
+                                   fmt::format("Cannot resolve {}:{}; getaddrinfo error: {}",
+                                               eps.node(),
+                                               eps.service(),
+                                               gai_strerror(res)));
+                return false;
+            }
+
+            // looping over the results of a /etc/host or DNS query
+            auto const bound = listeners.size();
+            for (auto const* it = eps.result(); it != nullptr; it = it->ai_next) {
+                bindable_endpoint const ep{it};
+                if (auto const inherited_sock = inherited.take(it->ai_addr); inherited_sock != -1) {
+                    listeners.push_back(inherited_sock);
+                    listener_families.push_back(it->ai_family);
+                    continue;
+                }
+                socket_type sock =
+                  ::socket(it->ai_family, it->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, it->ai_protocol);
+                if (sock == -1) {
+                    this->logger.warning(
+                      logger_cat,
+                      fmt::format("Can't open a socket for {}:{}; trying the next one if exists",
+                                  eps.node(),
+                                  eps.service()),
+                      last_error());
+                    continue;
+                }
+
+                int optval = 1;
+                // IPv6 sockets shouldn't take the IPv4 addresses too, there's an IPv4 socket for them
+                if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1 ||
+                    (ep.is_ipv6() &&
+                     setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &optval, sizeof(optval)) == -1)) {
+                    this->logger.warning(logger_cat,
+                                         "We weren't able to set necessary options for the specified socket",
+                                         last_error());
+                    ::close(sock);
+                    continue;
+                }
+
+                if (::bind(sock, it->ai_addr, it->ai_addrlen) == -1 ||
+                    !start_listening(sock, it->ai_family)) {
+                    this->logger.warning(
+                      logger_cat,
+                      fmt::format("Can't bind to a socket for {}:{}; trying the next one if exists",
+                                  eps.node(),
+                                  eps.service()),
+                      last_error());
+                    ::close(sock); // close it because for some reason we can't bind to it
+                    continue;
+                }
+
+                listeners.push_back(sock);
+                listener_families.push_back(it->ai_family);
+            }
+            if (listeners.size() == bound) {
+                this->logger.error(logger_cat,
+                                   fmt::format("Cannot listen on {}:{}", eps.node(), eps.service()));
+                return false;
+            }
+            return true;
+        }
+    };
+
+
+    /**
+     * The connections of one event loop; the closed connections are kept to be reused for the next ones.
+     */
+    template <typename ConnectionType>
+    struct connection_pool {
+        using connection_type = ConnectionType;
+
+        // get a closed connection, or make a new one
+        connection_type& checkout(auto const& et) {
+            if (free_connections.empty()) {
+                return *connections.emplace_back(stl::make_unique<connection_type>(et));
+            }
+            auto* conn = free_connections.back();
+            free_connections.pop_back();
+            return *conn;
+        }
+
+        void release(connection_type& conn) {
+            free_connections.push_back(&conn);
+        }
+
+        // number of the connections that are open
+        [[nodiscard]] stl::size_t open_count() const noexcept {
+            return connections.size() - free_connections.size();
+        }
+
+        // call it for each of the connections, the closed ones included
+        template <typename Callable>
+        void for_each(Callable&& callable) {
+            for (auto& conn : connections) {
+                callable(*conn);
+            }
+        }
+
+        // close all the connections
+        void clear() noexcept {
+            free_connections.clear();
+            connections.clear();
+        }
+
+      private:
+        stl::vector<stl::unique_ptr<connection_type>> connections{};
+        stl::vector<connection_type*>                 free_connections{};
+    };
+
+} // namespace webpp::posix
+
+#endif // webpp_posix
+
+#endif // WEBPP_POSIX_LISTENERS_HPP
@@ -1,230 +1,287 @@
-#ifndef WEBPP_INTERFACES_COMMON_SERVER_H
-#define WEBPP_INTERFACES_COMMON_SERVER_H
+#ifndef WEBPP_POSIX_SERVER_HPP
+#define WEBPP_POSIX_SERVER_HPP
 
 #include "../../platform/posix.hpp"
 #ifdef webpp_posix // check if it's okay to use unix stuff here
 
-#    include "../../std/cassert.hpp"
-#    include "../../std/vector.hpp"
 #    include "../../traits/enable_traits.hpp"
 #    include "../../traits/traits.hpp"
 #    include "../server_concepts.hpp"
 #    include "./posix_connection.hpp"
-#    include "./posix_constants.hpp"
+#    include "./posix_listeners.hpp"
 #    include "./posix_thread_pool.hpp"
+#    include "../../std/optional.hpp"
 
-#    include <netdb.h>
-#    include <sys/socket.h>
-#    include <sys/types.h>
+#    include <array>
+#    include <chrono>
+#    include <sys/epoll.h>
 
 namespace webpp::posix {
 
-    struct bindable_endpoint {
-        addrinfo* endpoint;
-
-        bool is_ipv6() const noexcept {}
-
-        bool is_ipv4() const noexcept {}
-    };
-
-
-    /**
-     * This class has the ability to obtain all the IP addresses and Port number that the server can bind to
-     */
-    struct bindable_endpoints {
-      private:
-        addrinfo hints{.ai_flags     = AI_PASSIVE,  // passive to make it a server not a client
-                       .ai_family    = AF_UNSPEC,   // enable IPv6 and IPv4
-                       .ai_socktype  = SOCK_STREAM, // TCP only
-                       .ai_protocol  = 0,
-                       .ai_addrlen   = 0,
-                       .ai_addr      = nullptr,
-                       .ai_canonname = nullptr,
-                       .ai_next      = nullptr}
-
-
-        // yes, we're going to use std::string, we require "char", and not using allocators does not affect
-        // performance that much since this part of code is only needed to start the application and
-        // we don't care about its performance.
-        stl::string _service; // or port
-        addrinfo*   _result = nullptr;
-
-      public:
-        bindable_endpoints(istl::Stringifiable auto&& v_service = "http") noexcept
-          : _service{istl::stringify(stl::forward<decltype(v_service)>(v_service))} {}
-
-        bindable_endpoints(bindable_endpoints const&) =
-          delete; // I don't wanna deal with memory management for now
-        bindable_endpoints(bindable_endpoints&&) noexcept = default;
-
-        ~bindable_endpoints() noexcept {
-            // don't need to free anything in "hints" because it's pointers are always nullptr
-            if (result)
-                freeaddrinfo(result);
-        }
-
-        const addrinfo* result() const noexcept {
-            return _result;
-        }
-
-        const stl::string& service() const noexcept {
-            return _service;
-        }
-
-        void resolve() noexcept {
-            if (result == nullptr) {
-                int res = getaddrinfo(nullptr, service.data(), &hints, &result);
-                webpp_assert(res == 0, fmt::format("posix::getaddrinfo error: {}", gai_strerror(res)));
-            }
-        }
-
-        void enable_ipv6() noexcept {
-            switch (hints.ai_family) {
-                case AF_INET6:
-                case AF_UNSPEC: break; // nothing to do
-                case AF_INET: hints.ai_family = AF_UNSPEC; break;
-            }
-        }
-
-        void disable_ipv6() noexcept {
-            webpp_assert(hints.ai_family != AF_INET6,
-                         "cannot disable both ipv4 and ipv6; "
-                         "enable ipv4 before disabling ipv6 to "
-                         "prevent this error from happening.");
-            hints.ai_family = AF_INET;
-        }
-
-        void enable_ipv4() noexcept {
-            switch (hints.ai_family) {
-                case AF_INET:
-                case AF_UNSPEC: break; // nothing to do
-                case AF_INET6: hints.ai_family = AF_UNSPEC; break;
-            }
-        }
-
-        void disable_ipv4() noexcept {
-            webpp_assert(hints.ai_family != AF_INET,
-                         "cannot disable both ipv4 and ipv6; "
-                         "enable ipv6 before disabling ipv4 to "
-                         "prevent this error from happening.");
-            hints.ai_family = AF_INET6;
-        }
-    };
-
-
     /**
      * This class is the server and the connection manager.
+     *
+     * It's an edge-triggered epoll event loop that doesn't depend on anything but the OS:
+     *   - all the listening sockets are shared between the event loops
+     *   - each thread runs its own event loop, with its own epoll instance and its own connections; a
+     *     connection never leaves the thread that accepted it
+     *   - the listeners are registered with EPOLLEXCLUSIVE, so only one of the loops is woken up for a new
+     *     connection; that loop accepts it with a non-blocking accept4
+     *   - the connection objects (and their read buffers) are reused for the next connections
+     *   - when it's drained, the loops stop accepting and stop waiting for the next requests of the
+     *     connections, and each loop is done when its connections are closed (or the drain timeout is up)
      */
     template <Traits TraitsType, SessionManager SessionType, ThreadPool ThreadPoolType = posix_thread_pool>
-    struct posix_server : public enable_traits<TraitsType> {
+    struct posix_server : public posix_listeners<TraitsType> {
         using traits_type      = TraitsType;
         using etraits          = enable_traits<traits_type>;
+        using super            = posix_listeners<traits_type>;
         using session_type     = SessionType;
         using connection_type  = posix_connection<traits_type, session_type>;
         using socket_type      = int;
         using thread_pool_type = ThreadPoolType;
 
+        // maximum number of events that we get from each epoll_wait
+        static constexpr int max_events = 128;
+
+        // how often a draining loop checks if it's done
+        static constexpr int drain_check_interval = 100; // milliseconds
+
       private:
-        static constexpr auto                      logger_cat = "Posix/Server";
-        istl::vector<traits_type, connection_type> connections;
-        istl::vector<traits_type, acceptor_type>   acceptors;
-        thread_pool_type                           pool{};
+        // each thread has one of these
+        struct event_loop {
+            using events_type = stl::array<epoll_event, static_cast<stl::size_t>(max_events)>;
+
+            using time_point = stl::chrono::steady_clock::time_point;
+
+            int                              epoll_fd = -1;
+            connection_pool<connection_type> connections{};
+            events_type                      events{};
+            bool                             draining = false;
+            time_point                       drain_deadline{};
+
+            event_loop()                             = default;
+            event_loop(event_loop const&)            = delete;
+            event_loop(event_loop&&)                 = delete;
+            event_loop& operator=(event_loop const&) = delete;
+            event_loop& operator=(event_loop&&)      = delete;
+
+            ~event_loop() {
+                connections.clear(); // closes the open connections
+                if (epoll_fd != -1) {
+                    ::close(epoll_fd);
+                }
+            }
+        };
 
-      public:
-        bindable_endpoints endpoints;
+        using super::handoff_fd;
+        using super::listeners;
+        using super::logger_cat;
+        using super::stop_fd;
+
+        // The epoll user data of the listeners (and the stop event, and the handoff socket) is
+        // "(index << 1) | 1"; the connections' user data is their pointer, which is never odd.
+        static constexpr stl::uint64_t listener_tag = 1u;
 
-        posix_server(auto&&... args)
-          : etraits{stl::forward<decltype(args)>(args)...},
-            connections{etraits::get_allocator()} acceptors{etraits::get_allocator()} {};
+        // runs the event loops of the other threads; it's made when the server starts, with one thread for
+        // each of those loops, since the thread count may be changed until then
+        stl::optional<thread_pool_type> pool{};
+
+      public:
+        using super::super;
 
       private:
-        void accept(socket_type socket) noexcept {
-            // todo: check whether or not the server was stopped by a signal
-
-            // todo: before this completes, handler had a chance to run
-            if (!ec) {
-                connections.emplace_back(stl::move(socket));
-            } else {
-                logger.info(logger_cat, "Could not accept the user.", ec);
+        /**
+         * Accept all the connections that are waiting
+         */
+        void accept(event_loop& loop, socket_type listener) noexcept {
+            for (int i = 0; i != max_events; ++i) {
+                sockaddr_storage remote{};
+                socklen_t        remote_len = sizeof(remote);
+                socket_type      sock       = ::accept4(listener,
+                                             reinterpret_cast<sockaddr*>(&remote), // NOLINT
+                                             &remote_len,
+                                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (sock == -1) {
+                    switch (errno) {
+                        case EINTR:
+                        case ECONNABORTED: continue;
+                        case EAGAIN: return; // we've accepted all of them
+                        default:
+                            // we're probably out of file descriptors
+                            this->logger.warning(logger_cat, "Could not accept the user.", last_error());
+                            return;
+                    }
+                }
+
+                connection_type* conn; // NOLINT(cppcoreguidelines-init-variables)
+                try {
+                    conn = &loop.connections.checkout(*this);
+                    conn->open(sock, remote);
+                    this->tune_connection(sock, remote.ss_family);
+                } catch (stl::exception const& err) {
+                    this->logger.error(logger_cat, "Cannot create a connection.", err);
+                    ::close(sock);
+                    return;
+                }
+
+                epoll_event event{.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                                  .data   = {.ptr = conn}};
+                if (::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, sock, &event) == -1) [[unlikely]] {
+                    this->logger.warning(logger_cat, "Cannot watch the connection.", last_error());
+                    conn->done();
+                    loop.connections.release(*conn);
+                }
+                // The events of the data that's already received are reported right away, we don't have to
+                // read it here.
             }
         }
 
-        void start_accepting() noexcept {}
+        // add a listener, the stop event, or the handoff socket into the epoll instance
+        [[nodiscard]] bool watch(event_loop& loop, socket_type sock, stl::uint64_t index) noexcept {
+            // the stop event should wake up all the loops, a new connection should wake up only one of them
+            stl::uint32_t const flags = index == listeners.size() ? 0u : stl::uint32_t{EPOLLEXCLUSIVE};
+            epoll_event         event{.events = EPOLLIN | flags,
+                                      .data   = {.u64 = (index << 1u) | listener_tag}};
+            if (::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, sock, &event) == -1) {
+                this->logger.error(logger_cat, "Cannot watch the listener.", last_error());
+                return false;
+            }
+            return true;
+        }
 
         /**
-         * Initialize the connections based on the endpoints
+         * Stop accepting, and close the idle connections; the stop event is not watched anymore either
+         * (it's never read), the loop checks if it's done every once in a while instead.
          */
-        void bind() noexcept {
-            endpoints.resolve(); // resolve the servers
-
-            // looping over the results of a /etc/host or DNS query
-            for (auto* it = endpoints.result(); it != NULL; it = it->ai_next) {
-                socket_type sock = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
-                if (sock == -1) {
-                    etraits::logger.warning(
-                      logger_cat,
-                      fmt::format("Can't open a socket for {}:{}; trying the next one if exists",
-                                  ep.server_name(),
-                                  ep.service()),
-                      errno);
-                    continue;
+        void start_draining(event_loop& loop) noexcept {
+            for (auto const sock : listeners) {
+                ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+            }
+            ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, stop_fd, nullptr);
+            if (handoff_fd != -1) {
+                ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, handoff_fd, nullptr);
+            }
+            loop.connections.for_each([&loop](connection_type& conn) noexcept {
+                if (conn.is_open() && !conn.drain()) {
+                    loop.connections.release(conn);
                 }
+            });
+            loop.draining       = true;
+            loop.drain_deadline = stl::chrono::steady_clock::now() + this->drain_timeout;
+        }
 
-                int optval = 1;
-                if (setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1) {
-                    etraits::logger.warning(
-                      logger_cat,
-                      "We weren't able to set necessary options for the specified socket",
-                      errno);
-                    close(sock);
-                    continue;
-                }
+        [[nodiscard]] bool is_drained(event_loop const& loop) const noexcept {
+            return loop.connections.open_count() == 0 ||
+                   stl::chrono::steady_clock::now() >= loop.drain_deadline;
+        }
 
-                if (bind(sock, it->ai_addr, it->ai_addrlen) == -1) {
-                    etraits::logger.warning(
-                      logger_cat,
-                      fmt::format("Can't bind to a socket for {}:{}; trying the next one if exists",
-                                  ep.server_name(),
-                                  ep.service()),
-                      errno);
-                    close(sock); // close it because for some reason we can't bind to it
-                    continue;
+        void run_loop() noexcept {
+            event_loop loop;
+            loop.epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+            if (loop.epoll_fd == -1) {
+                this->logger.error(logger_cat, "Cannot create an epoll instance.", last_error());
+                return;
+            }
+            for (stl::size_t i = 0; i != listeners.size(); ++i) {
+                if (!watch(loop, listeners[i], i)) {
+                    return;
                 }
+            }
+            if (!watch(loop, stop_fd, listeners.size())) {
+                return;
+            }
+            if (handoff_fd != -1 && !watch(loop, handoff_fd, listeners.size() + 1)) {
+                return;
+            }
 
-                connections.emplace_back(sock); // pass the socket to a connection
+            this->logger.info(logger_cat, "Starting running IO tasks in a thread.");
+            for (;;) {
+                if (loop.draining && (this->is_stopping() || is_drained(loop))) {
+                    this->logger.info(logger_cat, "Drained the connections of the thread.");
+                    return;
+                }
+                int const count = ::epoll_wait(loop.epoll_fd,
+                                               loop.events.data(),
+                                               max_events,
+                                               loop.draining ? drain_check_interval : -1);
+                if (count == -1) [[unlikely]] {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    this->logger.error(logger_cat, "Error while waiting for the events.", last_error());
+                    return;
+                }
+                for (int i = 0; i != count; ++i) {
+                    auto const& event = loop.events[static_cast<stl::size_t>(i)];
+                    if ((event.data.u64 & listener_tag) == 0) [[likely]] {
+                        auto* conn = static_cast<connection_type*>(event.data.ptr);
+                        if (conn->is_open() && !conn->handle(event.events)) {
+                            loop.connections.release(*conn);
+                        }
+                        continue;
+                    }
+                    auto const index = static_cast<stl::size_t>(event.data.u64 >> 1u);
+                    if (index == listeners.size()) {
+                        // the stop event is never read, so it wakes up all the loops
+                        if (this->is_stopping()) {
+                            this->logger.info(logger_cat,
+                                              "Finished all the IO tasks in the thread successfully.");
+                            return;
+                        }
+                        start_draining(loop);
+                        continue; // the connections that it has closed are skipped
+                    }
+                    if (index == listeners.size() + 1) {
+                        this->hand_over();
+                        continue;
+                    }
+                    if (!loop.draining) {
+                        accept(loop, listeners[index]);
+                    }
+                }
             }
         }
 
       public:
-        void operator()() noexcept {
-            pool.post(
-              [this]() {
-                  // Run until the tasks finishes normally.
-                  // Don't worry, we'll accept another connection when we finish one of them
-                  for (;;) {
-                      try {
-                          start_accepting();
-                          etraits::logger.info(logger_cat, "Starting running IO tasks in a thread.");
-                          io.run();
-                          etraits::logger.info(logger_cat,
-                                               "Finished all the IO tasks in the thread successfully.");
-                          break;
-                      } catch (stl::exception const& err) {
-                          etraits::logger.error(logger_cat, "Server tasks finished with errors.", err);
-                      }
-                  }
-              },
-              connections.get_allocator());
-        }
+        int operator()() noexcept {
+            if (stop_fd == -1 || !this->bind()) {
+                return -1;
+            }
 
-        void stop() noexcept {
-            // this will stop all threads
-            etraits::logger.info(logger_cat, "Stopping all the IO tasks.");
+            auto const pool_size = this->thread_count == 0 ? 0 : this->thread_count - 1;
+            try {
+                if constexpr (stl::is_constructible_v<thread_pool_type, stl::size_t>) {
+                    pool.emplace(pool_size);
+                } else {
+                    pool.emplace();
+                }
+            } catch (stl::exception const& err) {
+                this->logger.error(logger_cat, "Cannot start the threads.", err);
+                this->close_listeners();
+                this->close_handoff();
+                return -1;
+            }
+            for (stl::size_t i = 0; i < pool_size; ++i) {
+                pool->post([this] {
+                    run_loop();
+                });
+            }
+            run_loop();
+
+            if constexpr (requires { pool->join(); }) {
+                pool->join();
+            }
+            pool.reset();
+            this->close_listeners();
+            this->close_handoff();
+            return 0;
         }
+
     };
 
 } // namespace webpp::posix
 
 #endif // webpp_posix
 
-#endif // WEBPP_INTERFACES_COMMON_SERVER_H
+#endif // WEBPP_POSIX_SERVER_HPP
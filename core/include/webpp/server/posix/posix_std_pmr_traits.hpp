@@ -1,7 +1,7 @@
 // Created by moisrex on 9/7/20.
 
-#ifndef WEBPP_ASIO_STD_PMR_TRAITS_HPP
-#define WEBPP_ASIO_STD_PMR_TRAITS_HPP
+#ifndef WEBPP_POSIX_STD_PMR_TRAITS_HPP
+#define WEBPP_POSIX_STD_PMR_TRAITS_HPP
 
 #include "../../traits/std_pmr_traits.hpp"
 #include "posix_traits.hpp"
@@ -16,4 +16,4 @@ namespace webpp::posix {
 
 } // namespace webpp::posix
 
-#endif // WEBPP_ASIO_STD_PMR_TRAITS_HPP
+#endif // WEBPP_POSIX_STD_PMR_TRAITS_HPP
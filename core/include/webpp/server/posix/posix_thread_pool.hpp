@@ -3,10 +3,124 @@
 #ifndef WEBPP_POSIX_THREAD_POOL_HPP
 #define WEBPP_POSIX_THREAD_POOL_HPP
 
+#include "../../std/std.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace webpp::posix {
 
+    /**
+     * A fixed size thread pool; the tasks are run in the order that they're posted.
+     *
+     * The posix server runs one (never ending) event loop in each of the threads, so the pool should have
+     * at least as many threads as the server has event loops.
+     */
+    struct posix_thread_pool {
+        using task_type = stl::function<void()>;
+
+        explicit posix_thread_pool(stl::size_t thread_count = stl::thread::hardware_concurrency()) {
+            threads.reserve(thread_count);
+            for (stl::size_t i = 0; i != thread_count; ++i) {
+                threads.emplace_back([this] {
+                    current_pool = this;
+                    run();
+                });
+            }
+        }
+
+        posix_thread_pool(posix_thread_pool const&)            = delete;
+        posix_thread_pool(posix_thread_pool&&)                 = delete;
+        posix_thread_pool& operator=(posix_thread_pool const&) = delete;
+        posix_thread_pool& operator=(posix_thread_pool&&)      = delete;
+
+        ~posix_thread_pool() {
+            stop();
+            join();
+        }
+
+        // run the task in one of the threads
+        void post(auto&& task) {
+            {
+                stl::scoped_lock lock{tasks_mutex};
+                tasks.emplace_back(stl::forward<decltype(task)>(task));
+            }
+            tasks_cond.notify_one();
+        }
+
+        // there's no continuation optimizations for us to do; same as post
+        void defer(auto&& task) {
+            post(stl::forward<decltype(task)>(task));
+        }
+
+        // run the task right now if we're already in one of the threads, otherwise post it
+        void dispatch(auto&& task) {
+            if (current_pool == this) {
+                stl::invoke(stl::forward<decltype(task)>(task));
+            } else {
+                post(stl::forward<decltype(task)>(task));
+            }
+        }
+
+        // don't run the tasks that are not started yet, and let the threads exit
+        void stop() noexcept {
+            {
+                stl::scoped_lock lock{tasks_mutex};
+                stopped = true;
+            }
+            tasks_cond.notify_all();
+        }
+
+        // wait for all the posted tasks to finish, and let the threads exit
+        void join() noexcept {
+            {
+                stl::scoped_lock lock{tasks_mutex};
+                finishing = true;
+            }
+            tasks_cond.notify_all();
+            for (auto& thread : threads) {
+                if (thread.joinable() && thread.get_id() != stl::this_thread::get_id()) {
+                    thread.join();
+                }
+            }
+        }
+
+        [[nodiscard]] stl::size_t size() const noexcept {
+            return threads.size();
+        }
+
+      private:
+        void run() {
+            for (;;) {
+                task_type task;
+                {
+                    stl::unique_lock lock{tasks_mutex};
+                    tasks_cond.wait(lock, [this] {
+                        return stopped || finishing || !tasks.empty();
+                    });
+                    if (stopped || tasks.empty()) {
+                        return;
+                    }
+                    task = stl::move(tasks.front());
+                    tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        static inline thread_local posix_thread_pool* current_pool = nullptr;
 
-    struct posix_thread_pool {};
+        stl::mutex               tasks_mutex;
+        stl::condition_variable  tasks_cond;
+        stl::deque<task_type>    tasks;
+        bool                     stopped   = false;
+        bool                     finishing = false;
+        stl::vector<stl::thread> threads;
+    };
 
 } // namespace webpp::posix
 
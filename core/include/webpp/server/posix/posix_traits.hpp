@@ -4,8 +4,8 @@
 #define WEBPP_POSIX_TRAITS_HPP
 
 #include "../server_concepts.hpp"
-#include "asio_server.hpp"
-#include "asio_thread_pool.hpp"
+#include "posix_server.hpp"
+#include "posix_thread_pool.hpp"
 
 namespace webpp::posix {
 
@@ -16,7 +16,7 @@ namespace webpp::posix {
         using thread_pool_type = ThreadPoolType;
 
         template <SessionManager SessionType>
-        using server_type = asio_server<traits_type, SessionType, thread_pool_type>;
+        using server_type = posix_server<traits_type, SessionType, thread_pool_type>;
     };
 
 
@@ -0,0 +1,388 @@
+#ifndef WEBPP_POSIX_PREFORK_HPP
+#define WEBPP_POSIX_PREFORK_HPP
+
+#include "../../platform/posix.hpp"
+#ifdef webpp_posix
+
+#    include "../../std/format.hpp"
+#    include "../../std/string.hpp"
+#    include "../../std/string_view.hpp"
+#    include "../../std/type_traits.hpp"
+#    include "../../std/vector.hpp"
+#    include "../../traits/traits.hpp"
+#    include "../socket_handoff.hpp"
+#    include "./posix_listeners.hpp"
+
+#    include <algorithm>
+#    include <array>
+#    include <charconv>
+#    include <chrono>
+#    include <csignal>
+#    include <cstdio>
+#    include <fstream>
+#    include <poll.h>
+#    include <sched.h>
+#    include <sys/signalfd.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+
+namespace webpp::posix {
+
+    namespace details {
+        /**
+         * Parse a list of the kernel like "0-3,8-11" into the set; false if it's not a valid list.
+         */
+        [[nodiscard]] inline bool parse_cpu_list(stl::string_view list, cpu_set_t& cpus) noexcept {
+            CPU_ZERO(&cpus);
+            while (!list.empty() && (list.back() == '\n' || list.back() == ' ')) {
+                list.remove_suffix(1);
+            }
+            if (list.empty()) {
+                return false;
+            }
+            while (!list.empty()) {
+                auto const       comma = list.find(',');
+                stl::string_view range = list.substr(0, comma);
+                list.remove_prefix(comma == stl::string_view::npos ? list.size() : comma + 1);
+
+                int        first = 0;
+                int        last  = 0;
+                auto const end   = range.data() + range.size();
+                auto       res   = stl::from_chars(range.data(), end, first);
+                last             = first;
+                if (res.ec == stl::errc{} && res.ptr != end && *res.ptr == '-') {
+                    res = stl::from_chars(res.ptr + 1, end, last);
+                }
+                if (res.ec != stl::errc{} || res.ptr != end || last < first || last >= CPU_SETSIZE) {
+                    return false;
+                }
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    CPU_SET(cpu, &cpus);
+                }
+            }
+            return true;
+        }
+
+        [[nodiscard]] inline bool read_cpu_list(stl::string const& path, cpu_set_t& cpus) {
+            stl::ifstream file{path};
+            stl::string   list;
+            return stl::getline(file, list) && parse_cpu_list(list, cpus);
+        }
+
+        /**
+         * The CPUs of each of the NUMA nodes of the machine; it's empty if the kernel doesn't tell.
+         */
+        [[nodiscard]] inline stl::vector<cpu_set_t> numa_nodes() {
+            static constexpr stl::string_view nodes_dir = "/sys/devices/system/node/";
+
+            stl::vector<cpu_set_t> nodes;
+            cpu_set_t              online; // the nodes are listed in the same format as the CPUs
+            if (!read_cpu_list(stl::string{nodes_dir} + "online", online)) {
+                return nodes;
+            }
+            for (int node = 0; node < CPU_SETSIZE; ++node) {
+                if (!CPU_ISSET(node, &online)) {
+                    continue;
+                }
+                cpu_set_t cpus;
+                auto      path = stl::string{nodes_dir} + "node" + stl::to_string(node) + "/cpulist";
+                if (read_cpu_list(path, cpus)) {
+                    nodes.push_back(cpus);
+                }
+            }
+            return nodes;
+        }
+    } // namespace details
+
+
+    /**
+     * Run the server in multiple processes that share the same listening sockets (pre-forking):
+     *   - the supervisor opens the listeners, and forks the workers; each worker runs its own server (with
+     *     its own threads) on the listeners that it's given
+     *   - a worker that exits (a crash, mostly) is replaced; if it dies right after starting, it's replaced
+     *     after the restart delay, so a worker that can't start doesn't turn into a fork loop
+     *   - SIGTERM, SIGINT and SIGQUIT are forwarded to the workers and no worker is replaced after them;
+     *     SIGHUP, SIGUSR1 and SIGUSR2 are just forwarded. The workers that are still running after the drain
+     *     timeout are killed. The workers are in their own process groups, so the signals of the terminal
+     *     only reach them through the supervisor.
+     *   - optionally, each worker is pinned to the CPUs of one of the NUMA nodes (in turn); the memory that
+     *     a worker allocates after it's started is then on its own node (the first-touch policy of the
+     *     kernel), and the allocators of the workers never share memory
+     *
+     * A crash only takes down the connections of one worker, and the rest of the workers keep serving.
+     *
+     *   posix::prefork<default_traits> cluster{et};
+     *   cluster.endpoints    = posix::bindable_endpoints{"8080"};
+     *   cluster.worker_count = 4;
+     *   return cluster([](stl::size_t index, inherited_sockets listeners) {
+     *       http::beast<app_type> server;
+     *       server.port(8080).inherit(stl::move(listeners));
+     *       return server();
+     *   });
+     *
+     * The servers of the workers should listen on the same endpoints as the supervisor, or they'd open
+     * their own listeners. The supervisor should run on the main thread before any other threads are
+     * started; the signals are blocked in it and read from a signalfd. A drain of the supervisor (and a
+     * handoff, see handoff_path) is forwarded to the workers as SIGTERM, and a stop as SIGKILL.
+     * The thread_count is not used; each worker's server has its own.
+     */
+    template <Traits TraitsType>
+    struct prefork : public posix_listeners<TraitsType> {
+        using traits_type = TraitsType;
+        using super       = posix_listeners<traits_type>;
+        using duration    = typename super::duration;
+        using clock       = stl::chrono::steady_clock;
+
+        static constexpr auto logger_cat = "Posix/Prefork";
+
+        // how often the workers are checked, if no signal arrives
+        static constexpr int check_interval = 100; // milliseconds
+
+        static constexpr stl::array<int, 3> stop_signals{SIGTERM, SIGINT, SIGQUIT};
+        static constexpr stl::array<int, 3> forwarded_signals{SIGHUP, SIGUSR1, SIGUSR2};
+
+      private:
+        struct worker {
+            pid_t             pid = -1;
+            clock::time_point started{};
+            clock::time_point restart_at{}; // when it's dead
+        };
+
+        stl::vector<worker>    workers{};
+        stl::vector<cpu_set_t> nodes{}; // see numa_pinning
+        sigset_t               old_mask{};
+        int                    signal_fd = -1;
+
+        // a stop signal (or a drain) has arrived; the workers are not replaced anymore
+        bool              shutting_down = false;
+        clock::time_point kill_deadline{};
+
+      public:
+        // number of the worker processes
+        stl::size_t worker_count = stl::thread::hardware_concurrency();
+
+        // pin each worker to the CPUs of one of the NUMA nodes; nothing's done if there's only one node
+        bool numa_pinning = false;
+
+        // a worker that dies sooner than this after it's started, is replaced after this long
+        duration restart_delay{stl::chrono::seconds(1)};
+
+        using super::super;
+
+        /**
+         * Open the listeners, and run the workers until they're stopped; each worker calls
+         * "run_worker(index, listeners)" in its own process, and its return value is the worker's exit
+         * status. Returns -1 if the listeners can't be opened.
+         */
+        template <typename Callable>
+            requires(stl::is_invocable_r_v<int, Callable, stl::size_t, inherited_sockets>)
+        [[nodiscard]] int operator()(Callable&& run_worker) noexcept {
+            if (this->stop_fd == -1 || !this->bind()) {
+                return -1;
+            }
+            if (!block_signals()) {
+                this->close_listeners();
+                this->close_handoff();
+                return -1;
+            }
+            if (numa_pinning) {
+                try {
+                    nodes = details::numa_nodes();
+                } catch (stl::exception const& err) {
+                    this->logger.warning(logger_cat, "Cannot read the NUMA nodes.", err);
+                }
+                if (nodes.size() < 2) {
+                    nodes.clear();
+                }
+            }
+            workers.assign(worker_count == 0 ? 1 : worker_count, worker{});
+            this->logger.info(logger_cat, fmt::format("Starting {} workers.", workers.size()));
+
+            while (!is_done()) {
+                reap();
+                auto const now = clock::now();
+                if (!shutting_down) {
+                    for (stl::size_t index = 0; index < workers.size(); ++index) {
+                        if (workers[index].pid == -1 && workers[index].restart_at <= now) {
+                            start_worker(index, run_worker);
+                        }
+                    }
+                } else if (now >= kill_deadline) {
+                    send_to_workers(SIGKILL);
+                }
+                wait_for_events();
+            }
+
+            this->logger.info(logger_cat, "All the workers are stopped.");
+            ::close(stl::exchange(signal_fd, -1));
+            ::pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+            this->close_listeners();
+            this->close_handoff();
+            return 0;
+        }
+
+      private:
+        // number of the workers that are running
+        [[nodiscard]] stl::size_t running_count() const noexcept {
+            return static_cast<stl::size_t>(stl::count_if(workers.begin(), workers.end(), [](auto const& w) {
+                return w.pid != -1;
+            }));
+        }
+
+        [[nodiscard]] bool is_done() const noexcept {
+            return shutting_down && running_count() == 0;
+        }
+
+        // the signals are read from the signalfd instead of being handled
+        [[nodiscard]] bool block_signals() noexcept {
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, SIGCHLD);
+            for (int const sig : stop_signals) {
+                sigaddset(&mask, sig);
+            }
+            for (int const sig : forwarded_signals) {
+                sigaddset(&mask, sig);
+            }
+            ::pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+            signal_fd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (signal_fd == -1) {
+                this->logger.error(logger_cat, "Cannot create the signalfd.", last_error());
+                ::pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+                return false;
+            }
+            return true;
+        }
+
+        template <typename Callable>
+        void start_worker(stl::size_t index, Callable& run_worker) noexcept {
+            pid_t const pid = ::fork();
+            if (pid == -1) {
+                this->logger.error(logger_cat, "Cannot fork a worker.", last_error());
+                workers[index].restart_at = clock::now() + restart_delay;
+                return;
+            }
+            if (pid == 0) {
+                // the worker; nothing of the supervisor is destructed in here, the process ends with _exit
+                // It gets its own process group, so a Ctrl-C on the terminal only reaches the supervisor,
+                // and the worker only gets the one signal that the supervisor forwards.
+                ::setpgid(0, 0);
+                ::close(signal_fd);
+                ::close(this->stop_fd);
+                if (this->handoff_fd != -1) {
+                    ::close(this->handoff_fd);
+                }
+                ::pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+                if (!nodes.empty()) {
+                    auto const& cpus = nodes[index % nodes.size()];
+                    if (::sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+                        this->logger.warning(logger_cat, "Cannot pin the worker to its node.", last_error());
+                    }
+                }
+                int status = 1;
+                try {
+                    status = run_worker(index, inherited_sockets{this->listeners});
+                } catch (stl::exception const& err) {
+                    this->logger.error(logger_cat, "The worker has thrown.", err);
+                } catch (...) {
+                    this->logger.error(logger_cat, "The worker has thrown.");
+                }
+                stl::fflush(nullptr);
+                ::_exit(status);
+            }
+            // in the supervisor too, so a signal that comes before the worker has called it is not doubled
+            ::setpgid(pid, pid);
+            workers[index].pid     = pid;
+            workers[index].started = clock::now();
+        }
+
+        // collect the workers that have exited, and schedule their replacements
+        void reap() noexcept {
+            int   status = 0;
+            pid_t pid    = 0;
+            while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+                auto const it = stl::find_if(workers.begin(), workers.end(), [=](auto const& w) {
+                    return w.pid == pid;
+                });
+                if (it == workers.end()) {
+                    continue; // not ours
+                }
+                auto const now = clock::now();
+                it->pid        = -1;
+                it->restart_at = now - it->started < restart_delay ? now + restart_delay : now;
+                if (shutting_down) {
+                    continue;
+                }
+                auto const index = static_cast<stl::size_t>(it - workers.begin());
+                if (WIFSIGNALED(status)) {
+                    this->logger.warning(logger_cat,
+                                         fmt::format("Worker {} (pid {}) is killed by signal {}; restarting.",
+                                                     index,
+                                                     pid,
+                                                     WTERMSIG(status)));
+                } else {
+                    this->logger.warning(logger_cat,
+                                         fmt::format("Worker {} (pid {}) has exited with {}; restarting.",
+                                                     index,
+                                                     pid,
+                                                     WEXITSTATUS(status)));
+                }
+            }
+        }
+
+        void send_to_workers(int sig) noexcept {
+            for (auto const& w : workers) {
+                if (w.pid != -1) {
+                    ::kill(w.pid, sig);
+                }
+            }
+        }
+
+        void shut_down(int sig) noexcept {
+            if (!shutting_down) {
+                shutting_down = true;
+                kill_deadline = clock::now() + this->drain_timeout;
+                this->logger.info(logger_cat, "Stopping the workers.");
+            }
+            send_to_workers(sig);
+        }
+
+        void wait_for_events() noexcept {
+            stl::array<pollfd, 3> fds{
+              pollfd{.fd = signal_fd, .events = POLLIN, .revents = 0},
+              pollfd{.fd = this->stop_fd, .events = POLLIN, .revents = 0},
+              pollfd{.fd = this->handoff_fd, .events = POLLIN, .revents = 0}, // ignored if it's -1
+            };
+            if (::poll(fds.data(), fds.size(), check_interval) <= 0) {
+                return;
+            }
+            if ((fds[0].revents & POLLIN) != 0) {
+                signalfd_siginfo info{};
+                while (::read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    auto const sig = static_cast<int>(info.ssi_signo);
+                    if (stl::find(stop_signals.begin(), stop_signals.end(), sig) != stop_signals.end()) {
+                        shut_down(sig);
+                    } else if (sig != SIGCHLD) {
+                        send_to_workers(sig);
+                    }
+                }
+            }
+            if ((fds[1].revents & POLLIN) != 0) {
+                eventfd_t value = 0;
+                static_cast<void>(::eventfd_read(this->stop_fd, &value));
+                shut_down(this->is_stopping() ? SIGKILL : SIGTERM);
+            }
+            if ((fds[2].revents & POLLIN) != 0) {
+                this->hand_over(); // the supervisor is drained if the new one takes the listeners
+                if (this->handed_off) {
+                    this->close_handoff();
+                }
+            }
+        }
+    };
+
+} // namespace webpp::posix
+
+#endif // webpp_posix
+
+#endif // WEBPP_POSIX_PREFORK_HPP
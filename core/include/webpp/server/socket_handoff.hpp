@@ -0,0 +1,298 @@
+#ifndef WEBPP_SERVER_SOCKET_HANDOFF_HPP
+#define WEBPP_SERVER_SOCKET_HANDOFF_HPP
+
+#include "../platform/posix.hpp"
+
+#ifdef webpp_posix
+
+#    include "../std/span.hpp"
+#    include "../std/string_view.hpp"
+#    include "../std/vector.hpp"
+
+#    include <algorithm>
+#    include <chrono>
+#    include <cstring>
+#    include <fcntl.h>
+#    include <netinet/in.h>
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/time.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#    include <utility>
+
+/**
+ * Handing the listening sockets over to a new process, so the server can be restarted without refusing a
+ * single connection:
+ *   1. the new process connects to the handoff socket of the old one, and receives its listeners
+ *      (SCM_RIGHTS); the sockets that it doesn't have an endpoint for are closed
+ *   2. the new process starts accepting on them (the connections that are waiting in their backlog are
+ *      accepted by the new process), and confirms it
+ *   3. the old process stops accepting, and drains its connections
+ *
+ * If the new process doesn't confirm it (it fails to start), the old process keeps serving.
+ * The handoff socket should be a path on the file system, the file is replaced by the new process.
+ */
+namespace webpp {
+
+    // the most file descriptors that one message can carry on Linux (SCM_MAX_FD)
+    static constexpr stl::size_t max_handoff_sockets = 253;
+
+    namespace details {
+        [[nodiscard]] inline bool handoff_address(stl::string_view path, sockaddr_un& addr) noexcept {
+            addr.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+                return false;
+            }
+            stl::copy(path.begin(), path.end(), static_cast<char*>(addr.sun_path));
+            addr.sun_path[path.size()] = '\0';
+            return true;
+        }
+
+        inline void set_socket_timeout(int sock, stl::chrono::steady_clock::duration timeout) noexcept {
+            auto const usecs = stl::chrono::duration_cast<stl::chrono::microseconds>(timeout).count();
+            timeval    tv{.tv_sec = static_cast<time_t>(usecs / 1'000'000), .tv_usec = usecs % 1'000'000};
+            ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            ::setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        }
+    } // namespace details
+
+    /**
+     * Send the sockets through a connected Unix socket; the other side gets its own copies of them.
+     */
+    [[nodiscard]] inline bool send_sockets(int channel, stl::span<int const> socks) noexcept {
+        if (socks.size() > max_handoff_sockets) {
+            return false;
+        }
+        stl::vector<char> control(CMSG_SPACE(sizeof(int) * max_handoff_sockets));
+        char              count = 'L'; // at least one byte of data has to be sent along
+        iovec             iov{.iov_base = &count, .iov_len = 1};
+        msghdr            msg{};
+        msg.msg_iov    = &iov;
+        msg.msg_iovlen = 1;
+        if (!socks.empty()) {
+            msg.msg_control    = control.data();
+            msg.msg_controllen = CMSG_SPACE(sizeof(int) * socks.size());
+            auto* cmsg         = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level   = SOL_SOCKET;
+            cmsg->cmsg_type    = SCM_RIGHTS;
+            cmsg->cmsg_len     = CMSG_LEN(sizeof(int) * socks.size());
+            stl::memcpy(CMSG_DATA(cmsg), socks.data(), sizeof(int) * socks.size());
+        }
+        return ::sendmsg(channel, &msg, MSG_NOSIGNAL) == 1;
+    }
+
+    /**
+     * Receive the sockets that the other side has sent with send_sockets.
+     */
+    [[nodiscard]] inline stl::vector<int> receive_sockets(int channel) {
+        stl::vector<char> control(CMSG_SPACE(sizeof(int) * max_handoff_sockets));
+        char              data = 0;
+        iovec             iov{.iov_base = &data, .iov_len = 1};
+        msghdr            msg{};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control.data();
+        msg.msg_controllen = control.size();
+
+        stl::vector<int> socks;
+        if (::recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != 1) {
+            return socks;
+        }
+        for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            auto const count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            auto const first = socks.size();
+            socks.resize(first + count);
+            stl::memcpy(socks.data() + first, CMSG_DATA(cmsg), sizeof(int) * count);
+        }
+        return socks;
+    }
+
+    // whether the socket is bound to this address (a wildcard address only matches itself)
+    [[nodiscard]] inline bool is_bound_to(int sock, sockaddr const* addr) noexcept {
+        sockaddr_storage local{};
+        socklen_t        local_len = sizeof(local);
+        if (::getsockname(sock, reinterpret_cast<sockaddr*>(&local), &local_len) == -1 || // NOLINT
+            local.ss_family != addr->sa_family) {
+            return false;
+        }
+        switch (addr->sa_family) {
+            case AF_INET: {
+                auto const* lhs = reinterpret_cast<sockaddr_in const*>(&local); // NOLINT
+                auto const* rhs = reinterpret_cast<sockaddr_in const*>(addr);   // NOLINT
+                return lhs->sin_port == rhs->sin_port && lhs->sin_addr.s_addr == rhs->sin_addr.s_addr;
+            }
+            case AF_INET6: {
+                auto const* lhs = reinterpret_cast<sockaddr_in6 const*>(&local); // NOLINT
+                auto const* rhs = reinterpret_cast<sockaddr_in6 const*>(addr);   // NOLINT
+                return lhs->sin6_port == rhs->sin6_port &&
+                       stl::memcmp(&lhs->sin6_addr, &rhs->sin6_addr, sizeof(in6_addr)) == 0;
+            }
+            case AF_UNIX: {
+                auto const* lhs = reinterpret_cast<sockaddr_un const*>(&local); // NOLINT
+                auto const* rhs = reinterpret_cast<sockaddr_un const*>(addr);   // NOLINT
+                // the paths are zero-padded; the abstract names start with a null character
+                return stl::memcmp(lhs->sun_path, rhs->sun_path, sizeof(lhs->sun_path)) == 0;
+            }
+            default: return false;
+        }
+    }
+
+    /**
+     * The listeners that are received from the old process; each endpoint of the new process takes the one
+     * that's bound to its address (if any), instead of opening a new one.
+     */
+    struct inherited_sockets {
+      private:
+        int              channel = -1;
+        stl::vector<int> socks{};
+
+      public:
+        inherited_sockets() noexcept = default;
+
+        /**
+         * Get the listeners of the process that's listening on the handoff socket; there are none if nobody
+         * is listening on it.
+         */
+        explicit inherited_sockets(stl::string_view path, stl::chrono::steady_clock::duration timeout) {
+            sockaddr_un addr{};
+            if (!details::handoff_address(path, addr)) {
+                return;
+            }
+            channel = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (channel == -1) {
+                return;
+            }
+            details::set_socket_timeout(channel, timeout);
+            if (::connect(channel, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == -1) { // NOLINT
+                ::close(stl::exchange(channel, -1));
+                return;
+            }
+            socks = receive_sockets(channel);
+        }
+
+        /**
+         * Listeners that are already open in this process (the ones that a prefork supervisor has opened
+         * before forking the worker, for example).
+         */
+        explicit inherited_sockets(stl::vector<int> listeners) noexcept : socks{stl::move(listeners)} {}
+
+        inherited_sockets(inherited_sockets const&)            = delete;
+        inherited_sockets& operator=(inherited_sockets const&) = delete;
+
+        inherited_sockets(inherited_sockets&& other) noexcept
+          : channel{stl::exchange(other.channel, -1)},
+            socks{stl::move(other.socks)} {}
+
+        inherited_sockets& operator=(inherited_sockets&& other) noexcept {
+            if (this != &other) {
+                close();
+                channel = stl::exchange(other.channel, -1);
+                socks   = stl::move(other.socks);
+            }
+            return *this;
+        }
+
+        ~inherited_sockets() {
+            close();
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return socks.empty();
+        }
+
+        /**
+         * Take the listener that's bound to the address; it's non-blocking. Returns -1 if there's none.
+         */
+        [[nodiscard]] int take(sockaddr const* addr) noexcept {
+            auto const it = stl::find_if(socks.begin(), socks.end(), [=](int sock) noexcept {
+                return is_bound_to(sock, addr);
+            });
+            if (it == socks.end()) {
+                return -1;
+            }
+            int const sock = *it;
+            socks.erase(it);
+            ::fcntl(sock, F_SETFL, ::fcntl(sock, F_GETFL) | O_NONBLOCK);
+            return sock;
+        }
+
+        /**
+         * We're accepting on the taken listeners; let the old process stop accepting and drain its
+         * connections. The listeners that are not taken are closed.
+         */
+        void confirm() noexcept {
+            if (channel != -1) {
+                char const ready = 'R';
+                static_cast<void>(::send(channel, &ready, 1, MSG_NOSIGNAL));
+            }
+            close();
+        }
+
+        // without a confirmation, the old process keeps serving
+        void close() noexcept {
+            for (int const sock : socks) {
+                ::close(sock);
+            }
+            socks.clear();
+            if (channel != -1) {
+                ::close(stl::exchange(channel, -1));
+            }
+        }
+    };
+
+    /**
+     * Listen on the handoff socket; the file of the previous process is replaced. Returns -1 on errors.
+     */
+    [[nodiscard]] inline int listen_handoff(stl::string_view path) noexcept {
+        sockaddr_un addr{};
+        if (!details::handoff_address(path, addr)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        struct stat info {};
+        if (::stat(addr.sun_path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+            ::unlink(addr.sun_path);
+        }
+        int const sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock == -1) {
+            return -1;
+        }
+        if (::bind(sock, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == -1 || // NOLINT
+            ::listen(sock, 1) == -1) {
+            int const err = errno;
+            ::close(sock);
+            errno = err;
+            return -1;
+        }
+        return sock;
+    }
+
+    /**
+     * Accept the new process from the handoff socket, send it the listeners, and wait (up to the timeout)
+     * for it to confirm that it's accepting on them. Returns true if it's confirmed; the listeners should
+     * then be closed without removing their files, and the connections drained.
+     */
+    [[nodiscard]] inline bool hand_over_sockets(int                                 handoff,
+                                                stl::span<int const>                socks,
+                                                stl::chrono::steady_clock::duration timeout) noexcept {
+        int const channel = ::accept4(handoff, nullptr, nullptr, SOCK_CLOEXEC);
+        if (channel == -1) {
+            return false; // another thread took it, or it's gone already
+        }
+        details::set_socket_timeout(channel, timeout);
+        char       ready = 0;
+        bool const confirmed =
+          send_sockets(channel, socks) && ::recv(channel, &ready, 1, 0) == 1 && ready == 'R';
+        ::close(channel);
+        return confirmed;
+    }
+
+} // namespace webpp
+
+#endif // webpp_posix
+
+#endif // WEBPP_SERVER_SOCKET_HANDOFF_HPP
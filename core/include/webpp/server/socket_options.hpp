@@ -0,0 +1,131 @@
+#ifndef WEBPP_SERVER_SOCKET_OPTIONS_HPP
+#define WEBPP_SERVER_SOCKET_OPTIONS_HPP
+
+#include "../platform/posix.hpp"
+#include "../std/optional.hpp"
+#include "../std/string_view.hpp"
+
+#ifdef webpp_posix
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
+#    include <sys/socket.h>
+#endif
+
+namespace webpp {
+
+    /**
+     * The options of the listening sockets and of the connections that they accept; the options that are
+     * not set are left as the defaults of the OS. The TCP options are skipped for the Unix domain sockets,
+     * and the options that the platform doesn't have are ignored.
+     *
+     *   server.sock_options.defer_accept = 5;
+     *   server.sock_options.no_delay     = true;
+     */
+    struct socket_options {
+#ifdef SOMAXCONN
+        static constexpr int default_backlog = SOMAXCONN;
+#else
+        static constexpr int default_backlog = 128;
+#endif
+
+        // the length of the queue of the connections that are waiting to be accepted; the kernel caps it
+        // (net.core.somaxconn on Linux)
+        int backlog = default_backlog;
+
+        // TCP_DEFER_ACCEPT: only wake the server up when the first data of a connection arrives; this many
+        // seconds are waited for it
+        stl::optional<int> defer_accept{};
+
+        // TCP_FASTOPEN: the length of the queue of the connections that are still in their handshake, whose
+        // request came with the SYN
+        stl::optional<int> fast_open{};
+
+        // SO_RCVBUF and SO_SNDBUF of the listeners, which the accepted connections inherit; the kernel
+        // doubles them, and stops auto-tuning them
+        stl::optional<int> receive_buffer_size{};
+        stl::optional<int> send_buffer_size{};
+
+        // TCP_NODELAY of the connections: the small writes are sent right away instead of waiting for the
+        // ACK of the previous ones (the Nagle's algorithm)
+        bool no_delay = false;
+
+        // TCP_QUICKACK of the connections: the ACKs are not delayed; the kernel may turn it off later
+        bool quick_ack = false;
+
+        // SO_BUSY_POLL of the connections: the microseconds that a blocking read busy-polls the device
+        // queue; going over net.core.busy_read needs CAP_NET_ADMIN
+        stl::optional<int> busy_poll{};
+    };
+
+#ifdef webpp_posix
+
+    namespace details {
+        [[nodiscard]] inline bool set_socket_option(int sock, int level, int name, int value) noexcept {
+            return ::setsockopt(sock, level, name, &value, sizeof(value)) == 0;
+        }
+    } // namespace details
+
+    /**
+     * Set the options of a listener; it's done before "listen" so the buffer sizes are used in the window
+     * scale of the handshakes. Returns the name of the option that failed (errno tells why), or an empty
+     * string.
+     */
+    [[nodiscard]] inline stl::string_view
+    apply_listener_options(int sock, int family, socket_options const& opts) noexcept {
+        using details::set_socket_option;
+        if (opts.receive_buffer_size &&
+            !set_socket_option(sock, SOL_SOCKET, SO_RCVBUF, *opts.receive_buffer_size)) {
+            return "SO_RCVBUF";
+        }
+        if (opts.send_buffer_size &&
+            !set_socket_option(sock, SOL_SOCKET, SO_SNDBUF, *opts.send_buffer_size)) {
+            return "SO_SNDBUF";
+        }
+        if (family == AF_UNIX) {
+            return {};
+        }
+#    ifdef TCP_DEFER_ACCEPT
+        if (opts.defer_accept &&
+            !set_socket_option(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, *opts.defer_accept)) {
+            return "TCP_DEFER_ACCEPT";
+        }
+#    endif
+#    ifdef TCP_FASTOPEN
+        if (opts.fast_open && !set_socket_option(sock, IPPROTO_TCP, TCP_FASTOPEN, *opts.fast_open)) {
+            return "TCP_FASTOPEN";
+        }
+#    endif
+        return {};
+    }
+
+    /**
+     * Set the options of an accepted connection; nothing is set (no system call is made) for the options
+     * that are left as the defaults. Returns the name of the option that failed, or an empty string.
+     */
+    [[nodiscard]] inline stl::string_view
+    apply_connection_options(int sock, int family, socket_options const& opts) noexcept {
+        using details::set_socket_option;
+        if (family == AF_UNIX) {
+            return {};
+        }
+        if (opts.no_delay && !set_socket_option(sock, IPPROTO_TCP, TCP_NODELAY, 1)) {
+            return "TCP_NODELAY";
+        }
+#    ifdef TCP_QUICKACK
+        if (opts.quick_ack && !set_socket_option(sock, IPPROTO_TCP, TCP_QUICKACK, 1)) {
+            return "TCP_QUICKACK";
+        }
+#    endif
+#    ifdef SO_BUSY_POLL
+        if (opts.busy_poll && !set_socket_option(sock, SOL_SOCKET, SO_BUSY_POLL, *opts.busy_poll)) {
+            return "SO_BUSY_POLL";
+        }
+#    endif
+        return {};
+    }
+
+#endif
+
+} // namespace webpp
+
+#endif // WEBPP_SERVER_SOCKET_OPTIONS_HPP
@@ -0,0 +1,169 @@
+#ifndef WEBPP_SERVER_TIMER_WHEEL_HPP
+#define WEBPP_SERVER_TIMER_WHEEL_HPP
+
+#include "../std/std.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+namespace webpp {
+
+    /**
+     * An entry of a timer wheel; it's embedded in the object that owns the deadline (an intrusive list
+     * node), so arming and cancelling a deadline never allocates.
+     */
+    struct timer_wheel_entry {
+        timer_wheel_entry* prev   = nullptr;
+        timer_wheel_entry* next   = nullptr;
+        stl::uint64_t      expiry = 0; // the tick that it expires in
+
+        [[nodiscard]] bool is_armed() const noexcept {
+            return prev != nullptr;
+        }
+    };
+
+    /**
+     * A hashed timer wheel: the deadlines are put into one of the slots of a circle by the tick they expire
+     * in, and the wheel is turned one slot per tick; so arming, re-arming, and cancelling a deadline are
+     * O(1), and turning the wheel only touches the deadlines of the slots that it passes.
+     *
+     * The deadlines that are farther than one turn of the wheel stay in their slot for the next turns.
+     * The deadlines are rounded up to the resolution, so they never expire early, but they may expire up to
+     * one tick late.
+     *
+     * It's not thread-safe; one wheel is meant to be used by one thread (or under one lock), with one
+     * timer that turns it every tick for all of its entries.
+     *
+     * EntryType should be derived from timer_wheel_entry.
+     */
+    template <typename EntryType, stl::size_t SlotCount = 512>
+    struct timer_wheel {
+        using entry_type = EntryType;
+        using clock_type = stl::chrono::steady_clock;
+        using duration   = clock_type::duration;
+        using time_point = clock_type::time_point;
+
+        static constexpr stl::size_t slot_count = SlotCount;
+
+        static_assert(stl::is_base_of_v<timer_wheel_entry, entry_type>,
+                      "The entries of the timer wheel should be derived from timer_wheel_entry.");
+        static_assert(slot_count != 0 && (slot_count & (slot_count - 1)) == 0,
+                      "The slot count should be a power of two.");
+
+        explicit timer_wheel(duration tick_resolution, time_point now = clock_type::now()) noexcept
+          : resolution{stl::max(tick_resolution, duration{1})},
+            start{now} {
+            for (auto& slot : slots) {
+                slot.prev = &slot;
+                slot.next = &slot;
+            }
+        }
+
+        timer_wheel(timer_wheel const&)                = delete;
+        timer_wheel(timer_wheel&&) noexcept            = delete;
+        timer_wheel& operator=(timer_wheel const&)     = delete;
+        timer_wheel& operator=(timer_wheel&&) noexcept = delete;
+        ~timer_wheel()                                 = default;
+
+        /**
+         * Arm the deadline to expire after the timeout; it's re-armed if it's already armed.
+         */
+        void arm(entry_type& entry, duration timeout, time_point now = clock_type::now()) noexcept {
+            cancel(entry);
+            entry.expiry = stl::max(ticks_of(now - start + timeout + resolution - duration{1}), current + 1);
+
+            auto& slot      = slots[entry.expiry & (slot_count - 1)];
+            entry.prev      = slot.prev;
+            entry.next      = &slot;
+            slot.prev->next = &entry;
+            slot.prev       = &entry;
+            ++armed;
+        }
+
+        void cancel(entry_type& entry) noexcept {
+            if (!entry.is_armed()) {
+                return;
+            }
+            entry.prev->next = entry.next;
+            entry.next->prev = entry.prev;
+            entry.prev       = nullptr;
+            entry.next       = nullptr;
+            --armed;
+        }
+
+        /**
+         * Turn the wheel up to "now", and call the callback with the deadlines that are expired; the
+         * deadlines are disarmed before the callback is called, so it can re-arm them.
+         * The callback should not cancel the other deadlines.
+         *
+         * Returns the number of the expired deadlines.
+         */
+        template <typename CallbackType>
+        stl::size_t advance(CallbackType&& on_expire, time_point now = clock_type::now()) {
+            auto const    target  = ticks_of(now - start);
+            stl::size_t   expired = 0;
+            stl::uint64_t tick    = current;
+
+            // all the slots are visited at most once, even if we're late for more than one turn
+            if (target - tick > slot_count) {
+                tick = target - slot_count;
+            }
+            while (tick != target) {
+                ++tick;
+                auto& slot = slots[tick & (slot_count - 1)];
+                auto* it   = slot.next;
+                while (it != &slot) {
+                    auto* const next = it->next;
+                    if (it->expiry <= target) {
+                        auto& entry = static_cast<entry_type&>(*it);
+                        cancel(entry);
+                        ++expired;
+                        on_expire(entry);
+                    }
+                    it = next;
+                }
+            }
+            current = target;
+            return expired;
+        }
+
+        /**
+         * Call the callback with all the armed deadlines; the callback should not arm or cancel them.
+         */
+        template <typename CallbackType>
+        void for_each(CallbackType&& callback) {
+            for (auto& slot : slots) {
+                for (auto* it = slot.next; it != &slot; it = it->next) {
+                    callback(static_cast<entry_type&>(*it));
+                }
+            }
+        }
+
+        // the number of the armed deadlines
+        [[nodiscard]] stl::size_t size() const noexcept {
+            return armed;
+        }
+
+        [[nodiscard]] duration tick_resolution() const noexcept {
+            return resolution;
+        }
+
+      private:
+        // the ticks since the start, rounded down
+        [[nodiscard]] stl::uint64_t ticks_of(duration elapsed) const noexcept {
+            return static_cast<stl::uint64_t>(stl::max<duration::rep>(elapsed / resolution, 0));
+        }
+
+        stl::array<timer_wheel_entry, slot_count> slots{}; // the heads of the circular lists
+        duration                                  resolution;
+        time_point                                start;
+        stl::uint64_t                             current = 0; // the last tick that is processed
+        stl::size_t                               armed   = 0;
+    };
+
+} // namespace webpp
+
+#endif // WEBPP_SERVER_TIMER_WHEEL_HPP
@@ -1,6 +1,20 @@
 #ifndef WEBPP_SERVER_USAGE_HPP
 #define WEBPP_SERVER_USAGE_HPP
 
+#include "../std/std.hpp"
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+#ifdef __linux__
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
 namespace webpp::host {
     using percent_type = unsigned short;
 
@@ -8,13 +22,265 @@ namespace webpp::host {
      * The options for is_busy
      */
     struct usage_options {
-        percent_type cpu    = 95; // percent
-        percent_type memory = 95; // percent
+        percent_type cpu       = 95; // percent
+        percent_type memory    = 95; // percent
+        stl::size_t  in_flight = 0;  // the requests that are being served; zero means no limit
     };
 
+    namespace details {
+
+        using file_buffer_type = stl::array<char, 4096>;
+
+        /**
+         * Read a small file (from /proc or /sys) into the buffer; returns an empty view if it can't be read.
+         * It's read with one read call, these files are generated by the kernel as a whole.
+         */
+        [[nodiscard]] inline stl::string_view read_small_file(char const*       path,
+                                                              file_buffer_type& buf) noexcept {
+#ifdef __linux__
+            int const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                return {};
+            }
+            auto const size = ::read(fd, buf.data(), buf.size());
+            ::close(fd);
+            if (size <= 0) {
+                return {};
+            }
+            return {buf.data(), static_cast<stl::size_t>(size)};
+#else
+            static_cast<void>(path);
+            static_cast<void>(buf);
+            return {};
+#endif
+        }
+
+        // parse the number at the beginning of the string (after the spaces), and remove it from the string
+        [[nodiscard]] inline bool consume_number(stl::string_view& str, stl::uint64_t& number) noexcept {
+            auto const start = str.find_first_not_of(' ');
+            if (start == stl::string_view::npos) {
+                return false;
+            }
+            auto const res = stl::from_chars(str.data() + start, str.data() + str.size(), number);
+            if (res.ec != stl::errc{}) {
+                return false;
+            }
+            str.remove_prefix(static_cast<stl::size_t>(res.ptr - str.data()));
+            return true;
+        }
+
+        // the value of a field of /proc/meminfo, in kB
+        [[nodiscard]] inline stl::uint64_t meminfo_field(stl::string_view meminfo,
+                                                         stl::string_view name) noexcept {
+            auto const pos = meminfo.find(name);
+            if (pos == stl::string_view::npos) {
+                return 0;
+            }
+            meminfo.remove_prefix(pos + name.size());
+            stl::uint64_t value = 0;
+            static_cast<void>(consume_number(meminfo, value));
+            return value;
+        }
+
+        [[nodiscard]] constexpr percent_type to_percent(stl::uint64_t part, stl::uint64_t whole) noexcept {
+            if (whole == 0) {
+                return 0;
+            }
+            return static_cast<percent_type>(stl::min<stl::uint64_t>(part * 100 / whole, 100));
+        }
+
+        /**
+         * The time that the CPUs have spent since the boot, from the first line of /proc/stat:
+         *   cpu  user nice system idle iowait irq softirq steal guest guest_nice
+         * The guest times are already included in the user times.
+         */
+        struct cpu_times {
+            stl::uint64_t idle  = 0;
+            stl::uint64_t total = 0;
+        };
+
+        [[nodiscard]] inline bool read_cpu_times(cpu_times& times) noexcept {
+            static constexpr stl::size_t field_count = 8; // up to "steal"
+            static constexpr stl::size_t idle_index  = 3;
+            static constexpr stl::size_t iowait      = 4;
+
+            file_buffer_type buf;
+            auto             stat = read_small_file("/proc/stat", buf);
+            if (!stat.starts_with("cpu ")) {
+                return false;
+            }
+            stat.remove_prefix(3);
+            times = {};
+            for (stl::size_t index = 0; index != field_count; ++index) {
+                stl::uint64_t value = 0;
+                if (!consume_number(stat, value)) {
+                    return index > iowait; // the older kernels don't have all the fields
+                }
+                if (index == idle_index || index == iowait) {
+                    times.idle += value;
+                }
+                times.total += value;
+            }
+            return true;
+        }
+
+        /**
+         * The memory usage of the cgroup of this process (if it has a limit), or of the whole host.
+         * Both cgroup v2 (memory.current and memory.max) and v1 (memory.usage_in_bytes and
+         * memory.limit_in_bytes) are supported; the limits that are more than the host's memory mean
+         * there's no limit.
+         */
+        [[nodiscard]] inline percent_type read_memory_usage(stl::string_view cgroup_dir) noexcept {
+            file_buffer_type buf;
+            auto const       meminfo   = read_small_file("/proc/meminfo", buf);
+            auto const       total     = meminfo_field(meminfo, "MemTotal:") * 1024;
+            auto const       available = meminfo_field(meminfo, "MemAvailable:") * 1024;
+
+            auto const read_number = [&buf](stl::string_view dir,
+                                            char const*      file) noexcept -> stl::uint64_t {
+                stl::array<char, 512> path{};
+                if (dir.size() + stl::char_traits<char>::length(file) >= path.size()) {
+                    return 0;
+                }
+                auto* const end = stl::copy(dir.begin(), dir.end(), path.data());
+                stl::char_traits<char>::copy(end, file, stl::char_traits<char>::length(file) + 1);
+                auto          content = read_small_file(path.data(), buf);
+                stl::uint64_t value   = 0;
+                return consume_number(content, value) ? value : 0; // "max" means no limit
+            };
+
+            static constexpr stl::string_view cgroup_v1_dir = "/sys/fs/cgroup/memory";
+            if (auto const limit = read_number(cgroup_dir, "/memory.max"); limit != 0 && limit < total) {
+                return to_percent(read_number(cgroup_dir, "/memory.current"), limit);
+            }
+            if (auto const limit = read_number(cgroup_v1_dir, "/memory.limit_in_bytes");
+                limit != 0 && limit < total) {
+                return to_percent(read_number(cgroup_v1_dir, "/memory.usage_in_bytes"), limit);
+            }
+            return total > available ? to_percent(total - available, total) : 0;
+        }
+
+        /**
+         * The usage of the host, shared by the whole process.
+         *
+         * The CPU and the memory usages are sampled at most once per sample interval, by whichever thread
+         * asks for them first after the interval; the rest of the threads only load two atomics, so it's
+         * cheap enough to be checked for every request.
+         * The CPU usage is the usage of the whole host in the last interval.
+         */
+        struct usage_sampler {
+            static constexpr stl::chrono::milliseconds sample_interval{250};
+
+            using clock_type = stl::chrono::steady_clock;
+            using rep_type   = clock_type::rep;
+
+            stl::atomic<percent_type> cpu{0};
+            stl::atomic<percent_type> memory{0};
+            stl::atomic<stl::size_t>  in_flight{0};
+
+            [[nodiscard]] static usage_sampler& instance() noexcept {
+                static usage_sampler sampler;
+                return sampler;
+            }
+
+            void sample() noexcept {
+                auto const now = clock_type::now().time_since_epoch().count();
+                if (now < next_sample.load(stl::memory_order_relaxed)) [[likely]] {
+                    return;
+                }
+                if (sampling.test_and_set(stl::memory_order_acquire)) {
+                    return; // another thread is sampling right now
+                }
+                next_sample.store(now + clock_type::duration{sample_interval}.count(),
+                                  stl::memory_order_relaxed);
+
+                if (cpu_times times; read_cpu_times(times)) {
+                    auto const total = times.total - last_cpu.total;
+                    auto const idle  = times.idle - last_cpu.idle;
+                    if (last_cpu.total != 0 && total != 0) {
+                        auto const busy = total - stl::min(idle, total);
+                        cpu.store(to_percent(busy, total), stl::memory_order_relaxed);
+                    }
+                    last_cpu = times;
+                }
+                memory.store(read_memory_usage(cgroup_dir()), stl::memory_order_relaxed);
+
+                sampling.clear(stl::memory_order_release);
+            }
+
+          private:
+            stl::atomic<rep_type> next_sample{0};
+            stl::atomic_flag      sampling{};
+            cpu_times             last_cpu{}; // only touched by the thread that's sampling
+
+            // the directory of this process's cgroup (v2), from "0::/path" in /proc/self/cgroup
+            [[nodiscard]] stl::string_view cgroup_dir() noexcept {
+                if (cgroup_path_size == 0) {
+                    static constexpr stl::string_view root = "/sys/fs/cgroup";
+                    file_buffer_type                  buf;
+                    auto const                        cgroups = read_small_file("/proc/self/cgroup", buf);
+                    stl::string_view                  path;
+                    if (auto const pos = cgroups.find("0::/"); pos != stl::string_view::npos) {
+                        path = cgroups.substr(pos + 3);
+                        path = path.substr(0, path.find('\n'));
+                        if (path == "/") {
+                            path = {};
+                        }
+                    }
+                    if (root.size() + path.size() > cgroup_path.size()) {
+                        path = {}; // too long, use the root's
+                    }
+                    auto* const end  = stl::copy(root.begin(), root.end(), cgroup_path.data());
+                    cgroup_path_size = static_cast<stl::size_t>(
+                      stl::copy(path.begin(), path.end(), end) - cgroup_path.data());
+                }
+                return {cgroup_path.data(), cgroup_path_size};
+            }
+
+            stl::array<char, 256> cgroup_path{};
+            stl::size_t           cgroup_path_size = 0;
+        };
+
+    } // namespace details
+
+    // CPU usage of the host, in percent
+    [[nodiscard]] inline percent_type cpu_usage() noexcept {
+        auto& sampler = details::usage_sampler::instance();
+        sampler.sample();
+        return sampler.cpu.load(stl::memory_order_relaxed);
+    }
+
+    // memory usage of the cgroup of this process, or of the host if the cgroup doesn't have a limit
+    [[nodiscard]] inline percent_type memory_usage() noexcept {
+        auto& sampler = details::usage_sampler::instance();
+        sampler.sample();
+        return sampler.memory.load(stl::memory_order_relaxed);
+    }
+
+    // the requests that are being served by this process
+    [[nodiscard]] inline stl::size_t in_flight_requests() noexcept {
+        return details::usage_sampler::instance().in_flight.load(stl::memory_order_relaxed);
+    }
+
+    inline void requests_started(stl::size_t count = 1) noexcept {
+        details::usage_sampler::instance().in_flight.fetch_add(count, stl::memory_order_relaxed);
+    }
+
+    inline void requests_finished(stl::size_t count = 1) noexcept {
+        details::usage_sampler::instance().in_flight.fetch_sub(count, stl::memory_order_relaxed);
+    }
+
     // check if the running host is busy or not
-    // todo: implement this
-    bool is_busy(usage_options);
+    [[nodiscard]] inline bool is_busy(usage_options options) noexcept {
+        auto& sampler = details::usage_sampler::instance();
+        auto const in_flight = sampler.in_flight.load(stl::memory_order_relaxed);
+        if (options.in_flight != 0 && in_flight >= options.in_flight) {
+            return true;
+        }
+        sampler.sample();
+        return sampler.cpu.load(stl::memory_order_relaxed) >= options.cpu ||
+               sampler.memory.load(stl::memory_order_relaxed) >= options.memory;
+    }
 } // namespace webpp::host
 
 #endif // WEBPP_SERVER_USAGE_HPP
@@ -46,7 +46,7 @@ namespace webpp::details {
 #        define webpp_assert(condition, message)                                    \
             ((condition) /* void() fails with -Winvalid-constexpr on clang 4.0.1 */ \
                ? (void) 0                                                           \
-               : ::webpp::detail::assert_fail(__FILE__, __LINE__, (message)))
+               : ::webpp::details::assert_fail(__FILE__, __LINE__, (message)))
 #    endif
 #endif
 
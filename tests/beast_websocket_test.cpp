@@ -0,0 +1,179 @@
+#include "../core/include/webpp/http/bodies/string.hpp"
+#include "../core/include/webpp/http/protocols/beast.hpp"
+#include "../core/include/webpp/http/routes/context.hpp"
+#include "common_pch.hpp"
+
+#include <atomic>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/websocket.hpp>
+#include <string>
+#include <thread>
+
+using namespace webpp;
+using namespace webpp::http;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
+
+namespace {
+
+    namespace net = boost::asio;
+    namespace ws  = boost::beast::websocket;
+
+    using client_type = ws::stream<net::ip::tcp::socket>;
+
+    // sends the messages back
+    struct echo_handler : beast_proto::websocket_handler {
+        void on_message(beast_proto::websocket_connection& conn,
+                        stl::string_view                  message,
+                        bool                              binary) override {
+            static_cast<void>(binary ? conn.send_binary(message) : conn.send(message));
+        }
+    };
+
+    // the number of the messages that the flooding handler could queue
+    stl::atomic<int> flood_queued{-1};
+
+    // sends more messages than it's allowed to queue, as soon as the connection is open
+    struct flooding_handler : beast_proto::websocket_handler {
+        void on_open(beast_proto::websocket_connection& conn) override {
+            int queued = 0;
+            for (int i = 0; i != 4; ++i) {
+                queued += conn.send(stl::to_string(i)) ? 1 : 0;
+            }
+            flood_queued = queued;
+        }
+
+        void on_message(beast_proto::websocket_connection&, stl::string_view, bool) override {}
+    };
+
+    // everything is upgraded to a websocket with the specified handler
+    template <typename HandlerType>
+    struct websocket_app {
+        HTTPResponse auto operator()(HTTPRequest auto&& req) {
+            using request_type = stl::remove_cvref_t<decltype(req)>;
+            using extensions   = typename merge_root_extensions<typename request_type::root_extensions,
+                                                                extension_pack<string_body>>::type;
+            simple_context<request_type, extensions> ctx{req};
+            return beast_proto::websocket_route<HandlerType>{}(ctx, req);
+        }
+    };
+
+    void connect(net::ip::tcp::socket& sock, unsigned short port) {
+        net::ip::tcp::endpoint const endpoint{net::ip::make_address("127.0.0.1"), port};
+        boost::system::error_code    ec;
+        for (int i = 0; i != 100; ++i) { // the server may not be listening yet
+            if (sock.connect(endpoint, ec); !ec) {
+                return;
+            }
+            sock.close();
+            stl::this_thread::sleep_for(stl::chrono::milliseconds(10));
+        }
+        FAIL() << "Cannot connect to the server: " << ec.message();
+    }
+
+    void open_websocket(client_type& client, unsigned short port) {
+        connect(client.next_layer(), port);
+        client.handshake("127.0.0.1", "/");
+    }
+
+    stl::string read_message(client_type& client) {
+        boost::beast::flat_buffer buf;
+        client.read(buf);
+        return boost::beast::buffers_to_string(buf.data());
+    }
+
+} // namespace
+
+TEST(BeastWebSocket, UpgradeAndEcho) {
+    beast<websocket_app<echo_handler>> server;
+    server.address("127.0.0.1").port(18210);
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    net::io_context io;
+    client_type     client{io};
+    open_websocket(client, 18210);
+    client.write(net::buffer(stl::string_view{"hello"}));
+    EXPECT_EQ(read_message(client), "hello");
+    client.binary(true);
+    client.write(net::buffer(stl::string_view{"bin"}));
+    EXPECT_EQ(read_message(client), "bin");
+    EXPECT_TRUE(client.got_binary());
+    client.close(ws::close_code::normal);
+
+    server.stop();
+    runner.join();
+}
+
+TEST(BeastWebSocket, MessageTooBig) {
+    beast<websocket_app<echo_handler>> server;
+    server.address("127.0.0.1").port(18211);
+    server.websockets({.max_message_size = 16});
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    net::io_context io;
+    client_type     client{io};
+    open_websocket(client, 18211);
+    client.write(net::buffer(stl::string(100, 'x')));
+
+    // the server closes the connection with 1009
+    boost::beast::flat_buffer buf;
+    boost::beast::error_code  ec;
+    client.read(buf, ec);
+    EXPECT_EQ(ec, ws::error::closed);
+    EXPECT_EQ(client.reason().code, ws::close_code::too_big);
+
+    server.stop();
+    runner.join();
+}
+
+TEST(BeastWebSocket, SendQueueLimit) {
+    beast<websocket_app<flooding_handler>> server;
+    server.address("127.0.0.1").port(18212);
+    server.websockets({.max_queued_messages = 2});
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    net::io_context io;
+    client_type     client{io};
+    open_websocket(client, 18212);
+
+    // the first two are queued, and the rest are refused
+    EXPECT_EQ(read_message(client), "0");
+    EXPECT_EQ(read_message(client), "1");
+    EXPECT_EQ(flood_queued, 2);
+    client.close(ws::close_code::normal);
+
+    server.stop();
+    runner.join();
+}
+
+TEST(BeastWebSocket, UpgradeRequired) {
+    beast<websocket_app<echo_handler>> server;
+    server.address("127.0.0.1").port(18213);
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    net::io_context        io;
+    net::ip::tcp::socket   sock{io};
+    stl::string_view const request = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    connect(sock, 18213);
+    net::write(sock, net::buffer(request));
+    stl::string response;
+    net::read_until(sock, net::dynamic_buffer(response), "\r\n\r\n");
+    EXPECT_TRUE(response.starts_with("HTTP/1.1 426")) << response;
+    EXPECT_NE(response.find("Upgrade: websocket\r\n"), stl::string::npos) << response;
+
+    server.stop();
+    runner.join();
+}
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
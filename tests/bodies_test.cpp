@@ -1,11 +1,13 @@
 // Created by moisrex on 2/4/20.
 
 #include "../core/include/webpp/http/bodies/string.hpp"
+#include "../core/include/webpp/http/headers/date.hpp"
 #include "../core/include/webpp/http/response_body.hpp"
 #include "../core/include/webpp/std/string.hpp"
 #include "common_pch.hpp"
 
 #include <filesystem>
+#include <sstream>
 
 using namespace webpp;
 using namespace webpp::http;
@@ -91,4 +93,77 @@ TEST(Body, StringCustomBody) {
     body2     = body_str2;
     body_str2 = body2.template as<stl::string>();
     EXPECT_EQ("nice", body_str2);
-}
\ No newline at end of file
+}
+TEST(Body, ReadInPieces) {
+    enable_owner_traits<default_traits> et;
+    std::array<std::byte, 4>            piece{};
+    auto const                          piece_size = static_cast<std::streamsize>(piece.size());
+
+    // blob bodies are read in order, and only once
+    body_type                         blob_body{et};
+    body_type::blob_communicator_type blob;
+    std::string_view const            data = "blob body";
+    for (auto const c : data) {
+        blob.push_back(static_cast<std::byte>(c));
+    }
+    blob_body = blob;
+    EXPECT_EQ(blob_body.which_communicator(), communicator_type::blob_based);
+    std::string read;
+    while (auto const size = blob_body.read(piece.data(), piece_size)) {
+        read.append(reinterpret_cast<char const*>(piece.data()), static_cast<std::size_t>(size));
+    }
+    EXPECT_EQ(read, data);
+
+    // stream bodies are read as they're produced
+    body_type  stream_body{et};
+    auto const stream = std::make_shared<std::stringstream>();
+    *stream << "stream body";
+    stream_body = body_type::stream_communicator_type{stream};
+    EXPECT_EQ(stream_body.which_communicator(), communicator_type::stream_based);
+    read.clear();
+    while (auto const size = stream_body.read(piece.data(), piece_size)) {
+        read.append(reinterpret_cast<char const*>(piece.data()), static_cast<std::size_t>(size));
+    }
+    EXPECT_EQ(read, "stream body");
+}
+
+#ifdef webpp_posix
+TEST(Body, FileBody) {
+    enable_owner_traits<default_traits> et;
+    std::filesystem::path               file = std::filesystem::temp_directory_path();
+    file.append("webpp_file_body_test");
+    std::ofstream{file} << "file body";
+
+    body_type::file_communicator_type file_body{file};
+    ASSERT_TRUE(file_body.is_open());
+    EXPECT_EQ(file_body.size(), 9);
+
+    std::string etag;
+    file_body.etag_to(etag);
+    EXPECT_TRUE(etag.starts_with('"') && etag.ends_with("-9\""));
+
+    body_type the_body{et};
+    the_body = std::move(file_body);
+    EXPECT_EQ(the_body.which_communicator(), communicator_type::file_based);
+    EXPECT_EQ(the_body.size(), 9);
+    ASSERT_NE(the_body.file(), nullptr);
+
+    // the copies have their own descriptors
+    auto                     copy = the_body;
+    std::array<std::byte, 4> piece{};
+    std::string              read;
+    while (auto const size = copy.read(piece.data(), static_cast<std::streamsize>(piece.size()))) {
+        read.append(reinterpret_cast<char const*>(piece.data()), static_cast<std::size_t>(size));
+    }
+    EXPECT_EQ(read, "file body");
+    EXPECT_EQ(the_body.file()->remaining(), 9);
+
+    std::filesystem::remove(file);
+    EXPECT_FALSE(body_type::file_communicator_type{file}.is_open());
+}
+#endif
+
+TEST(Body, HTTPDate) {
+    auto const date = format_http_date(784111777);
+    EXPECT_EQ(std::string_view(date.data(), date.size()), "Sun, 06 Nov 1994 08:49:37 GMT");
+}
@@ -0,0 +1,100 @@
+#include "../core/include/webpp/http/bodies/string.hpp"
+#include "../core/include/webpp/http/protocols/cgi.hpp"
+#include "../core/include/webpp/http/protocols/cgi_proto/cgi_environment.hpp"
+#include "../core/include/webpp/http/routes/context.hpp"
+#include "common_pch.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+using namespace webpp;
+using namespace webpp::http;
+using namespace webpp::http::cgi_proto;
+
+TEST(CGI, Environment) {
+    // set before the first lookup, which builds the index
+    ASSERT_EQ(::setenv("WEBPP_TEST_QUERY", "a=1&b=2", 1), 0);
+    ASSERT_EQ(::setenv("WEBPP_TEST_EMPTY", "", 1), 0);
+
+    EXPECT_EQ(cgi_environment::get("WEBPP_TEST_QUERY"), "a=1&b=2");
+    EXPECT_EQ(cgi_environment::get("WEBPP_TEST_EMPTY"), "");
+    EXPECT_EQ(cgi_environment::get("WEBPP_TEST_QUER"), "");
+    EXPECT_EQ(cgi_environment::get("WEBPP_TEST_MISSING"), "");
+
+    // the values are in environ itself
+    EXPECT_EQ(cgi_environment::get("WEBPP_TEST_QUERY").data(), ::getenv("WEBPP_TEST_QUERY"));
+
+    EXPECT_EQ(cgi_environment::scan("WEBPP_TEST_QUERY"), "a=1&b=2");
+    EXPECT_EQ(cgi_environment::scan("WEBPP_TEST_QUER"), "");
+}
+
+namespace {
+    // responds with the body that's chosen by the test
+    struct body_app {
+        enum struct body_kind { text, file, stream };
+
+        static inline body_kind             kind = body_kind::text;
+        static inline stl::filesystem::path file_path{};
+
+        HTTPResponse auto operator()(HTTPRequest auto&& req) {
+            using request_type = stl::remove_cvref_t<decltype(req)>;
+            using extensions   = typename merge_root_extensions<typename request_type::root_extensions,
+                                                                extension_pack<string_body>>::type;
+            simple_context<request_type, extensions> ctx{req};
+            switch (kind) {
+                case body_kind::file: return ctx.file(file_path);
+                case body_kind::stream: {
+                    auto res    = ctx.string("");
+                    auto stream = stl::make_shared<stl::stringstream>();
+                    *stream << "stream body";
+                    res.body = typename decltype(res.body)::stream_communicator_type{stl::move(stream)};
+                    return res;
+                }
+                default: return ctx.string("text body");
+            }
+        }
+    };
+
+    // run the CGI application, and get what it writes to the standard output
+    stl::string run_cgi(body_app::body_kind kind) {
+        body_app::kind = kind;
+
+        auto* const out        = ::tmpfile();
+        int const   old_stdout = ::dup(STDOUT_FILENO);
+        ::fflush(stdout);
+        ::dup2(::fileno(out), STDOUT_FILENO);
+        http::cgi<body_app> app;
+        app();
+        ::dup2(old_stdout, STDOUT_FILENO);
+        ::close(old_stdout);
+
+        stl::string output(static_cast<stl::size_t>(::ftell(out)), '\0');
+        ::rewind(out);
+        output.resize(::fread(output.data(), 1, output.size(), out));
+        ::fclose(out);
+        return output;
+    }
+} // namespace
+
+TEST(CGI, ResponseBodies) {
+    auto const text = run_cgi(body_app::body_kind::text);
+    EXPECT_TRUE(text.starts_with("Status: 200")) << text;
+    EXPECT_NE(text.find("\r\nContent-Type: text/html; charset=utf-8\r\n"), stl::string::npos) << text;
+    EXPECT_TRUE(text.ends_with("\r\n\r\ntext body")) << text;
+
+    body_app::file_path = stl::filesystem::temp_directory_path() / "webpp_cgi_file_body_test";
+    stl::ofstream{body_app::file_path} << "file body";
+    auto const file = run_cgi(body_app::body_kind::file);
+    stl::filesystem::remove(body_app::file_path);
+    EXPECT_TRUE(file.starts_with("Status: 200")) << file;
+    EXPECT_NE(file.find("\r\nContent-Length: 9\r\n"), stl::string::npos) << file;
+    EXPECT_NE(file.find("\r\nETag: "), stl::string::npos) << file;
+    EXPECT_TRUE(file.ends_with("\r\n\r\nfile body")) << file;
+
+    auto const stream = run_cgi(body_app::body_kind::stream);
+    EXPECT_TRUE(stream.starts_with("Status: 200")) << stream;
+    EXPECT_EQ(stream.find("Content-Length"), stl::string::npos) << stream; // the size is not known
+    EXPECT_TRUE(stream.ends_with("\r\n\r\nstream body")) << stream;
+}
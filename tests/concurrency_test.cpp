@@ -2,9 +2,12 @@
 
 
 #include "../core/include/webpp/concurrency/atomic_counter.hpp"
+#include "../core/include/webpp/concurrency/bounded_queue.hpp"
 #include "common_pch.hpp"
 
+#include <string>
 #include <thread>
+#include <vector>
 
 using namespace webpp;
 using namespace webpp::stl;
@@ -51,4 +54,69 @@ TEST(ConcurrencyTest, STDAtomicCounter) {
 
 
 
+TEST(ConcurrencyTest, BoundedQueue) {
+    bounded_queue<string> queue{3};
+    EXPECT_EQ(queue.capacity(), 4);
+    EXPECT_TRUE(queue.empty());
+
+    string out;
+    EXPECT_FALSE(queue.try_pop(out));
+
+    EXPECT_TRUE(queue.try_push("one"));
+    EXPECT_TRUE(queue.try_emplace(3ul, 't'));
+    EXPECT_TRUE(queue.try_push("three"));
+    EXPECT_TRUE(queue.try_push("four"));
+    EXPECT_FALSE(queue.try_push("five"));
+    EXPECT_FALSE(queue.empty());
+
+    EXPECT_TRUE(queue.try_pop(out));
+    EXPECT_EQ(out, "one");
+    EXPECT_TRUE(queue.try_pop(out));
+    EXPECT_EQ(out, "ttt");
+    EXPECT_TRUE(queue.try_push("five"));
+    // the rest of them are destroyed with the queue
+}
+
+
+TEST(ConcurrencyTest, BoundedQueueMultiThreaded) {
+    constexpr int       per_thread = 10'000;
+    constexpr int       producers  = 3;
+    bounded_queue<int>  queue{64};
+    atomic<long long>   sum{0};
+    atomic<int>         popped{0};
+    std::vector<thread> threads;
+
+    for (int p = 0; p != producers; ++p) {
+        threads.emplace_back([&] {
+            for (int i = 1; i <= per_thread; ++i) {
+                while (!queue.try_push(i)) {
+                    this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int c = 0; c != 2; ++c) {
+        threads.emplace_back([&] {
+            int value = 0;
+            while (popped.load() != producers * per_thread) {
+                if (queue.try_pop(value)) {
+                    sum += value;
+                    ++popped;
+                } else {
+                    this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    EXPECT_EQ(popped.load(), producers * per_thread);
+    EXPECT_EQ(sum.load(), static_cast<long long>(producers) * per_thread * (per_thread + 1) / 2);
+    EXPECT_TRUE(queue.empty());
+}
+
+
+
 // NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
@@ -0,0 +1,288 @@
+#include "../core/include/webpp/http/protocols/fastcgi/fcgi_session_manager.hpp"
+#include "common_pch.hpp"
+
+#include <string>
+
+using namespace webpp;
+using namespace webpp::http::fastcgi;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
+
+namespace {
+
+    // replies with the method and the body of the request
+    struct echo_responder {
+        stl::uint32_t operator()(fcgi_request_manager<default_traits>& req) const {
+            req.write("Content-Type: text/plain\r\n\r\n");
+            req.write(req.param("REQUEST_METHOD"));
+            req.write(" ");
+            req.write(req.body());
+            return 0;
+        }
+    };
+
+    using session_type = fcgi_session_manager<default_traits, echo_responder, 2>;
+
+    stl::string record(record_type type, stl::uint16_t req_id, stl::string_view content) {
+        stl::string out;
+        append_record(out, type, req_id, content.data(), content.size());
+        return out;
+    }
+
+    stl::string begin(stl::uint16_t req_id, bool keep_conn = true, role the_role = role::responder) {
+        stl::string body(8, '\0');
+        body[1] = static_cast<char>(the_role);
+        body[2] = keep_conn ? 1 : 0;
+        return record(record_type::begin_request, req_id, body);
+    }
+
+    stl::string params(stl::uint16_t req_id, stl::string_view name, stl::string_view value) {
+        stl::string content;
+        append_name_value(content, name, value);
+        return record(record_type::params, req_id, content);
+    }
+
+    // a parsed record of the output
+    struct output_record {
+        record_type   type;
+        stl::uint16_t id;
+        stl::string   content;
+    };
+
+    // the output buffers of the session, the way they're sent
+    stl::string output_of(session_type& session) {
+        stl::string out;
+        for (auto const& buf : session.output_buffers()) {
+            out.append(static_cast<char const*>(buf.iov_base), buf.iov_len);
+        }
+        return out;
+    }
+
+    stl::vector<output_record> parse(stl::string_view out) {
+        stl::vector<output_record> records;
+        while (out.size() >= header_size) {
+            header hdr{record_type::unknown_type, 0, 0, 0};
+            stl::memcpy(&hdr, out.data(), sizeof(hdr));
+            records.push_back({hdr.type,
+                               hdr.request_id(),
+                               stl::string{out.substr(header_size, hdr.content_length())}});
+            EXPECT_EQ((header_size + hdr.content_length() + hdr.padding_length) % 8, 0);
+            out.remove_prefix(header_size + hdr.content_length() + hdr.padding_length);
+        }
+        EXPECT_TRUE(out.empty());
+        return records;
+    }
+
+    // feed the data to the session the way the connections do
+    bool feed(session_type& session, stl::string_view data) {
+        bool need_more = true;
+        while (!data.empty()) {
+            auto&      buf  = session.buffer();
+            auto const size = stl::min(data.size(), buf.size());
+            stl::memcpy(buf.data(), data.data(), size);
+            data.remove_prefix(size);
+            need_more = session.read(size);
+        }
+        return need_more;
+    }
+
+} // namespace
+
+TEST(FastCGI, NameValuePairs) {
+    stl::string const long_value(300, 'x');
+    stl::string       content;
+    append_name_value(content, "SHORT", "value");
+    append_name_value(content, "LONG", long_value);
+
+    char const*      pos = content.data();
+    char const*      end = pos + content.size();
+    stl::string_view name;
+    stl::string_view value;
+    ASSERT_TRUE(fcgi_manager::process_header_params(pos, end, name, value));
+    EXPECT_EQ(name, "SHORT");
+    EXPECT_EQ(value, "value");
+    ASSERT_TRUE(fcgi_manager::process_header_params(pos, end, name, value));
+    EXPECT_EQ(name, "LONG");
+    EXPECT_EQ(value, long_value);
+    EXPECT_FALSE(fcgi_manager::process_header_params(pos, end, name, value));
+    EXPECT_EQ(pos, end);
+
+    // the lengths are longer than the data
+    content = "\x05\x05NAME";
+    pos     = content.data();
+    end     = pos + content.size();
+    EXPECT_FALSE(fcgi_manager::process_header_params(pos, end, name, value));
+}
+
+TEST(FastCGI, MultiplexedRequests) {
+    enable_owner_traits<default_traits> et;
+    session_type                        session{et};
+
+    // two requests whose records are interleaved
+    stl::string input = begin(1) + begin(2) + params(1, "REQUEST_METHOD", "POST") +
+                        params(2, "REQUEST_METHOD", "GET") + record(record_type::params, 2, {}) +
+                        record(record_type::params, 1, {}) + record(record_type::std_in, 1, "body");
+    EXPECT_TRUE(feed(session, input));
+
+    // the second request is complete now
+    EXPECT_FALSE(feed(session, record(record_type::std_in, 2, {})));
+    auto records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(records[0].type, record_type::std_out);
+    EXPECT_EQ(records[0].id, 2);
+    EXPECT_EQ(records[0].content, "Content-Type: text/plain\r\n\r\nGET ");
+    EXPECT_EQ(records[1].type, record_type::std_out);
+    EXPECT_TRUE(records[1].content.empty());
+    EXPECT_EQ(records[2].type, record_type::end_request);
+    EXPECT_EQ(records[2].id, 2);
+    EXPECT_TRUE(session.keep_connection());
+
+    // the last record of the first request arrives in two pieces
+    auto const last = record(record_type::std_in, 1, {});
+    EXPECT_TRUE(feed(session, stl::string_view{last}.substr(0, 3)));
+    EXPECT_FALSE(feed(session, stl::string_view{last}.substr(3)));
+    records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(records[0].id, 1);
+    EXPECT_EQ(records[0].content, "Content-Type: text/plain\r\n\r\nPOST body");
+    EXPECT_EQ(records[2].type, record_type::end_request);
+    EXPECT_EQ(records[2].id, 1);
+
+    // a third and a fourth request at the same time are over the limit of 2
+    EXPECT_TRUE(feed(session, begin(3) + begin(4)));
+    EXPECT_FALSE(feed(session, begin(5)));
+    records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(records[0].type, record_type::end_request);
+    EXPECT_EQ(records[0].id, 5);
+    EXPECT_EQ(static_cast<protocol_status>(records[0].content[4]), protocol_status::overloaded);
+
+    // aborted requests are ended right away
+    auto const aborts = record(record_type::abort_request, 3, {}) + record(record_type::abort_request, 4, {});
+    EXPECT_FALSE(feed(session, aborts));
+    records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(records[0].id, 3);
+    EXPECT_EQ(records[1].id, 4);
+
+    // the web server doesn't want to keep the connection
+    EXPECT_TRUE(feed(session, begin(6, false) + record(record_type::params, 6, {})));
+    EXPECT_FALSE(feed(session, record(record_type::std_in, 6, {})));
+    EXPECT_FALSE(session.keep_connection());
+}
+
+TEST(FastCGI, ParamsAcrossRecords) {
+    stl::string content;
+    append_name_value(content, "LONG_NAME", stl::string(300, 'x'));
+    append_name_value(content, "REQUEST_METHOD", "PUT");
+
+    // the pairs are split at every position, even inside their lengths; and the buffer of the session is
+    // overwritten by the next records before the request is responded
+    for (stl::size_t split = 1; split != content.size(); ++split) {
+        enable_owner_traits<default_traits> et;
+        session_type                        session{et};
+        auto const first  = stl::string_view{content}.substr(0, split);
+        auto const second = stl::string_view{content}.substr(split);
+        EXPECT_TRUE(feed(session, begin(1) + record(record_type::params, 1, first)));
+        auto const rest = record(record_type::params, 1, second) + record(record_type::params, 1, {});
+        EXPECT_TRUE(feed(session, rest));
+        auto const body = record(record_type::std_in, 1, "in") + record(record_type::std_in, 1, {});
+        EXPECT_FALSE(feed(session, body));
+        auto const records = parse(output_of(session));
+        ASSERT_EQ(records.size(), 3) << split;
+        EXPECT_EQ(records[0].content, "Content-Type: text/plain\r\n\r\nPUT in") << split;
+    }
+
+    // a pair that's cut off is malformed
+    enable_owner_traits<default_traits> et;
+    session_type                        session{et};
+    auto const half = stl::string_view{content}.substr(0, 10);
+    EXPECT_FALSE(
+      feed(session, begin(1) + record(record_type::params, 1, half) + record(record_type::params, 1, {})));
+    auto const records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(records[0].type, record_type::std_err);
+    EXPECT_EQ(records[1].type, record_type::end_request);
+}
+
+TEST(FastCGI, ManagementRecords) {
+    enable_owner_traits<default_traits> et;
+    session_type                        session{et};
+
+    stl::string names;
+    append_name_value(names, "FCGI_MAX_CONNS", "");
+    append_name_value(names, "FCGI_MAX_REQS", "");
+    append_name_value(names, "FCGI_MPXS_CONNS", "");
+    append_name_value(names, "UNKNOWN_VARIABLE", "");
+    EXPECT_FALSE(feed(session, record(record_type::get_values, 0, names)));
+
+    auto records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(records[0].type, record_type::get_values_result);
+
+    char const*      pos = records[0].content.data();
+    char const*      end = pos + records[0].content.size();
+    stl::string_view name;
+    stl::string_view value;
+    ASSERT_TRUE(fcgi_manager::process_header_params(pos, end, name, value));
+    EXPECT_EQ(name, "FCGI_MAX_CONNS");
+    EXPECT_EQ(value, stl::to_string(max_connections()));
+    ASSERT_TRUE(fcgi_manager::process_header_params(pos, end, name, value));
+    EXPECT_EQ(name, "FCGI_MAX_REQS");
+    EXPECT_EQ(value, "2");
+    ASSERT_TRUE(fcgi_manager::process_header_params(pos, end, name, value));
+    EXPECT_EQ(name, "FCGI_MPXS_CONNS");
+    EXPECT_EQ(value, "1");
+    EXPECT_FALSE(fcgi_manager::process_header_params(pos, end, name, value));
+
+    // unknown management records, and unknown roles
+    EXPECT_FALSE(feed(session, record(static_cast<record_type>(42), 0, {})));
+    records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(records[0].type, record_type::unknown_type);
+    EXPECT_EQ(records[0].content[0], 42);
+
+    EXPECT_FALSE(feed(session, begin(1, true, role::authorizer)));
+    records = parse(output_of(session));
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(records[0].type, record_type::end_request);
+    EXPECT_EQ(static_cast<protocol_status>(records[0].content[4]), protocol_status::unknown_role);
+}
+
+TEST(FastCGI, RecordWriter) {
+    using writer_type = fcgi_record_writer<default_traits>;
+
+    enable_owner_traits<default_traits> et;
+    writer_type                         writer{et};
+
+    // a large body is split into aligned records, and it's not copied
+    stl::string const body(max_aligned_content_length + 100, 'b');
+    writer.write(record_type::std_out, 1, "head:");
+    writer.write_ref(record_type::std_out, 1, body);
+    writer.write(record_type::std_out, 1, writer_type::string_type(1000, 'm'));
+    writer.end_stream(record_type::std_out, 1);
+
+    auto const  buffers = writer.buffers();
+    stl::string out;
+    bool        points_to_body = false;
+    for (auto const& buf : buffers) {
+        points_to_body = points_to_body || buf.iov_base == body.data();
+        out.append(static_cast<char const*>(buf.iov_base), buf.iov_len);
+    }
+    EXPECT_TRUE(points_to_body);
+    EXPECT_EQ(out.size(), writer.size());
+
+    auto const records = parse(out);
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(records[0].content.size(), max_aligned_content_length);
+    EXPECT_EQ(records[0].content, "head:" + body.substr(0, max_aligned_content_length - 5));
+    EXPECT_EQ(records[1].content, body.substr(max_aligned_content_length - 5) + stl::string(1000, 'm'));
+    EXPECT_EQ(records[1].id, 1);
+    EXPECT_TRUE(records[2].content.empty());
+
+    writer.clear();
+    EXPECT_TRUE(writer.empty());
+    EXPECT_TRUE(writer.buffers().empty());
+}
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
@@ -0,0 +1,488 @@
+#include "../core/include/webpp/http/protocols/h2/h2_session_manager.hpp"
+#include "common_pch.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace webpp;
+using namespace webpp::http::h2;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
+
+namespace {
+
+    using fields_type = stl::vector<stl::pair<stl::string, stl::string>>;
+
+    stl::string from_hex(stl::string_view hex) {
+        stl::string out;
+        for (stl::size_t index = 0; index + 1 < hex.size(); index += 2) {
+            out.push_back(static_cast<char>(stl::stoi(stl::string{hex.substr(index, 2)}, nullptr, 16)));
+        }
+        return out;
+    }
+
+    template <typename DecoderT>
+    fields_type decode(DecoderT& decoder, stl::string_view hex) {
+        fields_type fields;
+        EXPECT_TRUE(decoder.decode(from_hex(hex), [&](stl::string_view name, stl::string_view value) {
+            fields.emplace_back(name, value);
+        })) << hex;
+        return fields;
+    }
+
+    // replies with the method, the target, and the body of the request
+    struct echo_responder {
+        template <typename StreamT>
+        void operator()(StreamT& stream) const {
+            stream.response_header("Content-Type", "text/plain");
+            stream.response_header("Connection", "keep-alive"); // dropped
+            stream.write(stream.method());
+            stream.write(" ");
+            stream.write(stream.target());
+            stream.write(" ");
+            stream.write(stream.body());
+        }
+    };
+
+    using session_type = h2_session_manager<default_traits, echo_responder>;
+
+    struct frame {
+        frame_header header;
+        stl::string  payload;
+    };
+
+    stl::string make_frame(frame_type       type,
+                           stl::uint8_t     frame_flags,
+                           stl::uint32_t    stream_id,
+                           stl::string_view payload) {
+        stl::string out;
+        append_frame_header(out, payload.size(), type, frame_flags, stream_id);
+        out.append(payload);
+        return out;
+    }
+
+    stl::string settings(stl::initializer_list<stl::pair<setting, stl::uint32_t>> values = {}) {
+        stl::string payload;
+        for (auto const& [identifier, value] : values) {
+            append_setting(payload, identifier, value);
+        }
+        return make_frame(frame_type::settings, 0, 0, payload);
+    }
+
+    // a request without the dynamic table: the method, the path, and the scheme are literals
+    stl::string request(stl::uint32_t    stream_id,
+                        stl::string_view method,
+                        stl::string_view path,
+                        bool             end_stream) {
+        stl::string block;
+        hpack_append_integer(block, 2, 4); // :method
+        hpack_append_string(block, method);
+        hpack_append_integer(block, 4, 4); // :path
+        hpack_append_string(block, path);
+        block.push_back(static_cast<char>(0x86)); // :scheme http
+        block.push_back(static_cast<char>(0x41)); // :authority, with indexing
+        hpack_append_string(block, "example.com");
+        auto const frame_flags =
+          static_cast<stl::uint8_t>(flag::end_headers | (end_stream ? flag::end_stream : 0));
+        return make_frame(frame_type::headers, frame_flags, stream_id, block);
+    }
+
+    // feed the data to the session the way the connections do, and collect the output
+    bool feed(session_type& session, stl::string_view data, stl::string& output) {
+        bool need_more = true;
+        while (!data.empty() && session.keep_connection()) {
+            auto&      buf  = session.buffer();
+            auto const size = stl::min(data.size(), buf.size());
+            stl::memcpy(buf.data(), data.data(), size);
+            data.remove_prefix(size);
+            need_more = session.read(size);
+            output.append(session.output());
+        }
+        return need_more;
+    }
+
+    stl::vector<frame> parse_frames(stl::string_view output) {
+        stl::vector<frame> frames;
+        while (output.size() >= frame_header_size) {
+            auto const header = frame_header::parse(output);
+            frames.push_back({header, stl::string{output.substr(frame_header_size, header.length)}});
+            output.remove_prefix(frame_header_size + header.length);
+        }
+        EXPECT_TRUE(output.empty());
+        return frames;
+    }
+
+    // the response's header block decoded, and its body
+    fields_type response_fields(hpack_decoder<default_traits>& decoder, frame const& headers) {
+        fields_type fields;
+        EXPECT_EQ(headers.header.type, frame_type::headers);
+        EXPECT_TRUE(decoder.decode(headers.payload, [&](stl::string_view name, stl::string_view value) {
+            fields.emplace_back(name, value);
+        }));
+        return fields;
+    }
+
+    auto make_session(enable_owner_traits<default_traits>& et) {
+        return stl::make_unique<session_type>(et);
+    }
+
+} // namespace
+
+TEST(HTTP2, HPACKIntegers) {
+    // RFC 7541, C.1
+    stl::string out;
+    hpack_append_integer(out, 10, 5);
+    EXPECT_EQ(out, from_hex("0a"));
+    out.clear();
+    hpack_append_integer(out, 1337, 5);
+    EXPECT_EQ(out, from_hex("1f9a0a"));
+    out.clear();
+    hpack_append_integer(out, 42, 8);
+    EXPECT_EQ(out, from_hex("2a"));
+
+    stl::uint32_t value = 0;
+    auto const    input = from_hex("1f9a0a");
+    stl::string_view rest = input;
+    EXPECT_TRUE(hpack_decode_integer(rest, 5, value));
+    EXPECT_EQ(value, 1337);
+    EXPECT_TRUE(rest.empty());
+
+    // too large, or not finished
+    rest = "\x1f\xff\xff\xff\xff\x0f";
+    EXPECT_FALSE(hpack_decode_integer(rest, 5, value));
+    rest = "\x1f\x9a";
+    EXPECT_FALSE(hpack_decode_integer(rest, 5, value));
+}
+
+TEST(HTTP2, Huffman) {
+    // RFC 7541, C.4 and C.6
+    stl::vector<stl::pair<stl::string_view, stl::string_view>> const samples{
+      {"www.example.com", "f1e3c2e5f23a6ba0ab90f4ff"},
+      {"no-cache", "a8eb10649cbf"},
+      {"custom-key", "25a849e95ba97d7f"},
+      {"custom-value", "25a849e95bb8e8b4bf"},
+      {"302", "6402"},
+      {"private", "aec3771a4b"},
+      {"Mon, 21 Oct 2013 20:13:21 GMT", "d07abe941054d444a8200595040b8166e082a62d1bff"},
+      {"https://www.example.com", "9d29ad171863c78f0b97c8e9ae82ae43d3"},
+    };
+    for (auto const& [text, hex] : samples) {
+        stl::string encoded;
+        huffman_encode(text, encoded);
+        EXPECT_EQ(encoded, from_hex(hex)) << text;
+        EXPECT_EQ(huffman_encoded_size(text), encoded.size());
+
+        stl::string decoded;
+        EXPECT_TRUE(huffman_decode(encoded, decoded));
+        EXPECT_EQ(decoded, text);
+    }
+
+    // all the octets
+    stl::string all;
+    for (int chr = 0; chr != 256; ++chr) {
+        all.push_back(static_cast<char>(chr));
+    }
+    stl::string encoded;
+    stl::string decoded;
+    huffman_encode(all, encoded);
+    EXPECT_TRUE(huffman_decode(encoded, decoded));
+    EXPECT_EQ(decoded, all);
+
+    // the padding should be the most significant bits of EOS, and shorter than an octet
+    decoded.clear();
+    EXPECT_FALSE(huffman_decode(from_hex("60"), decoded)); // "/" and "00"
+    decoded.clear();
+    EXPECT_FALSE(huffman_decode(from_hex("6402ff"), decoded));
+    decoded.clear();
+    EXPECT_FALSE(huffman_decode(from_hex("ffffffff"), decoded)); // EOS
+}
+
+TEST(HTTP2, HPACKRequests) {
+    enable_owner_traits<default_traits> et;
+    hpack_decoder<default_traits>       decoder{et};
+
+    // RFC 7541, C.4: requests with Huffman coding
+    EXPECT_EQ(decode(decoder, "828684418cf1e3c2e5f23a6ba0ab90f4ff"),
+              (fields_type{{":method", "GET"},
+                           {":scheme", "http"},
+                           {":path", "/"},
+                           {":authority", "www.example.com"}}));
+    EXPECT_EQ(decoder.table_bytes(), 57);
+
+    EXPECT_EQ(decode(decoder, "828684be5886a8eb10649cbf"),
+              (fields_type{{":method", "GET"},
+                           {":scheme", "http"},
+                           {":path", "/"},
+                           {":authority", "www.example.com"},
+                           {"cache-control", "no-cache"}}));
+    EXPECT_EQ(decoder.table_bytes(), 110);
+
+    EXPECT_EQ(decode(decoder, "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"),
+              (fields_type{{":method", "GET"},
+                           {":scheme", "https"},
+                           {":path", "/index.html"},
+                           {":authority", "www.example.com"},
+                           {"custom-key", "custom-value"}}));
+    EXPECT_EQ(decoder.table_bytes(), 164);
+    EXPECT_EQ(decoder.size(), 3);
+
+    // an index that's not in the table
+    EXPECT_FALSE(decoder.decode(from_hex("c2"), [](auto, auto) {}));
+}
+
+TEST(HTTP2, HPACKEviction) {
+    enable_owner_traits<default_traits> et;
+    hpack_decoder<default_traits>       decoder{et};
+    decoder.max_table_size(256);
+
+    // RFC 7541, C.5: responses without Huffman coding, with evictions
+    EXPECT_EQ(decode(decoder,
+                     "4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a32312047"
+                     "4d546e1768747470733a2f2f7777772e6578616d706c652e636f6d"),
+              (fields_type{{":status", "302"},
+                           {"cache-control", "private"},
+                           {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                           {"location", "https://www.example.com"}}));
+    EXPECT_EQ(decoder.table_bytes(), 222);
+
+    EXPECT_EQ(decode(decoder, "4803333037c1c0bf"),
+              (fields_type{{":status", "307"},
+                           {"cache-control", "private"},
+                           {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                           {"location", "https://www.example.com"}}));
+    EXPECT_EQ(decoder.table_bytes(), 222);
+
+    EXPECT_EQ(decode(decoder,
+                     "88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a6970773866"
+                     "6f6f3d4153444a4b48514b425a584f5157454f50495541585157454f49553b206d61782d61"
+                     "67653d333630303b2076657273696f6e3d31"),
+              (fields_type{{":status", "200"},
+                           {"cache-control", "private"},
+                           {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+                           {"location", "https://www.example.com"},
+                           {"content-encoding", "gzip"},
+                           {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}}));
+    EXPECT_EQ(decoder.table_bytes(), 215);
+    EXPECT_EQ(decoder.size(), 3);
+
+    // the name of the new entry is the name of the entry that it evicts; only one entry fits in the table
+    stl::string const value(13, 'm');
+    EXPECT_EQ(decode(decoder, "3f1d770d6d6d6d6d6d6d6d6d6d6d6d6d6d"), (fields_type{{"set-cookie", value}}));
+    for (int round = 0; round != 20; ++round) {
+        EXPECT_EQ(decode(decoder, "7e0d6d6d6d6d6d6d6d6d6d6d6d6d6d"), (fields_type{{"set-cookie", value}}));
+        EXPECT_EQ(decoder.size(), 1);
+    }
+
+    // the size updates should be at the start of the block, and in our limit
+    EXPECT_TRUE(decoder.decode(from_hex("20"), [](auto, auto) {}));
+    EXPECT_EQ(decoder.size(), 0);
+    EXPECT_FALSE(decoder.decode(from_hex("3fe21f"), [](auto, auto) {}));
+    EXPECT_FALSE(decoder.decode(from_hex("8820"), [](auto, auto) {}));
+}
+
+TEST(HTTP2, HPACKEncoder) {
+    enable_owner_traits<default_traits> et;
+    hpack_decoder<default_traits>       decoder{et};
+
+    stl::string block;
+    hpack_append_status(block, 200);
+    EXPECT_EQ(block, "\x88");
+    hpack_append_status(block, 302);
+    hpack_append_field(block, "Content-Type", "text/plain");
+    hpack_append_field(block, "X-Custom-Header", "Value");
+    hpack_append_field(block, "an-extra-long-header-name-that-is-not-static", "");
+
+    fields_type fields;
+    EXPECT_TRUE(decoder.decode(block, [&](stl::string_view name, stl::string_view value) {
+        fields.emplace_back(name, value);
+    }));
+    EXPECT_EQ(fields,
+              (fields_type{{":status", "200"},
+                           {":status", "302"},
+                           {"content-type", "text/plain"},
+                           {"x-custom-header", "Value"},
+                           {"an-extra-long-header-name-that-is-not-static", ""}}));
+    EXPECT_EQ(decoder.size(), 0); // the encoder doesn't index
+}
+
+TEST(HTTP2, PriorKnowledge) {
+    enable_owner_traits<default_traits> et;
+    auto                                session = make_session(et);
+    hpack_decoder<default_traits>       decoder{et};
+    stl::string                         output;
+
+    // the preface, one byte at a time
+    auto const preface = stl::string{connection_preface} + settings();
+    for (auto const chr : preface) {
+        feed(*session, {&chr, 1}, output);
+    }
+    auto frames = parse_frames(output);
+    ASSERT_EQ(frames.size(), 2);
+    EXPECT_EQ(frames[0].header.type, frame_type::settings);
+    EXPECT_FALSE(frames[0].header.has(flag::ack));
+    EXPECT_EQ(frames[1].header.type, frame_type::settings);
+    EXPECT_TRUE(frames[1].header.has(flag::ack));
+
+    output.clear();
+    EXPECT_FALSE(feed(*session, request(1, "GET", "/hello", true), output));
+    frames = parse_frames(output);
+    ASSERT_EQ(frames.size(), 2);
+    EXPECT_EQ(response_fields(decoder, frames[0]),
+              (fields_type{{":status", "200"}, {"content-type", "text/plain"}, {"content-length", "11"}}));
+    EXPECT_TRUE(frames[0].header.has(flag::end_headers));
+    EXPECT_FALSE(frames[0].header.has(flag::end_stream));
+    EXPECT_EQ(frames[1].header.type, frame_type::data);
+    EXPECT_EQ(frames[1].header.stream_id, 1);
+    EXPECT_TRUE(frames[1].header.has(flag::end_stream));
+    EXPECT_EQ(frames[1].payload, "GET /hello ");
+    EXPECT_EQ(session->stream_count(), 0);
+
+    // PING
+    output.clear();
+    feed(*session, make_frame(frame_type::ping, 0, 0, "12345678"), output);
+    frames = parse_frames(output);
+    ASSERT_EQ(frames.size(), 1);
+    EXPECT_TRUE(frames[0].header.has(flag::ack));
+    EXPECT_EQ(frames[0].payload, "12345678");
+    EXPECT_TRUE(session->keep_connection());
+}
+
+TEST(HTTP2, Multiplexing) {
+    enable_owner_traits<default_traits> et;
+    auto                                session = make_session(et);
+    hpack_decoder<default_traits>       decoder{et};
+    stl::string                         output;
+
+    // the streams can only send 8 bytes of DATA, until their windows are updated
+    feed(*session, stl::string{connection_preface} + settings({{setting::initial_window_size, 8}}), output);
+
+    // the body of the stream 1 comes after the whole request of the stream 3
+    output.clear();
+    feed(*session,
+         request(1, "POST", "/one", false) + request(3, "GET", "/three", true) +
+           make_frame(frame_type::data, flag::end_stream, 1, "body"),
+         output);
+    auto frames = parse_frames(output);
+    ASSERT_EQ(frames.size(), 5);
+    EXPECT_EQ(frames[0].header.stream_id, 3); // responded first
+    EXPECT_EQ(response_fields(decoder, frames[0])[0].second, "200");
+    EXPECT_EQ(frames[1].header.stream_id, 1);
+    EXPECT_EQ(response_fields(decoder, frames[1])[2].second, "14");
+    EXPECT_EQ(frames[4].header.type, frame_type::window_update); // the connection's window
+    EXPECT_EQ(frames[4].header.stream_id, 0);
+    EXPECT_EQ(read_uint31(frames[4].payload), 4);
+
+    // one frame of each stream in turn
+    stl::vector<stl::pair<stl::uint32_t, stl::string>> data;
+    for (auto const& item : frames) {
+        if (item.header.type == frame_type::data) {
+            data.emplace_back(item.header.stream_id, item.payload);
+        }
+    }
+    EXPECT_EQ(data, (stl::vector<stl::pair<stl::uint32_t, stl::string>>{{1, "POST /on"}, {3, "GET /thr"}}));
+    EXPECT_EQ(session->stream_count(), 2);
+
+    stl::string update;
+    append_window_update(update, 1, 100);
+    append_window_update(update, 3, 100);
+    output.clear();
+    feed(*session, update, output);
+    frames = parse_frames(output);
+    ASSERT_EQ(frames.size(), 2);
+    EXPECT_EQ(frames[0].payload, "e body");
+    EXPECT_TRUE(frames[0].header.has(flag::end_stream));
+    EXPECT_EQ(frames[1].payload, "ee ");
+    EXPECT_EQ(session->stream_count(), 0);
+}
+
+TEST(HTTP2, Upgrade) {
+    enable_owner_traits<default_traits> et;
+    auto                                session = make_session(et);
+    hpack_decoder<default_traits>       decoder{et};
+    stl::string                         output;
+
+    stl::string_view const upgrade = "GET /up HTTP/1.1\r\n"
+                                     "Host: example.com\r\n"
+                                     "Connection: Upgrade, HTTP2-Settings\r\n"
+                                     "Upgrade: h2c\r\n"
+                                     "HTTP2-Settings: AAMAAABkAAQAoAAAAAIAAAAA\r\n"
+                                     "\r\n";
+    feed(*session, upgrade, output);
+    stl::string_view const switching = "HTTP/1.1 101 Switching Protocols\r\n"
+                                       "Connection: Upgrade\r\n"
+                                       "Upgrade: h2c\r\n\r\n";
+    ASSERT_TRUE(output.starts_with(switching));
+    auto frames = parse_frames(stl::string_view{output}.substr(switching.size()));
+    ASSERT_EQ(frames.size(), 3);
+    EXPECT_EQ(frames[0].header.type, frame_type::settings);
+    EXPECT_EQ(frames[1].header.stream_id, 1);
+    EXPECT_EQ(response_fields(decoder, frames[1])[0].second, "200");
+    EXPECT_EQ(frames[2].payload, "GET /up ");
+
+    // then the client sends its preface
+    output.clear();
+    feed(*session, stl::string{connection_preface} + settings() + request(3, "GET", "/next", true), output);
+    frames = parse_frames(output);
+    ASSERT_EQ(frames.size(), 3);
+    EXPECT_TRUE(frames[0].header.has(flag::ack));
+    EXPECT_EQ(frames[1].header.stream_id, 3);
+    EXPECT_EQ(frames[2].payload, "GET /next ");
+
+    // the requests that don't upgrade
+    auto http1 = make_session(et);
+    output.clear();
+    feed(*http1, "GET / HTTP/1.1\r\nHost: example.com\r\n\r\n", output);
+    EXPECT_TRUE(output.starts_with("HTTP/1.1 426 Upgrade Required\r\n"));
+    EXPECT_FALSE(http1->keep_connection());
+}
+
+TEST(HTTP2, Errors) {
+    enable_owner_traits<default_traits> et;
+    stl::string                         output;
+    auto const                          preface = stl::string{connection_preface} + settings();
+
+    auto const goaway_code = [](stl::string_view out) {
+        auto const frames = parse_frames(out);
+        EXPECT_FALSE(frames.empty());
+        EXPECT_EQ(frames.back().header.type, frame_type::goaway);
+        return static_cast<error_code>(read_uint32(stl::string_view{frames.back().payload}.substr(4)));
+    };
+
+    // the first frame should be SETTINGS
+    auto session = make_session(et);
+    feed(*session, stl::string{connection_preface} + make_frame(frame_type::ping, 0, 0, "12345678"), output);
+    EXPECT_EQ(goaway_code(output), error_code::protocol_error);
+    EXPECT_FALSE(session->keep_connection());
+
+    // the header block can't be decoded
+    session = make_session(et);
+    output.clear();
+    feed(*session, preface + make_frame(frame_type::headers, flag::end_headers | flag::end_stream, 1, "\xff"),
+         output);
+    auto const after_settings = 2 * frame_header_size + setting_size;
+    EXPECT_EQ(goaway_code(output.substr(after_settings)), error_code::compression_error);
+
+    // a frame in the middle of a header block
+    session = make_session(et);
+    output.clear();
+    feed(*session, preface + make_frame(frame_type::headers, 0, 1, "\x82") + settings(), output);
+    EXPECT_EQ(goaway_code(output.substr(after_settings)), error_code::protocol_error);
+
+    // a malformed request is only a stream error
+    session = make_session(et);
+    output.clear();
+    stl::string block;
+    hpack_append_integer(block, 2, 4);
+    hpack_append_string(block, "GET"); // without :path and :scheme
+    feed(*session, preface + make_frame(frame_type::headers, flag::end_headers | flag::end_stream, 1, block),
+         output);
+    auto const frames = parse_frames(output);
+    ASSERT_EQ(frames.size(), 3);
+    EXPECT_EQ(frames[2].header.type, frame_type::rst_stream);
+    EXPECT_EQ(static_cast<error_code>(read_uint32(frames[2].payload)), error_code::protocol_error);
+    EXPECT_TRUE(session->keep_connection());
+}
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
@@ -1,6 +1,7 @@
 // Created by moisrex on 9/24/20.
 #include "../core/include/webpp/http/syntax/http_lexer.hpp"
 #include "../core/include/webpp/http/syntax/request_parser.hpp"
+#include "../core/include/webpp/http/syntax/response_serializer.hpp"
 #include "common_pch.hpp"
 
 
@@ -47,6 +48,8 @@ TEST(HTTPRequestParser, RequestLine) {
     EXPECT_EQ(parser1.http_version_view, "1.1");
     EXPECT_EQ(parser1.request_target_view, "/home");
     EXPECT_EQ(parser1.method_view, "GET");
+    EXPECT_EQ(400, req_parser{}.parse_request_line(" / HTTP/1.1"));
+    EXPECT_EQ(400, req_parser{}.parse_request_line("GE\tT / HTTP/1.1"));
     http::version ver = parser1.get_http_version();
     EXPECT_EQ(ver.major_value(), 1);
     EXPECT_EQ(ver.minor_value(), 1);
@@ -77,4 +80,251 @@ TEST(HTTPRequestParser, HeaderLexer) {
 
     EXPECT_EQ(lexer.header_views.at(0).at(0), "one");
     EXPECT_EQ(lexer.header_views.at(0).at(1), "1");
-}
\ No newline at end of file
+}
+namespace {
+    // parse the request, giving the parser one more byte each time, the way a slow client sends it
+    http::status_code parse_byte_by_byte(req_parser& parser, std::string& request) {
+        for (std::size_t size = 1; size <= request.size(); ++size) {
+            if (auto const status = parser.parse({request.data(), size}); status != http::status_code::ok) {
+                return status;
+            }
+            if (parser.is_done()) {
+                break;
+            }
+        }
+        return http::status_code::ok;
+    }
+} // namespace
+
+TEST(HTTPRequestParser, ResumableParsing) {
+    std::string request = "\r\nPOST /path?query HTTP/1.1\r\n"
+                          "Host: example.com\r\n"
+                          "Content-Type:text/plain  \r\n"
+                          "Content-Length: 11\r\n"
+                          "\r\n"
+                          "hello worldGET / HTTP/1.1\r\n";
+
+    req_parser parser;
+    ASSERT_EQ(parse_byte_by_byte(parser, request), http::status_code::ok);
+    ASSERT_TRUE(parser.is_done());
+    EXPECT_EQ(parser.method_view, "POST");
+    EXPECT_EQ(parser.request_target_view, "/path?query");
+    EXPECT_EQ(parser.http_version_view, "1.1");
+    ASSERT_EQ(parser.headers().size(), 3);
+    EXPECT_EQ(parser.header("host"), "example.com");
+    EXPECT_EQ(parser.header("Content-Type"), "text/plain");
+    EXPECT_EQ(parser.content_length(), 11);
+    EXPECT_EQ(parser.body(), "hello world");
+    EXPECT_EQ(std::string_view{request}.substr(parser.consumed()), "GET / HTTP/1.1\r\n");
+
+    // the rest of the input is the next request
+    request.erase(0, parser.consumed());
+    request += "\r\n";
+    parser.reset();
+    ASSERT_EQ(parser.parse({request.data(), request.size()}), http::status_code::ok);
+    EXPECT_TRUE(parser.is_done());
+    EXPECT_EQ(parser.method_view, "GET");
+    EXPECT_TRUE(parser.headers().empty());
+    EXPECT_TRUE(parser.body().empty());
+}
+
+TEST(HTTPRequestParser, ChunkedBody) {
+    std::string request = "PUT /file HTTP/1.1\r\n"
+                          "Transfer-Encoding: gzip, chunked\r\n"
+                          "\r\n"
+                          "5\r\nhello\r\n"
+                          "1;name=value\r\n \r\n"
+                          "0005\r\nworld\r\n"
+                          "0\r\n"
+                          "Trailer: ignored\r\n"
+                          "\r\n";
+    auto const size = request.size();
+
+    req_parser parser;
+    EXPECT_EQ(parse_byte_by_byte(parser, request), http::status_code::not_implemented); // gzip
+
+    request.replace(request.find("gzip, "), 6, "");
+    parser.reset();
+    ASSERT_EQ(parse_byte_by_byte(parser, request), http::status_code::ok);
+    ASSERT_TRUE(parser.is_done());
+    EXPECT_TRUE(parser.is_chunked());
+    EXPECT_EQ(parser.body(), "hello world");
+    EXPECT_EQ(parser.consumed(), size - 6);
+}
+
+TEST(HTTPRequestParser, MalformedRequests) {
+    auto parse = [](std::string request, std::size_t max_body = 1024) {
+        req_parser parser;
+        parser.max_target_size = 100;
+        parser.max_body_size   = max_body;
+        return parse_byte_by_byte(parser, request);
+    };
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n"),
+              http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n"),
+              http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nContent-Length: -1\r\n\r\n"), http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nName : value\r\n\r\n"), http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nName: value\r\n folded\r\n\r\n"), http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nName: bad\x01value\r\n\r\n"), http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n"),
+              http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n"),
+              http::status_code::bad_request);
+    EXPECT_EQ(parse("GET / HTTP/2.0\r\n\r\n"), http::status_code::http_version_not_supported);
+    EXPECT_EQ(parse("GET /" + std::string(200, 'a')), http::status_code::uri_too_long);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nContent-Length: 1025\r\n\r\n"), http::status_code::payload_too_large);
+    EXPECT_EQ(parse("GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n401\r\n"),
+              http::status_code::payload_too_large);
+}
+
+TEST(HTTPRequestParser, Scanners) {
+    // the predicates that the SIMD scanners use, agree with the tables of the scalar scanners
+    for (int i = 0; i < 256; ++i) {
+        auto const c = static_cast<std::uint8_t>(i);
+        EXPECT_EQ(http::details::is_not_tchar(c), !is_tchar(static_cast<char>(c))) << i;
+        EXPECT_EQ(http::details::is_not_field_content(c), !is_field_content(static_cast<char>(c))) << i;
+    }
+
+    std::string_view const line = "Content-Type: text/html; charset=utf-8\r\n";
+    EXPECT_EQ(find_first_not_tchar(line), 12);
+    EXPECT_EQ(find_first_not_field_content(line), line.size() - 2);
+    EXPECT_EQ(find_first_not_tchar(std::string_view{"token"}), 5);
+    EXPECT_EQ(find_first_not_field_content(std::string_view{"value\x7F"}), 5);
+    EXPECT_EQ(find_sp(std::string_view{"/path?q=1 HTTP/1.1"}), 9);
+    EXPECT_EQ(find_sp(std::string_view{"/path"}), 5);
+
+    // longer than a SIMD register, with the stop at every position
+    std::string long_line(100, 'a');
+    for (std::size_t i = 0; i < long_line.size(); ++i) {
+        auto str = long_line;
+        str[i]   = '\n';
+        EXPECT_EQ(find_first_not_field_content(std::string_view{str}), i);
+        str[i] = ':';
+        EXPECT_EQ(find_first_not_tchar(std::string_view{str}), i);
+        str[i] = ' ';
+        EXPECT_EQ(find_sp(std::string_view{str}), i);
+    }
+}
+
+
+namespace {
+    struct test_field {
+        stl::string name;
+        stl::string value;
+    };
+
+    struct test_headers : stl::vector<test_field> {
+        status_code_type status_code = 200;
+    };
+
+    struct test_headers_with_reason : test_headers {
+        stl::string_view reason_phrase{};
+    };
+} // namespace
+
+TEST(HTTPResponseSerializer, Head) {
+    test_headers headers;
+    headers.emplace_back("Content-Type", "text/plain");
+    headers.emplace_back("Content-Length", "1000"); // replaced by the real size
+    headers.status_code = 404;
+
+    stl::string out;
+    EXPECT_TRUE(serialize_response_head(out, headers, {.content_length = 5}));
+    EXPECT_EQ(out, "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\n");
+
+    out.clear();
+    EXPECT_FALSE(
+      serialize_response_head(out, headers, {.framing = body_framing::chunked, .keep_alive = false}));
+    EXPECT_EQ(out,
+              "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n"
+              "Connection: close\r\n\r\n");
+
+    out.clear();
+    EXPECT_TRUE(serialize_response_head(out, headers, {.version = http_1_0, .content_length = 5}));
+    EXPECT_EQ(out,
+              "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n"
+              "Connection: keep-alive\r\n\r\n");
+
+    // the app can close the connection
+    headers.emplace_back("Connection", "Close");
+    headers.status_code = 204;
+    out.clear();
+    EXPECT_FALSE(serialize_response_head(out, headers, {}));
+    EXPECT_EQ(out, "HTTP/1.1 204 No Content\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+
+    // CGI and FastCGI
+    out.clear();
+    headers.pop_back();
+    headers.status_code = 200;
+    EXPECT_TRUE(
+      serialize_response_head(out, headers, {.style = status_line_style::cgi, .content_length = 2}));
+    EXPECT_EQ(out, "Status: 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\n");
+}
+
+TEST(HTTPResponseSerializer, StatusLines) {
+    static_assert(status_line(200, {}) == "HTTP/1.1 200 OK\r\n");
+    static_assert(status_line(404, {.version = http_1_0}) == "HTTP/1.0 404 Not Found\r\n");
+    static_assert(status_line(503, {.style = status_line_style::cgi}) ==
+                  "Status: 503 Service Unavailable\r\n");
+    static_assert(status_line(599, {}).empty()); // no standard reason phrase
+    static_assert(status_line(99, {}).empty());
+
+    // every code that has a reason phrase gets the same line as the one that's built at runtime
+    for (status_code_type code = 100; code < 600; ++code) {
+        stl::string_view const phrase = status_code_reason_phrase(code);
+        if (phrase.empty()) {
+            EXPECT_TRUE(status_line(code, {}).empty());
+            continue;
+        }
+        auto const rest = stl::to_string(code) + ' ' + stl::string{phrase} + "\r\n";
+        EXPECT_EQ(status_line(code, {}), "HTTP/1.1 " + rest);
+        EXPECT_EQ(status_line(code, {.version = http_1_0}), "HTTP/1.0 " + rest);
+    }
+
+    stl::string out;
+    append_status_line(out, 599, {});
+    EXPECT_EQ(out, "HTTP/1.1 599 \r\n");
+}
+
+TEST(HTTPResponseSerializer, ReasonPhrase) {
+    test_headers_with_reason headers;
+    headers.status_code   = 200;
+    headers.reason_phrase = "Fine";
+
+    stl::string out;
+    serialize_response_head(out, headers, {.content_length = 0});
+    EXPECT_EQ(out, "HTTP/1.1 200 Fine\r\nContent-Length: 0\r\n\r\n");
+
+    out.clear();
+    headers.status_code = 599;
+    serialize_response_head(out, headers, {.style = status_line_style::cgi, .content_length = 0});
+    EXPECT_EQ(out, "Status: 599 Fine\r\nContent-Length: 0\r\n\r\n");
+}
+
+TEST(HTTPResponseSerializer, Date) {
+    auto const field = cached_date_field();
+    ASSERT_EQ(field.size(), date_field_size);
+    EXPECT_TRUE(field.starts_with("Date: "));
+    EXPECT_TRUE(field.ends_with(" GMT\r\n"));
+
+    test_headers headers;
+    stl::string  out;
+    serialize_response_head(out, headers, {.content_length = 0, .date = true});
+    EXPECT_TRUE(out.starts_with("HTTP/1.1 200 OK\r\nDate: "));
+    EXPECT_TRUE(out.ends_with(" GMT\r\nContent-Length: 0\r\n\r\n"));
+
+    // the Date field of the app is kept, and not duplicated
+    out.clear();
+    headers.emplace_back("date", "Sun, 06 Nov 1994 08:49:37 GMT");
+    serialize_response_head(out, headers, {.content_length = 0, .date = true});
+    EXPECT_EQ(out, "HTTP/1.1 200 OK\r\ndate: Sun, 06 Nov 1994 08:49:37 GMT\r\nContent-Length: 0\r\n\r\n");
+
+    // CGI responses don't have it, the web server adds it
+    out.clear();
+    headers.clear();
+    serialize_response_head(out,
+                            headers,
+                            {.style = status_line_style::cgi, .content_length = 0, .date = true});
+    EXPECT_EQ(out, "Status: 200 OK\r\nContent-Length: 0\r\n\r\n");
+}
@@ -0,0 +1,218 @@
+#include "../core/include/webpp/http/protocols/shosted/self_hosted_session_manager.hpp"
+#include "common_pch.hpp"
+
+#include <memory>
+#include <string>
+
+using namespace webpp;
+using namespace webpp::http;
+using namespace webpp::http::shosted;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
+
+namespace {
+
+    struct echo_responder;
+
+    using session_type = self_hosted_session_manager<default_traits, echo_responder>;
+
+    // replies with the method, the target, and the body of the request
+    struct echo_responder {
+        template <typename SessionT>
+        void operator()(SessionT& session) const {
+            session.response_header("Content-Type", "text/plain");
+            session.write(session.method());
+            session.write(" ");
+            session.write(session.target());
+            session.write(" ");
+            session.write(session.body());
+        }
+    };
+
+    // has its own Date field
+    struct dated_responder {
+        template <typename SessionT>
+        void operator()(SessionT& session) const {
+            session.response_header("Date", "Thu, 01 Jan 1970 00:00:00 GMT");
+            session.write("old");
+        }
+    };
+
+    // feed the data to the session the way the connections do, and collect the output
+    template <typename SessionT>
+    bool feed(SessionT& session, stl::string_view data, stl::string& output) {
+        bool need_more = true;
+        while (!data.empty() && session.keep_connection()) {
+            auto&      buf  = session.buffer();
+            auto const size = stl::min(data.size(), buf.size());
+            stl::memcpy(buf.data(), data.data(), size);
+            data.remove_prefix(size);
+            need_more = session.read(size);
+            output.append(session.output());
+        }
+        return need_more;
+    }
+
+    // the Date fields change every second, so they're checked and removed from the responses
+    stl::string without_date(stl::string output) {
+        static constexpr stl::string_view date_prefix = "\r\nDate: ";
+        auto pos = output.find(date_prefix);
+        for (; pos != stl::string::npos; pos = output.find(date_prefix, pos)) {
+            auto const end = output.find("\r\n", pos + 2);
+            EXPECT_EQ(end - pos, date_field_size) << output.substr(pos, end - pos); // its CRLF is in front
+            EXPECT_TRUE(output.substr(pos, end - pos).ends_with(" GMT"));
+            output.erase(pos, end - pos);
+        }
+        return output;
+    }
+
+    // the sessions are too large for the stack
+    auto make_session(enable_owner_traits<default_traits>& et) {
+        return stl::make_unique<session_type>(et);
+    }
+
+} // namespace
+
+TEST(SelfHosted, IncrementalRequests) {
+    enable_owner_traits<default_traits> et;
+    auto                                session = make_session(et);
+    stl::string                         output;
+
+    // one byte at a time
+    stl::string_view const request =
+      "POST /echo HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nhello";
+    for (stl::size_t i = 0; i < request.size() - 1; ++i) {
+        EXPECT_TRUE(feed(*session, request.substr(i, 1), output));
+    }
+    EXPECT_FALSE(feed(*session, request.substr(request.size() - 1), output));
+    EXPECT_EQ(without_date(output),
+              "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 16\r\n\r\nPOST /echo hello");
+    EXPECT_TRUE(session->keep_connection());
+
+    // pipelined requests are answered together
+    output.clear();
+    EXPECT_FALSE(feed(*session, "GET /one HTTP/1.1\r\n\r\nGET /two HTTP/1.1\r\n\r\nGET /th", output));
+    EXPECT_EQ(without_date(output),
+              "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 9\r\n\r\nGET /one "
+              "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 9\r\n\r\nGET /two ");
+
+    output.clear();
+    EXPECT_FALSE(feed(*session, "ree HTTP/1.0\r\n\r\n", output));
+    EXPECT_EQ(without_date(output),
+              "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 11\r\nConnection: close\r\n\r\n"
+              "GET /three ");
+    EXPECT_FALSE(session->keep_connection());
+}
+
+TEST(SelfHosted, LargeBody) {
+    enable_owner_traits<default_traits> et;
+    auto                                session = make_session(et);
+    stl::string                         output;
+
+    // the body is larger than the buffer of the session
+    stl::string const body(session_type::buffer_size + 1000, 'b');
+    stl::string const request = "PUT /file HTTP/1.1\r\nContent-Length: " + stl::to_string(body.size()) +
+                                "\r\n\r\n" + body + "GET /next";
+    EXPECT_FALSE(feed(*session, request, output));
+    EXPECT_TRUE(output.ends_with("PUT /file " + body));
+    EXPECT_TRUE(session->keep_connection());
+
+    // the rest of the input is the next request
+    output.clear();
+    EXPECT_FALSE(feed(*session, " HTTP/1.1\r\n\r\n", output));
+    EXPECT_TRUE(output.ends_with("\r\n\r\nGET /next "));
+
+    // a chunked body that's larger than the buffer
+    output.clear();
+    stl::string const chunk(session_type::buffer_size / 2 + 1000, 'c');
+    stl::string       chunks;
+    for (int i = 0; i < 2; ++i) {
+        chunks += ::fmt::format("{:x}\r\n{}\r\n", chunk.size(), chunk);
+    }
+    chunks += "0\r\n\r\n";
+    auto const chunked_request = "POST /chunks HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" + chunks;
+    EXPECT_FALSE(feed(*session, chunked_request, output));
+    EXPECT_TRUE(output.ends_with("POST /chunks " + chunk + chunk));
+    EXPECT_TRUE(session->keep_connection());
+}
+
+TEST(SelfHosted, Limits) {
+    enable_owner_traits<default_traits> et;
+    stl::string                         output;
+
+    // the long URI is rejected before the request line is complete
+    auto session = make_session(et);
+    EXPECT_FALSE(feed(*session, "GET /" + stl::string(session_type::limits.uri, 'a'), output));
+    EXPECT_TRUE(output.starts_with("HTTP/1.1 414 "));
+    EXPECT_FALSE(session->keep_connection());
+
+    // the large body is rejected before it's received
+    output.clear();
+    session = make_session(et);
+    EXPECT_FALSE(feed(*session, "POST / HTTP/1.1\r\nContent-Length: 2000000\r\n\r\n", output));
+    EXPECT_TRUE(output.starts_with("HTTP/1.1 413 "));
+
+    output.clear();
+    session = make_session(et);
+    EXPECT_FALSE(feed(*session, "GET / HTTP/1.1\r\nContent-Length: 9000\r\n\r\n", output));
+    EXPECT_TRUE(output.starts_with("HTTP/1.1 413 "));
+
+    // the headers don't fit in the buffer
+    output.clear();
+    session = make_session(et);
+    stl::string const cookie(session_type::buffer_size, 'c');
+    EXPECT_FALSE(feed(*session, "GET / HTTP/1.1\r\nCookie: " + cookie, output));
+    EXPECT_TRUE(output.starts_with("HTTP/1.1 431 "));
+
+    // malformed headers
+    output.clear();
+    session = make_session(et);
+    EXPECT_FALSE(feed(*session, "GET / HTTP/1.1\r\nBad Header: value\r\n\r\n", output));
+    EXPECT_TRUE(output.starts_with("HTTP/1.1 400 "));
+}
+
+TEST(SelfHosted, LoadShedding) {
+    // only the in-flight requests can make the host busy here
+    static constexpr limits_type limits{
+      .body = {},
+      .load = {.shed = true, .usage = {.cpu = 101, .memory = 101, .in_flight = 1}}
+    };
+    using shedding_session_type = self_hosted_session_manager<default_traits, echo_responder, limits>;
+
+    enable_owner_traits<default_traits> et;
+    auto const  session = stl::make_unique<shedding_session_type>(et);
+    stl::string output;
+
+    EXPECT_FALSE(feed(*session, "GET /one HTTP/1.1\r\n\r\n", output));
+    EXPECT_EQ(without_date(output),
+              "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 9\r\n\r\nGET /one ");
+    EXPECT_EQ(host::in_flight_requests(), 0);
+
+    // another request is being served somewhere else in the process
+    output.clear();
+    host::requests_started();
+    EXPECT_FALSE(feed(*session, "GET /two HTTP/1.1\r\n\r\n", output));
+    host::requests_finished();
+    EXPECT_EQ(output, service_unavailable_response);
+    EXPECT_FALSE(session->keep_connection());
+}
+
+TEST(SelfHosted, ResponderDate) {
+    enable_owner_traits<default_traits> et;
+    auto const  session = stl::make_unique<self_hosted_session_manager<default_traits, dated_responder>>(et);
+    stl::string output;
+
+    // the responder's Date is sent instead of the cached one
+    EXPECT_FALSE(feed(*session, "GET / HTTP/1.1\r\n\r\n", output));
+    EXPECT_EQ(output,
+              "HTTP/1.1 200 OK\r\nDate: Thu, 01 Jan 1970 00:00:00 GMT\r\nContent-Length: 3\r\n\r\nold");
+}
+
+TEST(SelfHosted, HostUsage) {
+    EXPECT_LE(host::cpu_usage(), 100);
+    EXPECT_LE(host::memory_usage(), 100);
+    EXPECT_FALSE(host::is_busy({.cpu = 101, .memory = 101}));
+    EXPECT_TRUE(host::is_busy({.cpu = 0, .memory = 0}));
+}
+
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
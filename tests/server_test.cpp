@@ -1,11 +1,596 @@
+#include "../core/include/webpp/http/bodies/string.hpp"
 #include "../core/include/webpp/http/http.hpp"
+#include "../core/include/webpp/http/protocols/beast.hpp"
+#include "../core/include/webpp/http/routes/context.hpp"
+#include "../core/include/webpp/http/protocols/shosted/self_hosted_session_manager.hpp"
+#include "../core/include/webpp/server/posix/io_uring_server.hpp"
+#include "../core/include/webpp/server/posix/posix_server.hpp"
+#include "../core/include/webpp/server/posix/prefork.hpp"
+#include "../core/include/webpp/server/socket_options.hpp"
+#include "../core/include/webpp/server/timer_wheel.hpp"
 #include "common_pch.hpp"
 
+#include <arpa/inet.h>
+#include <filesystem>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <thread>
+
 
 using namespace webpp;
 
 TEST(Server, Creation) {}
 
+namespace {
+    struct test_deadline : timer_wheel_entry {
+        int id = 0;
+
+        explicit test_deadline(int in_id) noexcept : id{in_id} {}
+    };
+} // namespace
+
+TEST(Server, TimerWheel) {
+    using namespace stl::chrono_literals;
+    using wheel_type = timer_wheel<test_deadline, 8>;
+
+    auto const       start = wheel_type::clock_type::now();
+    wheel_type       wheel{100ms, start};
+    test_deadline    first{1};
+    test_deadline    second{2};
+    test_deadline    far{3};
+    stl::vector<int> expired;
+    auto const       collect = [&expired](test_deadline const& deadline) {
+        expired.push_back(deadline.id);
+    };
+
+    wheel.arm(first, 250ms, start);
+    wheel.arm(second, 250ms, start);
+    wheel.arm(far, 2s, start); // more than one turn of the wheel
+    EXPECT_EQ(wheel.size(), 3);
+
+    // never early
+    EXPECT_EQ(wheel.advance(collect, start + 299ms), 0);
+
+    // re-arming moves it, cancelling removes it
+    wheel.arm(second, 300ms, start + 100ms);
+    EXPECT_EQ(wheel.advance(collect, start + 300ms), 1);
+    EXPECT_EQ(expired, stl::vector<int>{1});
+    EXPECT_FALSE(first.is_armed());
+
+    wheel.cancel(second);
+    wheel.cancel(second);
+    EXPECT_EQ(wheel.advance(collect, start + 1s), 0);
+    EXPECT_EQ(wheel.size(), 1);
+
+    // late for more than a whole turn
+    EXPECT_EQ(wheel.advance(collect, start + 5s), 1);
+    EXPECT_EQ(expired, (stl::vector<int>{1, 3}));
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+namespace {
+
+    // sends back each line that it receives; closes the connection after "bye"
+    struct echo_session : enable_traits<default_traits> {
+        static constexpr auto logger_category = "Test/Echo";
+
+        explicit echo_session(enable_traits<default_traits> const& et) : enable_traits<default_traits>{et} {}
+
+        // small enough for a line to need more than one read
+        stl::array<char, 8> buf{};
+        stl::string         data;
+        stl::string         out;
+
+        auto& buffer() noexcept {
+            return buf;
+        }
+
+        bool read(stl::size_t bytes) {
+            data.append(buf.data(), bytes);
+            return data.find('\n') == stl::string::npos;
+        }
+
+        stl::string_view output() {
+            auto const end = data.find('\n') + 1;
+            out            = data.substr(0, end);
+            data.erase(0, end);
+            return out;
+        }
+
+        [[nodiscard]] bool keep_connection() const noexcept {
+            return out != "bye\n";
+        }
+
+        [[nodiscard]] bool is_idle() const noexcept {
+            return data.empty();
+        }
+
+        [[nodiscard]] stl::string_view remote_addr() const noexcept {
+            return {};
+        }
+
+        void done() noexcept {}
+    };
+
+    // an echo session whose process crashes on "crash"
+    struct crashing_session : echo_session {
+        using echo_session::echo_session;
+
+        bool read(stl::size_t bytes) {
+            bool const more = echo_session::read(bytes);
+            if (data == "crash\n") {
+                ::raise(SIGKILL);
+            }
+            return more;
+        }
+    };
+
+    stl::string receive_line(int sock) {
+        stl::string line;
+        char        chr = 0;
+        while (::recv(sock, &chr, 1, 0) == 1) {
+            line += chr;
+            if (chr == '\n') {
+                break;
+            }
+        }
+        return line;
+    }
+
+    // talk to an echo server that's listening on the address
+    template <typename AddrT>
+    void check_echo_server_at(AddrT const& addr) {
+        int sock = ::socket(reinterpret_cast<sockaddr const*>(&addr)->sa_family, SOCK_STREAM, 0); // NOLINT
+        ASSERT_NE(sock, -1);
+        bool connected = false;
+        for (int tries = 0; tries != 100 && !connected; ++tries) {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            connected = ::connect(sock, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == 0;
+            if (!connected) {
+                stl::this_thread::sleep_for(stl::chrono::milliseconds(10));
+            }
+        }
+        ASSERT_TRUE(connected);
+
+        // one line in two sends
+        ASSERT_EQ(::send(sock, "hel", 3, 0), 3);
+        ASSERT_EQ(::send(sock, "lo\n", 3, 0), 3);
+        EXPECT_EQ(receive_line(sock), "hello\n");
+
+        // two lines in one send
+        stl::string_view const lines = "a line that doesn't fit the buffer\nsecond\n";
+        ASSERT_EQ(::send(sock, lines.data(), lines.size(), 0), static_cast<ssize_t>(lines.size()));
+        EXPECT_EQ(receive_line(sock), "a line that doesn't fit the buffer\n");
+        EXPECT_EQ(receive_line(sock), "second\n");
+
+        // the server closes the connection
+        ASSERT_EQ(::send(sock, "bye\n", 4, 0), 4);
+        EXPECT_EQ(receive_line(sock), "bye\n");
+        char chr = 0;
+        EXPECT_EQ(::recv(sock, &chr, 1, 0), 0);
+        ::close(sock);
+    }
+
+    [[nodiscard]] sockaddr_in local_address(stl::uint16_t port) noexcept {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons(port);
+        ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        return addr;
+    }
+
+    // talk to an echo server that's listening on 127.0.0.1:port
+    void check_echo_server(stl::uint16_t port) {
+        check_echo_server_at(local_address(port));
+    }
+
+    // a connection to 127.0.0.1:port, that has said the line to the echo server
+    [[nodiscard]] int connect_and_say(stl::uint16_t port, stl::string_view line) {
+        auto const addr = local_address(port);
+        int const  sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        for (int tries = 0; tries != 100; ++tries) {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+            if (::connect(sock, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == 0) {
+                break;
+            }
+            stl::this_thread::sleep_for(stl::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(::send(sock, line.data(), line.size(), 0), static_cast<ssize_t>(line.size()));
+        return sock;
+    }
+
+    [[nodiscard]] bool is_closed_by_server(int sock) {
+        char chr = 0;
+        return ::recv(sock, &chr, 1, 0) == 0;
+    }
+
+    void check_echo_server(stl::string_view unix_path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        stl::copy(unix_path.begin(), unix_path.end(), static_cast<char*>(addr.sun_path));
+        check_echo_server_at(addr);
+    }
+
+    // replies with the size of the body of the request
+    struct body_size_responder {
+        template <typename SessionT>
+        void operator()(SessionT& session) const {
+            session.response_header("Content-Type", "text/plain");
+            session.write(stl::to_string(session.body().size()));
+        }
+    };
+
+    using shosted_session = http::shosted::self_hosted_session_manager<default_traits, body_size_responder>;
+
+    // everything that's received until the server closes the connection
+    stl::string receive_all(int sock) {
+        stl::string           data;
+        stl::array<char, 512> buf{};
+        ssize_t               res = 0;
+        while ((res = ::recv(sock, buf.data(), buf.size(), 0)) > 0) {
+            data.append(buf.data(), static_cast<stl::size_t>(res));
+        }
+        return data;
+    }
+
+    // post a body that's larger than what's left of the session's buffer after each read
+    void check_large_body(stl::uint16_t port) {
+        stl::string const body(600'000, 'x');
+        int const         sock = connect_and_say(port,
+                                         "POST /upload HTTP/1.1\r\nConnection: close\r\nContent-Length: " +
+                                           stl::to_string(body.size()) + "\r\n\r\n");
+        for (stl::string_view rest = body; !rest.empty();) {
+            ssize_t const res = ::send(sock, rest.data(), rest.size(), 0);
+            ASSERT_GT(res, 0);
+            rest.remove_prefix(static_cast<stl::size_t>(res));
+        }
+        auto const response = receive_all(sock);
+        EXPECT_TRUE(response.starts_with("HTTP/1.1 200 OK\r\n")) << response;
+        EXPECT_TRUE(response.ends_with("\r\n\r\n600000")) << response;
+        ::close(sock);
+    }
+
+} // namespace
+
+TEST(Server, PosixEchoServer) {
+    enable_owner_traits<default_traits>               et;
+    posix::posix_server<default_traits, echo_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18181", "127.0.0.1"};
+    server.thread_count = 2;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    check_echo_server(18181);
+    server.stop();
+    runner.join();
+}
+
+TEST(Server, PosixSelfHostedLargeBody) {
+    enable_owner_traits<default_traits>                  et;
+    posix::posix_server<default_traits, shosted_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18188", "127.0.0.1"};
+    server.thread_count = 1;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    check_large_body(18188);
+    server.stop();
+    runner.join();
+}
+
+TEST(Server, PosixMultipleListeners) {
+    auto const unix_path = (stl::filesystem::temp_directory_path() / "webpp_server_test.sock").string();
+
+    enable_owner_traits<default_traits>               et;
+    posix::posix_server<default_traits, echo_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18183", "127.0.0.1"};
+    server.thread_count = 2;
+    server.listen(posix::bindable_endpoints::unix_socket(unix_path));
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    check_echo_server(18183);
+    check_echo_server(stl::string_view{unix_path});
+    server.stop();
+    runner.join();
+    EXPECT_FALSE(stl::filesystem::exists(unix_path)); // the socket file is removed
+}
+
+TEST(Server, SocketOptions) {
+    socket_options opts;
+    opts.no_delay            = true;
+    opts.receive_buffer_size = 64 * 1024;
+    opts.defer_accept        = 5;
+
+    int const sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(sock, -1);
+    EXPECT_EQ(apply_listener_options(sock, AF_INET, opts), "");
+    EXPECT_EQ(apply_connection_options(sock, AF_INET, opts), "");
+
+    int       value = 0;
+    socklen_t len   = sizeof(value);
+    ASSERT_EQ(::getsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &value, &len), 0);
+    EXPECT_NE(value, 0);
+    ASSERT_EQ(::getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &value, &len), 0);
+    EXPECT_GE(value, 64 * 1024);
+    ::close(sock);
+
+    // the TCP options are not set on the Unix sockets
+    int const unix_sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_NE(unix_sock, -1);
+    EXPECT_EQ(apply_listener_options(unix_sock, AF_UNIX, opts), "");
+    EXPECT_EQ(apply_connection_options(unix_sock, AF_UNIX, opts), "");
+    ::close(unix_sock);
+}
+
+TEST(Server, PosixEchoServerWithSocketOptions) {
+    enable_owner_traits<default_traits>               et;
+    posix::posix_server<default_traits, echo_session> server{et};
+    server.endpoints                 = posix::bindable_endpoints{"18184", "127.0.0.1"};
+    server.thread_count              = 1;
+    server.sock_options.backlog      = 16;
+    server.sock_options.defer_accept = 1;
+    server.sock_options.no_delay     = true;
+    server.sock_options.quick_ack    = true;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    check_echo_server(18184);
+    server.stop();
+    runner.join();
+}
+
+TEST(Server, PosixDrain) {
+    enable_owner_traits<default_traits>               et;
+    posix::posix_server<default_traits, echo_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18185", "127.0.0.1"};
+    server.thread_count = 1;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    int const idle = connect_and_say(18185, "hello\n");
+    EXPECT_EQ(receive_line(idle), "hello\n");
+    int const busy = connect_and_say(18185, "hal");
+    stl::this_thread::sleep_for(stl::chrono::milliseconds(50)); // the server reads the half line
+
+    server.drain();
+    EXPECT_TRUE(is_closed_by_server(idle));
+
+    // the request that's being received is finished, and then the connection is closed
+    ASSERT_EQ(::send(busy, "f\n", 2, 0), 2);
+    EXPECT_EQ(receive_line(busy), "half\n");
+    EXPECT_TRUE(is_closed_by_server(busy));
+    runner.join();
+    ::close(idle);
+    ::close(busy);
+}
+
+TEST(Server, PosixSelfHostedDrain) {
+    enable_owner_traits<default_traits>                  et;
+    posix::posix_server<default_traits, shosted_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18191", "127.0.0.1"};
+    server.thread_count = 1;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    int const idle = connect_and_say(18191, "GET / HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(receive_line(idle), "HTTP/1.1 200 OK\r\n");
+    int const busy = connect_and_say(18191, "POST / HTTP/1.1\r\nContent-Length: 4\r\n\r\nha");
+    stl::this_thread::sleep_for(stl::chrono::milliseconds(50)); // the server reads the half request
+
+    // the keep-alive connection is closed right away, not after the drain timeout
+    auto const start = stl::chrono::steady_clock::now();
+    server.drain();
+    ASSERT_EQ(::send(busy, "lf", 2, 0), 2);
+    EXPECT_TRUE(receive_all(busy).ends_with("\r\n\r\n4"));
+    runner.join();
+    EXPECT_LT(stl::chrono::steady_clock::now() - start, server.drain_timeout / 2);
+    ::close(idle);
+    ::close(busy);
+}
+
+TEST(Server, PosixHandoff) {
+    auto const handoff_path = (stl::filesystem::temp_directory_path() / "webpp_handoff_test.sock").string();
+
+    enable_owner_traits<default_traits>               et;
+    posix::posix_server<default_traits, echo_session> old_server{et};
+    old_server.endpoints    = posix::bindable_endpoints{"18186", "127.0.0.1"};
+    old_server.thread_count = 1;
+    old_server.handoff_path = handoff_path;
+
+    stl::thread old_runner{[&] {
+        EXPECT_EQ(old_server(), 0);
+    }};
+    int const old_conn = connect_and_say(18186, "old\n");
+    EXPECT_EQ(receive_line(old_conn), "old\n");
+
+    // the new one takes the listener, and the old one is drained
+    posix::posix_server<default_traits, echo_session> new_server{et};
+    new_server.endpoints    = posix::bindable_endpoints{"18186", "127.0.0.1"};
+    new_server.thread_count = 1;
+    new_server.handoff_path = handoff_path;
+    stl::thread new_runner{[&] {
+        EXPECT_EQ(new_server(), 0);
+    }};
+    EXPECT_TRUE(is_closed_by_server(old_conn));
+    old_runner.join();
+    ::close(old_conn);
+
+    check_echo_server(18186);
+    EXPECT_TRUE(stl::filesystem::exists(handoff_path)); // it's the new one's now
+    new_server.stop();
+    new_runner.join();
+    EXPECT_FALSE(stl::filesystem::exists(handoff_path));
+}
+
+#ifdef webpp_posix
+TEST(Server, CpuList) {
+    cpu_set_t cpus;
+    ASSERT_TRUE(posix::details::parse_cpu_list("0-2,5\n", cpus));
+    EXPECT_EQ(CPU_COUNT(&cpus), 4);
+    EXPECT_TRUE(CPU_ISSET(2, &cpus));
+    EXPECT_FALSE(CPU_ISSET(3, &cpus));
+    EXPECT_TRUE(CPU_ISSET(5, &cpus));
+    EXPECT_FALSE(posix::details::parse_cpu_list("", cpus));
+    EXPECT_FALSE(posix::details::parse_cpu_list("3-1", cpus));
+    EXPECT_FALSE(posix::details::parse_cpu_list("1,x", cpus));
+}
+
+TEST(Server, PosixPrefork) {
+    enable_owner_traits<default_traits> et;
+    posix::prefork<default_traits>      cluster{et};
+    cluster.endpoints     = posix::bindable_endpoints{"18187", "127.0.0.1"};
+    cluster.worker_count  = 2;
+    cluster.restart_delay = stl::chrono::milliseconds(10);
+
+    // each worker tells whether it leads its own process group
+    stl::array<int, 2> group_pipe{};
+    ASSERT_EQ(::pipe(group_pipe.data()), 0);
+
+    stl::thread runner{[&] {
+        // the workers can't open the port themselves, the supervisor is listening on it
+        EXPECT_EQ(cluster([&](stl::size_t, inherited_sockets listeners) {
+            char const own_group = ::getpgrp() == ::getpid() ? 'y' : 'n';
+            static_cast<void>(::write(group_pipe[1], &own_group, 1));
+            enable_owner_traits<default_traits>                   worker_et;
+            posix::posix_server<default_traits, crashing_session> server{worker_et};
+            server.endpoints    = posix::bindable_endpoints{"18187", "127.0.0.1"};
+            server.thread_count = 1;
+            server.inherit(stl::move(listeners));
+            return server();
+        }),
+                  0);
+    }};
+    check_echo_server(18187);
+
+    // the crashed workers are replaced
+    for (int i = 0; i != 4; ++i) {
+        int const sock = connect_and_say(18187, "crash\n");
+        EXPECT_TRUE(is_closed_by_server(sock));
+        ::close(sock);
+    }
+    check_echo_server(18187);
+
+    cluster.drain();
+    runner.join();
+
+    // so a Ctrl-C on the terminal only reaches the supervisor
+    char own_group = 0;
+    ASSERT_EQ(::read(group_pipe[0], &own_group, 1), 1);
+    EXPECT_EQ(own_group, 'y');
+    ::close(group_pipe[0]);
+    ::close(group_pipe[1]);
+}
+#endif
+
+#ifdef webpp_io_uring
+TEST(Server, IOUringEchoServer) {
+    if (!posix::io_uring_server<default_traits, echo_session>::is_supported()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    enable_owner_traits<default_traits>                  et;
+    posix::io_uring_server<default_traits, echo_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18182", "127.0.0.1"};
+    server.thread_count = 2;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    check_echo_server(18182);
+    server.stop();
+    runner.join();
+}
+
+TEST(Server, IOUringDrain) {
+    if (!posix::io_uring_server<default_traits, echo_session>::is_supported()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    enable_owner_traits<default_traits>                  et;
+    posix::io_uring_server<default_traits, echo_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18192", "127.0.0.1"};
+    server.thread_count = 2;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    int const idle = connect_and_say(18192, "hello\n");
+    EXPECT_EQ(receive_line(idle), "hello\n");
+    int const busy = connect_and_say(18192, "hal");
+    stl::this_thread::sleep_for(stl::chrono::milliseconds(50)); // the server reads the half line
+
+    auto const start = stl::chrono::steady_clock::now();
+    server.drain();
+    EXPECT_TRUE(is_closed_by_server(idle));
+
+    // the request that's being received is finished, and then the connection is closed
+    ASSERT_EQ(::send(busy, "f\n", 2, 0), 2);
+    EXPECT_EQ(receive_line(busy), "half\n");
+    EXPECT_TRUE(is_closed_by_server(busy));
+    runner.join();
+    EXPECT_LT(stl::chrono::steady_clock::now() - start, server.drain_timeout / 2);
+    ::close(idle);
+    ::close(busy);
+}
+
+TEST(Server, IOUringHandoff) {
+    if (!posix::io_uring_server<default_traits, echo_session>::is_supported()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    auto const handoff_path =
+      (stl::filesystem::temp_directory_path() / "webpp_io_uring_handoff_test.sock").string();
+
+    enable_owner_traits<default_traits>                  et;
+    posix::io_uring_server<default_traits, echo_session> old_server{et};
+    old_server.endpoints    = posix::bindable_endpoints{"18190", "127.0.0.1"};
+    old_server.thread_count = 2;
+    old_server.handoff_path = handoff_path;
+
+    stl::thread old_runner{[&] {
+        EXPECT_EQ(old_server(), 0);
+    }};
+    check_echo_server(18190);
+
+    // the new one takes the listener, and the old one stops
+    posix::io_uring_server<default_traits, echo_session> new_server{et};
+    new_server.endpoints    = posix::bindable_endpoints{"18190", "127.0.0.1"};
+    new_server.thread_count = 1;
+    new_server.handoff_path = handoff_path;
+    stl::thread new_runner{[&] {
+        EXPECT_EQ(new_server(), 0);
+    }};
+    old_runner.join();
+
+    check_echo_server(18190);
+    EXPECT_TRUE(stl::filesystem::exists(handoff_path)); // it's the new one's now
+    new_server.stop();
+    new_runner.join();
+    EXPECT_FALSE(stl::filesystem::exists(handoff_path));
+}
+
+TEST(Server, IOUringSelfHostedLargeBody) {
+    if (!posix::io_uring_server<default_traits, shosted_session>::is_supported()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    enable_owner_traits<default_traits>                     et;
+    posix::io_uring_server<default_traits, shosted_session> server{et};
+    server.endpoints    = posix::bindable_endpoints{"18189", "127.0.0.1"};
+    server.thread_count = 1;
+
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+    check_large_body(18189);
+    server.stop();
+    runner.join();
+}
+#endif
+
 
 //
 // namespace webpp {
@@ -73,3 +658,215 @@ TEST(Server, Creation) {}
 //    app.run();
 //    EXPECT_EQ(app.body_result, "Something");
 //}
+
+namespace {
+
+    // the context of the beast apps below
+    template <typename ReqT>
+    using beast_context_type =
+      http::simple_context<ReqT,
+                           typename merge_root_extensions<typename ReqT::root_extensions,
+                                                          extension_pack<http::string_body>>::type>;
+
+    // answers with the target of the request
+    struct target_app {
+        http::HTTPResponse auto operator()(http::HTTPRequest auto&& req) {
+            beast_context_type<stl::remove_cvref_t<decltype(req)>> ctx{req};
+            return ctx.string(req.uri());
+        }
+    };
+
+    // one response, and its body if it has a Content-Length
+    stl::string receive_response(int sock) {
+        stl::string data;
+        char        chr = 0;
+        while (!data.ends_with("\r\n\r\n") && ::recv(sock, &chr, 1, 0) == 1) {
+            data += chr;
+        }
+        auto const length_field = data.find("Content-Length: ");
+        if (length_field == stl::string::npos) {
+            return data;
+        }
+        for (auto length = stl::stoul(data.substr(length_field + 16)); length != 0; --length) {
+            if (::recv(sock, &chr, 1, 0) != 1) {
+                break;
+            }
+            data += chr;
+        }
+        return data;
+    }
+
+    void say(int sock, stl::string_view data) {
+        ASSERT_EQ(::send(sock, data.data(), data.size(), 0), static_cast<ssize_t>(data.size()));
+    }
+
+    // the size of the bodies that are streamed to the uploading app
+    stl::atomic<stl::size_t> uploaded_bytes{0};
+
+    // streams the bodies of "/upload", with a bigger limit than the default limit of POST
+    struct uploading_app : target_app {
+        static http::status_code on_request_head(http::HTTPRequest auto& req) {
+            if (req.uri() == "/upload") {
+                req.body_limit(4 * 1024 * 1024);
+                req.stream_body([](stl::string_view piece) {
+                    uploaded_bytes += piece.size();
+                });
+            }
+            return http::status_code::continue_;
+        }
+    };
+
+} // namespace
+
+TEST(Server, BeastKeepAlive) {
+    http::beast<target_app> server;
+    server.address("127.0.0.1").port(18193);
+    server.keep_alive(stl::chrono::milliseconds(300), 3);
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    // the same connection serves the requests until the request cap
+    int const sock = connect_and_say(18193, "GET /1 HTTP/1.1\r\nHost: a\r\n\r\n");
+    auto      res  = receive_response(sock);
+    EXPECT_TRUE(res.starts_with("HTTP/1.1 200 OK\r\n")) << res;
+    EXPECT_TRUE(res.ends_with("\r\n\r\n/1")) << res;
+    say(sock, "GET /2 HTTP/1.1\r\nHost: a\r\n\r\n");
+    res = receive_response(sock);
+    EXPECT_TRUE(res.ends_with("\r\n\r\n/2")) << res;
+    EXPECT_EQ(res.find("Connection: close"), stl::string::npos) << res;
+    say(sock, "GET /3 HTTP/1.1\r\nHost: a\r\n\r\n");
+    res = receive_response(sock);
+    EXPECT_TRUE(res.ends_with("\r\n\r\n/3")) << res;
+    EXPECT_NE(res.find("Connection: close"), stl::string::npos) << res;
+    EXPECT_TRUE(is_closed_by_server(sock));
+    ::close(sock);
+
+    // an idle connection is closed after the keep-alive timeout
+    int const idle = connect_and_say(18193, "GET /idle HTTP/1.1\r\nHost: a\r\n\r\n");
+    EXPECT_TRUE(receive_response(idle).ends_with("/idle"));
+    auto const start = stl::chrono::steady_clock::now();
+    EXPECT_TRUE(is_closed_by_server(idle));
+    auto const idle_time = stl::chrono::steady_clock::now() - start;
+    EXPECT_GE(idle_time, stl::chrono::milliseconds(300));
+    EXPECT_LT(idle_time, stl::chrono::seconds(2));
+    ::close(idle);
+
+    server.stop();
+    runner.join();
+}
+
+TEST(Server, BeastPipelining) {
+    http::beast<target_app> server;
+    server.address("127.0.0.1").port(18194);
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    // three requests in one send are answered in order
+    int const sock = connect_and_say(18194,
+                                     "GET /a HTTP/1.1\r\nHost: a\r\n\r\n"
+                                     "GET /b HTTP/1.1\r\nHost: a\r\n\r\n"
+                                     "GET /c HTTP/1.1\r\nHost: a\r\n\r\n");
+    EXPECT_TRUE(receive_response(sock).ends_with("\r\n\r\n/a"));
+    EXPECT_TRUE(receive_response(sock).ends_with("\r\n\r\n/b"));
+    EXPECT_TRUE(receive_response(sock).ends_with("\r\n\r\n/c"));
+
+    // a request that ends in the next send, after a whole one
+    say(sock, "GET /d HTTP/1.1\r\nHost: a\r\n\r\nGET /e HTTP/1.1\r\nHo");
+    EXPECT_TRUE(receive_response(sock).ends_with("\r\n\r\n/d"));
+    say(sock, "st: a\r\n\r\n");
+    EXPECT_TRUE(receive_response(sock).ends_with("\r\n\r\n/e"));
+    ::close(sock);
+
+    server.stop();
+    runner.join();
+}
+
+#ifdef SO_REUSEPORT
+TEST(Server, BeastSharded) {
+    http::beast<target_app> server;
+    server.address("127.0.0.1").port(18195);
+    server.enable_sharding();
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    // the connections are spread over the shards; each of them is served
+    for (int i = 0; i != 4; ++i) {
+        auto const target = "/" + stl::to_string(i);
+        int const  sock   = connect_and_say(18195, "GET " + target + " HTTP/1.1\r\nHost: a\r\n\r\n");
+        EXPECT_TRUE(receive_response(sock).ends_with("\r\n\r\n" + target));
+        ::close(sock);
+    }
+
+    // the listeners have SO_REUSEPORT, so another one can be bound to the same port
+    int const  other = ::socket(AF_INET, SOCK_STREAM, 0);
+    int const  on    = 1;
+    auto const addr  = local_address(18195);
+    ASSERT_EQ(::setsockopt(other, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)), 0);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    EXPECT_EQ(::bind(other, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)), 0);
+    ::close(other);
+
+    server.stop();
+    runner.join();
+}
+#endif
+
+TEST(Server, BeastRequestHead) {
+    http::beast<uploading_app> server;
+    server.address("127.0.0.1").port(18196);
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    // the client is asked for the body after its head is accepted
+    int const sock = connect_and_say(18196,
+                                     "POST /continue HTTP/1.1\r\nHost: a\r\nContent-Length: 4\r\n"
+                                     "Expect: 100-continue\r\n\r\n");
+    EXPECT_EQ(receive_response(sock), "HTTP/1.1 100 Continue\r\n\r\n");
+    say(sock, "body");
+    auto const res = receive_response(sock);
+    EXPECT_TRUE(res.starts_with("HTTP/1.1 200 OK\r\n")) << res;
+    EXPECT_TRUE(res.ends_with("\r\n\r\n/continue")) << res;
+    ::close(sock);
+
+    // a body that's declared bigger than the limit is refused before it's sent, without a 100 Continue
+    int const big = connect_and_say(18196,
+                                    "POST /big HTTP/1.1\r\nHost: a\r\nContent-Length: 10000000\r\n"
+                                    "Expect: 100-continue\r\n\r\n");
+    EXPECT_TRUE(receive_response(big).starts_with("HTTP/1.1 413 "));
+    EXPECT_TRUE(is_closed_by_server(big));
+    ::close(big);
+
+    server.stop();
+    runner.join();
+}
+
+TEST(Server, BeastStreamedUpload) {
+    http::beast<uploading_app> server;
+    server.address("127.0.0.1").port(18197);
+    stl::thread runner{[&] {
+        EXPECT_EQ(server(), 0);
+    }};
+
+    // bigger than the default limit of POST, and than what beast reads at once
+    stl::string const body(3 * 1024 * 1024, 'x');
+    int const         sock = connect_and_say(18197,
+                                     "POST /upload HTTP/1.1\r\nHost: a\r\nContent-Length: " +
+                                       stl::to_string(body.size()) + "\r\n\r\n");
+    for (stl::string_view rest = body; !rest.empty();) {
+        ssize_t const res = ::send(sock, rest.data(), rest.size(), 0);
+        ASSERT_GT(res, 0);
+        rest.remove_prefix(static_cast<stl::size_t>(res));
+    }
+    auto const res = receive_response(sock);
+    EXPECT_TRUE(res.starts_with("HTTP/1.1 200 OK\r\n")) << res;
+    EXPECT_TRUE(res.ends_with("\r\n\r\n/upload")) << res;
+    EXPECT_EQ(uploaded_bytes, body.size());
+    ::close(sock);
+
+    server.stop();
+    runner.join();
+}